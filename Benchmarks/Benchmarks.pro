@@ -0,0 +1,51 @@
+# ***** BEGIN LICENSE BLOCK *****
+# This file is part of Natron <https://natrongithub.github.io/>,
+# (C) 2018-2021 The Natron developers
+# (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+#
+# Natron is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# Natron is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+# ***** END LICENSE BLOCK *****
+
+# Microbenchmarks of the engine, kept out of the unit tests: they take long, their results depend
+# on the machine and they only print timings. Run the Benchmarks executable on an otherwise idle machine,
+# possibly with --gtest_filter to select some of them. They are only built when qmake is run
+# with CONFIG+=benchmarks.
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += moc rcc
+CONFIG += boost boost-serialization-lib opengl qt cairo python shiboken pyside 
+CONFIG += static-gui static-engine static-host-support static-breakpadclient static-libmv static-openmvg static-ceres static-libtess
+QT += gui core opengl network
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+
+CONFIG += openmvg-flags glad-flags
+
+!noexpat: CONFIG += expat
+
+INCLUDEPATH += ../Tests/google-test/include
+INCLUDEPATH += ../Tests/google-test
+
+include(../global.pri)
+
+SOURCES += \
+    ../Tests/google-test/src/gtest-all.cc \
+    ../Tests/wmain.cpp \
+    Cache_Benchmark.cpp \
+    Hash64_Benchmark.cpp \
+    Image_Benchmark.cpp \
+    ImageConvertKernels_Benchmark.cpp \
+    MemoryAllocator_Benchmark.cpp \
+    TaskScheduler_Benchmark.cpp
@@ -0,0 +1,136 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QThread>
+
+#include "Engine/Cache.h"
+#include "Engine/Image.h"
+#include "Engine/ImageKey.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+typedef Cache<Image> ImageCache;
+
+/**
+ * @brief Calls getOrCreate() in a loop on a small set of keys, which is what render threads do
+ * when several nodes of the same comp are rendered concurrently.
+ **/
+class CacheHammerThread
+    : public QThread
+{
+public:
+
+    CacheHammerThread(const ImageCache* cache,
+                      const ImageParamsPtr& params,
+                      int seed,
+                      int nKeys,
+                      int nLookups)
+        : QThread()
+        , _cache(cache)
+        , _params(params)
+        , _seed(seed)
+        , _nKeys(nKeys)
+        , _nLookups(nLookups)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        U64 state = (U64)_seed * 0x9e3779b97f4a7c15ULL + 1;
+
+        for (int i = 0; i < _nLookups; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            int k = (int)( (state >> 33) % (U64)_nKeys );
+            ImageKey key(0, (U64)k, false, 0, ViewIdx(0), 1., false, false);
+            ImagePtr image;
+            _cache->getOrCreate(key, _params, 0, &image);
+        }
+    }
+
+    const ImageCache* _cache;
+    ImageParamsPtr _params;
+    int _seed;
+    int _nKeys;
+    int _nLookups;
+};
+
+double
+runGetOrCreateBenchmark(std::size_t nShards,
+                        int nThreads,
+                        int nLookupsPerThread)
+{
+    // Entries are never allocated, only looked-up, so the cache never needs to evict
+    ImageCache cache("CacheTestCache", NATRON_CACHE_VERSION, 1024ULL * 1024ULL * 1024ULL, 1., nShards);
+    RectD rod(0, 0, 16, 16);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    std::vector<CacheHammerThread*> threads;
+
+    for (int i = 0; i < nThreads; ++i) {
+        threads.push_back( new CacheHammerThread(&cache, params, i, 4096, nLookupsPerThread) );
+    }
+
+    TimeLapse timer;
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->start();
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->wait();
+        delete threads[i];
+    }
+    double elapsed = timer.getTimeSinceCreation();
+    cache.waitForDeleterThread();
+
+    return elapsed > 0 ? (double)nThreads * nLookupsPerThread / elapsed : 0.;
+}
+} // anon namespace
+
+// Prints the number of getOrCreate() per second with a single shard and with the default number of shards,
+// for an increasing number of threads, so that the scaling with the number of cores can be observed.
+TEST(CacheBenchmark, GetOrCreateContention)
+{
+    int maxThreads = std::max(1, QThread::idealThreadCount());
+    std::size_t nShards = ImageCache::getDefaultShardsCount();
+
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        double singleShard = runGetOrCreateBenchmark(1, nThreads, 20000);
+        double sharded = runGetOrCreateBenchmark(nShards, nThreads, 20000);
+        printf("getOrCreate, %d thread(s): 1 shard: %.0f lookups/s, %d shards: %.0f lookups/s\n",
+               nThreads, singleShard, (int)nShards, sharded);
+    }
+}
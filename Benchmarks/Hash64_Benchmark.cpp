@@ -0,0 +1,60 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <chrono>
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include "Engine/Hash64.h"
+
+NATRON_NAMESPACE_USING
+
+/*
+ * Microbenchmark of the hash of a node with 200 knob values, recomputed 100000 times, with both algorithms.
+ */
+TEST(Hash64Benchmark,
+     StreamingAndCRC64)
+{
+    const char* names[2] = { "streaming", "CRC-64" };
+    U64 results[2] = { 0, 0 };
+
+    for (int a = 0; a < 2; ++a) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int n = 0; n < 100000; ++n) {
+            Hash64 hash( (Hash64::HashAlgorithmEnum)a );
+            for (int i = 0; i < 200; ++i) {
+                hash.append<double>(i * 0.5 + n);
+            }
+            hash.computeHash();
+            results[a] ^= hash.value();
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::cout << "Hash64 " << names[a] << ": " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+    }
+    // use the results so that the loops are not optimized out
+    EXPECT_NE(results[0], results[1]);
+}
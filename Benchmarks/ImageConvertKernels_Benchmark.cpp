@@ -0,0 +1,299 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <bitset>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include <boost/make_shared.hpp>
+
+#include <QtCore/QThreadPool>
+
+#include "Engine/Image.h"
+#include "Engine/ImageConvertKernels.h"
+#include "Engine/ImageStatistics.h"
+
+NATRON_NAMESPACE_USING
+
+// The correctness of the code measured here is checked by Tests/ImageConvertKernels_Test.cpp
+
+namespace {
+
+// An image of random values in [0, 1] (or [0, maxValue] for integer depths)
+ImagePtr
+makeRandomImage(const ImagePlaneDesc& components,
+                const RectI& bounds,
+                ImageBitDepthEnum depth)
+{
+    const RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    ImagePtr img = boost::make_shared<Image>(components, rod, bounds, 0, 1., depth, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const int rowElements = bounds.width() * components.getNumComponents();
+
+    std::srand(2000);
+    Image::WriteAccess acc( img.get() );
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        void* row = acc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < rowElements; ++i) {
+            // coverity[dont_call]
+            float value = std::rand() / (float)RAND_MAX;
+            switch (depth) {
+            case eImageBitDepthByte:
+                ( (unsigned char*)row )[i] = (unsigned char)(value * 255);
+                break;
+            case eImageBitDepthShort:
+                ( (unsigned short*)row )[i] = (unsigned short)(value * 65535);
+                break;
+            case eImageBitDepthHalf:
+                ( (Half*)row )[i] = Half(value);
+                break;
+            case eImageBitDepthFloat:
+                ( (float*)row )[i] = value;
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
+        }
+    }
+
+    return img;
+}
+
+// Downscales the roi of img from level 0 to the given level, with the kernels of the given instruction set
+// and at most maxThreads threads
+ImagePtr
+downscale(const ImagePtr& img,
+          const RectI& roi,
+          unsigned int level,
+          ImageConvertKernels::InstructionSetEnum set,
+          int maxThreads)
+{
+    const RectI dstBounds = roi.downscalePowerOfTwoSmallestEnclosing(level);
+    ImagePtr output = boost::make_shared<Image>(img->getComponents(), img->getRoD(), dstBounds, level, 1., img->getBitDepth(), eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const int previousMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+    ImageConvertKernels::setInstructionSet(set);
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    img->downscaleMipMap(img->getRoD(), roi, 0, level, false, output.get() );
+    QThreadPool::globalInstance()->setMaxThreadCount(previousMaxThreads);
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+
+    return output;
+}
+
+// Copies the unprocessed channels of original into img, mixes it with original with a mask and premultiplies it,
+// with the kernels of the given instruction set (in a single pass) and at most maxThreads threads
+void
+postRender(const ImagePtr& img,
+           const ImagePtr& original,
+           const ImagePtr& mask,
+           ImageConvertKernels::InstructionSetEnum set,
+           int maxThreads)
+{
+    const int previousMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    std::bitset<4> processChannels;
+
+    processChannels[0] = processChannels[1] = processChannels[2] = true;
+    ImageConvertKernels::setInstructionSet(set);
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    img->copyUnProcessedChannelsMaskMixAndPremult(img->getBounds(), eImagePremultiplicationPremultiplied, eImagePremultiplicationPremultiplied, processChannels, original, true,
+                                                  true, mask.get(), true, false, 0.8f, true);
+    QThreadPool::globalInstance()->setMaxThreadCount(previousMaxThreads);
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+// Computes the statistics of the whole image with the kernels of the given instruction set and at most maxThreads threads
+ImageStatistics
+computeStatistics(const ImagePtr& img,
+                  const ImageStatisticsRequest& request,
+                  ImageConvertKernels::InstructionSetEnum set,
+                  int maxThreads)
+{
+    const int previousMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    ImageStatistics stats;
+
+    ImageConvertKernels::setInstructionSet(set);
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    img->computeStatistics(img->getBounds(), request, &stats);
+    QThreadPool::globalInstance()->setMaxThreadCount(previousMaxThreads);
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+
+    return stats;
+}
+
+} // anon namespace
+
+/*
+ * Microbenchmark of Image::convertToFormat on an HD RGBA image, with the generic per-pixel code
+ * (instruction set "none") and with the kernels of each instruction set supported by this processor.
+ */
+TEST(ImageConvertKernelsBenchmark,
+     ConvertToFormat)
+{
+    const RectI bounds(0, 0, 1920, 1080);
+    const RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    const int nIterations = 10;
+    const ImageBitDepthEnum depths[2] = { eImageBitDepthByte, eImageBitDepthShort };
+    const char* depthNames[2] = { "byte", "short" };
+    ImagePtr floatImg = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds, eImageBitDepthFloat);
+    ImagePtr backImg = boost::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    for (int d = 0; d < 2; ++d) {
+        for (int set = ImageConvertKernels::eInstructionSetNone; set <= ImageConvertKernels::getSupportedInstructionSet(); ++set) {
+            ImageConvertKernels::setInstructionSet( (ImageConvertKernels::InstructionSetEnum)set );
+            ImagePtr intImg = boost::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., depths[d], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < nIterations; ++i) {
+                floatImg->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, intImg.get() );
+            }
+            std::chrono::steady_clock::time_point converted = std::chrono::steady_clock::now();
+            for (int i = 0; i < nIterations; ++i) {
+                intImg->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, backImg.get() );
+            }
+            std::chrono::steady_clock::time_point back = std::chrono::steady_clock::now();
+
+            double gigabytes = (double)nIterations * bounds.area() * 4 * sizeof(float) / (1024. * 1024. * 1024.);
+            std::cout << ImageConvertKernels::getInstructionSetName( (ImageConvertKernels::InstructionSetEnum)set )
+                      << ": float to " << depthNames[d] << " " << gigabytes / std::chrono::duration<double>(converted - start).count() << " GB/s"
+                      << ", " << depthNames[d] << " to float " << gigabytes / std::chrono::duration<double>(back - converted).count() << " GB/s" << std::endl;
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+/*
+ * Microbenchmark of Image::downscaleMipMap on a 4K float and an 8K byte RGBA image, with the generic per-pixel code
+ * in a single thread, with the kernels in a single thread and with the kernels on all the threads of the pool.
+ */
+TEST(ImageConvertKernelsBenchmark,
+     MipMap)
+{
+    const RectI bounds[2] = { RectI(0, 0, 3840, 2160), RectI(0, 0, 7680, 4320) };
+    const ImageBitDepthEnum depths[2] = { eImageBitDepthFloat, eImageBitDepthByte };
+    const char* names[2] = { "4K float", "8K byte" };
+    const unsigned int levels[2] = { 1, 3 };
+    const int maxThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+    for (int b = 0; b < 2; ++b) {
+        ImagePtr img = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds[b], depths[b]);
+        for (int l = 0; l < 2; ++l) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ImagePtr reference = downscale(img, bounds[b], levels[l], ImageConvertKernels::eInstructionSetNone, 1);
+            std::chrono::steady_clock::time_point generic = std::chrono::steady_clock::now();
+            ImagePtr singleThreaded = downscale(img, bounds[b], levels[l], ImageConvertKernels::getSupportedInstructionSet(), 1);
+            std::chrono::steady_clock::time_point kernels = std::chrono::steady_clock::now();
+            ImagePtr multiThreaded = downscale(img, bounds[b], levels[l], ImageConvertKernels::getSupportedInstructionSet(), maxThreads);
+            std::chrono::steady_clock::time_point threads = std::chrono::steady_clock::now();
+
+            std::cout << names[b] << " to level " << levels[l]
+                      << ": generic " << std::chrono::duration<double, std::milli>(generic - start).count() << " ms"
+                      << ", " << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getSupportedInstructionSet() )
+                      << " " << std::chrono::duration<double, std::milli>(kernels - generic).count() << " ms"
+                      << ", " << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getSupportedInstructionSet() )
+                      << " on " << maxThreads << " threads " << std::chrono::duration<double, std::milli>(threads - kernels).count() << " ms" << std::endl;
+        }
+    }
+}
+
+/*
+ * Microbenchmark of the operations done after a render on an HD and a 4K float RGBA image: with the generic per-pixel
+ * code in a single thread, with the kernels in a single thread and with the kernels on all the threads of the pool.
+ */
+TEST(ImageConvertKernelsBenchmark,
+     PostRender)
+{
+    const RectI bounds[2] = { RectI(0, 0, 1920, 1080), RectI(0, 0, 3840, 2160) };
+    const char* names[2] = { "HD", "4K" };
+    const int maxThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+    for (int b = 0; b < 2; ++b) {
+        ImagePtr original = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds[b], eImageBitDepthFloat);
+        ImagePtr mask = makeRandomImage(ImagePlaneDesc::getAlphaComponents(), bounds[b], eImageBitDepthFloat);
+        ImagePtr reference = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds[b], eImageBitDepthFloat);
+        ImagePtr singleThreaded = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds[b], eImageBitDepthFloat);
+        ImagePtr multiThreaded = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds[b], eImageBitDepthFloat);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        postRender(reference, original, mask, ImageConvertKernels::eInstructionSetNone, 1);
+        std::chrono::steady_clock::time_point generic = std::chrono::steady_clock::now();
+        postRender(singleThreaded, original, mask, ImageConvertKernels::getSupportedInstructionSet(), 1);
+        std::chrono::steady_clock::time_point kernels = std::chrono::steady_clock::now();
+        postRender(multiThreaded, original, mask, ImageConvertKernels::getSupportedInstructionSet(), maxThreads);
+        std::chrono::steady_clock::time_point threads = std::chrono::steady_clock::now();
+
+        std::cout << names[b] << " copy channels, mask mix and premult"
+                  << ": generic " << std::chrono::duration<double, std::milli>(generic - start).count() << " ms"
+                  << ", " << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getSupportedInstructionSet() )
+                  << " " << std::chrono::duration<double, std::milli>(kernels - generic).count() << " ms"
+                  << ", " << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getSupportedInstructionSet() )
+                  << " on " << maxThreads << " threads " << std::chrono::duration<double, std::milli>(threads - kernels).count() << " ms" << std::endl;
+    }
+}
+
+/*
+ * Microbenchmark of the statistics computed on the rendered images (NaNs fix, range of each channel and RGB histograms)
+ * on an HD and a 4K float RGBA image: with the scalar code in a single thread, with the kernels in a single thread
+ * and with the kernels on all the threads of the pool.
+ */
+TEST(ImageConvertKernelsBenchmark,
+     Statistics)
+{
+    const RectI bounds[2] = { RectI(0, 0, 1920, 1080), RectI(0, 0, 3840, 2160) };
+    const char* names[2] = { "HD", "4K" };
+    const int maxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    ImageStatisticsRequest requests[2];
+
+    requests[0].fixNaNs = true;
+    requests[1].histograms.push_back(eImageStatisticsValueChannel0);
+    requests[1].histograms.push_back(eImageStatisticsValueChannel1);
+    requests[1].histograms.push_back(eImageStatisticsValueChannel2);
+    requests[1].histogramBins = 256 * 5;
+    const char* requestNames[2] = { "NaNs fix and ranges", "RGB histograms" };
+
+    for (int b = 0; b < 2; ++b) {
+        ImagePtr img = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds[b], eImageBitDepthFloat);
+        for (int r = 0; r < 2; ++r) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ImageStatistics reference = computeStatistics(img, requests[r], ImageConvertKernels::eInstructionSetScalar, 1);
+            std::chrono::steady_clock::time_point scalar = std::chrono::steady_clock::now();
+            ImageStatistics singleThreaded = computeStatistics(img, requests[r], ImageConvertKernels::getSupportedInstructionSet(), 1);
+            std::chrono::steady_clock::time_point kernels = std::chrono::steady_clock::now();
+            ImageStatistics multiThreaded = computeStatistics(img, requests[r], ImageConvertKernels::getSupportedInstructionSet(), maxThreads);
+            std::chrono::steady_clock::time_point threads = std::chrono::steady_clock::now();
+
+            std::cout << names[b] << " " << requestNames[r]
+                      << ": scalar " << std::chrono::duration<double, std::milli>(scalar - start).count() << " ms"
+                      << ", " << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getSupportedInstructionSet() )
+                      << " " << std::chrono::duration<double, std::milli>(kernels - scalar).count() << " ms"
+                      << ", " << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getSupportedInstructionSet() )
+                      << " on " << maxThreads << " threads " << std::chrono::duration<double, std::milli>(threads - kernels).count() << " ms" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <random>
+#include <gtest/gtest.h>
+
+#include "Engine/Image.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+enum ViewerPatternEnum
+{
+    eViewerPatternCacheHit = 0, // the whole frame was already rendered
+    eViewerPatternPan, // the viewer was panned: half of the frame was rendered
+    eViewerPatternZoomOut, // the viewer zoomed out: the center of the frame was rendered
+    eViewerPatternScattered, // scattered tiles were rendered by concurrent renders
+    eViewerPatternRenderingElsewhere, // as eViewerPatternZoomOut, with a region being rendered by another thread
+    eViewerPatternCount
+};
+
+const char* const viewerPatternNames[eViewerPatternCount] = {
+    "cache hit", "pan", "zoom out", "scattered", "rendering elsewhere"
+};
+
+// Marks the given pattern on a 4K bitmap, either keeping the tile states up to date or forcing the pixel scan
+void
+markViewerPattern(ViewerPatternEnum pattern,
+                  bool useTiles,
+                  Bitmap* bm)
+{
+    const RectI& bounds = bm->getBounds();
+
+    switch (pattern) {
+    case eViewerPatternCacheHit:
+        bm->markForRendered(bounds);
+        break;
+    case eViewerPatternPan:
+        bm->markForRendered( RectI(0, 0, 2000, bounds.y2) );
+        break;
+    case eViewerPatternZoomOut:
+    case eViewerPatternRenderingElsewhere:
+        bm->markForRendered( RectI(950, 530, 2890, 1630) );
+        if (pattern == eViewerPatternRenderingElsewhere) {
+            bm->markForRendering( RectI(2890, 530, 3200, 1630) );
+        }
+        break;
+    case eViewerPatternScattered: {
+        std::minstd_rand rng(1);
+        for (int i = 0; i < 200; ++i) {
+            int x1 = rng() % bounds.x2;
+            int y1 = rng() % bounds.y2;
+            bm->markForRendered( RectI( x1, y1, std::min<int>(x1 + 50 + rng() % 250, bounds.x2), std::min<int>(y1 + 50 + rng() % 250, bounds.y2) ) );
+        }
+        break;
+    }
+    case eViewerPatternCount:
+        break;
+    }
+    if (!useTiles) {
+        bm->invalidateTiles(bounds);
+    }
+}
+} // anon namespace
+
+/*
+ * Microbenchmark of the search of the rectangles left to render in a 4K bitmap, for the patterns left by
+ * the usual viewer interactions, with the tile states and with the pixel scan.
+ */
+TEST(BitmapBenchmark,
+     TilesAndPixelScan)
+{
+    const RectI bounds(0, 0, 3840, 2160);
+    const int iterations = 20;
+
+    for (int p = 0; p < eViewerPatternCount; ++p) {
+        double seconds[2];
+        for (int useTiles = 0; useTiles < 2; ++useTiles) {
+            Bitmap bm(bounds);
+            markViewerPattern( (ViewerPatternEnum)p, useTiles, &bm );
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::size_t nRects = 0;
+            for (int i = 0; i < iterations; ++i) {
+                std::list<RectI> rects;
+                bool renderingElsewhere = false;
+                bm.minimalNonMarkedRects_trimap(bounds, rects, &renderingElsewhere);
+                nRects += rects.size();
+            }
+            seconds[useTiles] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+            EXPECT_LE( nRects, (std::size_t)iterations * 4 );
+        }
+        std::cout << viewerPatternNames[p] << ": pixel scan " << seconds[0] * 1e3 << " ms"
+                  << ", tiles " << seconds[1] * 1e3 << " ms" << std::endl;
+    }
+}
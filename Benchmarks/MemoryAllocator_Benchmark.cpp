@@ -0,0 +1,130 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/MemoryAllocator.h"
+
+NATRON_NAMESPACE_USING
+
+/*
+ * Microbenchmark of the huge pages modes: allocates a 256 MiB float buffer, touches all of it as
+ * a render writing an image does, then reads it at random positions as a transform or a distortion does,
+ * which is what suffers most from TLB misses with regular pages.
+ */
+TEST(MemoryAllocatorBenchmark,
+     HugePages)
+{
+    const MemoryHugePagesModeEnum modes[3] = { eMemoryHugePagesModeNone, eMemoryHugePagesModeTransparent, eMemoryHugePagesModeExplicit };
+    const char* modeNames[3] = { "none", "transparent", "explicit" };
+    const std::size_t count = 64 * 1024 * 1024;
+    const std::size_t nReads = 16 * 1024 * 1024;
+    double sums[3];
+
+    std::cout << "Huge page size: " << MemoryAllocator::getHugePageSize() / 1024 << " KiB" << std::endl;
+    for (int m = 0; m < 3; ++m) {
+        MemoryAllocator::setHugePagesMode(modes[m]);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        MemoryAllocationTypeEnum type;
+        float* data = (float*)MemoryAllocator::allocate(count * sizeof(float), &type);
+        ASSERT_TRUE(data != NULL);
+        for (std::size_t i = 0; i < count; ++i) {
+            data[i] = (float)(i & 0xff);
+        }
+        std::chrono::steady_clock::time_point touched = std::chrono::steady_clock::now();
+
+        double sum = 0.;
+        unsigned int seed = 12345;
+        for (std::size_t i = 0; i < nReads; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            sum += data[seed % count];
+        }
+        std::chrono::steady_clock::time_point read = std::chrono::steady_clock::now();
+        sums[m] = sum;
+
+        MemoryAllocator::deallocate(data, count * sizeof(float), type);
+
+        std::cout << "Huge pages " << modeNames[m] << (type == eMemoryAllocationTypeMap ? " (mapped)" : " (malloc)")
+                  << ": allocate and write " << std::chrono::duration_cast<std::chrono::milliseconds>(touched - start).count() << " ms"
+                  << ", random reads " << std::chrono::duration_cast<std::chrono::milliseconds>(read - touched).count() << " ms" << std::endl;
+    }
+    MemoryAllocator::setHugePagesMode(eMemoryHugePagesModeNone);
+
+    EXPECT_EQ(sums[0], sums[1]);
+    EXPECT_EQ(sums[0], sums[2]);
+}
+
+/*
+ * Microbenchmark of the pool: each iteration allocates the temporary float images of a 2K render on a few threads,
+ * writes them and frees them, as renderRoI does for its intermediate buffers.
+ */
+TEST(MemoryAllocatorBenchmark,
+     Pool)
+{
+    const std::size_t size = 2048 * 1556 * 4 * sizeof(float);
+    const int iterations = 20;
+    const int nThreads = 4;
+    double seconds[2];
+
+    for (int pooled = 0; pooled < 2; ++pooled) {
+        MemoryAllocator::setPoolCapacity(pooled ? 4 * nThreads * size : 0);
+        MemoryAllocator::resetPoolStats();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; ++t) {
+            threads.push_back( std::thread([size, iterations]() {
+                for (int i = 0; i < iterations; ++i) {
+                    MemoryAllocationTypeEnum type;
+                    float* data = (float*)MemoryAllocator::allocate(size, &type);
+                    for (std::size_t j = 0; j < size / sizeof(float); j += 1024) {
+                        data[j] = (float)j;
+                    }
+                    MemoryAllocator::deallocate(data, size, type);
+                }
+            }) );
+        }
+        for (int t = 0; t < nThreads; ++t) {
+            threads[t].join();
+        }
+        seconds[pooled] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (pooled) {
+            MemoryPoolStats stats = MemoryAllocator::getPoolStats();
+            std::cout << "Pool hit rate: " << stats.getHitRate() * 100. << "%" << std::endl;
+        }
+    }
+    MemoryAllocator::setPoolCapacity(0);
+
+    std::cout << "Allocate, touch and free " << nThreads * iterations << " buffers of " << size / (1024 * 1024) << " MiB"
+              << ": without pool " << seconds[0] * 1000 << " ms, with pool " << seconds[1] * 1000 << " ms" << std::endl;
+}
@@ -0,0 +1,85 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QThreadPool>
+
+#include "Engine/TaskScheduler.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+double
+burnCycles(const int& seed)
+{
+    double x = seed;
+
+    for (int i = 0; i < 2000000; ++i) {
+        x = x * 1.0000001 + 0.5;
+    }
+
+    return x;
+}
+}
+
+/*
+ * Scaling of a CPU bound map from 1 thread to the hardware concurrency.
+ */
+TEST(TaskSchedulerBenchmark,
+     Scaling)
+{
+    const int originalMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    const int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<int> seeds(64);
+
+    for (std::size_t i = 0; i < seeds.size(); ++i) {
+        seeds[i] = (int)i;
+    }
+    double singleThreadMs = 0.;
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
+        const U64 stolenBefore = TaskScheduler::instance()->getStolenTasksCount();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<double> results;
+        TaskScheduler::blockingMapped(seeds, &burnCycles, &results);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (nThreads == 1) {
+            singleThreadMs = ms;
+        }
+        std::cout << nThreads << " thread(s): " << ms << " ms, speedup " << singleThreadMs / ms
+                  << ", stolen tasks " << TaskScheduler::instance()->getStolenTasksCount() - stolenBefore << std::endl;
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(originalMaxThreads);
+}
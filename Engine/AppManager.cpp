@@ -51,6 +51,7 @@
 #include <cstddef>
 #include <cassert>
 #include <stdexcept>
+#include <cstdio> // for std::snprintf
 #include <cstring> // for std::memcpy
 #include <sstream> // stringstream
 #include <locale>
@@ -98,6 +99,7 @@
 
 
 #include "Global/ProcInfo.h"
+#include "Global/FStreamsSupport.h"
 #include "Global/GLIncludes.h"
 #include "Global/StrUtils.h"
 #ifdef DEBUG
@@ -117,6 +119,7 @@
 #include "Engine/JoinViewsNode.h"
 #include "Engine/LibraryBinary.h"
 #include "Engine/Log.h"
+#include "Engine/MemoryAllocator.h"
 #include "Engine/MemoryInfo.h" // getSystemTotalRAM, printAsRAM
 #include "Engine/Node.h"
 #include "Engine/OfxImageEffectInstance.h"
@@ -130,7 +133,9 @@
 #include "Engine/ReadNode.h"
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoSmear.h"
+#include "Engine/SharedImageCache.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TraceRecorder.h"
 #include "Engine/TrackerNode.h"
 #include "Engine/ThreadPool.h"
 #include "Engine/Utils.h"
@@ -456,6 +461,9 @@ AppManager::~AppManager()
         }
     }
 
+    // In GUI mode the trace covers the whole session
+    _imp->writeTrace();
+
     for (PluginsMap::iterator it = _imp->_plugins.begin(); it != _imp->_plugins.end(); ++it) {
         for (PluginVersionsOrdered::reverse_iterator itver = it->second.rbegin(); itver != it->second.rend(); ++itver) {
             delete *itver;
@@ -477,6 +485,7 @@ AppManager::~AppManager()
     _imp->_nodeCache->waitForDeleterThread();
     _imp->_diskCache->waitForDeleterThread();
     _imp->_viewerCache->waitForDeleterThread();
+    _imp->_sharedImageCache.reset();
     _imp->_nodeCache.reset();
     _imp->_viewerCache.reset();
     _imp->_diskCache.reset();
@@ -946,14 +955,29 @@ AppManager::initGui(const CLArgs& cl)
 bool
 AppManager::loadInternalAfterInitGui(const CLArgs& cl)
 {
+    MemoryAllocator::setHugePagesMode( _imp->_settings->getHugePagesMode() );
+    MemoryAllocator::setAccessHintsEnabled( _imp->_settings->isMemoryAccessHintsEnabled() );
+
     try {
         size_t maxCacheRAM = _imp->_settings->getRamMaximumPercent() * getSystemTotalRAM();
+        // Part of the RAM of the cache is kept for the pool of freed image buffers
+        size_t poolCapacity = maxCacheRAM * NATRON_MEMORY_POOL_CACHE_FRACTION;
+        MemoryAllocator::setPoolCapacity(poolCapacity);
+        maxCacheRAM -= poolCapacity;
         U64 viewerCacheSize = _imp->_settings->getMaximumViewerDiskCacheSize();
         U64 maxDiskCacheNode = _imp->_settings->getMaximumDiskCacheNodeSize();
+        std::size_t nShards = (std::size_t)std::max(0, _imp->_settings->getCacheShardsCount());
+        if (nShards == 0) {
+            nShards = Cache<Image>::getDefaultShardsCount();
+        }
+
+        double compressedPercent = _imp->_settings->getCompressedCachePercent();
 
-        _imp->_nodeCache = boost::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1.);
+        _imp->_nodeCache = boost::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1. - compressedPercent, nShards);
+        _imp->_nodeCache->setMaximumCompressedSize(maxCacheRAM * compressedPercent);
         _imp->_diskCache = boost::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0.);
-        _imp->_viewerCache = boost::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0.);
+        setApplicationsCachesCostAwareEviction( _imp->_settings->isCostAwareCacheEvictionEnabled() );
+        _imp->_viewerCache = boost::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0., nShards);
         _imp->setViewerCacheTileSize();
     } catch (std::logic_error&) {
         // ignore
@@ -977,6 +1001,11 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         _imp->restoreCaches();
     }
 
+    U64 sharedImageCacheSize = _imp->_settings->getSharedImageCacheSize();
+    if (sharedImageCacheSize > 0) {
+        _imp->openSharedImageCache(sharedImageCacheSize);
+    }
+
     if (cl.isOpenFXCacheClearRequestedOnLaunch()) {
         setLoadingStatus( tr("Clearing the OpenFX Plugins cache...") );
         clearPluginsLoadedCache();
@@ -1030,6 +1059,11 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         args = cl;
     }
 
+    if ( !args.getTraceFilePath().isEmpty() ) {
+        _imp->traceFilePath = args.getTraceFilePath();
+        TraceRecorder::instance()->start();
+    }
+
     AppInstancePtr mainInstance = newAppInstance(args, false);
 
     hideSplashScreen();
@@ -1052,6 +1086,10 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
                     wasKilled = false;
                 }
             }
+            if ( !args.getCacheStatsFilePath().isEmpty() && !writeCacheStatistics( args.getCacheStatsFilePath() ) ) {
+                std::cerr << tr("Failure to write the cache statistics file %1.").arg( args.getCacheStatsFilePath() ).toStdString() << std::endl;
+            }
+            _imp->writeTrace();
             if (!wasKilled) {
                 try {
                     mainInstance->getProject()->reset(true/*aboutToQuit*/, true /*blocking*/);
@@ -1316,7 +1354,9 @@ AppManager::wipeAndCreateDiskCacheStructure()
     clearAllCaches();
 
     assert(_imp->_diskCache);
+    _imp->_diskCache->closeIndex();
     _imp->cleanUpCacheDiskStructure( _imp->_diskCache->getCachePath(), false );
+    _imp->openDiskCacheIndex();
     assert(_imp->_viewerCache);
     _imp->cleanUpCacheDiskStructure( _imp->_viewerCache->getCachePath() , true);
 }
@@ -1378,9 +1418,31 @@ void
 AppManager::setApplicationsCachesMaximumMemoryPercent(double p)
 {
     size_t maxCacheRAM = p * getSystemTotalRAM_conditionnally();
+    size_t poolCapacity = maxCacheRAM * NATRON_MEMORY_POOL_CACHE_FRACTION;
+    MemoryAllocator::setPoolCapacity(poolCapacity);
+    maxCacheRAM -= poolCapacity;
+    double compressedPercent = _imp->_settings->getCompressedCachePercent();
 
     _imp->_nodeCache->setMaximumCacheSize(maxCacheRAM);
-    _imp->_nodeCache->setMaximumInMemorySize(1);
+    _imp->_nodeCache->setMaximumInMemorySize(1. - compressedPercent);
+    _imp->_nodeCache->setMaximumCompressedSize(maxCacheRAM * compressedPercent);
+}
+
+void
+AppManager::setApplicationsCachesCostAwareEviction(bool enabled)
+{
+    CacheEvictionPolicyEnum policy = enabled ? eCacheEvictionPolicyCostAware : eCacheEvictionPolicyLRU;
+
+    _imp->_nodeCache->setEvictionPolicy(policy);
+    _imp->_diskCache->setEvictionPolicy(policy);
+}
+
+void
+AppManager::setSharedImageCacheMaximumSize(U64 size)
+{
+    if (_imp->_sharedImageCache) {
+        _imp->_sharedImageCache->setMaximumSize(size);
+    }
 }
 
 void
@@ -2392,6 +2454,140 @@ AppManager::removeAllCacheEntriesForHolder(const CacheEntryHolder* holder,
     _imp->_viewerCache->removeAllEntriesForHolderPublic(holder, blocking);
 }
 
+std::list<std::string>
+AppManager::getCacheNames() const
+{
+    std::list<std::string> ret;
+
+    ret.push_back( _imp->_nodeCache->cacheName() );
+    ret.push_back( _imp->_diskCache->cacheName() );
+    ret.push_back( _imp->_viewerCache->cacheName() );
+
+    return ret;
+}
+
+bool
+AppManager::getCacheStatistics(const std::string& cacheName,
+                               CacheHolderStatsMap* stats) const
+{
+    if ( cacheName == _imp->_nodeCache->cacheName() ) {
+        _imp->_nodeCache->getHolderStats(stats);
+    } else if ( cacheName == _imp->_diskCache->cacheName() ) {
+        _imp->_diskCache->getHolderStats(stats);
+    } else if ( cacheName == _imp->_viewerCache->cacheName() ) {
+        _imp->_viewerCache->getHolderStats(stats);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+void
+AppManager::getCacheStatisticsForHolder(const std::string& holderID,
+                                        CacheHolderStats* stats) const
+{
+    std::list<std::string> cacheNames = getCacheNames();
+
+    for (std::list<std::string>::const_iterator it = cacheNames.begin(); it != cacheNames.end(); ++it) {
+        CacheHolderStatsMap cacheStats;
+        getCacheStatistics(*it, &cacheStats);
+        CacheHolderStatsMap::const_iterator found = cacheStats.find(holderID);
+        if ( found != cacheStats.end() ) {
+            stats->merge(found->second);
+        }
+    }
+}
+
+void
+AppManager::resetCacheStatistics()
+{
+    _imp->_nodeCache->resetStats();
+    _imp->_diskCache->resetStats();
+    _imp->_viewerCache->resetStats();
+}
+
+void
+AppManager::notifyNodeCacheHitNeedingDownscale(const ImageKey& key) const
+{
+    _imp->_nodeCache->notifyHitNeedingDownscale(key);
+}
+
+static void
+writeJSONString(std::ostream& os,
+                const std::string& str)
+{
+    os << StrUtils::toJSONString(str);
+}
+
+static void
+writeJSONCacheHolderStats(std::ostream& os,
+                          const CacheHolderStats& stats)
+{
+    std::vector<std::pair<std::string, double> > values;
+
+    stats.getValues(&values);
+    os << "{";
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        os << (i == 0 ? "" : ", ");
+        writeJSONString(os, values[i].first);
+        os << ": " << values[i].second;
+    }
+    os << "}";
+}
+
+bool
+AppManager::writeCacheStatistics(const QString& filePath) const
+{
+    FStreamsSupport::ofstream ofile;
+
+    FStreamsSupport::open( &ofile, filePath.toStdString() );
+    if (!ofile) {
+        return false;
+    }
+
+    // Counters may be large and the lock wait times small: keep all their digits
+    ofile.precision(17);
+
+    // {"NodeCache": {"total": {...}, "holders": {"<holder ID>": {...}, ...}}, ..., "MemoryPool": {...}}
+    ofile << "{" << std::endl;
+    std::list<std::string> cacheNames = getCacheNames();
+    for (std::list<std::string>::const_iterator it = cacheNames.begin(); it != cacheNames.end(); ++it) {
+        CacheHolderStatsMap cacheStats;
+        getCacheStatistics(*it, &cacheStats);
+
+        CacheHolderStats total;
+        for (CacheHolderStatsMap::const_iterator it2 = cacheStats.begin(); it2 != cacheStats.end(); ++it2) {
+            total.merge(it2->second);
+        }
+
+        ofile << "    ";
+        writeJSONString(ofile, *it);
+        ofile << ": {" << std::endl << "        \"total\": ";
+        writeJSONCacheHolderStats(ofile, total);
+        ofile << "," << std::endl << "        \"holders\": {";
+        for (CacheHolderStatsMap::const_iterator it2 = cacheStats.begin(); it2 != cacheStats.end(); ++it2) {
+            ofile << (it2 == cacheStats.begin() ? "" : ",") << std::endl << "            ";
+            writeJSONString(ofile, it2->first);
+            ofile << ": ";
+            writeJSONCacheHolderStats(ofile, it2->second);
+        }
+        ofile << std::endl << "        }" << std::endl << "    }," << std::endl;
+    }
+
+    MemoryPoolStats poolStats = MemoryAllocator::getPoolStats();
+    ofile << "    \"MemoryPool\": {\"hits\": " << poolStats.hits
+          << ", \"misses\": " << poolStats.misses
+          << ", \"hitRate\": " << poolStats.getHitRate()
+          << ", \"overflows\": " << poolStats.overflows
+          << ", \"released\": " << poolStats.released
+          << ", \"idleBytes\": " << poolStats.idleBytes
+          << ", \"capacity\": " << poolStats.capacity << "}" << std::endl;
+    ofile << "}" << std::endl;
+
+    return (bool)ofile;
+}
+
 const QString &
 AppManager::getApplicationBinaryPath() const
 {
@@ -2413,6 +2609,13 @@ AppManager::getImage(const ImageKey & key,
     return _imp->_nodeCache->get(key, returnValue);
 }
 
+bool
+AppManager::peekImage(const ImageKey & key,
+                      std::list<ImagePtr>* returnValue) const
+{
+    return _imp->_nodeCache->peek(key, returnValue);
+}
+
 bool
 AppManager::getImageOrCreate(const ImageKey & key,
                              const ImageParamsPtr& params,
@@ -2436,6 +2639,31 @@ AppManager::getImageOrCreate_diskCache(const ImageKey & key,
     return _imp->_diskCache->getOrCreate(key, params, 0, returnValue);
 }
 
+bool
+AppManager::getImageFromSharedCache(const ImageKey & key,
+                                    std::list<ImagePtr>* returnValue) const
+{
+    if (!_imp->_sharedImageCache) {
+        return false;
+    }
+
+    return _imp->_sharedImageCache->get(key, _imp->_nodeCache.get(), returnValue);
+}
+
+void
+AppManager::publishImageToSharedCache(const ImagePtr& image) const
+{
+    if (_imp->_sharedImageCache) {
+        _imp->_sharedImageCache->publishInBackground(image);
+    }
+}
+
+SharedImageCachePtr
+AppManager::getSharedImageCache() const
+{
+    return _imp->_sharedImageCache;
+}
+
 bool
 AppManager::getTexture(const FrameKey & key,
                        std::list<FrameEntryPtr>* returnValue) const
@@ -2469,6 +2697,12 @@ AppManager::getCachesTotalMemorySize() const
     return  _imp->_nodeCache->getMemoryCacheSize();
 }
 
+U64
+AppManager::getCachesMaximumMemorySize() const
+{
+    return  _imp->_nodeCache->getMaximumMemorySize();
+}
+
 U64
 AppManager::getCachesTotalDiskSize() const
 {
@@ -2780,6 +3014,11 @@ AppManager::checkCacheFreeMemoryIsGoodEnough()
     size_t systemRAMToKeepFree = getSystemTotalRAM() * appPTR->getCurrentSettings()->getUnreachableRamPercent();
     size_t totalFreeRAM = getAmountFreePhysicalRAM();
 
+    if (totalFreeRAM <= systemRAMToKeepFree) {
+        // The buffers kept for reuse are the cheapest memory to give back
+        MemoryAllocator::releasePool();
+        totalFreeRAM = getAmountFreePhysicalRAM();
+    }
     while (totalFreeRAM <= systemRAMToKeepFree) {
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << "Total system free RAM is below the threshold:" << printAsRAM(totalFreeRAM)
@@ -51,6 +51,7 @@ CLANG_DIAG_ON(deprecated)
 #endif
 
 #include "Engine/AfterQuitProcessingI.h"
+#include "Engine/CacheHolderStats.h"
 #include "Engine/Plugin.h"
 #include "Engine/KnobFactory.h"
 #include "Engine/ImageLocker.h"
@@ -201,6 +202,11 @@ public:
      **/
     bool getImage(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
 
+    /**
+     * @brief Same as getImage but only looks in RAM and does not count as an access to the cache, see Cache::peek().
+     **/
+    bool peekImage(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
+
     /**
      * @brief Same as getImage, but if it couldn't find a matching image in the cache, it will create one with the given parameters.
      **/
@@ -209,6 +215,20 @@ public:
 
     bool getImage_diskCache(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
 
+    /**
+     * @brief Attempts to load an image published by another process in the shared image cache, see SharedImageCache.
+     * The images found are inserted in the node cache. Returns false if the shared image cache is disabled.
+     **/
+    bool getImageFromSharedCache(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
+
+    /**
+     * @brief Publishes a fully rendered image in the shared image cache, if it is enabled.
+     * The image file is written in the background, see SharedImageCache::publishInBackground().
+     **/
+    void publishImageToSharedCache(const ImagePtr& image) const;
+
+    SharedImageCachePtr getSharedImageCache() const;
+
     bool getImageOrCreate_diskCache(const ImageKey & key, const ImageParamsPtr& params,
                                     ImagePtr* returnValue) const;
 
@@ -221,11 +241,16 @@ public:
 
 
     U64 getCachesTotalMemorySize() const;
+    U64 getCachesMaximumMemorySize() const;
     U64 getCachesTotalDiskSize() const;
     CacheSignalEmitterPtr getOrActivateViewerCacheSignalEmitter() const;
 
     void setApplicationsCachesMaximumMemoryPercent(double p);
 
+    void setApplicationsCachesCostAwareEviction(bool enabled);
+
+    void setSharedImageCacheMaximumSize(U64 size);
+
     void setApplicationsCachesMaximumViewerDiskSpace(unsigned long long size);
 
     void setApplicationsCachesMaximumDiskSpace(unsigned long long size);
@@ -245,6 +270,31 @@ public:
 
     void removeAllCacheEntriesForHolder(const CacheEntryHolder* holder, bool blocking);
 
+    /**
+     * @brief Returns the names of the caches whose statistics can be queried with getCacheStatistics()
+     **/
+    std::list<std::string> getCacheNames() const;
+
+    /**
+     * @brief Returns the statistics of each holder of the cache with the given name, by holder ID.
+     * Returns false if there is no such cache.
+     **/
+    bool getCacheStatistics(const std::string& cacheName, CacheHolderStatsMap* stats) const;
+
+    /**
+     * @brief Returns the statistics of the given holder (see CacheEntryHolder::getCacheID()) summed over all the caches.
+     **/
+    void getCacheStatisticsForHolder(const std::string& holderID, CacheHolderStats* stats) const;
+
+    void resetCacheStatistics();
+
+    void notifyNodeCacheHitNeedingDownscale(const ImageKey& key) const;
+
+    /**
+     * @brief Writes the statistics of all caches, per holder and in total, to a JSON file.
+     **/
+    bool writeCacheStatistics(const QString& filePath) const;
+
     SettingsPtr getCurrentSettings() const WARN_UNUSED_RETURN;
     const KnobFactory & getKnobFactory() const WARN_UNUSED_RETURN;
 
@@ -71,7 +71,9 @@ GCC_DIAG_ON(unused-parameter)
 #include "Engine/ProcessHandler.h" // ProcessInputChannel
 #include "Engine/RectDSerialization.h"
 #include "Engine/RectISerialization.h"
+#include "Engine/SharedImageCache.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TraceRecorder.h"
 
 
 // Don't forget to update glad.h and glad.c as well when updating these
@@ -232,11 +234,13 @@ AppManagerPrivate::AppManagerPrivate()
     , _nodeCache()
     , _diskCache()
     , _viewerCache()
+    , _sharedImageCache()
     , diskCachesLocationMutex()
     , diskCachesLocation()
     , _backgroundIPC()
     , _loaded(false)
     , _binaryPath()
+    , traceFilePath()
     , _nodesGlobalMemoryUse(0)
     , errorLogMutex()
     , errorLog()
@@ -458,6 +462,13 @@ template <typename T>
 void
 saveCache(Cache<T>* cache)
 {
+    if ( cache->hasIndex() ) {
+        // The index is kept up to date as entries are moved to disk, no table of contents is needed
+        cache->save(NULL);
+
+        return;
+    }
+
     std::string cacheRestoreFilePath = cache->getRestoreFilePath();
     FStreamsSupport::ofstream ofile;
     FStreamsSupport::open(&ofile, cacheRestoreFilePath);
@@ -481,6 +492,20 @@ saveCache(Cache<T>* cache)
     }
 }
 
+void
+AppManagerPrivate::writeTrace()
+{
+    if ( traceFilePath.isEmpty() ) {
+        return;
+    }
+    TraceRecorder* recorder = TraceRecorder::instance();
+    recorder->stop();
+    if ( !recorder->writeChromeTrace( traceFilePath.toStdString() ) ) {
+        std::cerr << "Failure to write the trace file " << traceFilePath.toStdString() << '.' << std::endl;
+    }
+    traceFilePath.clear();
+}
+
 void
 AppManagerPrivate::saveCaches()
 {
@@ -495,38 +520,49 @@ void
 restoreCache(AppManagerPrivate* p,
              Cache<T>* cache)
 {
+    typename Cache<T>::CacheTOC tableOfContents;
+
     if ( p->checkForCacheDiskStructure( cache->getCachePath(), cache->isTileCache() ) ) {
         std::string settingsFilePath = cache->getRestoreFilePath();
         FStreamsSupport::ifstream ifile;
         FStreamsSupport::open(&ifile, settingsFilePath);
         if (!ifile) {
-            std::cerr << "Failure to open cache restore file at: " << settingsFilePath << std::endl;
+            // Caches with an index only have a table of contents if it was saved by a version without index
+            if ( cache->isTileCache() ) {
+                std::cerr << "Failure to open cache restore file at: " << settingsFilePath << std::endl;
 
-            return;
-        }
-        typename Cache<T>::CacheTOC tableOfContents;
-        unsigned int cacheVersion = 0x1; //< default to 1 before NATRON_CACHE_VERSION was introduced
-        try {
-            boost::archive::binary_iarchive iArchive(ifile);
-            if (cache->cacheVersion() >= NATRON_CACHE_VERSION) {
-                iArchive >> cacheVersion;
+                return;
             }
-            //Only load caches with same version, otherwise wipe it!
-            if ( cacheVersion == cache->cacheVersion() ) {
-                iArchive >> tableOfContents;
-            } else {
+        } else {
+            unsigned int cacheVersion = 0x1; //< default to 1 before NATRON_CACHE_VERSION was introduced
+            try {
+                boost::archive::binary_iarchive iArchive(ifile);
+                if (cache->cacheVersion() >= NATRON_CACHE_VERSION) {
+                    iArchive >> cacheVersion;
+                }
+                //Only load caches with same version, otherwise wipe it!
+                if ( cacheVersion == cache->cacheVersion() ) {
+                    iArchive >> tableOfContents;
+                } else {
+                    p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
+                }
+            } catch (const std::exception & e) {
+                qDebug() << "Exception when reading disk cache TOC:" << e.what();
                 p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
+                tableOfContents.clear();
             }
-        } catch (const std::exception & e) {
-            qDebug() << "Exception when reading disk cache TOC:" << e.what();
-            p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
+            ifile.close();
 
-            return;
+            QFile restoreFile( QString::fromUtf8( settingsFilePath.c_str() ) );
+            restoreFile.remove();
         }
+    }
 
-        QFile restoreFile( QString::fromUtf8( settingsFilePath.c_str() ) );
-        restoreFile.remove();
+    if ( !cache->isTileCache() ) {
+        p->openDiskCacheIndex();
+    }
 
+    if ( !tableOfContents.empty() ) {
         cache->restore(tableOfContents);
     }
 }
@@ -538,6 +574,35 @@ AppManagerPrivate::restoreCaches()
     restoreCache<Image>( this, _diskCache.get() );
 } // restoreCaches
 
+void
+AppManagerPrivate::openSharedImageCache(U64 maximumSize)
+{
+    QString directoryPath = appPTR->getDiskCacheLocation();
+    StrUtils::ensureLastPathSeparator(directoryPath);
+    directoryPath.append( QString::fromUtf8(NATRON_SHARED_IMAGE_CACHE_DIR_NAME) );
+
+    try {
+        _sharedImageCache = boost::make_shared<SharedImageCache>(directoryPath.toStdString(), maximumSize);
+    } catch (const std::exception & e) {
+        qDebug() << "The shared image cache is disabled:" << e.what();
+        _sharedImageCache.reset();
+    }
+}
+
+void
+AppManagerPrivate::openDiskCacheIndex()
+{
+    Cache<Image>::IndexSerializerPtr serializer = boost::make_shared<Cache<Image>::IndexSerializer>();
+
+    if ( !_diskCache->openIndex(serializer) ) {
+        // The index was written by another version or could not be read: the files it referenced are lost
+        cleanUpCacheDiskStructure( _diskCache->getCachePath(), false );
+        if ( !_diskCache->openIndex(serializer) ) {
+            qDebug() << "Warning: the disk cache index could not be created, the disk cache will not be persistent";
+        }
+    }
+}
+
 bool
 AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool isTiled)
 {
@@ -546,9 +611,11 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool is
     if ( !settingsFilePath.endsWith( QChar::fromLatin1('/') ) ) {
         settingsFilePath += QChar::fromLatin1('/');
     }
+    QString indexFilePath = settingsFilePath + QString::fromUtf8(NATRON_CACHE_INDEX_FILE_NAME);
     settingsFilePath += QString::fromUtf8("restoreFile." NATRON_CACHE_FILE_EXT);
 
-    if ( !QFile::exists(settingsFilePath) ) {
+    // The disk cache is persisted by its index, the restore file only exists if it was saved by a version without index
+    if ( !QFile::exists(settingsFilePath) && ( isTiled || !QFile::exists(indexFilePath) ) ) {
         cleanUpCacheDiskStructure(cachePath, isTiled);
 
         return false;
@@ -559,9 +626,7 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool is
         QStringList files = directory.entryList(QDir::AllDirs);
 
 
-        /*Now counting actual data files in the cache*/
         /*check if there's 256 subfolders, otherwise reset cache.*/
-        int count = 0; // -1 because of the restoreFile
         int subFolderCount = 0;
         Q_FOREACH(const QString &file, files) {
             QString subFolder(cachePath);
@@ -574,12 +639,6 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool is
             QDir d(subFolder);
             if ( d.exists() ) {
                 ++subFolderCount;
-                QStringList items = d.entryList();
-                for (int j = 0; j < items.size(); ++j) {
-                    if ( ( items[j] != QString::fromUtf8(".") ) && ( items[j] != QString::fromUtf8("..") ) ) {
-                        ++count;
-                    }
-                }
             }
         }
         if (subFolderCount < 256) {
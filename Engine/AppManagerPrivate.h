@@ -106,12 +106,14 @@ public:
     ImageCachePtr _nodeCache; //< Images cache
     ImageCachePtr _diskCache; //< Images disk cache (used by DiskCache nodes)
     FrameEntryCachePtr _viewerCache; //< Viewer textures cache
+    SharedImageCachePtr _sharedImageCache; //< Images shared with the other processes of the computer, may be NULL
     mutable QMutex diskCachesLocationMutex;
     QString diskCachesLocation;
     boost::scoped_ptr<ProcessInputChannel> _backgroundIPC; //< object used to communicate with the main app
     //if this app is background, see the ProcessInputChannel def
     bool _loaded; //< true when the first instance is completely loaded.
     QString _binaryPath; //< the path to the application's binary
+    QString traceFilePath; //< where to write the render trace given with --trace, empty if not tracing
     U64 _nodesGlobalMemoryUse; //< how much memory all the nodes are using (besides the cache)
     mutable QMutex errorLogMutex;
     std::list<LogEntry> errorLog;
@@ -217,6 +219,11 @@ public:
 
     void saveCaches();
 
+    /**
+     * @brief Stops the render trace started with --trace and writes it, only the first call does something.
+     **/
+    void writeTrace();
+
     void restoreCaches();
 
     static void addOpenGLRequirementsString(QString& str, OpenGLRequirementsTypeEnum type);
@@ -225,6 +232,16 @@ public:
 
     void cleanUpCacheDiskStructure(const QString & cachePath, bool isTiled);
 
+    /**
+     * @brief Opens the index persisting the disk cache, recreating the disk cache folder if the index cannot be used
+     **/
+    void openDiskCacheIndex();
+
+    /**
+     * @brief Opens the image cache shared with the other processes, in the disk cache location
+     **/
+    void openSharedImageCache(U64 maximumSize);
+
     /**
      * @brief Called on startup to initialize the max opened files
      **/
@@ -69,6 +69,8 @@ public:
     std::list<std::pair<int, std::pair<int, int> > > frameRanges;
     bool rangeSet;
     bool enableRenderStats;
+    QString cacheStatsFilePath;
+    QString traceFilePath;
     bool isEmpty;
     mutable QString imageFilename;
 #ifdef NATRON_USE_BREAKPAD
@@ -99,6 +101,8 @@ public:
         , frameRanges()
         , rangeSet(false)
         , enableRenderStats(false)
+        , cacheStatsFilePath()
+        , traceFilePath()
         , isEmpty(true)
         , imageFilename()
 #ifdef NATRON_USE_BREAKPAD
@@ -260,6 +264,8 @@ CLArgs::operator=(const CLArgs& other)
     _imp->frameRanges = other._imp->frameRanges;
     _imp->rangeSet = other._imp->rangeSet;
     _imp->enableRenderStats = other._imp->enableRenderStats;
+    _imp->cacheStatsFilePath = other._imp->cacheStatsFilePath;
+    _imp->traceFilePath = other._imp->traceFilePath;
     _imp->isEmpty = other._imp->isEmpty;
     _imp->imageFilename = other._imp->imageFilename;
     _imp->exportDocsPath = other._imp->exportDocsPath;
@@ -362,7 +368,16 @@ CLArgs::printUsage(const std::string& programName)
         "     breakdown contains information about each nodes, render times etc...\n"
         "     This option is useful for debugging purposes or to control that a render\n"
         "     is working correctly.\n"
-        "     **Please note** that it does not work when writing video files."
+        "     **Please note** that it does not work when writing video files.\n"
+        "  --cache-stats <JSON file path>\n"
+        "     Write the statistics of the image caches to the given JSON file once\n"
+        "     the render is finished: hits, misses, evictions and memory used, in total\n"
+        "     and for each node. This is useful to choose the cache sizes.\n"
+        "  --trace <JSON file path>\n"
+        "     Record a timeline of the render activity (renders of each node, tiles,\n"
+        "     cache lookups, OpenFX actions, Python expressions...) on every thread\n"
+        "     and write it to the given file in the Chrome trace event format once\n"
+        "     Natron quits. It can be opened in chrome://tracing or in Perfetto.\n"
         "  <frameRanges>\n"
         "      One or more frame ranges, separated by commas.\n"
         "      Each frame range must be one of the following:\n"
@@ -592,6 +607,18 @@ CLArgs::getBreakpadComPipeFilePath() const
 }
 #endif // NATRON_USE_BREAKPAD
 
+const QString &
+CLArgs::getCacheStatsFilePath() const
+{
+    return _imp->cacheStatsFilePath;
+}
+
+const QString &
+CLArgs::getTraceFilePath() const
+{
+    return _imp->traceFilePath;
+}
+
 const QString &
 CLArgs::getExportDocsPath() const
 {
@@ -937,6 +964,40 @@ CLArgsPrivate::parse()
     }
 #endif // NATRON_USE_BREAKPAD
 
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("cache-stats"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+
+            if ( it == args.end() || it->startsWith( QChar::fromLatin1('-') ) ) {
+                std::cout << tr("You must specify the cache statistics file path").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+
+            cacheStatsFilePath = *it;
+            it = args.erase(it);
+        }
+    }
+
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("trace"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+
+            if ( it == args.end() || it->startsWith( QChar::fromLatin1('-') ) ) {
+                std::cout << tr("You must specify the trace file path").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+
+            traceFilePath = *it;
+            it = args.erase(it);
+        }
+    }
+
     {
         QStringList::iterator it = hasToken( QString::fromUtf8("export-docs"), QString() );
         if ( it != args.end() ) {
@@ -1269,6 +1330,8 @@ CLArgsPrivate::parse()
     qDebug() << "isBackground:" << isBackground;
     qDebug() << "isInterpreterMode:" << isInterpreterMode;
     qDebug() << "enableRenderStats:" << enableRenderStats;
+    qDebug() << "cacheStatsFilePath:" << cacheStatsFilePath;
+    qDebug() << "traceFilePath:" << traceFilePath;
 #ifdef NATRON_USE_BREAKPAD
     qDebug() << "breakpadProcessPID:" << breakpadProcessPID;
     qDebug() << "breakpadProcessFilePath:" << breakpadProcessFilePath;
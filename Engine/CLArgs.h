@@ -141,6 +141,10 @@ public:
 
     bool areRenderStatsEnabled() const;
 
+    const QString& getCacheStatsFilePath() const;
+
+    const QString& getTraceFilePath() const;
+
 #ifdef NATRON_USE_BREAKPAD
     const QString& getBreakpadProcessExecutableFilePath() const;
     qint64 getBreakpadProcessPID() const;
@@ -39,6 +39,7 @@
 #include <algorithm> // min, max
 #include <string>
 #include <stdexcept>
+#include <atomic>
 
 #include "Global/GlobalDefines.h"
 #include "Global/StrUtils.h"
@@ -48,8 +49,10 @@ GCC_DIAG_OFF(deprecated)
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutexLocker>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QObject>
 #include <QtCore/QBuffer>
+#include <QtCore/QFile>
 #include <QtCore/QRunnable>
 GCC_DIAG_ON(deprecated)
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
@@ -59,11 +62,16 @@ GCC_DIAG_ON(deprecated)
 
 #include "Engine/AppManager.h" //for access to settings
 #include "Engine/CacheEntry.h"
+#include "Engine/CacheEvictionPolicy.h"
+#include "Engine/CacheHolderStats.h"
+#include "Engine/CacheIndexFile.h"
+#include "Engine/CacheWriteBehindQueue.h"
 #include "Engine/ImageLocker.h"
 #include "Engine/LRUHashTable.h"
 #include "Engine/MemoryInfo.h" // getSystemTotalRAM
 #include "Engine/Settings.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/Timer.h"
 
 #include "Engine/EngineFwd.h"
 
@@ -72,126 +80,295 @@ GCC_DIAG_ON(deprecated)
 
 #define NATRON_TILE_CACHE_FILE_SIZE_BYTES 2000000000
 
+//Maximum number of threads freeing the entries evicted from a cache, and number of entries each of them frees at once
+#define NATRON_CACHE_DELETER_MAX_THREADS 4
+#define NATRON_CACHE_DELETER_BATCH 16
+
 ///When defined, number of opened files, memory size and disk size of the cache are printed whenever there's activity.
 //#define NATRON_DEBUG_CACHE
 
 NATRON_NAMESPACE_ENTER
 
 /**
- * @brief The point of this thread is to delete the content of the list in a separate thread so the thread calling
- * get() doesn't wait for all the entries to be deleted (which can be expensive for large images)
+ * @brief Statistics of a DeleterThreadPool, see DeleterThreadPool::getStats()
+ **/
+struct CacheDeleterStats
+{
+    // Bytes of RAM held by the entries waiting to be freed or being freed
+    std::size_t beingFreedSize;
+
+    // Bytes freed so far
+    U64 reclaimedBytes;
+
+    // Number of batches freed so far, and the total and maximum time in seconds between the eviction of a batch
+    // and the moment its memory was returned
+    U64 reclaimedBatches;
+    double reclaimTime;
+    double maxReclaimTime;
+
+    CacheDeleterStats()
+        : beingFreedSize(0)
+        , reclaimedBytes(0)
+        , reclaimedBatches(0)
+        , reclaimTime(0.)
+        , maxReclaimTime(0.)
+    {
+    }
+
+    double getAverageReclaimTime() const
+    {
+        return reclaimedBatches == 0 ? 0. : reclaimTime / reclaimedBatches;
+    }
+};
+
+/**
+ * @brief Hit statistics of a cache, see Cache::getStats()
+ **/
+struct CacheStats
+{
+    U64 hits[eCacheTierCount];
+
+    // Total time in seconds spent returning the hits of each tier, including uncompressing or re-mapping entries
+    double hitsTime[eCacheTierCount];
+    U64 misses;
+
+    // Bytes held by the compressed tier and bytes its entries would take uncompressed
+    std::size_t compressedSize;
+    std::size_t compressedDataSize;
+
+    // Writes of the entries evicted from the in-memory portion to their backing file
+    CacheWriteBehindStats writeBehind;
+
+    // Memory returned by the threads freeing the evicted entries
+    CacheDeleterStats deleter;
+
+    CacheStats()
+        : misses(0)
+        , compressedSize(0)
+        , compressedDataSize(0)
+    {
+        for (int i = 0; i < eCacheTierCount; ++i) {
+            hits[i] = 0;
+            hitsTime[i] = 0.;
+        }
+    }
+
+    double getCompressionRatio() const
+    {
+        return compressedSize == 0 ? 0. : (double)compressedDataSize / compressedSize;
+    }
+
+    double getAverageHitLatency(CacheTierEnum tier) const
+    {
+        return hits[tier] == 0 ? 0. : hitsTime[tier] / hits[tier];
+    }
+};
+
+/**
+ * @brief The point of these threads is to delete the content of the list in separate threads so the thread calling
+ * get() doesn't wait for all the entries to be deleted (which can be expensive for large images).
+ * When a lot of memory is dropped at once (e.g. clearing the cache or closing a project) a single thread cannot
+ * return it fast enough, so the entries are split in batches freed by a few threads.
+ * The size of the entries not freed yet is reported by getBeingFreedSize(), so that the cache does not evict
+ * more entries to make room for memory that is already about to be returned.
  **/
 template <typename T>
-class DeleterThread
-    : public QThread
+class DeleterThreadPool
 {
+    typedef boost::shared_ptr<T> TPtr;
+
+    class WorkerThread
+        : public QThread
+    {
+        DeleterThreadPool* _pool;
+
+    public:
+
+        WorkerThread(DeleterThreadPool* pool)
+            : QThread()
+            , _pool(pool)
+        {
+            setObjectName( QString::fromUtf8("CacheDeleter") );
+        }
+
+    private:
+
+        virtual void run() OVERRIDE FINAL
+        {
+            _pool->runWorker();
+        }
+    };
+
+    typedef boost::shared_ptr<WorkerThread> WorkerThreadPtr;
+
+    struct DeleteBatch
+    {
+        std::vector<TPtr> entries;
+        std::size_t size;
+
+        // Started when the batch is queued
+        TimeLapse queuedTime;
+    };
+
     mutable QMutex _entriesQueueMutex;
-    std::list<boost::shared_ptr<T> >_entriesQueue;
+    std::list<boost::shared_ptr<DeleteBatch> > _entriesQueue;
     QWaitCondition _entriesQueueNotEmptyCond;
+
+    // Number of batches taken from the queue by the workers and not freed yet
+    int _nWorking;
+    bool _mustQuit;
+    std::vector<WorkerThreadPtr> _threads;
     CacheAPI* cache;
-    QMutex mustQuitMutex;
-    QWaitCondition mustQuitCond;
-    bool mustQuit;
+
+    // Protected by _entriesQueueMutex
+    U64 _beingFreedSize;
+    U64 _reclaimedBytes;
+    U64 _reclaimedBatches;
+    U64 _reclaimMicroSeconds;
+    U64 _maxReclaimMicroSeconds;
 
 public:
 
-    DeleterThread(CacheAPI* cache)
-        : QThread()
-        , _entriesQueueMutex()
+    DeleterThreadPool(CacheAPI* cache)
+        : _entriesQueueMutex()
         , _entriesQueue()
         , _entriesQueueNotEmptyCond()
+        , _nWorking(0)
+        , _mustQuit(false)
+        , _threads()
         , cache(cache)
-        , mustQuitMutex()
-        , mustQuitCond()
-        , mustQuit(false)
+        , _beingFreedSize(0)
+        , _reclaimedBytes(0)
+        , _reclaimedBatches(0)
+        , _reclaimMicroSeconds(0)
+        , _maxReclaimMicroSeconds(0)
     {
-        setObjectName( QString::fromUtf8("CacheDeleter") );
     }
 
-    virtual ~DeleterThread()
+    ~DeleterThreadPool()
     {
+        quitThread();
     }
 
-    void appendToQueue(const std::list<boost::shared_ptr<T> > & entriesToDelete)
+    void appendToQueue(const std::list<TPtr> & entriesToDelete)
     {
         if ( entriesToDelete.empty() ) {
             return;
         }
 
-        {
-            QMutexLocker k(&_entriesQueueMutex);
-            _entriesQueue.insert( _entriesQueue.begin(), entriesToDelete.begin(), entriesToDelete.end() );
+        std::list<boost::shared_ptr<DeleteBatch> > batches;
+        for (typename std::list<TPtr>::const_iterator it = entriesToDelete.begin(); it != entriesToDelete.end(); ++it) {
+            if ( batches.empty() || (batches.back()->entries.size() == NATRON_CACHE_DELETER_BATCH) ) {
+                batches.push_back( boost::make_shared<DeleteBatch>() );
+                batches.back()->entries.reserve(NATRON_CACHE_DELETER_BATCH);
+                batches.back()->size = 0;
+            }
+            batches.back()->entries.push_back(*it);
+            // Entries stored on disk do not hold RAM once their mapping is closed
+            if ( !(*it)->isStoredOnDisk() ) {
+                batches.back()->size += (*it)->size();
+            }
         }
-        if ( !isRunning() ) {
-            start();
-        } else {
-            QMutexLocker k(&_entriesQueueMutex);
-            _entriesQueueNotEmptyCond.wakeOne();
+
+        QMutexLocker k(&_entriesQueueMutex);
+        for (typename std::list<boost::shared_ptr<DeleteBatch> >::iterator it = batches.begin(); it != batches.end(); ++it) {
+            _beingFreedSize += (*it)->size;
+        }
+        _entriesQueue.splice(_entriesQueue.end(), batches);
+        if ( _threads.empty() ) {
+            int nThreads = std::max( 1, std::min(QThread::idealThreadCount() / 2, NATRON_CACHE_DELETER_MAX_THREADS) );
+            for (int i = 0; i < nThreads; ++i) {
+                WorkerThreadPtr thread(new WorkerThread(this));
+                thread->start();
+                _threads.push_back(thread);
+            }
         }
+        _entriesQueueNotEmptyCond.wakeAll();
     }
 
+    /**
+     * @brief Frees the remaining entries and stops the threads.
+     **/
     void quitThread()
     {
-        if ( !isRunning() ) {
-            return;
-        }
-        QMutexLocker k(&mustQuitMutex);
-        assert(!mustQuit);
-        mustQuit = true;
-
+        std::vector<WorkerThreadPtr> threads;
         {
-            QMutexLocker k2(&_entriesQueueMutex);
-            _entriesQueue.push_back( boost::shared_ptr<T>() );
-            _entriesQueueNotEmptyCond.wakeOne();
+            QMutexLocker k(&_entriesQueueMutex);
+            _mustQuit = true;
+            _entriesQueueNotEmptyCond.wakeAll();
+            threads.swap(_threads);
         }
-        while (mustQuit) {
-            mustQuitCond.wait(k.mutex());
+        for (std::size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->wait();
         }
+        QMutexLocker k(&_entriesQueueMutex);
+        _mustQuit = false;
     }
 
     bool isWorking() const
     {
         QMutexLocker k(&_entriesQueueMutex);
 
-        return !_entriesQueue.empty();
+        return !_entriesQueue.empty() || _nWorking > 0;
+    }
+
+    /**
+     * @brief Returns the size in bytes of the entries appended to the queue and not freed yet
+     **/
+    std::size_t getBeingFreedSize() const
+    {
+        QMutexLocker k(&_entriesQueueMutex);
+
+        return _beingFreedSize;
+    }
+
+    void getStats(CacheDeleterStats* stats) const
+    {
+        QMutexLocker k(&_entriesQueueMutex);
+
+        stats->beingFreedSize = _beingFreedSize;
+        stats->reclaimedBytes = _reclaimedBytes;
+        stats->reclaimedBatches = _reclaimedBatches;
+        stats->reclaimTime = _reclaimMicroSeconds / 1000000.;
+        stats->maxReclaimTime = _maxReclaimMicroSeconds / 1000000.;
     }
 
 private:
 
-    virtual void run() OVERRIDE FINAL
+    void runWorker()
     {
         for (;; ) {
-            bool quit;
+            boost::shared_ptr<DeleteBatch> batch;
             {
-                QMutexLocker k(&mustQuitMutex);
-                quit = mustQuit;
+                QMutexLocker k(&_entriesQueueMutex);
+                while ( _entriesQueue.empty() && !_mustQuit ) {
+                    _entriesQueueNotEmptyCond.wait(k.mutex());
+                }
+                if ( _entriesQueue.empty() ) {
+                    // _mustQuit is set and everything was freed
+                    return;
+                }
+                batch = _entriesQueue.front();
+                _entriesQueue.pop_front();
+                ++_nWorking;
             }
 
-            {
-                boost::shared_ptr<T> front;
-                {
-                    QMutexLocker k(&_entriesQueueMutex);
-                    if ( quit && _entriesQueue.empty() ) {
-                        _entriesQueueMutex.unlock();
-                        QMutexLocker k(&mustQuitMutex);
-                        assert(mustQuit);
-                        mustQuit = false;
-                        mustQuitCond.wakeOne();
-
-                        return;
-                    }
-                    while ( _entriesQueue.empty() ) {
-                        _entriesQueueNotEmptyCond.wait(k.mutex());
-                    }
+            for (std::size_t i = 0; i < batch->entries.size(); ++i) {
+                batch->entries[i]->scheduleForDestruction();
+            }
+            // After this, the images are guaranteed to be freed
+            batch->entries.clear();
 
-                    assert( !_entriesQueue.empty() );
-                    front = _entriesQueue.front();
-                    _entriesQueue.pop_front();
-                }
-                if (front) {
-                    front->scheduleForDestruction();
-                }
-            } // front. After this scope, the image is guaranteed to be freed
+            U64 reclaimMicroSeconds = (U64)(batch->queuedTime.getTimeSinceCreation() * 1000000.);
+            {
+                QMutexLocker k(&_entriesQueueMutex);
+                _reclaimMicroSeconds += reclaimMicroSeconds;
+                _maxReclaimMicroSeconds = std::max(_maxReclaimMicroSeconds, reclaimMicroSeconds);
+                _reclaimedBytes += batch->size;
+                ++_reclaimedBatches;
+                _beingFreedSize -= batch->size;
+                --_nWorking;
+            }
             cache->notifyMemoryDeallocated();
         }
     }
@@ -211,6 +388,17 @@ class CacheCleanerThread
         std::string holderID;
         U64 nodeHash;
         bool removeAll;
+
+        // If true, this request only compacts the index of the cache, see CacheIndexFile
+        bool compactIndex;
+
+        CleanRequest()
+            : holderID()
+            , nodeHash(0)
+            , removeAll(false)
+            , compactIndex(false)
+        {
+        }
     };
 
     std::list<CleanRequest> _requestsQueues;
@@ -259,6 +447,22 @@ public:
         }
     }
 
+    void appendCompactIndexRequest()
+    {
+        {
+            QMutexLocker k(&_requestQueueMutex);
+            CleanRequest r;
+            r.compactIndex = true;
+            _requestsQueues.push_back(r);
+        }
+        if ( !isRunning() ) {
+            start();
+        } else {
+            QMutexLocker k(&_requestQueueMutex);
+            _requestsQueueNotEmptyCond.wakeOne();
+        }
+    }
+
     void quitThread()
     {
         if ( !isRunning() ) {
@@ -318,7 +522,11 @@ private:
                     front = _requestsQueues.front();
                     _requestsQueues.pop_front();
                 }
-                cache->removeAllEntriesWithDifferentNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
+                if (front.compactIndex) {
+                    cache->compactIndex();
+                } else {
+                    cache->removeAllEntriesWithDifferentNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
+                }
             }
         }
     }
@@ -400,6 +608,23 @@ public:
 
     typedef std::list<SerializedEntry> CacheTOC;
 
+    /**
+     * @brief Converts the key and parameters of an entry to the payload of its record in the index of the cache
+     * and back, see openIndex(). IndexSerializer, defined in CacheSerialization.h, implements it with boost serialization.
+     **/
+    class IndexSerializerBase
+    {
+    public:
+        virtual ~IndexSerializerBase() {}
+
+        virtual void serialize(const key_t& key, const ParamsTypePtr& params, std::string* payload) const = 0;
+        virtual bool deserialize(const std::string& payload, key_t* key, ParamsTypePtr* params) const = 0;
+    };
+
+    typedef boost::shared_ptr<IndexSerializerBase> IndexSerializerPtr;
+
+    class IndexSerializer;
+
 public:
 
 
@@ -481,24 +706,102 @@ public:
 
 private:
 
+    /**
+     * @brief The hash space of the cache is partitioned into independently locked shards, so that threads
+     * looking up entries with different hashes do not serialize on the same mutexes.
+     * An entry always lives in the shard selected by its hash, be it in the memory, compressed or disk portion.
+     **/
+    struct CacheShard
+    {
+        mutable QMutex lock; //protects memoryCache, compressedCache, diskCache & uncompressingEntries
+        mutable QMutex getLock; //prevents get() and getOrCreate() to be called simultaneously for this shard
+
+        /*These are mutable because we need to modify the LRU list even
+             when we call get() and we want this function to be const.*/
+        mutable CacheContainer memoryCache;
+
+        // Entries evicted from memoryCache whose buffer was compressed, see CacheCompression
+        mutable CacheContainer compressedCache;
+        mutable CacheContainer diskCache;
+
+        // Entries taken out of compressedCache by a lookup and being uncompressed without the lock, see lookupInternal()
+        mutable std::list<EntryTypePtr> uncompressingEntries;
+
+        // Priority of the last entry evicted with the cost-aware policy, see CacheCostAwarePriority
+        mutable double inflation;
+
+        // Statistics of the entries of this shard, by holder ID, see getHolderStats()
+        mutable CacheHolderStatsMap holderStats;
+
+        CacheShard()
+            : lock()
+            , getLock()
+            , memoryCache()
+            , compressedCache()
+            , diskCache()
+            , uncompressingEntries()
+            , inflation(0.)
+            , holderStats()
+        {
+        }
+    };
+
+    /**
+     * @brief Same as QMutexLocker, but adds the time spent waiting for the mutex to waitTime.
+     * Uncontended locks are not timed, so that measuring costs nothing when there is no contention.
+     **/
+    class MeasuredMutexLocker
+    {
+        QMutex* _mutex;
+
+    public:
+
+        MeasuredMutexLocker(QMutex* mutex,
+                            double* waitTime)
+            : _mutex(mutex)
+        {
+            if ( !_mutex->tryLock() ) {
+                TimeLapse timer;
+                _mutex->lock();
+                *waitTime += timer.getTimeSinceCreation();
+            }
+        }
+
+        ~MeasuredMutexLocker()
+        {
+            _mutex->unlock();
+        }
+    };
+
+    typedef boost::shared_ptr<CacheShard> CacheShardPtr;
 
-    std::size_t _maximumInMemorySize;     // the maximum size of the in-memory portion of the cache.(in % of the maximum cache size)
-    std::size_t _maximumCacheSize;     // maximum size allowed for the cache
+    std::atomic<std::size_t> _maximumInMemorySize;     // the maximum size of the in-memory portion of the cache.(in % of the maximum cache size)
+    std::atomic<std::size_t> _maximumCacheSize;     // maximum size allowed for the cache
 
     /*mutable because we need to change modify it in the sealEntryInternal function which
          is called by an external object that have a const ref to the cache.
      */
-    mutable std::size_t _memoryCacheSize;     // current size of the cache in bytes
-    mutable std::size_t _diskCacheSize;
-    mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize
-    mutable QMutex _lock; //protects _memoryCache & _diskCache
-    mutable QMutex _getLock;  //prevents get() and getOrCreate() to be called simultaneously
-
-
-    /*These 2 are mutable because we need to modify the LRU list even
-         when we call get() and we want this function to be const.*/
-    mutable CacheContainer _memoryCache;
-    mutable CacheContainer _diskCache;
+    mutable std::atomic<std::size_t> _memoryCacheSize;     // current size of the cache in bytes
+    mutable std::atomic<std::size_t> _diskCacheSize;
+
+    // The compressed portion of the cache lives in RAM next to the in-memory portion, 0 disables it.
+    std::atomic<std::size_t> _maximumCompressedSize;
+    mutable std::atomic<std::size_t> _compressedCacheSize; // bytes held by compressed buffers
+    mutable std::atomic<std::size_t> _compressedDataSize; // bytes these buffers would take uncompressed
+
+    // Hit statistics, see getStats()
+    mutable std::atomic<U64> _tierHits[eCacheTierCount];
+    mutable std::atomic<U64> _tierHitsMicroSeconds[eCacheTierCount];
+    mutable std::atomic<U64> _misses;
+    std::atomic<int> _evictionPolicy; // CacheEvictionPolicyEnum
+    mutable QMutex _memoryFullMutex; // used along with _memoryFullCondition
+
+    // The shards, their number is a power of 2 so that a shard index is obtained by masking the hash
+    std::vector<CacheShardPtr> _shards;
+    std::size_t _shardsMask;
+
+    // Index of the shard where the next eviction across shards starts, so that all shards are evicted evenly
+    mutable std::atomic<std::size_t> _nextEvictionShard;
     const std::string _cacheName;
     const unsigned int _version;
 
@@ -509,10 +812,23 @@ private:
     ///Store the system physical total RAM in a member
     std::size_t _maxPhysicalRAM;
     bool _tearingDown;
-    mutable DeleterThread<EntryType> _deleterThread;
-    mutable QWaitCondition _memoryFullCondition; //< protected by _sizeLock
+    mutable DeleterThreadPool<EntryType> _deleter;
+
+    ///Writes the entries evicted from the in-memory portion to their backing file, off the render threads
+    mutable CacheWriteBehindQueue<EntryType> _writeBehindQueue;
+    mutable QWaitCondition _memoryFullCondition; //< protected by _memoryFullMutex
     mutable CacheCleanerThread _cleanerThread;
 
+    // If set, the disk portion is persisted by this index rather than by save()/restore(). Only for non tiled caches.
+    boost::shared_ptr<CacheIndexFile> _index;
+    IndexSerializerPtr _indexSerializer;
+
+    // The records of the entries moved to the disk portion and removed from the index while a shard lock is held:
+    // they are written to the index by flushIndexUpdates(), once the lock is released
+    mutable QMutex _indexUpdatesMutex;
+    mutable std::list<CacheIndexFile::Record> _indexAdditions;
+    mutable std::list<CacheIndexFile::Record> _indexRemovals;
+
     // If tiled, the cache will consist only of a few large files that each contain tiles of the same size.
     // This is useful to cache chunks of data that always have the same size.
     mutable QMutex _tileCacheMutex;
@@ -522,56 +838,105 @@ private:
     // True when clearing the cache, protected by _tileCacheMutex
     bool _clearingCache;
 
-    // Used when the cache is tiled
+    // Used when the cache is tiled, protected by _cacheFilesLock.
+    // _isTiled and _tileByteSize are only changed while holding both _tileCacheMutex and
+    // _cacheFilesLock for writing, so they may be read under either of them.
+    mutable QReadWriteLock _cacheFilesLock;
     std::set<TileCacheFilePtr> _cacheFiles;
-
-    // When set these are used for fast search of a free tile
-    TileCacheFileWPtr _nextAvailableCacheFile;
-    int _nextAvailableCacheFileIndex;
 public:
 
 
+    /**
+     * @param nShards The number of independently locked shards the hash space is partitioned into.
+     * It is rounded up to a power of 2 and clamped to NATRON_CACHE_MAX_SHARDS. A value of 1 makes
+     * every lookup go through the same pair of mutexes.
+     **/
     Cache(const std::string & cacheName,
           unsigned int version,
           U64 maximumCacheSize,      // total size
-          double maximumInMemoryPercentage //how much should live in RAM
+          double maximumInMemoryPercentage, //how much should live in RAM
+          std::size_t nShards = 1
           )
         : CacheAPI()
         , _maximumInMemorySize(maximumCacheSize * maximumInMemoryPercentage)
         , _maximumCacheSize(maximumCacheSize)
         , _memoryCacheSize(0)
         , _diskCacheSize(0)
-        , _sizeLock()
-        , _lock()
-        , _getLock()
-        , _memoryCache()
-        , _diskCache()
+        , _maximumCompressedSize(0)
+        , _compressedCacheSize(0)
+        , _compressedDataSize(0)
+        , _misses(0)
+        , _evictionPolicy(eCacheEvictionPolicyLRU)
+        , _memoryFullMutex()
+        , _shards()
+        , _shardsMask(0)
+        , _nextEvictionShard(0)
         , _cacheName(cacheName)
         , _version(version)
         , _signalEmitter()
         , _maxPhysicalRAM( getSystemTotalRAM() )
         , _tearingDown(false)
-        , _deleterThread(this)
+        , _deleter(this)
+        , _writeBehindQueue()
         , _memoryFullCondition()
         , _cleanerThread(this)
+        , _index()
+        , _indexSerializer()
+        , _indexUpdatesMutex()
+        , _indexAdditions()
+        , _indexRemovals()
         , _tileCacheMutex()
         , _isTiled(false)
         , _tileByteSize(0)
         , _clearingCache(false)
+        , _cacheFilesLock()
         , _cacheFiles()
-        , _nextAvailableCacheFile()
-        , _nextAvailableCacheFileIndex(-1)
     {
         _signalEmitter = boost::make_shared<CacheSignalEmitter>();
+
+        for (int i = 0; i < eCacheTierCount; ++i) {
+            _tierHits[i] = 0;
+            _tierHitsMicroSeconds[i] = 0;
+        }
+
+        std::size_t shardsCount = 1;
+        while ( shardsCount < nShards && shardsCount < NATRON_CACHE_MAX_SHARDS ) {
+            shardsCount <<= 1;
+        }
+        _shards.resize(shardsCount);
+        for (std::size_t i = 0; i < shardsCount; ++i) {
+            _shards[i] = boost::make_shared<CacheShard>();
+        }
+        _shardsMask = shardsCount - 1;
     }
 
     virtual ~Cache()
     {
-        QMutexLocker locker(&_lock);
-
+        _writeBehindQueue.quitThreads();
+        _deleter.quitThread();
         _tearingDown = true;
-        _memoryCache.clear();
-        _diskCache.clear();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            QMutexLocker locker(&_shards[i]->lock);
+            _shards[i]->memoryCache.clear();
+            _shards[i]->compressedCache.clear();
+            _shards[i]->diskCache.clear();
+        }
+    }
+
+    /**
+     * @brief Returns a number of shards suited to this computer: twice the number of cores, so that
+     * concurrent render threads rarely hit the same shard.
+     **/
+    static std::size_t getDefaultShardsCount()
+    {
+        int nCores = QThread::idealThreadCount();
+
+        return nCores > 0 ? std::min( (std::size_t)nCores * 2, (std::size_t)NATRON_CACHE_MAX_SHARDS ) : 1;
+    }
+
+    std::size_t getShardsCount() const
+    {
+        return _shards.size();
     }
 
     virtual bool isTileCache() const OVERRIDE FINAL
@@ -593,6 +958,7 @@ public:
      **/
     void setTiled(bool tiled, std::size_t tileByteSize)
     {
+        QWriteLocker k0(&_cacheFilesLock);
         QMutexLocker k(&_tileCacheMutex);
         _isTiled = tiled;
         _tileByteSize = tileByteSize;
@@ -601,7 +967,8 @@ public:
 
     void waitForDeleterThread()
     {
-        _deleterThread.quitThread();
+        _writeBehindQueue.quitThreads();
+        _deleter.quitThread();
         _cleanerThread.quitThread();
     }
 
@@ -619,34 +986,91 @@ public:
     bool get(const typename EntryType::key_type & key,
              std::list<EntryTypePtr>* returnValue) const
     {
-        ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
+        CacheShard& shard = getShard( key.getHash() );
+        double lockWaitTime = 0.;
+
+        bool found;
+        {
+            ///Be atomic, so it cannot be created by another thread in the meantime
+            MeasuredMutexLocker getlocker(&shard.getLock, &lockWaitTime);
 
-        ///lock the cache before reading it.
-        QMutexLocker locker(&_lock);
+            ///lock the shard before reading it.
+            MeasuredMutexLocker locker(&shard.lock, &lockWaitTime);
+
+            found = getInternal(shard, key, lockWaitTime, returnValue);
+        }
+        flushIndexUpdates();
 
-        return getInternal(key, returnValue);
+        return found;
     } // get
 
+    /**
+     * @brief Same as get() but only looks in the in-memory portion of the cache, and neither counts a hit or a miss
+     * nor makes the entries more recently used: this is used to plan a render without altering the cache.
+     **/
+    bool peek(const typename EntryType::key_type & key,
+              std::list<EntryTypePtr>* returnValue) const
+    {
+        CacheShard& shard = getShard( key.getHash() );
+        QMutexLocker locker(&shard.lock);
+        CacheIterator memoryCached = shard.memoryCache( key.getHash() );
+
+        if ( memoryCached == shard.memoryCache.end() ) {
+            return false;
+        }
+        std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
+        for (typename std::list<EntryTypePtr>::const_iterator it = ret.begin(); it != ret.end(); ++it) {
+            if ( (*it)->getKey() == key ) {
+                returnValue->push_back(*it);
+            }
+        }
+
+        return !returnValue->empty();
+    }
+
 private:
 
+    CacheShard& getShard(hash_type hash) const
+    {
+        // Mix the bits of the hash so that hashes that only differ in their high bits still land in different shards
+        U64 h = (U64)hash;
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+
+        return *_shards[h & _shardsMask];
+    }
+
+    /**
+     * @brief Subtract size from the given counter without wrapping around: the counters may not always fallback to 0
+     **/
+    static void atomicSubtractClamped(std::atomic<std::size_t>& counter,
+                                      std::size_t size)
+    {
+        std::size_t cur = counter.load();
+
+        while ( !counter.compare_exchange_weak(cur, size > cur ? 0 : cur - size) ) {
+        }
+    }
 
 
     virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) OVERRIDE FINAL WARN_UNUSED_RETURN
     {
-        QMutexLocker k(&_tileCacheMutex);
+        QWriteLocker k(&_cacheFilesLock);
         assert(_isTiled);
         if (!_isTiled) {
             throw std::logic_error("allocTile() but cache is not tiled!");
         }
+        int index = dataOffset / _tileByteSize;
+
+        // The dataOffset should be a multiple of the tile size
+        assert(_tileByteSize * index == dataOffset);
         for (std::set<TileCacheFilePtr>::iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
             if ((*it)->file->path() == filepath) {
-                int index = dataOffset / _tileByteSize;
-
-                // The dataOffset should be a multiple of the tile size
-                assert(_tileByteSize * index == dataOffset);
-                assert(!(*it)->usedTiles[index]);
-                (*it)->usedTiles[index] = true;
+                bool wasFree = (*it)->markTileUsed(index);
+                assert(wasFree);
+                Q_UNUSED(wasFree);
                 return *it;
             }
         }
@@ -656,14 +1080,10 @@ private:
             TileCacheFilePtr ret = boost::make_shared<TileCacheFile>();
             ret->file = boost::make_shared<MemoryFile>(filepath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
             std::size_t nTilesPerFile = std::floor( ( (double)NATRON_TILE_CACHE_FILE_SIZE_BYTES ) / _tileByteSize );
-            ret->usedTiles.resize(nTilesPerFile, false);
-            int index = dataOffset / _tileByteSize;
+            ret->initTiles(nTilesPerFile);
 
-            // The dataOffset should be a multiple of the tile size
-            assert(_tileByteSize * index == dataOffset);
-            assert(index >= 0 && index < (int)ret->usedTiles.size());
-            assert(!ret->usedTiles[index]);
-            ret->usedTiles[index] = true;
+            assert(index >= 0 && index < (int)ret->getNumTiles());
+            ret->markTileUsed(index);
             _cacheFiles.insert(ret);
             return ret;
 
@@ -681,67 +1101,54 @@ private:
      **/
     virtual TileCacheFilePtr allocTile(std::size_t *dataOffset) OVERRIDE FINAL
     {
-
-        QMutexLocker k(&_tileCacheMutex);
-
-        assert(_isTiled);
-        if (!_isTiled) {
-            throw std::logic_error("allocTile() but cache is not tiled!");
-        }
         // First, search for a file with available space.
-        // If not found create one
-        TileCacheFilePtr foundAvailableFile;
-        int foundTileIndex = -1;
+        // Each file finds a free tile in O(log(n)) under its own lock, so concurrent allocations only
+        // share the read lock on the set of files.
         {
-            foundAvailableFile = _nextAvailableCacheFile.lock();
-            if (_nextAvailableCacheFileIndex != -1 && foundAvailableFile) {
-                foundTileIndex = _nextAvailableCacheFileIndex;
-                *dataOffset = foundTileIndex * _tileByteSize;
-                _nextAvailableCacheFileIndex = -1;
-                _nextAvailableCacheFile.reset();
-            } else {
-                foundTileIndex = -1;
-                foundAvailableFile.reset();
+            QReadLocker k(&_cacheFilesLock);
+
+            assert(_isTiled);
+            if (!_isTiled) {
+                throw std::logic_error("allocTile() but cache is not tiled!");
             }
-        }
-        if (foundTileIndex == -1) {
             for (std::set<TileCacheFilePtr>::iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
-                for (std::size_t i = 0; i < (*it)->usedTiles.size(); ++i) {
-                    if (!(*it)->usedTiles[i])  {
-                        foundTileIndex = i;
-                        *dataOffset = i * _tileByteSize;
-                        break;
-                    }
-                }
+                int foundTileIndex = (*it)->allocTile();
                 if (foundTileIndex != -1) {
-                    foundAvailableFile = *it;
-                    break;
+                    *dataOffset = foundTileIndex * _tileByteSize;
+                    return *it;
                 }
             }
         }
 
-        if (!foundAvailableFile) {
-            // Create a file if all space is taken
-            foundAvailableFile = boost::make_shared<TileCacheFile>();
-            int nCacheFiles = (int)_cacheFiles.size();
-            std::stringstream cacheFilePathSs;
-            cacheFilePathSs << getCachePath().toStdString() << "/CachePart" << nCacheFiles;
-            std::string cacheFilePath = cacheFilePathSs.str();
-            foundAvailableFile->file = boost::make_shared<MemoryFile>(cacheFilePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate);
+        // All files are full, create one
+        QWriteLocker k(&_cacheFilesLock);
 
-            std::size_t nTilesPerFile = std::floor(((double)NATRON_TILE_CACHE_FILE_SIZE_BYTES) / _tileByteSize);
-            std::size_t cacheFileSize = nTilesPerFile * _tileByteSize;
-            foundAvailableFile->file->resize(cacheFileSize);
-            foundAvailableFile->usedTiles.resize(nTilesPerFile, false);
-            *dataOffset = 0;
-            foundTileIndex = 0;
-            _cacheFiles.insert(foundAvailableFile);
-            _nextAvailableCacheFile = foundAvailableFile;
-            _nextAvailableCacheFileIndex = 1;
+        // Another thread may have created a file or freed a tile while we were waiting for the write lock
+        for (std::set<TileCacheFilePtr>::iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
+            int foundTileIndex = (*it)->allocTile();
+            if (foundTileIndex != -1) {
+                *dataOffset = foundTileIndex * _tileByteSize;
+                return *it;
+            }
         }
 
-        // Notify the memory file that this portion of the file is valid
-        foundAvailableFile->usedTiles[foundTileIndex] = true;
+        TileCacheFilePtr foundAvailableFile = boost::make_shared<TileCacheFile>();
+        int nCacheFiles = (int)_cacheFiles.size();
+        std::stringstream cacheFilePathSs;
+        cacheFilePathSs << getCachePath().toStdString() << "/CachePart" << nCacheFiles;
+        std::string cacheFilePath = cacheFilePathSs.str();
+        foundAvailableFile->file = boost::make_shared<MemoryFile>(cacheFilePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate);
+
+        std::size_t nTilesPerFile = std::floor(((double)NATRON_TILE_CACHE_FILE_SIZE_BYTES) / _tileByteSize);
+        std::size_t cacheFileSize = nTilesPerFile * _tileByteSize;
+        foundAvailableFile->file->resize(cacheFileSize);
+        foundAvailableFile->initTiles(nTilesPerFile);
+
+        int foundTileIndex = foundAvailableFile->allocTile();
+        assert(foundTileIndex == 0);
+        *dataOffset = foundTileIndex * _tileByteSize;
+        _cacheFiles.insert(foundAvailableFile);
+
         return foundAvailableFile;
     }
 
@@ -750,50 +1157,65 @@ private:
              **/
     virtual void freeTile(const TileCacheFilePtr& file, std::size_t dataOffset) OVERRIDE FINAL
     {
-        QMutexLocker k(&_tileCacheMutex);
+        bool removeFile = false;
+        {
+            QReadLocker k(&_cacheFilesLock);
 
-        assert(_isTiled);
-        if (!_isTiled) {
-            throw std::logic_error("allocTile() but cache is not tiled!");
-        }
-        std::set<TileCacheFilePtr>::iterator foundTileFile = _cacheFiles.find(file);
-        assert(foundTileFile != _cacheFiles.end());
-        if (foundTileFile == _cacheFiles.end()) {
-            return;
+            assert(_isTiled);
+            if (!_isTiled) {
+                throw std::logic_error("allocTile() but cache is not tiled!");
+            }
+            std::set<TileCacheFilePtr>::iterator foundTileFile = _cacheFiles.find(file);
+            assert(foundTileFile != _cacheFiles.end());
+            if (foundTileFile == _cacheFiles.end()) {
+                return;
+            }
+            int index = dataOffset / _tileByteSize;
+
+            // The dataOffset should be a multiple of the tile size
+            assert(_tileByteSize * index == dataOffset);
+            assert(index >= 0 && index < (int)(*foundTileFile)->getNumTiles());
+            bool wasUsed = (*foundTileFile)->freeTile(index);
+            assert(wasUsed);
+            Q_UNUSED(wasUsed);
+
+            // The content of the tile is garbage now, release its pages
+            (*foundTileFile)->file->advise(eMemoryAccessHintDontNeed, (*foundTileFile)->file->data() + dataOffset, _tileByteSize);
+
+            // If the file does not have any tile associated, remove it
+            // A use_count of 2 means that the tile file is only referenced by the cache itself and the entry calling
+            // the freeTile() function, hence once its freed, no tile should be using it anymore
+            if ((*foundTileFile).use_count() <= 2) {
+                {
+                    QMutexLocker k2(&_tileCacheMutex);
+                    removeFile = _clearingCache;
+                }
+                // Do not remove the file except if we are clearing the cache
+                if (!removeFile) {
+                    // Invalidate this portion of the cache
+                    (*foundTileFile)->file->flush(MemoryFile::eFlushTypeInvalidate, (*foundTileFile)->file->data() + dataOffset, _tileByteSize);
+                }
+            }
         }
-        int index = dataOffset / _tileByteSize;
 
-        // The dataOffset should be a multiple of the tile size
-        assert(_tileByteSize * index == dataOffset);
-        assert(index >= 0 && index < (int)(*foundTileFile)->usedTiles.size());
-        assert((*foundTileFile)->usedTiles[index]);
-        (*foundTileFile)->usedTiles[index] = false;
-
-        // If the file does not have any tile associated, remove it
-        // A use_count of 2 means that the tile file is only referenced by the cache itself and the entry calling
-        // the freeTile() function, hence once its freed, no tile should be using it anymore
-        if ((*foundTileFile).use_count() <= 2) {
-            // Do not remove the file except if we are clearing the cache
-            if (_clearingCache) {
+        if (removeFile) {
+            QWriteLocker k(&_cacheFilesLock);
+            std::set<TileCacheFilePtr>::iterator foundTileFile = _cacheFiles.find(file);
+            if ( (foundTileFile != _cacheFiles.end()) && ( (*foundTileFile).use_count() <= 2 ) ) {
                 (*foundTileFile)->file->remove();
                 _cacheFiles.erase(foundTileFile);
-            } else {
-                // Invalidate this portion of the cache
-                (*foundTileFile)->file->flush(MemoryFile::eFlushTypeInvalidate, (*foundTileFile)->file->data() + dataOffset, _tileByteSize);
             }
-        } else {
-            _nextAvailableCacheFile = *foundTileFile;
-            _nextAvailableCacheFileIndex = index;
         }
     }
 
 
-    void createInternal(const typename EntryType::key_type & key,
+    void createInternal(CacheShard& shard,
+                        const typename EntryType::key_type & key,
                         const ParamsTypePtr & params,
                         ImageLockerHelper<EntryType>* entryLocker,
                         EntryTypePtr* returnValue) const
     {
-        //_lock must not be taken here
+        //shard.lock must not be taken here
 
         ///Before allocating the memory check that there's enough space to fit in memory
         appPTR->checkCacheFreeMemoryIsGoodEnough();
@@ -812,35 +1234,33 @@ private:
             ++safeCounter;
         }
 
-        U64 memoryCacheSize, maximumInMemorySize;
-        {
-            QMutexLocker k(&_sizeLock);
-            memoryCacheSize = _memoryCacheSize;
-            maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
-        }
+        U64 memoryCacheSize = getMemoryCacheSizeNotBeingFreed();
+        U64 maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize.load() );
         {
-            QMutexLocker locker(&_lock);
             std::list<EntryTypePtr> entriesToBeDeleted;
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             ///While the current cache size can't fit the new entry, erase the last recently used entries.
             ///Also if the total free RAM is under the limit of the system free RAM to keep free, erase LRU entries.
             while (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
+                if ( !tryEvictInMemoryEntryFromAnyShard(deleted) ) {
                     break;
                 }
 
                 for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
                     entriesToBeDeleted.push_back(*it);
-                    memoryCacheSize -= (*it)->size();
+                    memoryCacheSize -= std::min( (U64)(*it)->size(), memoryCacheSize );
                 }
 
                 occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             }
 
+            // Keep what can be compressed in the compressed portion rather than deleting it
+            compressEvictedEntries(entriesToBeDeleted);
+
             if ( !entriesToBeDeleted.empty() ) {
                 ///Launch a separate thread whose function will be to delete all the entries to be deleted
-                _deleterThread.appendToQueue(entriesToBeDeleted);
+                _deleter.appendToQueue(entriesToBeDeleted);
 
                 ///Clearing the list here will not delete the objects pointing to by the shared_ptr's because we made a copy
                 ///that the separate thread will delete
@@ -849,43 +1269,42 @@ private:
         }
         {
             //If _maximumcacheSize == 0 we don't return 1 otherwise we would cause a deadlock
-            QMutexLocker k(&_sizeLock);
-            double occupationPercentage =  _maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / _maximumCacheSize;
+            QMutexLocker k(&_memoryFullMutex);
+            std::size_t maximumCacheSize = _maximumCacheSize;
+            double occupationPercentage =  maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / maximumCacheSize;
 
             //_memoryCacheSize member will get updated while images are being destroyed by the parallel thread.
             //we wait for cache memory occupation to be < 100% to be sure we don't hit swap here
-            while ( occupationPercentage >= 1. && _deleterThread.isWorking() ) {
+            while ( occupationPercentage >= 1. && _deleter.isWorking() ) {
                 _memoryFullCondition.wait(k.mutex());
-                occupationPercentage =  _maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / _maximumCacheSize;
+                maximumCacheSize = _maximumCacheSize;
+                occupationPercentage =  maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / maximumCacheSize;
             }
         }
         if (_isTiled) {
 
-            QMutexLocker locker(&_lock);
             // For tiled caches, we insert directly into the disk cache, so make sure there is room for it
             std::list<EntryTypePtr> entriesToBeDeleted;
-            U64 diskCacheSize, maximumDiskCacheSize;
-            {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
-                maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
-            }
+            U64 diskCacheSize = _diskCacheSize;
+            std::size_t maximumCacheSize = _maximumCacheSize;
+            std::size_t maximumInMemorySize = _maximumInMemorySize;
+            U64 maximumDiskCacheSize = std::max( (std::size_t)1, maximumCacheSize - std::min(maximumInMemorySize, maximumCacheSize) );
             double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
+                if ( !tryEvictDiskEntryFromAnyShard(deleted) ) {
                     break;
                 }
 
                 for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    diskCacheSize -= (*it)->size();
+                    diskCacheSize -= std::min( (U64)(*it)->size(), diskCacheSize );
                     entriesToBeDeleted.push_back(*it);
                 }
                 diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             }
             if ( !entriesToBeDeleted.empty() ) {
                 ///Launch a separate thread whose function will be to delete all the entries to be deleted
-                _deleterThread.appendToQueue(entriesToBeDeleted);
+                _deleter.appendToQueue(entriesToBeDeleted);
 
                 ///Clearing the list here will not delete the objects pointing to by the shared_ptr's because we made a copy
                 ///that the separate thread will delete
@@ -894,7 +1313,7 @@ private:
 
         }
         {
-            QMutexLocker locker(&_lock);
+            QMutexLocker locker(&shard.lock);
 
             try {
                 returnValue->reset( new EntryType(key, params, this ) );
@@ -913,7 +1332,7 @@ private:
                 if (entryLocker) {
                     entryLocker->lock(*returnValue);
                 }
-                sealEntry(*returnValue, _isTiled ? false : true);
+                sealEntry(shard, *returnValue, _isTiled ? false : true);
             }
         }
     } // createInternal
@@ -923,13 +1342,15 @@ public:
     void swapOrInsert(const EntryTypePtr& entryToBeEvicted,
                       const EntryTypePtr& newEntry)
     {
-        QMutexLocker locker(&_lock);
-
         const typename EntryType::key_type& key = entryToBeEvicted->getKey();
         typename EntryType::hash_type hash = entryToBeEvicted->getHashKey();
+        CacheShard& shard = getShard(hash);
+
+        QMutexLocker locker(&shard.lock);
+
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache(hash);
-        if ( memoryCached != _memoryCache.end() ) {
+        CacheIterator memoryCached = shard.memoryCache(hash);
+        if ( memoryCached != shard.memoryCache.end() ) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( ( (*it)->getKey() == key ) && ( (*it)->getParams() == entryToBeEvicted->getParams() ) ) {
@@ -941,8 +1362,8 @@ public:
             ret.push_back(newEntry);
         } else {
             ///Look in disk cache
-            CacheIterator diskCached = _diskCache(hash);
-            if ( diskCached != _diskCache.end() ) {
+            CacheIterator diskCached = shard.diskCache(hash);
+            if ( diskCached != shard.diskCache.end() ) {
                 ///Remove the old entry
                 std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
@@ -953,7 +1374,7 @@ public:
                 }
             }
             ///Insert in mem cache
-            _memoryCache.insert(hash, newEntry);
+            shard.memoryCache.insert(hash, newEntry);
         }
     }
 
@@ -992,29 +1413,35 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
 
+        CacheShard& shard = getShard( key.getHash() );
+        double lockWaitTime = 0.;
+        bool found = false;
         {
             ///Be atomic, so it cannot be created by another thread in the meantime
-            QMutexLocker getlocker(&_getLock);
+            MeasuredMutexLocker getlocker(&shard.getLock, &lockWaitTime);
             std::list<EntryTypePtr> entries;
             bool didGetSucceed;
             {
-                QMutexLocker locker(&_lock);
-                didGetSucceed = getInternal(key, &entries);
+                MeasuredMutexLocker locker(&shard.lock, &lockWaitTime);
+                didGetSucceed = getInternal(shard, key, lockWaitTime, &entries);
             }
             if (didGetSucceed) {
                 for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
                     if (*(*it)->getParams() == *params) {
                         *returnValue = *it;
-
-                        return true;
+                        found = true;
+                        break;
                     }
                 }
             }
 
-            createInternal(key, params, locker, returnValue);
-
-            return false;
+            if (!found) {
+                createInternal(shard, key, params, locker, returnValue);
+            }
         } // getlocker
+        flushIndexUpdates();
+
+        return found;
     }
 
     /**
@@ -1033,13 +1460,20 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = shard.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->removeAnyBackingFile();
+                }
+                evictedFromMemory = shard.memoryCache.evict();
+            }
+            while ( shard.compressedCache.evict().second ) {
             }
-            evictedFromMemory = _memoryCache.evict();
+            // The lookups uncompressing these entries delete them instead of moving them to the memory portion
+            shard.uncompressingEntries.clear();
         }
 
         if (_signalEmitter) {
@@ -1059,24 +1493,33 @@ public:
      **/
     void clearDiskPortion()
     {
+        // Entries waiting to be written are referenced by the write-behind queue and could not be removed
+        _writeBehindQueue.waitForPendingWrites();
+
         if (_signalEmitter) {
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-
-        /// An entry which has a use_count greater than 1 is not removable:
-        /// The backing file must not be removed because it might be read/written to
-        /// at the same time. The best we can do is just let it here in the cache.
-        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        while (evictedFromDisk.second) {
-            if (!_isTiled) {
-                evictedFromDisk.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+
+            /// An entry which has a use_count greater than 1 is not removable:
+            /// The backing file must not be removed because it might be read/written to
+            /// at the same time. The best we can do is just let it here in the cache.
+            std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            while (evictedFromDisk.second) {
+                if (!_isTiled) {
+                    evictedFromDisk.second->removeAnyBackingFile();
+                }
+                evictedFromDisk = shard.diskCache.evict();
             }
-            evictedFromDisk = _diskCache.evict();
         }
+        while ( evictUnloadedIndexedEntry(NULL) ) {
+        }
+        flushIndexUpdates();
 
 
         _signalEmitter->blockSignals(false);
@@ -1092,27 +1535,26 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            // Move back the entry on disk if it can be store on disk
-            // For tiled caches, the tile is sharing the same file with other entries
-            // so we cannot close it, just remove the entry
-            if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
-                evictedFromMemory.second->deallocate();
-                /*insert it back into the disk portion */
-
-                U64 diskCacheSize, maximumCacheSize;
-                {
-                    QMutexLocker k(&_sizeLock);
-                    diskCacheSize = _diskCacheSize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-
-                /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-                while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
-                    {
-                        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = shard.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                // Move back the entry on disk if it can be store on disk
+                // For tiled caches, the tile is sharing the same file with other entries
+                // so we cannot close it, just remove the entry
+                if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
+                    addToIndex( evictedFromMemory.second, evictedFromMemory.second->dataSize() );
+                    evictedFromMemory.second->deallocate();
+                    /*insert it back into the disk portion */
+
+                    /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+                    while (_diskCacheSize + evictedFromMemory.second->size() >= _maximumCacheSize) {
+                        // Entries of the index that were never looked up go first
+                        if ( evictUnloadedIndexedEntry(NULL) ) {
+                            continue;
+                        }
+                        std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
                         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                         //we'll let the user of these entries purge the extra entries left in the cache later on
                         if (!evictedFromDisk.second) {
@@ -1121,24 +1563,25 @@ public:
                         ///Erase the file from the disk if we reach the limit.
                         evictedFromDisk.second->removeAnyBackingFile();
                     }
-                    {
-                        QMutexLocker k(&_sizeLock);
-                        diskCacheSize = _diskCacheSize;
-                        maximumCacheSize = _maximumCacheSize;
+
+                    /*update the disk cache size*/
+                    CacheIterator existingDiskCacheEntry = shard.diskCache( evictedFromMemory.second->getHashKey() );
+                    /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
+                    if ( existingDiskCacheEntry == shard.diskCache.end() ) {
+                        shard.diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
                     }
                 }
 
-                /*update the disk cache size*/
-                CacheIterator existingDiskCacheEntry = _diskCache( evictedFromMemory.second->getHashKey() );
-                /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-                if ( existingDiskCacheEntry == _diskCache.end() ) {
-                    _diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
-                }
+                evictedFromMemory = shard.memoryCache.evict();
             }
 
-            evictedFromMemory = _memoryCache.evict();
+            // Compressed entries only live in RAM
+            while ( shard.compressedCache.evict().second ) {
+            }
         }
 
+        flushIndexUpdates();
+
         _signalEmitter->blockSignals(false);
         if (emitSignals) {
             _signalEmitter->emitSignalClearedInMemoryPortion();
@@ -1152,49 +1595,50 @@ public:
         std::list<EntryTypePtr> entriesToBeDeleted;
 
         {
-            QMutexLocker locker(&_lock);
-            U64 memoryCacheSize, maximumInMemorySize;
-            {
-                QMutexLocker k(&_sizeLock);
-                memoryCacheSize = _memoryCacheSize;
-                maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
-            }
+            U64 memoryCacheSize = getMemoryCacheSizeNotBeingFreed();
+            U64 maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize.load() );
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
+                if ( !tryEvictInMemoryEntryFromAnyShard(deleted) ) {
                     break;
                 }
 
                 for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
                     if ( !(*it)->isStoredOnDisk() ) {
-                        memoryCacheSize -= (*it)->size();
+                        memoryCacheSize -= std::min( (U64)(*it)->size(), memoryCacheSize );
                     }
                     entriesToBeDeleted.push_back(*it);
                 }
                 occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             }
+            compressEvictedEntries(entriesToBeDeleted);
 
-            U64 diskCacheSize, maximumDiskCacheSize;
-            {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
-                maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
+            // The compressed portion may exceed its maximum size if it was just lowered
+            while ( _compressedCacheSize > _maximumCompressedSize ) {
+                if ( !tryEvictCompressedEntryFromAnyShard(entriesToBeDeleted) ) {
+                    break;
+                }
             }
+
+            U64 diskCacheSize = _diskCacheSize;
+            std::size_t maximumCacheSize = _maximumCacheSize;
+            std::size_t maximumInMemorySizeBytes = _maximumInMemorySize;
+            U64 maximumDiskCacheSize = std::max( (std::size_t)1, maximumCacheSize - std::min(maximumInMemorySizeBytes, maximumCacheSize) );
             double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
+                if ( !tryEvictDiskEntryFromAnyShard(deleted) ) {
                     break;
                 }
 
                 for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    diskCacheSize -= (*it)->size();
+                    diskCacheSize -= std::min( (U64)(*it)->size(), diskCacheSize );
                     entriesToBeDeleted.push_back(*it);
                 }
                 diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             }
-            
+
 
         }
     }
@@ -1206,15 +1650,18 @@ public:
      **/
     void getCopy(std::list<EntryTypePtr>* copy) const
     {
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
 
-        for (CacheIterator it = _memoryCache.begin(); it != _memoryCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
-        }
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
+            for (CacheIterator it = shard.memoryCache.begin(); it != shard.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
+            for (CacheIterator it = shard.diskCache.begin(); it != shard.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
         }
     }
 
@@ -1228,13 +1675,8 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
-        bool ret;
-        {
-            QMutexLocker locker(&_lock);
-            ret = tryEvictInMemoryEntry(entriesToBeDeleted);
-        }
 
-        return ret;
+        return tryEvictInMemoryEntryFromAnyShard(entriesToBeDeleted);
     }
 
     /**
@@ -1244,10 +1686,9 @@ public:
      **/
     bool evictLRUDiskEntry() const
     {
-
-        QMutexLocker locker(&_lock);
         std::list<EntryTypePtr> entriesToBeDeleted;
-        return tryEvictDiskEntry(entriesToBeDeleted);
+
+        return tryEvictDiskEntryFromAnyShard(entriesToBeDeleted);
     }
 
     /**
@@ -1257,19 +1698,12 @@ public:
     virtual void notifyEntrySizeChanged(std::size_t oldSize,
                                         std::size_t newSize) const OVERRIDE FINAL
     {
-        ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache
-        QMutexLocker k(&_sizeLock);
-
         ///This function can only be called for RAM buffers or while a memory mapped file is mapped into the RAM, so
         ///we just have to modify the RAM size.
-
-        ///Avoid overflows, _memoryCacheSize may not always fallback to 0
-        qint64 diff = (qint64)newSize - (qint64)oldSize;
-
-        if (diff < 0) {
-            _memoryCacheSize = diff > (qint64)_memoryCacheSize ? 0 : _memoryCacheSize + diff;
+        if (newSize < oldSize) {
+            atomicSubtractClamped(_memoryCacheSize, oldSize - newSize);
         } else {
-            _memoryCacheSize += diff;
+            _memoryCacheSize += newSize - oldSize;
         }
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
@@ -1283,10 +1717,6 @@ public:
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
-        ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
-        ///lock should already be taken.
-        QMutexLocker k(&_sizeLock);
-
         if (storage == eStorageModeDisk) {
             if (_isTiled) {
                 // For tile caches, we do not control which portion of the cache is in memory, so just keep track of the disk portion
@@ -1314,15 +1744,13 @@ public:
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
-        QMutexLocker k(&_sizeLock);
-
         if (storage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
+            atomicSubtractClamped(_memoryCacheSize, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
 #endif
         } else if (storage == eStorageModeDisk) {
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            atomicSubtractClamped(_diskCacheSize, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
@@ -1332,9 +1760,22 @@ public:
         _signalEmitter->emitRemovedEntry(time, (int)storage);
     }
 
+    /**
+     * @brief To be called by a CacheEntry destroyed while compressed.
+     **/
+    virtual void notifyCompressedEntryDestroyed(double time,
+                                                std::size_t compressedSize,
+                                                std::size_t dataSize) const OVERRIDE FINAL
+    {
+        atomicSubtractClamped(_compressedCacheSize, compressedSize);
+        atomicSubtractClamped(_compressedDataSize, dataSize);
+
+        _signalEmitter->emitRemovedEntry(time, (int)eStorageModeRAM);
+    }
+
     virtual void notifyMemoryDeallocated() const OVERRIDE FINAL
     {
-        QMutexLocker k(&_sizeLock);
+        QMutexLocker k(&_memoryFullMutex);
 
         _memoryFullCondition.wakeAll();
     }
@@ -1353,12 +1794,11 @@ public:
         if (_tearingDown) {
             return;
         }
-        QMutexLocker k(&_sizeLock);
 
         assert(oldStorage != newStorage);
         assert(newStorage != eStorageModeNone);
         if (oldStorage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
+            atomicSubtractClamped(_memoryCacheSize, size);
             _diskCacheSize += size;
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
@@ -1368,7 +1808,7 @@ public:
             appPTR->decreaseNCacheFilesOpened();
         } else if (oldStorage == eStorageModeDisk) {
             _memoryCacheSize += size;
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            atomicSubtractClamped(_diskCacheSize, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
@@ -1392,6 +1832,19 @@ public:
         appPTR->decreaseNCacheFilesOpened();
     }
 
+    virtual void notifyEntryBackingFileRemoved(U64 hash,
+                                               const std::string& filePath,
+                                               std::size_t dataOffset) const OVERRIDE FINAL
+    {
+        if (!_index || _isTiled) {
+            return;
+        }
+        _index->recordRemove(hash, filePath, dataOffset);
+        if ( _index->needsCompaction() ) {
+            _cleanerThread.appendCompactIndexRequest();
+        }
+    }
+
     // const data member: no need to take the lock
     const std::string & cacheName() const
     {
@@ -1428,48 +1881,183 @@ public:
         return newCachePath.toStdString();
     }
 
-    void setMaximumCacheSize(U64 newSize)
+    std::string getIndexFilePath() const
     {
-        QMutexLocker k(&_sizeLock);
+        QString indexPath( getCachePath() );
+        StrUtils::ensureLastPathSeparator(indexPath);
 
+        indexPath.append( QString::fromUtf8(NATRON_CACHE_INDEX_FILE_NAME) );
+
+        return indexPath.toStdString();
+    }
+
+    /**
+     * @brief Persists the disk portion of this non tiled cache with a CacheIndexFile in the cache folder: entries are
+     * recorded as they are moved to disk and forgotten when their backing file is removed, so that save() no longer
+     * needs to write a table of contents. The recorded entries are only created when they are first looked up.
+     * This must be called before any render, typically right after the cache folder structure is checked.
+     * @returns False if the index could not be opened or was written by another version of the cache: the cache
+     * folder should then be cleaned up and the index opened again.
+     **/
+    bool openIndex(const IndexSerializerPtr& serializer)
+    {
+        assert( !isTileCache() );
+        closeIndex();
+        _indexSerializer = serializer;
+        try {
+            _index = boost::make_shared<CacheIndexFile>(getIndexFilePath(), _version);
+        } catch (const std::exception & e) {
+            qDebug() << cacheName().c_str() << "could not open its index:" << e.what();
+
+            return false;
+        }
+        if ( _index->wasReset() ) {
+            // Release the mapping so that the caller can remove the file
+            _index.reset();
+
+            return false;
+        }
+        _diskCacheSize += _index->getUnloadedDataSize();
+
+        return true;
+    }
+
+    bool hasIndex() const
+    {
+        return (bool)_index;
+    }
+
+    /**
+     * @brief Unmaps the index opened by openIndex(), e.g before removing the cache folder.
+     * The entries it records that were not looked up are no longer accounted in the disk portion.
+     **/
+    void closeIndex()
+    {
+        flushIndexUpdates();
+        if (_index) {
+            atomicSubtractClamped( _diskCacheSize, _index->getUnloadedDataSize() );
+            _index.reset();
+        }
+    }
+
+    void setMaximumCacheSize(U64 newSize)
+    {
         _maximumCacheSize = newSize;
     }
 
     void setMaximumInMemorySize(double percentage)
     {
-        QMutexLocker k(&_sizeLock);
-
         _maximumInMemorySize = _maximumCacheSize * percentage;
     }
 
     std::size_t getMaximumSize() const
     {
-        QMutexLocker k(&_sizeLock);
-
         return _maximumCacheSize;
     }
 
     std::size_t getMaximumMemorySize() const
     {
-        QMutexLocker k(&_sizeLock);
-
         return _maximumInMemorySize;
     }
 
     std::size_t getMemoryCacheSize() const
     {
-        QMutexLocker k(&_sizeLock);
-
         return _memoryCacheSize;
     }
 
     std::size_t getDiskCacheSize() const
     {
-        QMutexLocker k(&_sizeLock);
-
         return _diskCacheSize;
     }
 
+    /**
+     * @brief Set the maximum size in bytes of the compressed portion of the cache. Entries evicted from the
+     * in-memory portion are compressed and kept in RAM until this size is reached, instead of being destroyed.
+     * 0 disables the compressed portion. It has no effect on tiled caches and entries stored on disk.
+     **/
+    void setMaximumCompressedSize(std::size_t size)
+    {
+        _maximumCompressedSize = size;
+    }
+
+    std::size_t getMaximumCompressedSize() const
+    {
+        return _maximumCompressedSize;
+    }
+
+    std::size_t getCompressedCacheSize() const
+    {
+        return _compressedCacheSize;
+    }
+
+    void setEvictionPolicy(CacheEvictionPolicyEnum policy)
+    {
+        _evictionPolicy = (int)policy;
+    }
+
+    CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        return (CacheEvictionPolicyEnum)_evictionPolicy.load();
+    }
+
+    void getStats(CacheStats* stats) const
+    {
+        for (int i = 0; i < eCacheTierCount; ++i) {
+            stats->hits[i] = _tierHits[i];
+            stats->hitsTime[i] = _tierHitsMicroSeconds[i] / 1000000.;
+        }
+        stats->misses = _misses;
+        stats->compressedSize = _compressedCacheSize;
+        stats->compressedDataSize = _compressedDataSize;
+        _writeBehindQueue.getStats(&stats->writeBehind);
+        _deleter.getStats(&stats->deleter);
+    }
+
+    void resetStats()
+    {
+        for (int i = 0; i < eCacheTierCount; ++i) {
+            _tierHits[i] = 0;
+            _tierHitsMicroSeconds[i] = 0;
+        }
+        _misses = 0;
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+            shard.holderStats.clear();
+        }
+    }
+
+    /**
+     * @brief Returns the statistics of each holder that has or had entries in the cache, by holder ID.
+     * This locks every shard in turn to measure the residency of the entries: it is meant to be called
+     * from time to time, not while rendering.
+     **/
+    void getHolderStats(CacheHolderStatsMap* stats) const
+    {
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+
+            for (CacheHolderStatsMap::const_iterator it = shard.holderStats.begin(); it != shard.holderStats.end(); ++it) {
+                (*stats)[it->first].merge(it->second);
+            }
+            addResidency(shard.memoryCache, eCacheTierMemory, stats);
+            addResidency(shard.compressedCache, eCacheTierCompressed, stats);
+            addResidency(shard.diskCache, eCacheTierDisk, stats);
+        }
+    }
+
+    /**
+     * @brief Called when an entry returned by get() was at a higher scale than requested and had to be downscaled.
+     **/
+    void notifyHitNeedingDownscale(const typename EntryType::key_type & key) const
+    {
+        CacheShard& shard = getShard( key.getHash() );
+        QMutexLocker locker(&shard.lock);
+
+        ++shard.holderStats[key.getCacheHolderID()].hitsNeedingDownscale;
+    }
+
     CacheSignalEmitterPtr activateSignalEmitter() const
     {
         return _signalEmitter;
@@ -1487,9 +2075,10 @@ public:
         std::list<EntryTypePtr> toRemove;
 
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( entry->getHashKey() );
-            if ( existingEntry != _memoryCache.end() ) {
+            CacheShard& shard = getShard( entry->getHashKey() );
+            QMutexLocker l(&shard.lock);
+            CacheIterator existingEntry = shard.memoryCache( entry->getHashKey() );
+            if ( existingEntry != shard.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( (*it)->getKey() == entry->getKey() ) {
@@ -1499,11 +2088,11 @@ public:
                     }
                 }
                 if ( ret.empty() ) {
-                    _memoryCache.erase(existingEntry);
+                    shard.memoryCache.erase(existingEntry);
                 }
             } else {
-                existingEntry = _diskCache( entry->getHashKey() );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = shard.diskCache( entry->getHashKey() );
+                if ( existingEntry != shard.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         if ( (*it)->getKey() == entry->getKey() ) {
@@ -1513,13 +2102,30 @@ public:
                         }
                     }
                     if ( ret.empty() ) {
-                        _diskCache.erase(existingEntry);
+                        shard.diskCache.erase(existingEntry);
                     }
                 }
             }
-        } // QMutexLocker l(&_lock);
+
+            // An entry with the same key may have been evicted and compressed before this one was created
+            existingEntry = shard.compressedCache( entry->getHashKey() );
+            if ( existingEntry != shard.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    if ( (*it)->getKey() == entry->getKey() ) {
+                        toRemove.push_back(*it);
+                        ret.erase(it);
+                        break;
+                    }
+                }
+                if ( ret.empty() ) {
+                    shard.compressedCache.erase(existingEntry);
+                }
+            }
+            shard.holderStats[entry->getKey().getCacheHolderID()].evictions[eCacheEvictionReasonRemoved] += toRemove.size();
+        } // QMutexLocker l(&shard.lock);
         if ( !toRemove.empty() ) {
-            _deleterThread.appendToQueue(toRemove);
+            _deleter.appendToQueue(toRemove);
 
             ///Clearing the list here will not delete the objects pointing to by the shared_ptr's because we made a copy
             ///that the separate thread will delete
@@ -1531,28 +2137,38 @@ public:
     {
         std::list<EntryTypePtr> toRemove;
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( hash);
-            if ( existingEntry != _memoryCache.end() ) {
+            CacheShard& shard = getShard(hash);
+            QMutexLocker l(&shard.lock);
+            CacheIterator existingEntry = shard.memoryCache( hash);
+            if ( existingEntry != shard.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     toRemove.push_back(*it);
                 }
-                _memoryCache.erase(existingEntry);
+                shard.memoryCache.erase(existingEntry);
             } else {
-                existingEntry = _diskCache( hash );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = shard.diskCache( hash );
+                if ( existingEntry != shard.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         toRemove.push_back(*it);
                     }
-                    _diskCache.erase(existingEntry);
+                    shard.diskCache.erase(existingEntry);
                 }
             }
-        } // QMutexLocker l(&_lock);
+            existingEntry = shard.compressedCache(hash);
+            if ( existingEntry != shard.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                toRemove.insert( toRemove.end(), ret.begin(), ret.end() );
+                shard.compressedCache.erase(existingEntry);
+            }
+            for (typename std::list<EntryTypePtr>::const_iterator it = toRemove.begin(); it != toRemove.end(); ++it) {
+                ++shard.holderStats[(*it)->getKey().getCacheHolderID()].evictions[eCacheEvictionReasonRemoved];
+            }
+        } // QMutexLocker l(&shard.lock);
 
         if ( !toRemove.empty() ) {
-            _deleterThread.appendToQueue(toRemove);
+            _deleter.appendToQueue(toRemove);
 
             ///Clearing the list here will not delete the objects pointing to by the shared_ptr's because we made a copy
             ///that the separate thread will delete
@@ -1593,29 +2209,45 @@ public:
         *diskOccupied = 0;
 
         std::string holderID = holder->getCacheID();
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
 
-        for (ConstCacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (ConstCacheIterator memIt = shard.memoryCache.begin(); memIt != shard.memoryCache.end(); ++memIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *ramOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *ramOccupied += (*it)->size();
+                        }
                     }
                 }
             }
-        }
 
-        for (ConstCacheIterator memIt = _diskCache.begin(); memIt != _diskCache.end(); ++memIt) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (ConstCacheIterator memIt = shard.compressedCache.begin(); memIt != shard.compressedCache.end(); ++memIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *diskOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *ramOccupied += (*it)->getCompressedSize();
+                        }
+                    }
+                }
+            }
+
+            for (ConstCacheIterator memIt = shard.diskCache.begin(); memIt != shard.diskCache.end(); ++memIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
+
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *diskOccupied += (*it)->size();
+                        }
                     }
                 }
             }
@@ -1624,16 +2256,25 @@ public:
 
 private:
 
+    virtual void compactIndex() OVERRIDE FINAL
+    {
+        if ( _index && _index->needsCompaction() ) {
+            _index->compact();
+        }
+    }
+
     virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string & holderID,
                                                                        U64 nodeHash,
                                                                        bool removeAll) OVERRIDE FINAL
     {
         std::list<EntryTypePtr> toDelete;
-        CacheContainer newMemCache, newDiskCache;
-        {
-            QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            CacheContainer newMemCache, newCompressedCache, newDiskCache;
+            QMutexLocker locker(&shard.lock);
+            std::size_t nDeletedBefore = toDelete.size();
 
-            for (ConstCacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
+            for (ConstCacheIterator memIt = shard.memoryCache.begin(); memIt != shard.memoryCache.end(); ++memIt) {
                 const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
@@ -1650,7 +2291,22 @@ private:
                 }
             }
 
-            for (ConstCacheIterator dIt = _diskCache.begin(); dIt != _diskCache.end(); ++dIt) {
+            for (ConstCacheIterator cIt = shard.compressedCache.begin(); cIt != shard.compressedCache.end(); ++cIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(cIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
+
+                    if ( (front->getKey().getCacheHolderID() == holderID) &&
+                         ( ( front->getKey().getTreeVersion() != nodeHash) || removeAll ) ) {
+                        toDelete.insert( toDelete.end(), entries.begin(), entries.end() );
+                    } else {
+                        typename EntryType::hash_type hash = front->getHashKey();
+                        newCompressedCache.insert(hash, entries);
+                    }
+                }
+            }
+
+            for (ConstCacheIterator dIt = shard.diskCache.begin(); dIt != shard.diskCache.end(); ++dIt) {
                 const std::list<EntryTypePtr> & entries = getValueFromIterator(dIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
@@ -1667,12 +2323,16 @@ private:
                 }
             }
 
-            _memoryCache = newMemCache;
-            _diskCache = newDiskCache;
-        } // QMutexLocker locker(&_lock);
+            shard.memoryCache = newMemCache;
+            shard.compressedCache = newCompressedCache;
+            shard.diskCache = newDiskCache;
+            if (toDelete.size() > nDeletedBefore) {
+                shard.holderStats[holderID].evictions[eCacheEvictionReasonRemoved] += toDelete.size() - nDeletedBefore;
+            }
+        } // for each shard
 
         if ( !toDelete.empty() ) {
-            _deleterThread.appendToQueue(toDelete);
+            _deleter.appendToQueue(toDelete);
 
             ///Clearing the list here will not delete the objects pointing to by the shared_ptr's because we made a copy
             ///that the separate thread will delete
@@ -1680,21 +2340,59 @@ private:
         }
     } // removeAllEntriesWithDifferentNodeHashForHolderPrivate
 
-    bool getInternal(const typename EntryType::key_type & key,
+    /**
+     * @brief Looks up the entries matching key and updates the statistics.
+     * @param lockWaitTime The time the caller waited for the shard locks
+     **/
+    bool getInternal(CacheShard& shard,
+                     const typename EntryType::key_type & key,
+                     double lockWaitTime,
                      std::list<EntryTypePtr>* returnValue) const
     {
-        ///Private should be locked
-        assert( !_lock.tryLock() );
+        TimeLapse timer;
+        CacheTierEnum tier = eCacheTierMemory;
+        bool found = lookupInternal(shard, key, returnValue, &tier);
+        CacheHolderStats& holderStats = shard.holderStats[key.getCacheHolderID()];
+
+        holderStats.lockWaitTime += lockWaitTime;
+        if (found) {
+            ++_tierHits[tier];
+            _tierHitsMicroSeconds[tier] += (U64)(timer.getTimeSinceCreation() * 1000000.);
+            ++holderStats.hits;
+            // Tiles of a tiled cache stay in the disk portion
+            if ( (tier != eCacheTierMemory) && ( !_isTiled || (tier != eCacheTierDisk) ) ) {
+                for (typename std::list<EntryTypePtr>::const_iterator it = returnValue->begin(); it != returnValue->end(); ++it) {
+                    holderStats.promotedBytes += (*it)->size();
+                }
+            }
+        } else {
+            ++_misses;
+            ++holderStats.misses;
+        }
+
+        return found;
+    }
+
+    bool lookupInternal(CacheShard& shard,
+                        const typename EntryType::key_type & key,
+                        std::list<EntryTypePtr>* returnValue,
+                        CacheTierEnum* tier) const
+    {
+        ///Private should be locked. The lock is released while compressed entries are uncompressed,
+        ///the getLock held by the caller keeps other lookups of this shard waiting meanwhile.
+        assert( !shard.getLock.tryLock() );
+        assert( !shard.lock.tryLock() );
 
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache( key.getHash() );
+        CacheIterator memoryCached = shard.memoryCache( key.getHash() );
 
-        if ( memoryCached != _memoryCache.end() ) {
+        if ( memoryCached != shard.memoryCache.end() ) {
             ///we found something with a matching hash key. There may be several entries linked to
             ///this key, we need to find one with matching params
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::const_iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( (*it)->getKey() == key ) {
+                    (*it)->registerCacheAccess(shard.inflation);
                     returnValue->push_back(*it);
 
                     ///Q_EMIT the added signal otherwise when first reading something that's already cached
@@ -1705,12 +2403,87 @@ private:
                 }
             }
 
+            *tier = eCacheTierMemory;
+
             return returnValue->size() > 0;
         } else {
+            ///look for compressed entries: they are uncompressed and moved back into the in-memory portion
+            CacheIterator compressedCached = shard.compressedCache( key.getHash() );
+            if ( compressedCached != shard.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(compressedCached);
+                std::list<EntryTypePtr> toUncompress;
+                std::list<EntryTypePtr> entriesToBeDeleted;
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end();) {
+                    if ( (*it)->getKey() == key ) {
+                        toUncompress.push_back(*it);
+                        shard.uncompressingEntries.push_back(*it);
+                        it = ret.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                if ( ret.empty() ) {
+                    shard.compressedCache.erase(compressedCached);
+                }
+
+                if ( !toUncompress.empty() ) {
+                    // The entries are not reachable from the containers anymore: as in compressEvictedEntries(), they are
+                    // uncompressed without holding the shard lock. Other lookups in this shard wait on the getLock held by
+                    // the caller, then find them in the memory portion.
+                    std::list<bool> uncompressed;
+                    shard.lock.unlock();
+                    for (typename std::list<EntryTypePtr>::iterator it = toUncompress.begin(); it != toUncompress.end(); ++it) {
+                        uncompressed.push_back( uncompressEntry(*it) );
+                    }
+                    shard.lock.lock();
+
+                    std::list<bool>::const_iterator ok = uncompressed.begin();
+                    for (typename std::list<EntryTypePtr>::iterator it = toUncompress.begin(); it != toUncompress.end(); ++it, ++ok) {
+                        typename std::list<EntryTypePtr>::iterator found = std::find(shard.uncompressingEntries.begin(), shard.uncompressingEntries.end(), *it);
+                        // The cache was cleared meanwhile
+                        if ( found == shard.uncompressingEntries.end() ) {
+                            entriesToBeDeleted.push_back(*it);
+                            continue;
+                        }
+                        shard.uncompressingEntries.erase(found);
+                        if (*ok) {
+                            sealEntry(shard, *it, true);
+                            returnValue->push_back(*it);
+                        } else {
+                            entriesToBeDeleted.push_back(*it);
+                        }
+                    }
+                }
+
+                if ( !returnValue->empty() ) {
+                    *tier = eCacheTierCompressed;
+                    if (_signalEmitter) {
+                        _signalEmitter->emitAddedEntry( key.getTime() );
+                    }
+
+                    //Only this shard is locked, so we can only evict from this shard, see below
+                    while (_memoryCacheSize > _maximumInMemorySize) {
+                        if ( !tryEvictInMemoryEntry(shard, entriesToBeDeleted) ) {
+                            break;
+                        }
+                    }
+                }
+                if ( !entriesToBeDeleted.empty() ) {
+                    _deleter.appendToQueue(entriesToBeDeleted);
+                }
+                if ( !returnValue->empty() ) {
+                    return true;
+                }
+            }
+
             ///fallback on the disk cache internal container
-            CacheIterator diskCached = _diskCache( key.getHash() );
+            *tier = eCacheTierDisk;
+            if (_index) {
+                loadIndexedEntries( shard, key.getHash() );
+            }
+            CacheIterator diskCached = shard.diskCache( key.getHash() );
 
-            if ( diskCached == _diskCache.end() ) {
+            if ( diskCached == shard.diskCache.end() ) {
                 /*the entry was neither in memory or disk, just allocate a new one*/
                 return false;
             } else {
@@ -1727,46 +2500,41 @@ private:
                          we re-open the mapping to the RAM put the entry
                          back into the memoryCache.*/
                         if (!_isTiled) {
-                            try {
-                                (*it)->reOpenFileMapping();
-                            } catch (const std::exception & e) {
-                                qDebug() << "Error while reopening cache file: " << e.what();
-                                ret.erase(it);
-
-                                return false;
-                            } catch (...) {
-                                qDebug() << "Error while reopening cache file";
-                                ret.erase(it);
-
-                                return false;
+                            // If the entry was not written to disk yet, it is still mapped and needs not be re-opened
+                            if ( !(*it)->cancelPendingWrite() ) {
+                                try {
+                                    (*it)->reOpenFileMapping();
+                                } catch (const std::exception & e) {
+                                    qDebug() << "Error while reopening cache file: " << e.what();
+                                    ret.erase(it);
+
+                                    return false;
+                                } catch (...) {
+                                    qDebug() << "Error while reopening cache file";
+                                    ret.erase(it);
+
+                                    return false;
+                                }
                             }
 
                             //put it back into the RAM
-                            _memoryCache.insert( (*it)->getHashKey(), *it );
-
+                            shard.memoryCache.insert( (*it)->getHashKey(), *it );
 
-                            U64 memoryCacheSize, maximumInMemorySize;
-                            {
-                                QMutexLocker k(&_sizeLock);
-                                memoryCacheSize = _memoryCacheSize;
-                                maximumInMemorySize = _maximumInMemorySize;
-                            }
                             std::list<EntryTypePtr> entriesToBeDeleted;
 
                             //now clear extra entries from the disk cache so it doesn't exceed the RAM limit.
-                            while (memoryCacheSize > maximumInMemorySize) {
-                                if ( !tryEvictInMemoryEntry(entriesToBeDeleted) ) {
+                            //Only this shard is locked, so we can only evict from this shard: locking another shard
+                            //here could deadlock with a thread doing the same from that other shard.
+                            while (_memoryCacheSize > _maximumInMemorySize) {
+                                if ( !tryEvictInMemoryEntry(shard, entriesToBeDeleted) ) {
                                     break;
                                 }
-
-                                {
-                                    QMutexLocker k(&_sizeLock);
-                                    memoryCacheSize = _memoryCacheSize;
-                                    maximumInMemorySize = _maximumInMemorySize;
-                                }
                             }
+                        } else {
+                            // Tiles are never unmapped: this only asks the system to read the tile ahead
+                            (*it)->reOpenFileMapping();
                         }
-                        
+                        (*it)->registerCacheAccess(shard.inflation);
                         returnValue->push_back(*it);
                         ///Q_EMIT the added signal otherwise when first reading something that's already cached
                         ///the timeline wouldn't update
@@ -1779,7 +2547,7 @@ private:
                             ret.erase(it);
 
                             ///Remove it from the disk cache
-                            _diskCache.erase(diskCached);
+                            shard.diskCache.erase(diskCached);
                         }
 
                         return true;
@@ -1796,25 +2564,28 @@ private:
     /** @brief Inserts into the cache an entry that was previously allocated by the createInternal()
      * function. This is called directly by createInternal() if the allocation was successful
      **/
-    void sealEntry(const EntryTypePtr & entry,
+    void sealEntry(CacheShard& shard,
+                   const EntryTypePtr & entry,
                    bool inMemory) const
     {
-        assert( !_lock.tryLock() );   // must be locked
+        assert( !shard.lock.tryLock() );   // must be locked
         typename EntryType::hash_type hash = entry->getHashKey();
 
+        entry->registerCacheAccess(shard.inflation);
+
         if (inMemory) {
             /*if the entry doesn't exist on the memory cache,make a new list and insert it*/
-            CacheIterator existingEntry = _memoryCache(hash);
-            if ( existingEntry == _memoryCache.end() ) {
-                _memoryCache.insert(hash, entry);
+            CacheIterator existingEntry = shard.memoryCache(hash);
+            if ( existingEntry == shard.memoryCache.end() ) {
+                shard.memoryCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
         } else {
-            CacheIterator existingEntry = _diskCache(hash);
-            if ( existingEntry == _diskCache.end() ) {
-                _diskCache.insert(hash, entry);
+            CacheIterator existingEntry = shard.diskCache(hash);
+            if ( existingEntry == shard.diskCache.end() ) {
+                shard.diskCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
@@ -1822,15 +2593,337 @@ private:
         }
     }
 
-    bool tryEvictInMemoryEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    /**
+     * @brief Creates the entries with the given hash that are recorded in the index but were not looked up
+     * since the index was opened, and inserts them in the disk portion.
+     **/
+    void loadIndexedEntries(CacheShard& shard,
+                            hash_type hash) const
+    {
+        assert( !shard.lock.tryLock() );   // must be locked
+        std::list<CacheIndexFile::Record> records;
+        _index->takeUnloadedRecords(hash, &records);
+        for (std::list<CacheIndexFile::Record>::iterator it = records.begin(); it != records.end(); ++it) {
+            // The size is accounted again by restoreMetadataFromFile()
+            atomicSubtractClamped(_diskCacheSize, it->dataSize);
+
+            key_t key;
+            ParamsTypePtr params;
+            EntryTypePtr entry;
+            // The payload is empty if the record is corrupted
+            if ( !it->payload.empty() && _indexSerializer->deserialize(it->payload, &key, &params) && (key.getHash() == hash) ) {
+                try {
+                    entry = boost::make_shared<EntryType>(key, params, this);
+                    ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
+                    entry->restoreMetadataFromFile(it->dataSize, it->filePath, it->dataOffsetInFile);
+                } catch (const std::exception & e) {
+                    qDebug() << e.what();
+                    entry.reset();
+                }
+            }
+            if (!entry) {
+                _index->recordRemove(hash, it->filePath, it->dataOffsetInFile);
+                QFile::remove( QString::fromUtf8( it->filePath.c_str() ) );
+                continue;
+            }
+            sealEntry(shard, entry, false /*inMemory*/);
+        }
+    }
+
+    /**
+     * @brief Records in the index an entry that is being moved to the disk portion.
+     * The record is written by flushIndexUpdates().
+     **/
+    void addToIndex(const EntryTypePtr& entry,
+                    std::size_t dataSize) const
+    {
+        if (!_index || _isTiled) {
+            return;
+        }
+        CacheIndexFile::Record record;
+        record.hash = entry->getHashKey();
+        record.dataSize = dataSize;
+        record.dataOffsetInFile = entry->getOffsetInFile();
+        record.filePath = entry->getFilePath();
+        _indexSerializer->serialize(entry->getKey(), entry->getParams(), &record.payload);
+
+        QMutexLocker k(&_indexUpdatesMutex);
+        _indexAdditions.push_back(record);
+    }
+
+    /**
+     * @brief Evicts the least recently recorded entry of the index that was not looked up since the index was opened:
+     * such entries are older than any entry of the disk portion. Its backing file is removed by flushIndexUpdates().
+     * @param dataSize[out] The size of the data of the entry
+     * @returns False if there is no such entry.
+     **/
+    bool evictUnloadedIndexedEntry(std::size_t* dataSize) const
+    {
+        if (!_index) {
+            return false;
+        }
+        CacheIndexFile::Record record;
+        if ( !_index->takeOldestUnloadedRecord(&record) ) {
+            return false;
+        }
+        atomicSubtractClamped(_diskCacheSize, record.dataSize);
+        if (dataSize) {
+            *dataSize = record.dataSize;
+        }
+
+        QMutexLocker k(&_indexUpdatesMutex);
+        _indexRemovals.push_back(record);
+
+        return true;
+    }
+
+    /**
+     * @brief Writes to the index the records queued by addToIndex() and evictUnloadedIndexedEntry(), and removes the
+     * backing files of the evicted entries. Appending to the index may grow its file and removing files takes a
+     * while, so this is done without holding any shard lock.
+     **/
+    void flushIndexUpdates() const
+    {
+        std::list<CacheIndexFile::Record> additions, removals;
+        {
+            QMutexLocker k(&_indexUpdatesMutex);
+            additions.swap(_indexAdditions);
+            removals.swap(_indexRemovals);
+        }
+        for (std::list<CacheIndexFile::Record>::iterator it = removals.begin(); it != removals.end(); ++it) {
+            if (_index) {
+                _index->recordRemove(it->hash, it->filePath, it->dataOffsetInFile);
+            }
+            QFile::remove( QString::fromUtf8( it->filePath.c_str() ) );
+        }
+        if (_index) {
+            for (std::list<CacheIndexFile::Record>::iterator it = additions.begin(); it != additions.end(); ++it) {
+                _index->recordAdd(*it);
+            }
+            if ( !removals.empty() && _index->needsCompaction() ) {
+                _cleanerThread.appendCompactIndexRequest();
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the size of the in-memory portion, minus what the deleter threads are about to free:
+     * evicting entries to make room for that memory would evict more than needed.
+     **/
+    U64 getMemoryCacheSizeNotBeingFreed() const
+    {
+        U64 memoryCacheSize = _memoryCacheSize;
+
+        return memoryCacheSize - std::min( (U64)_deleter.getBeingFreedSize(), memoryCacheSize );
+    }
+
+    /**
+     * @brief Adds the entries of a portion of a shard to the residency of their holder, see getHolderStats()
+     **/
+    static void addResidency(CacheContainer& container,
+                             CacheTierEnum tier,
+                             CacheHolderStatsMap* stats)
+    {
+        for (CacheIterator it = container.begin(); it != container.end(); ++it) {
+            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+            for (typename std::list<EntryTypePtr>::const_iterator it2 = entries.begin(); it2 != entries.end(); ++it2) {
+                CacheHolderStats& holderStats = (*stats)[(*it2)->getKey().getCacheHolderID()];
+                ++holderStats.residentEntries[tier];
+                switch (tier) {
+                case eCacheTierMemory:
+                    holderStats.residentSize[tier] += (*it2)->size();
+                    break;
+                case eCacheTierCompressed:
+                    holderStats.residentSize[tier] += (*it2)->getCompressedSize();
+                    break;
+                default:
+                    // The file of entries of the disk portion is usually not mapped
+                    holderStats.residentSize[tier] += (*it2)->getSizeInBytesFromParams();
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Evicts an entry from one of the portions of the shard, according to the eviction policy.
+     **/
+    std::pair<hash_type, EntryTypePtr> evictFromContainer(CacheShard& shard,
+                                                          CacheContainer& container) const
+    {
+        assert( !shard.lock.tryLock() );
+        if (_evictionPolicy == eCacheEvictionPolicyLRU) {
+            return container.evict();
+        }
+
+        CacheCostAwarePriority<EntryTypePtr> priority;
+        std::pair<hash_type, EntryTypePtr> evicted = container.evictLowestPriority(priority, NATRON_CACHE_EVICTION_SAMPLES);
+        if (evicted.second) {
+            shard.inflation = std::max( shard.inflation, priority(evicted.second) );
+        }
+
+        return evicted;
+    }
+
+    /**
+     * @brief Compresses the buffer of an entry evicted from the in-memory portion and updates the sizes of the portions.
+     * The entry must not be referenced by anything else.
+     **/
+    bool compressEntry(const EntryTypePtr& entry) const
+    {
+        std::size_t entrySize = entry->size();
+        std::size_t dataSize = entry->dataSize();
+
+        if ( !entry->compressBuffer() ) {
+            return false;
+        }
+        // size() also accounts for data that is not compressed (e.g: the bitmap of images), it is
+        // accounted again when the entry is uncompressed
+        atomicSubtractClamped(_memoryCacheSize, entrySize);
+        _compressedCacheSize += entry->getCompressedSize();
+        _compressedDataSize += dataSize;
+
+        return true;
+    }
+
+    /**
+     * @brief Inverse of compressEntry(). Returns false if the entry could not be restored, in which case it should be removed.
+     **/
+    bool uncompressEntry(const EntryTypePtr& entry) const
+    {
+        std::size_t compressedSize = entry->getCompressedSize();
+        std::size_t dataSize = entry->getUncompressedSize();
+        bool ok;
+
+        try {
+            ok = entry->uncompressBuffer();
+        } catch (const std::bad_alloc & e) {
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+        atomicSubtractClamped(_compressedCacheSize, compressedSize);
+        atomicSubtractClamped(_compressedDataSize, dataSize);
+        _memoryCacheSize += entry->size();
+
+        return true;
+    }
+
+    /**
+     * @brief Moves the RAM entries evicted from the in-memory portion to the compressed portion, if enabled.
+     * The entries that were not compressed are left in evicted so that the caller deletes them, along with the entries
+     * evicted from the compressed portion to make room.
+     * No shard lock must be held by the caller: evicted entries are not reachable by other threads, so they
+     * are compressed without holding any lock.
+     **/
+    void compressEvictedEntries(std::list<EntryTypePtr>& evicted) const
+    {
+        if ( _isTiled || (_maximumCompressedSize == 0) ) {
+            return;
+        }
+        bool compressedAny = false;
+        for (typename std::list<EntryTypePtr>::iterator it = evicted.begin(); it != evicted.end();) {
+            if ( (*it)->isStoredOnDisk() || !(*it).unique() || !compressEntry(*it) ) {
+                ++it;
+                continue;
+            }
+            {
+                CacheShard& shard = getShard( (*it)->getHashKey() );
+                QMutexLocker locker(&shard.lock);
+                shard.holderStats[(*it)->getKey().getCacheHolderID()].demotedBytes += (*it)->getUncompressedSize();
+                CacheIterator existingEntry = shard.compressedCache( (*it)->getHashKey() );
+                if ( existingEntry == shard.compressedCache.end() ) {
+                    shard.compressedCache.insert( (*it)->getHashKey(), *it );
+                } else {
+                    getValueFromIterator(existingEntry).push_back(*it);
+                }
+            }
+            compressedAny = true;
+            it = evicted.erase(it);
+        }
+
+        if (compressedAny) {
+            while ( _compressedCacheSize > _maximumCompressedSize ) {
+                if ( !tryEvictCompressedEntryFromAnyShard(evicted) ) {
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Same as tryEvictInMemoryEntryFromAnyShard() for the compressed portion.
+     **/
+    bool tryEvictCompressedEntryFromAnyShard(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        std::size_t start = _nextEvictionShard++;
+
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[(start + i) & _shardsMask];
+            QMutexLocker locker(&shard.lock);
+            std::pair<hash_type, EntryTypePtr> evicted = evictFromContainer(shard, shard.compressedCache);
+            if (evicted.second) {
+                ++shard.holderStats[evicted.second->getKey().getCacheHolderID()].evictions[eCacheEvictionReasonCompressedFull];
+                entriesToBeDeleted.push_back(evicted.second);
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Evicts an entry from the memory portion of one of the shards. Each shard is locked in turn,
+     * starting from a different shard at each call so that all shards are evicted evenly.
+     * No shard lock must be held by the caller.
+     **/
+    bool tryEvictInMemoryEntryFromAnyShard(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        std::size_t start = _nextEvictionShard++;
+
+        bool evicted = false;
+        for (std::size_t i = 0; i < _shards.size() && !evicted; ++i) {
+            CacheShard& shard = *_shards[(start + i) & _shardsMask];
+            QMutexLocker locker(&shard.lock);
+            evicted = tryEvictInMemoryEntry(shard, entriesToBeDeleted);
+        }
+        flushIndexUpdates();
+
+        return evicted;
+    }
+
+    /**
+     * @brief Same as tryEvictInMemoryEntryFromAnyShard() for the disk portion.
+     **/
+    bool tryEvictDiskEntryFromAnyShard(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        std::size_t start = _nextEvictionShard++;
+
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[(start + i) & _shardsMask];
+            QMutexLocker locker(&shard.lock);
+            if ( tryEvictDiskEntry(shard, entriesToBeDeleted) ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool tryEvictInMemoryEntry(CacheShard& shard,
+                               std::list<EntryTypePtr> & entriesToBeDeleted) const
     {
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _memoryCache.evict();
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = evictFromContainer(shard, shard.memoryCache);
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
             return false;
         }
+        CacheHolderStats& holderStats = shard.holderStats[evicted.second->getKey().getCacheHolderID()];
+        ++holderStats.evictions[eCacheEvictionReasonMemoryFull];
 
         // If it is stored on disk, remove it from memory
         // If the cache is tiled, the entry is sharing the same file with other entries so we cannot close the file.
@@ -1840,50 +2933,53 @@ private:
         } else {
 
             assert( evicted.second.unique() );
+            holderStats.demotedBytes += evicted.second->size();
+
+            addToIndex( evicted.second, evicted.second->dataSize() );
 
-            ///This is EXPENSIVE! it calls msync
-            evicted.second->deallocate();
+            ///Closing the mapping is EXPENSIVE! it calls msync: let the write-behind queue do it, unless it is full
+            if ( _isTiled || !evicted.second->setPendingWrite() || !_writeBehindQueue.appendToQueue(evicted.second) ) {
+                evicted.second->writeBehind();
+                evicted.second->deallocate();
+            }
 
             /*insert it back into the disk portion */
 
-            U64 diskCacheSize, maximumCacheSize, maximumInMemorySize;
-            {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
-                maximumInMemorySize = _maximumInMemorySize;
-                maximumCacheSize = _maximumCacheSize;
-            }
+            U64 diskCacheSize = _diskCacheSize;
 
             /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-            while ( ( diskCacheSize  + evicted.second->size() ) >= (maximumCacheSize - maximumInMemorySize) ) {
-                std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
+            while ( ( diskCacheSize  + evicted.second->size() ) >= (_maximumCacheSize - _maximumInMemorySize) ) {
+                // Entries of the index that were never looked up go first
+                std::size_t unloadedSize;
+                if ( evictUnloadedIndexedEntry(&unloadedSize) ) {
+                    diskCacheSize -= std::min( (U64)unloadedSize, diskCacheSize );
+                    continue;
+                }
+
+                std::pair<hash_type, EntryTypePtr> evictedFromDisk = evictFromContainer(shard, shard.diskCache);
                 //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                 //we'll let the user of these entries purge the extra entries left in the cache later on
                 if (!evictedFromDisk.second) {
                     break;
                 }
 
+                ++shard.holderStats[evictedFromDisk.second->getKey().getCacheHolderID()].evictions[eCacheEvictionReasonDiskFull];
+
                 ///Erase the file from the disk if we reach the limit.
                 evictedFromDisk.second->removeAnyBackingFile();
 
                 entriesToBeDeleted.push_back(evictedFromDisk.second);
 
-                {
-                    QMutexLocker k(&_sizeLock);
-                    maximumInMemorySize = _maximumInMemorySize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-
                 //The entry is not yet deleted for real since it's done in a separate thread when this function
                 ///size() will return 0 at this point, we have to recompute it
                 std::size_t fsize = evictedFromDisk.second->getElementsCountFromParams();
-                diskCacheSize -= fsize;
+                diskCacheSize -= std::min( (U64)fsize, diskCacheSize );
             }
 
-            CacheIterator existingDiskCacheEntry = _diskCache(evicted.first);
+            CacheIterator existingDiskCacheEntry = shard.diskCache(evicted.first);
             /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-            if ( existingDiskCacheEntry == _diskCache.end() ) {
-                _diskCache.insert(evicted.first, evicted.second);
+            if ( existingDiskCacheEntry == shard.diskCache.end() ) {
+                shard.diskCache.insert(evicted.first, evicted.second);
             } else {   /*append to the existing list*/
                 getValueFromIterator(existingDiskCacheEntry).push_back(evicted.second);
             }
@@ -1892,16 +2988,18 @@ private:
         return true;
     } // tryEvictEntry
 
-    bool tryEvictDiskEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    bool tryEvictDiskEntry(CacheShard& shard,
+                           std::list<EntryTypePtr> & entriesToBeDeleted) const
     {
 
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _diskCache.evict();
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = evictFromContainer(shard, shard.diskCache);
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
             return false;
         }
+        ++shard.holderStats[evicted.second->getKey().getCacheHolderID()].evictions[eCacheEvictionReasonDiskFull];
         if (!_isTiled) {
             // Erase the file from the disk if we reach the limit.
             evicted.second->removeAnyBackingFile();
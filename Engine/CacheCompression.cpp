@@ -0,0 +1,130 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheCompression.h"
+
+#include <cstring> // memcpy
+#include <climits> // INT_MAX
+#include <vector>
+
+// The fastest zlib level: the compressed tier trades some ratio for a hit latency that stays far below a re-render
+#define NATRON_CACHE_COMPRESSION_LEVEL 1
+
+NATRON_NAMESPACE_ENTER
+
+namespace CacheCompression {
+
+void
+shuffleBytes(const unsigned char* src,
+             std::size_t size,
+             std::size_t elementSize,
+             unsigned char* dst)
+{
+    if (elementSize <= 1) {
+        std::memcpy(dst, src, size);
+
+        return;
+    }
+    std::size_t nElements = size / elementSize;
+    for (std::size_t b = 0; b < elementSize; ++b) {
+        const unsigned char* s = src + b;
+        unsigned char* d = dst + b * nElements;
+        for (std::size_t i = 0; i < nElements; ++i, s += elementSize) {
+            d[i] = *s;
+        }
+    }
+    std::size_t shuffled = nElements * elementSize;
+    std::memcpy(dst + shuffled, src + shuffled, size - shuffled);
+}
+
+void
+unshuffleBytes(const unsigned char* src,
+               std::size_t size,
+               std::size_t elementSize,
+               unsigned char* dst)
+{
+    if (elementSize <= 1) {
+        std::memcpy(dst, src, size);
+
+        return;
+    }
+    std::size_t nElements = size / elementSize;
+    for (std::size_t b = 0; b < elementSize; ++b) {
+        const unsigned char* s = src + b * nElements;
+        unsigned char* d = dst + b;
+        for (std::size_t i = 0; i < nElements; ++i, d += elementSize) {
+            *d = s[i];
+        }
+    }
+    std::size_t shuffled = nElements * elementSize;
+    std::memcpy(dst + shuffled, src + shuffled, size - shuffled);
+}
+
+bool
+compress(const unsigned char* data,
+         std::size_t size,
+         std::size_t elementSize,
+         QByteArray* compressed)
+{
+    compressed->clear();
+    // qCompress takes an int size
+    if ( (size == 0) || (size > (std::size_t)INT_MAX) ) {
+        return false;
+    }
+
+    std::vector<unsigned char> shuffled(size);
+    shuffleBytes(data, size, elementSize, &shuffled[0]);
+
+    *compressed = qCompress(&shuffled[0], (int)size, NATRON_CACHE_COMPRESSION_LEVEL);
+    if ( compressed->isEmpty() || ( (std::size_t)compressed->size() >= size ) ) {
+        // Noise or already compact data: keeping it uncompressed costs less
+        compressed->clear();
+
+        return false;
+    }
+    // Release the memory reserved by the codec for the worst case
+    compressed->squeeze();
+
+    return true;
+}
+
+bool
+uncompress(const QByteArray& compressed,
+           std::size_t elementSize,
+           unsigned char* data,
+           std::size_t size)
+{
+    QByteArray shuffled = qUncompress(compressed);
+
+    if ( (std::size_t)shuffled.size() != size ) {
+        return false;
+    }
+    unshuffleBytes( (const unsigned char*)shuffled.constData(), size, elementSize, data );
+
+    return true;
+}
+} // namespace CacheCompression
+
+NATRON_NAMESPACE_EXIT
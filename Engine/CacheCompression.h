@@ -0,0 +1,73 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHECOMPRESSION_H
+#define NATRON_ENGINE_CACHECOMPRESSION_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include <QtCore/QByteArray>
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Lossless compression of cache entries that are kept in RAM after being evicted from the
+ * uncompressed portion of the cache.
+ * Pixel data is first byte-shuffled: the first byte of every element is stored, then the second byte of every element, etc.
+ * For float and half images, this groups the sign/exponent bytes, which vary slowly across an image, so that the
+ * LZ-based codec that follows finds much longer matches than on interleaved data.
+ **/
+namespace CacheCompression {
+
+/**
+ * @brief Transposes the bytes of size / elementSize elements of elementSize bytes from src to dst.
+ * Trailing bytes that do not make a full element are copied as-is.
+ **/
+void shuffleBytes(const unsigned char* src, std::size_t size, std::size_t elementSize, unsigned char* dst);
+
+/**
+ * @brief Inverse of shuffleBytes()
+ **/
+void unshuffleBytes(const unsigned char* src, std::size_t size, std::size_t elementSize, unsigned char* dst);
+
+/**
+ * @brief Compresses size bytes of data. elementSize is the size in bytes of a channel value (e.g: 4 for float images).
+ * Returns false if the data could not be made smaller, in which case compressed is left empty.
+ **/
+bool compress(const unsigned char* data, std::size_t size, std::size_t elementSize, QByteArray* compressed);
+
+/**
+ * @brief Uncompresses data compressed with compress() into a buffer of exactly size bytes.
+ * Returns false if the compressed data is corrupted or does not match the size.
+ **/
+bool uncompress(const QByteArray& compressed, std::size_t elementSize, unsigned char* data, std::size_t size);
+
+} // namespace CacheCompression
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHECOMPRESSION_H
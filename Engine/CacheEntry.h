@@ -40,6 +40,7 @@
 #include <sstream> // stringstream
 #include <algorithm>
 #include <utility>
+#include <atomic>
 
 #ifdef __NATRON_WIN32__
 #include <windows.h>
@@ -51,6 +52,7 @@
 #include <boost/scoped_ptr.hpp>
 #endif
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QFile>
 #include <QtCore/QMutex>
 #include <QtCore/QReadWriteLock>
@@ -61,11 +63,14 @@
 #include <SequenceParsing.h> // for removePath
 #endif
 
+#include "Engine/CacheCompression.h"
 #include "Engine/Hash64.h"
 #include "Engine/CacheEntryHolder.h"
+#include "Engine/MemoryAllocator.h"
 #include "Engine/MemoryFile.h"
 #include "Engine/NonKeyParams.h"
 #include "Engine/Texture.h"
+#include "Engine/TileCacheFile.h"
 #include "Engine/EngineFwd.h"
 #include "Global/GlobalDefines.h"
 #include "Global/StrUtils.h"
@@ -81,11 +86,15 @@ class RamBuffer
     T* data;
     U64 count;
 
+    // How data was allocated, see MemoryAllocator
+    MemoryAllocationTypeEnum allocationType;
+
 public:
 
     RamBuffer()
         : data(0)
         , count(0)
+        , allocationType(eMemoryAllocationTypeMalloc)
     {
     }
 
@@ -103,6 +112,7 @@ public:
     {
         std::swap(data, other.data);
         std::swap(count, other.count);
+        std::swap(allocationType, other.allocationType);
     }
 
     U64 size() const
@@ -115,48 +125,29 @@ public:
         if (size == 0) {
             return;
         }
-        count = size;
-        if (data) {
-            free(data);
-            data = 0;
-        }
-        if (count == 0) {
-            return;
-        }
-        data = (T*)malloc( size * sizeof(T) );
+        clear();
+        data = (T*)MemoryAllocator::allocate(size * sizeof(T), &allocationType);
         if (!data) {
             throw std::bad_alloc();
         }
+        count = size;
     }
 
     void clear()
     {
-        count = 0;
         if (data) {
-            free(data);
+            MemoryAllocator::deallocate(data, count * sizeof(T), allocationType);
             data = 0;
         }
+        count = 0;
     }
 
     ~RamBuffer()
     {
-        if (data) {
-            free(data);
-            data = 0;
-        }
+        clear();
     }
 };
 
-// This is a cache file with a fixed size that is a multiple of the tileByteSize.
-// A bitset represents the allocated tiles in the file.
-// A value of true means that a tile is used by a cache entry.
-class TileCacheFile
-{
-public:
-    MemoryFilePtr file;
-    std::vector<bool> usedTiles;
-};
-
 typedef TileCacheFilePtr TileCacheFilePtr;
 
 /**
@@ -198,6 +189,13 @@ public:
      **/
     virtual void notifyEntryDestroyed(double time, size_t size, StorageModeEnum storage) const = 0;
 
+    /**
+     * @brief Must be called by a cache entry destroyed while its buffer was compressed, instead of notifyEntryDestroyed().
+     * @param compressedSize The size of the compressed buffer
+     * @param dataSize The size the buffer had before being compressed
+     **/
+    virtual void notifyCompressedEntryDestroyed(double time, size_t compressedSize, size_t dataSize) const = 0;
+
     /**
      * @brief Called by the Cache deleter thread to wake up sleeping threads that were attempting to create a new image
      **/
@@ -221,6 +219,18 @@ public:
      **/
     virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string& holderID, U64 nodeHash, bool removeAll) = 0;
 
+    /**
+     * @brief Relevant only for non tiled caches. To be called when the backing file of an entry stored on disk is removed,
+     * so that the entry is no longer recorded in the index of the cache.
+     **/
+    virtual void notifyEntryBackingFileRemoved(U64 hash, const std::string& filePath, std::size_t dataOffset) const = 0;
+
+    /**
+     * @brief Rewrites the index of the cache without the records of removed entries, see CacheIndexFile.
+     * Called by the cache cleaner thread.
+     **/
+    virtual void compactIndex() = 0;
+
     /**
      * @brief Relevant only for tiled caches. This will allocate the memory required for a tile in the cache and lock it.
      * Note that the calling entry should have exactly the size of a tile in the cache.
@@ -377,6 +387,10 @@ public:
  * Thread safety : This class is not thread-safe but is used ONLY by the CacheEntryHelper class
  * which is itself manipulated by the Cache which is thread-safe.
  *
+ * RAM buffers may be shared between several Buffer objects, see shareRAM(): the first one that
+ * calls writable() gets its own copy of the data (copy-on-write). The data is accounted in the cache by
+ * the Buffer it was shared from, see isBorrowingRAM().
+ *
  * Maybe should we move this class as an internal class of CacheEntryHelper to prevent elsewhere
  * usages.
  **/
@@ -393,7 +407,12 @@ public:
         , _entry(0)
         , _cacheFile()
         , _cacheFileDataOffset(0)
+        , _compressedBuffer()
+        , _compressedCount(0)
         , _storageMode(eStorageModeRAM)
+        , _mayBeShared(0)
+        , _borrowedRAM(false)
+        , _shareMutex()
     {
     }
 
@@ -512,10 +531,18 @@ public:
                         _buffer.reset( new RamBuffer<DataType>() );
                     }
                     _buffer.swap(other._buffer);
+                    int mayBeShared = _mayBeShared;
+                    _mayBeShared = (int)other._mayBeShared;
+                    other._mayBeShared = mayBeShared;
+                    std::swap(_borrowedRAM, other._borrowedRAM);
                 }
             } else {
-                if (!_buffer) {
+                if (!_buffer || _mayBeShared) {
+                    // The whole buffer is overwritten: do not copy the shared one
+                    QMutexLocker k(&_shareMutex);
                     _buffer.reset( new RamBuffer<DataType>() );
+                    _mayBeShared = 0;
+                    _borrowedRAM = false;
                 }
                 _buffer->resize( other._backingFile->size() / sizeof(DataType) );
                 const char* src = other._backingFile->data();
@@ -556,6 +583,19 @@ public:
             _backingFile.reset();
             throw std::bad_alloc();
         }
+        // The whole entry is about to be read, start reading it ahead from disk
+        _backingFile->advise(eMemoryAccessHintSequential, 0, 0);
+        _backingFile->advise(eMemoryAccessHintWillNeed, 0, 0);
+    }
+
+    /**
+     * @brief Tells the system how the tile of the tile cache file holding this buffer is about to be accessed.
+     **/
+    void adviseTile(MemoryAccessHintEnum hint) const
+    {
+        if (_cacheFile && _entry) {
+            _cacheFile->file->advise(hint, _cacheFile->file->data() + _cacheFileDataOffset, _entry->getCacheTileSizeBytes());
+        }
     }
 
     void restoreBufferFromFile(const std::string & path, std::size_t dataOffset, AbstractCacheEntryBase* entry, bool isTileCache)
@@ -572,12 +612,143 @@ public:
         _storageMode = eStorageModeDisk;
     }
 
+    /**
+     * @brief Makes this buffer use the RAM buffer of other instead of its own, until one of them is written
+     * with writable(). Both must be in RAM and have the same size. This buffer then borrows the data of
+     * other, see isBorrowingRAM().
+     * Returns false if the buffer could not be shared, in which case it is left untouched.
+     **/
+    bool shareRAM(const Buffer& other)
+    {
+        if ( (this == &other) || (_storageMode != eStorageModeRAM) || (other._storageMode != eStorageModeRAM) || !_buffer ) {
+            return false;
+        }
+        boost::shared_ptr<RamBuffer<DataType> > shared;
+        {
+            QMutexLocker k(&other._shareMutex);
+            if ( !other._buffer || ( other._buffer->size() == 0 ) || ( other._buffer->size() != _buffer->size() ) ) {
+                return false;
+            }
+            shared = other._buffer;
+            other._mayBeShared = 1;
+        }
+        QMutexLocker k(&_shareMutex);
+        _buffer = shared;
+        _mayBeShared = 1;
+        _borrowedRAM = true;
+
+        return true;
+    }
+
+    /**
+     * @brief Returns true if the RAM buffer is currently shared with another Buffer.
+     **/
+    bool isSharingRAM() const
+    {
+        if (!_mayBeShared) {
+            return false;
+        }
+        QMutexLocker k(&_shareMutex);
+
+        return !updateMayBeShared();
+    }
+
+    /**
+     * @brief Returns true if the RAM buffer was taken from another Buffer by shareRAM() and was not written since.
+     * The data is accounted by the Buffer it was taken from: this stays true after that Buffer released it, until
+     * this one is written or deallocated, so that it is never accounted twice or not released.
+     **/
+    bool isBorrowingRAM() const
+    {
+        return _borrowedRAM;
+    }
+
+    /**
+     * @brief Replaces the RAM buffer by a compressed copy, see CacheCompression.
+     * @param elementSize The size in bytes of a channel value
+     * Returns false if the buffer is not in RAM, is shared or borrowed or did not compress, in which case it is left
+     * untouched.
+     **/
+    bool compress(std::size_t elementSize)
+    {
+        if ( (_storageMode != eStorageModeRAM) || !_buffer || (_buffer->size() == 0) || _borrowedRAM ) {
+            return false;
+        }
+        if (_mayBeShared) {
+            QMutexLocker k(&_shareMutex);
+            if ( !updateMayBeShared() ) {
+                return false;
+            }
+        }
+        if ( !CacheCompression::compress( (const unsigned char*)_buffer->getData(), _buffer->size() * sizeof(DataType), elementSize, &_compressedBuffer ) ) {
+            return false;
+        }
+        _compressedCount = _buffer->size();
+        _buffer->clear();
+
+        return true;
+    }
+
+    /**
+     * @brief Restores the RAM buffer from its compressed copy.
+     * Returns false if the compressed data could not be decoded, in which case the buffer stays compressed.
+     * WARNING: This function throws a std::bad_alloc if the allocation fails.
+     **/
+    bool uncompress(std::size_t elementSize)
+    {
+        if (_compressedCount == 0) {
+            return false;
+        }
+        if (!_buffer) {
+            _buffer.reset( new RamBuffer<DataType>() );
+        }
+        _buffer->resize(_compressedCount);
+        if ( !CacheCompression::uncompress( _compressedBuffer, elementSize, (unsigned char*)_buffer->getData(), _compressedCount * sizeof(DataType) ) ) {
+            _buffer->clear();
+
+            return false;
+        }
+        _compressedBuffer.clear();
+        _compressedCount = 0;
+
+        return true;
+    }
+
+    bool isCompressed() const
+    {
+        return _compressedCount != 0;
+    }
+
+    /**
+     * @brief Returns the size of the compressed buffer in bytes, 0 if not compressed.
+     **/
+    std::size_t getCompressedSize() const
+    {
+        return _compressedBuffer.size();
+    }
+
+    /**
+     * @brief Returns the size in bytes the buffer had before being compressed, 0 if not compressed.
+     **/
+    std::size_t getUncompressedSize() const
+    {
+        return _compressedCount * sizeof(DataType);
+    }
+
     void deallocate()
     {
         if (_storageMode == eStorageModeRAM) {
-            if (_buffer) {
+            if (_mayBeShared) {
+                // Only release our reference, the other Buffer may still use the data
+                QMutexLocker k(&_shareMutex);
+                _buffer.reset();
+                _mayBeShared = 0;
+            } else if (_buffer) {
                 _buffer->clear();
             }
+            _borrowedRAM = false;
+            _compressedBuffer.clear();
+            _compressedCount = 0;
         } else if (_storageMode == eStorageModeDisk) {
             if (_backingFile) {
                 bool flushOk = _backingFile->flush(MemoryFile::eFlushTypeAsync, 0, 0);
@@ -631,7 +802,9 @@ public:
     size_t size() const
     {
         if (_storageMode == eStorageModeRAM) {
-            return _buffer ? _buffer->size() * sizeof(DataType) : 0;
+            const RamBuffer<DataType>* buffer = getRAMBuffer();
+
+            return buffer ? buffer->size() * sizeof(DataType) : 0;
         } else if (_storageMode == eStorageModeDisk) {
             if (_backingFile) {
                 return _backingFile->size();
@@ -650,7 +823,9 @@ public:
 
     bool isAllocated() const
     {
-        return (_buffer && _buffer->size() > 0) || ( _backingFile && _backingFile->data() ) || _cacheFile || _glTexture;
+        const RamBuffer<DataType>* buffer = getRAMBuffer();
+
+        return (buffer && buffer->size() > 0) || ( _backingFile && _backingFile->data() ) || _cacheFile || _glTexture;
     }
 
     DataType* writable()
@@ -664,6 +839,10 @@ public:
                 return NULL;
             }
         } else if (_storageMode == eStorageModeRAM) {
+            if (_mayBeShared || _borrowedRAM) {
+                detachRAM();
+            }
+
             return _buffer ? _buffer->getData() : NULL;
         } else {
             // Other storage modes don't provide direct access to RAM handle
@@ -682,7 +861,9 @@ public:
                 return 0;
             }
         } else if (_storageMode == eStorageModeRAM) {
-            return _buffer ? _buffer->getData() : NULL;
+            const RamBuffer<DataType>* buffer = getRAMBuffer();
+
+            return buffer ? buffer->getData() : NULL;
         } else {
             // Other storage modes don't provide direct access to RAM handle
             return NULL;
@@ -721,8 +902,56 @@ public:
 
 private:
 
+    /*
+     * _buffer is only replaced under _shareMutex while _mayBeShared is set: when it is not set, the buffer
+     * belongs to this object only and may be accessed without taking the mutex.
+     */
+    const RamBuffer<DataType>* getRAMBuffer() const
+    {
+        if (_mayBeShared) {
+            QMutexLocker k(&_shareMutex);
+            updateMayBeShared();
+
+            return _buffer.get();
+        }
+
+        return _buffer.get();
+    }
+
+    /*
+     * Clears _mayBeShared once the other Buffers released the data, so that it is accessed without the mutex again.
+     * _shareMutex must be held: other Buffers only take a reference on the data of this one under it.
+     * Returns true if the data belongs to this object only.
+     */
+    bool updateMayBeShared() const
+    {
+        if ( _buffer && !_buffer.unique() ) {
+            return false;
+        }
+        _mayBeShared = 0;
+
+        return true;
+    }
+
+    /*
+     * Gives this object its own copy of a shared RAM buffer before it gets written. It then accounts for its data.
+     */
+    void detachRAM()
+    {
+        QMutexLocker k(&_shareMutex);
+
+        if ( !updateMayBeShared() ) {
+            boost::shared_ptr<RamBuffer<DataType> > copy( new RamBuffer<DataType>() );
+            copy->resize( _buffer->size() );
+            std::memcpy( copy->getData(), _buffer->getData(), _buffer->size() * sizeof(DataType) );
+            _buffer = copy;
+            _mayBeShared = 0;
+        }
+        _borrowedRAM = false;
+    }
+
     std::string _path;
-    boost::scoped_ptr<RamBuffer<DataType> > _buffer;
+    boost::shared_ptr<RamBuffer<DataType> > _buffer;
 
     /*mutable so the reOpenFileMapping function can reopen the mapped file. It doesn't
        change the underlying data*/
@@ -733,9 +962,20 @@ private:
     TileCacheFilePtr _cacheFile;
     std::size_t _cacheFileDataOffset;
 
+    // Set when the RAM buffer was compressed by the cache, _buffer is then empty
+    QByteArray _compressedBuffer;
+    U64 _compressedCount;
+
     // Used when we store images as OpenGL textures
     boost::scoped_ptr<Texture> _glTexture;
     StorageModeEnum _storageMode;
+
+    // Set when _buffer was shared with another Buffer by shareRAM(), cleared once it is not shared anymore
+    mutable QAtomicInt _mayBeShared;
+
+    // Set on the Buffer that called shareRAM(), see isBorrowingRAM()
+    bool _borrowedRAM;
+    mutable QMutex _shareMutex;
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -771,6 +1011,10 @@ public:
         , _cache()
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _pendingWrite(false)
+        , _renderCostMicroSeconds(0)
+        , _cacheAccessCount(0)
+        , _cacheInflation(0.)
     {
     }
 
@@ -789,6 +1033,10 @@ public:
         , _cache(cache)
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _pendingWrite(false)
+        , _renderCostMicroSeconds(0)
+        , _cacheAccessCount(0)
+        , _cacheInflation(0.)
     {
     }
 
@@ -945,6 +1193,10 @@ public:
     void reOpenFileMapping() const
     {
         if (_cache && _cache->isTileCache()) {
+            // The tile stays mapped, but its pages may have been written back and dropped
+            QReadLocker k(&_entryLock);
+            _data.adviseTile(eMemoryAccessHintWillNeed);
+
             return;
         }
         {
@@ -956,6 +1208,70 @@ public:
         }
     }
 
+    /**
+     * @brief Called by the cache when this entry, stored on disk and mapped, is evicted from the in-memory portion.
+     * The entry is accounted in the disk portion right away, but stays mapped until writeBehind() is called
+     * by the write-behind queue of the cache, see CacheWriteBehindQueue.
+     * Returns false if the entry is not mapped, in which case there is nothing to write.
+     **/
+    bool setPendingWrite()
+    {
+        std::size_t sz = size();
+        {
+            QWriteLocker k(&_entryLock);
+            if ( _pendingWrite || !_data.isAllocated() ) {
+                return false;
+            }
+            _pendingWrite = true;
+        }
+        if (_cache) {
+            _cache->notifyEntryStorageChanged( eStorageModeRAM, eStorageModeDisk, getTime(), sz );
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Called by the cache on a hit in the disk portion. If the entry was not written yet, it is still mapped:
+     * the write is cancelled, the entry is accounted back in the in-memory portion and true is returned.
+     * If the entry is being written, this waits for the write to complete and returns false, in which case
+     * reOpenFileMapping() must be called.
+     **/
+    bool cancelPendingWrite()
+    {
+        {
+            QWriteLocker k(&_entryLock);
+            if (!_pendingWrite) {
+                return false;
+            }
+            _pendingWrite = false;
+        }
+        if (_cache) {
+            _cache->notifyEntryStorageChanged( eStorageModeDisk, eStorageModeRAM, getTime(), size() );
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Flushes the mapping of an entry on which setPendingWrite() was called to its backing file and closes it,
+     * unless the write was cancelled in the meantime. Returns the number of bytes written.
+     * This is EXPENSIVE: it calls msync. It is called by the writer threads of CacheWriteBehindQueue.
+     **/
+    std::size_t writeBehind()
+    {
+        QWriteLocker k(&_entryLock);
+
+        if (!_pendingWrite) {
+            return 0;
+        }
+        _pendingWrite = false;
+        std::size_t sz = _data.size();
+        _data.deallocate();
+
+        return sz;
+    }
+
     /**
      * @brief Can be called several times without harm
      **/
@@ -963,17 +1279,28 @@ public:
     {
         std::size_t sz = size();
         bool dataAllocated;
+        bool compressed;
+        bool pendingWrite;
+        std::size_t compressedSize, uncompressedSize;
         double time = getTime();
         {
             QWriteLocker k(&_entryLock);
             dataAllocated = _data.isAllocated();
+            pendingWrite = _pendingWrite;
+            _pendingWrite = false;
+            compressed = _data.isCompressed();
+            compressedSize = _data.getCompressedSize();
+            uncompressedSize = _data.getUncompressedSize();
             _data.deallocate();
         }
 
         if (_cache) {
             const CacheEntryStorageInfo& info = _params->getStorageInfo();
-            if (info.mode == eStorageModeDisk) {
-                if (dataAllocated) {
+            if (compressed) {
+                _cache->notifyCompressedEntryDestroyed(time, compressedSize, uncompressedSize);
+            } else if (info.mode == eStorageModeDisk) {
+                // An entry pending a write was already accounted in the disk portion
+                if (dataAllocated && !pendingWrite) {
                     if (_cache->isTileCache()) {
                          _cache->notifyEntryDestroyed(time, sz, eStorageModeDisk);
                     } else {
@@ -1005,12 +1332,13 @@ public:
     }
 
     /**
-     * @brief Returns the size of the buffer in bytes.
+     * @brief Returns the size of the buffer in bytes. A buffer borrowed from another entry with shareData() is
+     * accounted by that entry only and counts as 0.
      **/
     size_t dataSize() const
     {
         bool got = _entryLock.tryLockForRead();
-        std::size_t r = _data.size();
+        std::size_t r = _data.isBorrowingRAM() ? 0 : _data.size();
 
         if (got) {
             _entryLock.unlock();
@@ -1025,6 +1353,89 @@ public:
     }
 
 
+    /**
+     * @brief Adds to the time spent producing the data of this entry. Each thread rendering a part of the entry
+     * adds the time it spent, so that this is the time it would take to render the entry again on a single core.
+     * This is used by the cost-aware eviction policy of the cache, see CacheEvictionPolicyEnum.
+     **/
+    void addRenderCost(double seconds)
+    {
+        _renderCostMicroSeconds += (U64)(seconds * 1000000.);
+    }
+
+    /**
+     * @brief Returns the time in seconds spent producing the data of this entry
+     **/
+    double getRenderCost() const
+    {
+        return _renderCostMicroSeconds / 1000000.;
+    }
+
+    /**
+     * @brief Called by the cache, under the lock of the shard holding the entry, whenever the entry is inserted or found.
+     * @param inflation The priority of the last entry evicted by the cache, see CacheCostAwarePriority
+     **/
+    void registerCacheAccess(double inflation)
+    {
+        ++_cacheAccessCount;
+        _cacheInflation = inflation;
+    }
+
+    U64 getCacheAccessCount() const
+    {
+        return _cacheAccessCount;
+    }
+
+    double getCacheInflation() const
+    {
+        return _cacheInflation;
+    }
+
+    /**
+     * @brief Called by the cache when the entry is evicted from the uncompressed portion of the cache:
+     * the RAM buffer is replaced by a compressed copy. Nothing else than the cache may hold a reference to the
+     * entry while it is compressed.
+     * Returns false if the entry is not stored in RAM or did not compress.
+     **/
+    bool compressBuffer()
+    {
+        QWriteLocker k(&_entryLock);
+
+        return _data.compress(_params->getStorageInfo().dataTypeSize);
+    }
+
+    /**
+     * @brief Called by the cache on a hit in the compressed portion of the cache.
+     * WARNING: This function throws a std::bad_alloc if the allocation fails.
+     **/
+    bool uncompressBuffer()
+    {
+        QWriteLocker k(&_entryLock);
+
+        return _data.uncompress(_params->getStorageInfo().dataTypeSize);
+    }
+
+    bool isCompressed() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _data.isCompressed();
+    }
+
+    std::size_t getCompressedSize() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _data.getCompressedSize();
+    }
+
+    std::size_t getUncompressedSize() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _data.getUncompressedSize();
+    }
+
     bool isStoredOnDisk() const
     {
         return _data.getStorageMode() == eStorageModeDisk;
@@ -1056,13 +1467,14 @@ public:
         bool hasRemovedFile;
         {
             QWriteLocker k(&_entryLock);
-            isAlloc = _data.isAllocated();
+            isAlloc = _data.isAllocated() && !_pendingWrite;
             hasRemovedFile = _data.removeAnyBackingFile();
         }
 
         if (hasRemovedFile) {
             _cache->backingFileClosed();
         }
+        _cache->notifyEntryBackingFileRemoved( getHashKey(), getFilePath(), getOffsetInFile() );
         if (isAlloc) {
             _cache->notifyEntryDestroyed(getTime(), getElementsCountFromParams(), eStorageModeRAM);
         } else {
@@ -1147,6 +1559,43 @@ protected:
         }
     }
 
+    /**
+     * @brief Makes this entry use the RAM buffer of other instead of its own, see Buffer::shareRAM().
+     * The buffer this entry had is released and the shared one stays accounted by other only, until this entry
+     * is written with writableData().
+     **/
+    bool shareData(const CacheEntryHelper<DataType, KeyType, ParamsType>& other)
+    {
+        size_t oldSize = size();
+
+        if ( !_data.shareRAM(other._data) ) {
+            return false;
+        }
+        if (_cache) {
+            _cache->notifyEntrySizeChanged( oldSize, size() );
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Returns the buffer to be written. A buffer borrowed with shareData() is copied first if it is
+     * still shared, and is accounted by this entry from now on.
+     **/
+    DataType* writableData()
+    {
+        if ( !_data.isBorrowingRAM() ) {
+            return _data.writable();
+        }
+        size_t oldSize = size();
+        DataType* ret = _data.writable();
+        if (_cache) {
+            _cache->notifyEntrySizeChanged( oldSize, size() );
+        }
+
+        return ret;
+    }
+
 private:
 
     virtual TileCacheFilePtr allocTile(std::size_t *dataOffset) OVERRIDE FINAL
@@ -1253,6 +1702,16 @@ protected:
     const CacheAPI* _cache;
     mutable QReadWriteLock _entryLock;
     bool _removeBackingFileBeforeDestruction;
+
+    // True while the entry is accounted in the disk portion of the cache but still mapped, see setPendingWrite()
+    bool _pendingWrite;
+
+    // Time spent producing the data of this entry, see addRenderCost()
+    std::atomic<U64> _renderCostMicroSeconds;
+
+    // Used by the cost-aware eviction policy, only accessed by the cache under the lock of the shard holding the entry
+    U64 _cacheAccessCount;
+    double _cacheInflation;
 };
 
 NATRON_NAMESPACE_EXIT
@@ -0,0 +1,71 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHEEVICTIONPOLICY_H
+#define NATRON_ENGINE_CACHEEVICTIONPOLICY_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+// Number of least recently used entries among which the cost-aware policy picks the entry to evict
+#define NATRON_CACHE_EVICTION_SAMPLES 16
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief How a cache picks the entry to evict when it is full
+ **/
+enum CacheEvictionPolicyEnum
+{
+    // The least recently used entry is evicted
+    eCacheEvictionPolicyLRU = 0,
+
+    // Among the NATRON_CACHE_EVICTION_SAMPLES least recently used entries, the one with the lowest
+    // CacheCostAwarePriority is evicted
+    eCacheEvictionPolicyCostAware
+};
+
+/**
+ * @brief Priority of an entry for the cost-aware eviction policy: the entry with the lowest priority is evicted first.
+ * This is GreedyDual-Size-Frequency: priority = L + frequency * cost / size, where cost is the time spent rendering
+ * the entry and L is the priority of the last entry evicted when the entry was last accessed. L only grows, so that
+ * entries that were expensive to render but are not accessed anymore eventually get evicted.
+ * EntryTypePtr must point to a CacheEntryHelper, or anything with the same getters.
+ **/
+template <typename EntryTypePtr>
+struct CacheCostAwarePriority
+{
+    double operator()(const EntryTypePtr& entry) const
+    {
+        std::size_t size = entry->getSizeInBytesFromParams();
+
+        return entry->getCacheInflation() + entry->getCacheAccessCount() * entry->getRenderCost() / (size == 0 ? 1 : size);
+    }
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEEVICTIONPOLICY_H
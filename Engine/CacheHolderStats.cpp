@@ -0,0 +1,101 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheHolderStats.h"
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+const char* evictionReasonNames[eCacheEvictionReasonCount] = {
+    "evictionsMemoryFull",
+    "evictionsCompressedFull",
+    "evictionsDiskFull",
+    "evictionsRemoved"
+};
+
+const char* tierNames[eCacheTierCount] = {
+    "Memory",
+    "Compressed",
+    "Disk"
+};
+
+} // anon namespace
+
+CacheHolderStats::CacheHolderStats()
+    : hits(0)
+    , hitsNeedingDownscale(0)
+    , misses(0)
+    , promotedBytes(0)
+    , demotedBytes(0)
+    , lockWaitTime(0.)
+{
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        evictions[i] = 0;
+    }
+    for (int i = 0; i < eCacheTierCount; ++i) {
+        residentEntries[i] = 0;
+        residentSize[i] = 0;
+    }
+}
+
+void
+CacheHolderStats::merge(const CacheHolderStats& other)
+{
+    hits += other.hits;
+    hitsNeedingDownscale += other.hitsNeedingDownscale;
+    misses += other.misses;
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        evictions[i] += other.evictions[i];
+    }
+    promotedBytes += other.promotedBytes;
+    demotedBytes += other.demotedBytes;
+    lockWaitTime += other.lockWaitTime;
+    for (int i = 0; i < eCacheTierCount; ++i) {
+        residentEntries[i] += other.residentEntries[i];
+        residentSize[i] += other.residentSize[i];
+    }
+}
+
+void
+CacheHolderStats::getValues(std::vector<std::pair<std::string, double> >* values) const
+{
+    values->push_back( std::make_pair( std::string("hits"), (double)hits ) );
+    values->push_back( std::make_pair( std::string("hitsNeedingDownscale"), (double)hitsNeedingDownscale ) );
+    values->push_back( std::make_pair( std::string("misses"), (double)misses ) );
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        values->push_back( std::make_pair( std::string(evictionReasonNames[i]), (double)evictions[i] ) );
+    }
+    values->push_back( std::make_pair( std::string("promotedBytes"), (double)promotedBytes ) );
+    values->push_back( std::make_pair( std::string("demotedBytes"), (double)demotedBytes ) );
+    values->push_back( std::make_pair( std::string("lockWaitTime"), lockWaitTime ) );
+    for (int i = 0; i < eCacheTierCount; ++i) {
+        values->push_back( std::make_pair( std::string("resident") + tierNames[i] + "Entries", (double)residentEntries[i] ) );
+        values->push_back( std::make_pair( std::string("resident") + tierNames[i] + "Bytes", (double)residentSize[i] ) );
+    }
+}
+
+NATRON_NAMESPACE_EXIT
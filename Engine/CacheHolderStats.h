@@ -0,0 +1,115 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_CACHEHOLDERSTATS_H
+#define NATRON_ENGINE_CACHEHOLDERSTATS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The portions of a cache an entry can be found in
+ **/
+enum CacheTierEnum
+{
+    eCacheTierMemory = 0, // uncompressed in RAM
+    eCacheTierCompressed, // compressed in RAM, see CacheCompression
+    eCacheTierDisk, // memory-mapped files
+    eCacheTierCount
+};
+
+/**
+ * @brief Why an entry left a portion of a cache
+ **/
+enum CacheEvictionReasonEnum
+{
+    // The in-memory portion was full: the entry went to the compressed or disk portion, or was deleted
+    eCacheEvictionReasonMemoryFull = 0,
+
+    // The compressed portion was full: the entry was deleted
+    eCacheEvictionReasonCompressedFull,
+
+    // The disk portion was full: the entry and its file were deleted
+    eCacheEvictionReasonDiskFull,
+
+    // The entry was removed because its holder changed or was deleted
+    eCacheEvictionReasonRemoved,
+
+    eCacheEvictionReasonCount
+};
+
+/**
+ * @brief Statistics of the entries of one CacheEntryHolder (i.e: a node) in a cache, see Cache::getHolderStats().
+ * Counters are accumulated since the cache was created or Cache::resetStats() was called, residency
+ * is the state of the cache when the statistics were queried.
+ **/
+struct CacheHolderStats
+{
+    U64 hits;
+
+    // Hits on an image at a higher scale than requested, that had to be downscaled. Also counted in hits.
+    U64 hitsNeedingDownscale;
+    U64 misses;
+    U64 evictions[eCacheEvictionReasonCount];
+
+    // Bytes moved back to the in-memory portion from the compressed or disk portion on a hit
+    U64 promotedBytes;
+
+    // Bytes moved out of the in-memory portion to the compressed or disk portion
+    U64 demotedBytes;
+
+    // Total time in seconds the threads looking up entries waited for the cache locks
+    double lockWaitTime;
+
+    // Number of entries and bytes currently held in each portion of the cache
+    std::size_t residentEntries[eCacheTierCount];
+    std::size_t residentSize[eCacheTierCount];
+
+    CacheHolderStats();
+
+    void merge(const CacheHolderStats& other);
+
+    /**
+     * @brief Returns all the statistics as a flat list of named values, in a stable order.
+     * This is what is exposed to Python and written as JSON.
+     **/
+    void getValues(std::vector<std::pair<std::string, double> >* values) const;
+};
+
+typedef std::map<std::string, CacheHolderStats> CacheHolderStatsMap;
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEHOLDERSTATS_H
@@ -0,0 +1,542 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheIndexFile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+// Size of a new index file, it then doubles each time it is full
+#define NATRON_CACHE_INDEX_INITIAL_SIZE (64 * 1024)
+
+#define NATRON_CACHE_INDEX_FORMAT_VERSION 2
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+const char kIndexMagic[8] = { 'N', 'T', 'C', 'I', 'N', 'D', 'E', 'X' };
+const U32 kRecordMagic = 0x4E524543; // "NREC"
+
+enum RecordTypeEnum
+{
+    eRecordTypeAdd = 1,
+    eRecordTypeRemove
+};
+
+struct IndexFileHeader
+{
+    char magic[8];
+    U32 formatVersion;
+    U32 cacheVersion;
+};
+
+// Followed by the file path and the payload, the record is padded to a multiple of 8 bytes
+struct RecordHeader
+{
+    U32 magic;
+    U32 type;
+    U64 hash;
+    U64 dataSize;
+    U64 dataOffsetInFile;
+    U32 filePathSize;
+    U32 payloadSize;
+    U32 checksum; // of the header and the file path, checked when the index is opened
+    U32 payloadChecksum; // only checked when the entry is looked up
+};
+
+U64
+getRecordSize(U32 filePathSize,
+              U32 payloadSize)
+{
+    U64 size = sizeof(RecordHeader) + filePathSize + payloadSize;
+
+    return (size + 7) & ~(U64)7;
+}
+
+// FNV-1a of the given bytes, continuing from hash
+U32
+hashBytes(U32 hash,
+          const void* data,
+          std::size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Checksum of the header and the file path of a record, computed with a null checksum field
+U32
+computeChecksum(const RecordHeader& header,
+                const char* filePath)
+{
+    RecordHeader h = header;
+
+    h.checksum = 0;
+    U32 hash = hashBytes(2166136261u, &h, sizeof(RecordHeader) );
+
+    return hashBytes(hash, filePath, header.filePathSize);
+}
+
+U32
+computePayloadChecksum(const char* payload,
+                       std::size_t payloadSize)
+{
+    return hashBytes(2166136261u, payload, payloadSize);
+}
+} // anon namespace
+
+CacheIndexFile::CacheIndexFile(const std::string& filePath,
+                               unsigned int cacheVersion)
+    : _lock()
+    , _filePath(filePath)
+    , _cacheVersion(cacheVersion)
+    , _file()
+    , _usedSize(0)
+    , _deadSize(0)
+    , _liveRecords()
+    , _unloadedRecords()
+    , _unloadedDataSize(0)
+    , _recordsCount(0)
+    , _wasReset(false)
+{
+    openFile();
+}
+
+CacheIndexFile::~CacheIndexFile()
+{
+}
+
+void
+CacheIndexFile::openFile()
+{
+    QString path = QString::fromUtf8( _filePath.c_str() );
+    QString tmpPath = path + QString::fromUtf8(".tmp");
+
+    if ( QFile::exists(tmpPath) ) {
+        // A compaction was interrupted: if the index was removed, the new one is complete
+        if ( QFile::exists(path) ) {
+            QFile::remove(tmpPath);
+        } else {
+            QFile::rename(tmpPath, path);
+        }
+    }
+
+    _file.open(_filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate);
+
+    bool valid = false;
+    if ( _file.data() && (_file.size() >= sizeof(IndexFileHeader)) ) {
+        IndexFileHeader header;
+        std::memcpy( &header, _file.data(), sizeof(IndexFileHeader) );
+        valid = std::memcmp( header.magic, kIndexMagic, sizeof(kIndexMagic) ) == 0 &&
+                header.formatVersion == NATRON_CACHE_INDEX_FORMAT_VERSION &&
+                header.cacheVersion == _cacheVersion;
+    }
+    if (!valid) {
+        _wasReset = _file.size() > 0;
+        initHeader();
+    }
+    scan();
+}
+
+void
+CacheIndexFile::initHeader()
+{
+    _file.resize(NATRON_CACHE_INDEX_INITIAL_SIZE);
+    if ( !_file.data() ) {
+        throw std::runtime_error("Failed to map the cache index " + _filePath);
+    }
+    std::memset(_file.data(), 0, NATRON_CACHE_INDEX_INITIAL_SIZE);
+
+    IndexFileHeader header;
+    std::memcpy( header.magic, kIndexMagic, sizeof(kIndexMagic) );
+    header.formatVersion = NATRON_CACHE_INDEX_FORMAT_VERSION;
+    header.cacheVersion = _cacheVersion;
+    std::memcpy( _file.data(), &header, sizeof(IndexFileHeader) );
+}
+
+void
+CacheIndexFile::scan()
+{
+    _liveRecords.clear();
+    _unloadedRecords.clear();
+    _unloadedDataSize = 0;
+    _recordsCount = 0;
+    _deadSize = 0;
+
+    const char* data = _file.data();
+    U64 size = _file.size();
+    U64 offset = sizeof(IndexFileHeader);
+    while ( offset + sizeof(RecordHeader) <= size ) {
+        RecordHeader header;
+        std::memcpy( &header, data + offset, sizeof(RecordHeader) );
+        if (header.magic != kRecordMagic) {
+            break;
+        }
+        U64 recordSize = getRecordSize(header.filePathSize, header.payloadSize);
+        if (offset + recordSize > size) {
+            break;
+        }
+        // The payload is only checked by takeUnloadedRecords(), so that opening the index does not read all of it
+        const char* body = data + offset + sizeof(RecordHeader);
+        if ( computeChecksum(header, body) != header.checksum ) {
+            // A record partially written when the process was interrupted: the end of the index
+            break;
+        }
+
+        std::string filePath(body, header.filePathSize);
+        if (header.type == eRecordTypeAdd) {
+            LiveRecord r;
+            r.recordOffset = offset;
+            r.recordSize = recordSize;
+            r.dataSize = header.dataSize;
+            r.dataOffsetInFile = header.dataOffsetInFile;
+            r.filePath = filePath;
+            r.loaded = false;
+            _liveRecords[header.hash].push_back(r);
+            _unloadedRecords[offset] = header.hash;
+            _unloadedDataSize += header.dataSize;
+            ++_recordsCount;
+        } else {
+            LiveRecordsMap::iterator found = _liveRecords.find(header.hash);
+            if ( found != _liveRecords.end() ) {
+                for (std::list<LiveRecord>::iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                    if ( (it->filePath == filePath) && (it->dataOffsetInFile == header.dataOffsetInFile) ) {
+                        eraseLiveRecord(found, it);
+                        break;
+                    }
+                }
+            }
+            _deadSize += recordSize;
+        }
+        offset += recordSize;
+    }
+    _usedSize = offset;
+
+    // Clear what may remain of a record partially written, so that it is not mistaken for a record later on
+    std::memset(_file.data() + _usedSize, 0, size - _usedSize);
+}
+
+void
+CacheIndexFile::append(int type,
+                       const Record& record,
+                       U64* recordOffset,
+                       U64* recordSize)
+{
+    RecordHeader header;
+
+    header.magic = kRecordMagic;
+    header.type = (U32)type;
+    header.hash = record.hash;
+    header.dataSize = record.dataSize;
+    header.dataOffsetInFile = record.dataOffsetInFile;
+    header.filePathSize = (U32)record.filePath.size();
+    header.payloadSize = (U32)record.payload.size();
+    header.payloadChecksum = computePayloadChecksum( record.payload.data(), record.payload.size() );
+
+    *recordSize = getRecordSize(header.filePathSize, header.payloadSize);
+    if ( _usedSize + *recordSize > _file.size() ) {
+        // The new part of the file is filled with zeroes
+        _file.resize( std::max( (U64)_file.size() * 2, _usedSize + *recordSize ) );
+    }
+    *recordOffset = _usedSize;
+
+    char* dst = _file.data() + _usedSize;
+    char* body = dst + sizeof(RecordHeader);
+    std::memcpy( body, record.filePath.data(), record.filePath.size() );
+    std::memcpy( body + record.filePath.size(), record.payload.data(), record.payload.size() );
+    header.checksum = computeChecksum(header, body);
+    std::memcpy( dst, &header, sizeof(RecordHeader) );
+    _usedSize += *recordSize;
+}
+
+void
+CacheIndexFile::eraseLiveRecord(LiveRecordsMap::iterator it,
+                                std::list<LiveRecord>::iterator it2)
+{
+    _deadSize += it2->recordSize;
+    if (!it2->loaded) {
+        _unloadedRecords.erase(it2->recordOffset);
+        _unloadedDataSize -= std::min(it2->dataSize, _unloadedDataSize);
+    }
+    --_recordsCount;
+    it->second.erase(it2);
+    if ( it->second.empty() ) {
+        _liveRecords.erase(it);
+    }
+}
+
+void
+CacheIndexFile::takeUnloadedRecords(U64 hash,
+                                    std::list<Record>* records)
+{
+    QMutexLocker k(&_lock);
+    LiveRecordsMap::iterator found = _liveRecords.find(hash);
+
+    if ( found == _liveRecords.end() ) {
+        return;
+    }
+    for (std::list<LiveRecord>::iterator it = found->second.begin(); it != found->second.end(); ++it) {
+        if (it->loaded) {
+            continue;
+        }
+        RecordHeader header;
+        std::memcpy( &header, _file.data() + it->recordOffset, sizeof(RecordHeader) );
+
+        Record r;
+        r.hash = hash;
+        r.dataSize = it->dataSize;
+        r.dataOffsetInFile = it->dataOffsetInFile;
+        r.filePath = it->filePath;
+        const char* payload = _file.data() + it->recordOffset + sizeof(RecordHeader) + header.filePathSize;
+        if ( computePayloadChecksum(payload, header.payloadSize) == header.payloadChecksum ) {
+            r.payload.assign(payload, header.payloadSize);
+        }
+        records->push_back(r);
+
+        it->loaded = true;
+        _unloadedRecords.erase(it->recordOffset);
+        _unloadedDataSize -= std::min(it->dataSize, _unloadedDataSize);
+    }
+}
+
+U64
+CacheIndexFile::getUnloadedDataSize() const
+{
+    QMutexLocker k(&_lock);
+
+    return _unloadedDataSize;
+}
+
+void
+CacheIndexFile::recordAdd(const Record& record)
+{
+    QMutexLocker k(&_lock);
+    std::list<LiveRecord>& records = _liveRecords[record.hash];
+
+    for (std::list<LiveRecord>::iterator it = records.begin(); it != records.end(); ++it) {
+        if ( (it->filePath == record.filePath) && (it->dataOffsetInFile == record.dataOffsetInFile) ) {
+            return;
+        }
+    }
+
+    LiveRecord r;
+    try {
+        append(eRecordTypeAdd, record, &r.recordOffset, &r.recordSize);
+    } catch (const std::exception& e) {
+        qDebug() << "Failed to write to the cache index:" << e.what();
+        if ( records.empty() ) {
+            _liveRecords.erase(record.hash);
+        }
+
+        return;
+    }
+    r.dataSize = record.dataSize;
+    r.dataOffsetInFile = record.dataOffsetInFile;
+    r.filePath = record.filePath;
+    r.loaded = true;
+    records.push_back(r);
+    ++_recordsCount;
+}
+
+void
+CacheIndexFile::recordRemove(U64 hash,
+                             const std::string& filePath,
+                             U64 dataOffsetInFile)
+{
+    QMutexLocker k(&_lock);
+    LiveRecordsMap::iterator found = _liveRecords.find(hash);
+
+    if ( found == _liveRecords.end() ) {
+        return;
+    }
+    for (std::list<LiveRecord>::iterator it = found->second.begin(); it != found->second.end(); ++it) {
+        if ( (it->filePath == filePath) && (it->dataOffsetInFile == dataOffsetInFile) ) {
+            eraseLiveRecord(found, it);
+
+            Record r;
+            r.hash = hash;
+            r.filePath = filePath;
+            r.dataOffsetInFile = dataOffsetInFile;
+            U64 recordOffset, recordSize;
+            try {
+                append(eRecordTypeRemove, r, &recordOffset, &recordSize);
+            } catch (const std::exception& e) {
+                qDebug() << "Failed to write to the cache index:" << e.what();
+
+                return;
+            }
+            _deadSize += recordSize;
+
+            return;
+        }
+    }
+}
+
+bool
+CacheIndexFile::takeOldestUnloadedRecord(Record* record)
+{
+    QMutexLocker k(&_lock);
+
+    if ( _unloadedRecords.empty() ) {
+        return false;
+    }
+    U64 recordOffset = _unloadedRecords.begin()->first;
+    record->hash = _unloadedRecords.begin()->second;
+    std::list<LiveRecord>& records = _liveRecords[record->hash];
+    for (std::list<LiveRecord>::iterator it = records.begin(); it != records.end(); ++it) {
+        if (it->recordOffset == recordOffset) {
+            record->dataSize = it->dataSize;
+            record->dataOffsetInFile = it->dataOffsetInFile;
+            record->filePath = it->filePath;
+            // It is not returned by takeUnloadedRecords() anymore
+            it->loaded = true;
+            _unloadedDataSize -= std::min(it->dataSize, _unloadedDataSize);
+            break;
+        }
+    }
+    _unloadedRecords.erase(recordOffset);
+
+    return true;
+}
+
+bool
+CacheIndexFile::removeOldestUnloadedRecord(Record* record)
+{
+    if ( !takeOldestUnloadedRecord(record) ) {
+        return false;
+    }
+    recordRemove(record->hash, record->filePath, record->dataOffsetInFile);
+
+    return true;
+}
+
+void
+CacheIndexFile::getFilePaths(std::set<std::string>* filePaths) const
+{
+    QMutexLocker k(&_lock);
+
+    for (LiveRecordsMap::const_iterator it = _liveRecords.begin(); it != _liveRecords.end(); ++it) {
+        for (std::list<LiveRecord>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+            filePaths->insert(it2->filePath);
+        }
+    }
+}
+
+std::size_t
+CacheIndexFile::getRecordsCount() const
+{
+    QMutexLocker k(&_lock);
+
+    return _recordsCount;
+}
+
+bool
+CacheIndexFile::needsCompaction() const
+{
+    QMutexLocker k(&_lock);
+    U64 liveSize = _usedSize - sizeof(IndexFileHeader) - std::min(_deadSize, _usedSize - sizeof(IndexFileHeader) );
+
+    return _deadSize > NATRON_CACHE_INDEX_COMPACTION_MIN_BYTES && _deadSize > liveSize;
+}
+
+void
+CacheIndexFile::compact()
+{
+    QMutexLocker k(&_lock);
+    std::string tmpPath = _filePath + ".tmp";
+
+    // Keep the records in the order they were written, so that removeOldestUnloadedRecord() still removes the oldest
+    std::map<U64, LiveRecord*> orderedRecords;
+    U64 liveSize = sizeof(IndexFileHeader);
+    for (LiveRecordsMap::iterator it = _liveRecords.begin(); it != _liveRecords.end(); ++it) {
+        for (std::list<LiveRecord>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+            orderedRecords[it2->recordOffset] = &*it2;
+            liveSize += it2->recordSize;
+        }
+    }
+
+    std::map<U64, U64> unloadedRecords;
+    try {
+        MemoryFile tmpFile(tmpPath, std::max( (U64)NATRON_CACHE_INDEX_INITIAL_SIZE, liveSize * 2 ), MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        std::memcpy( tmpFile.data(), _file.data(), sizeof(IndexFileHeader) );
+        U64 offset = sizeof(IndexFileHeader);
+        for (std::map<U64, LiveRecord*>::iterator it = orderedRecords.begin(); it != orderedRecords.end(); ++it) {
+            std::memcpy( tmpFile.data() + offset, _file.data() + it->first, it->second->recordSize );
+            if (!it->second->loaded) {
+                unloadedRecords[offset] = _unloadedRecords[it->first];
+            }
+            it->second->recordOffset = offset;
+            offset += it->second->recordSize;
+        }
+        tmpFile.flush(MemoryFile::eFlushTypeSync, 0, 0);
+    } catch (const std::exception& e) {
+        qDebug() << "Failed to compact the cache index:" << e.what();
+        // Restore the offsets of the records
+        for (std::map<U64, LiveRecord*>::iterator it = orderedRecords.begin(); it != orderedRecords.end(); ++it) {
+            it->second->recordOffset = it->first;
+        }
+        QFile::remove( QString::fromUtf8( tmpPath.c_str() ) );
+
+        return;
+    }
+
+    // If interrupted past this point, openFile() completes the replacement
+    _file.remove();
+    QFile::rename( QString::fromUtf8( tmpPath.c_str() ), QString::fromUtf8( _filePath.c_str() ) );
+    _file.open(_filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate);
+    if ( !_file.data() ) {
+        // The new index could not be opened, start over with an empty one
+        qDebug() << "Failed to open the compacted cache index" << _filePath.c_str();
+        initHeader();
+        scan();
+
+        return;
+    }
+    _usedSize = liveSize;
+    _deadSize = 0;
+    _unloadedRecords.swap(unloadedRecords);
+} // CacheIndexFile::compact
+
+void
+CacheIndexFile::sync()
+{
+    QMutexLocker k(&_lock);
+
+    _file.flush(MemoryFile::eFlushTypeSync, 0, 0);
+}
+
+NATRON_NAMESPACE_EXIT
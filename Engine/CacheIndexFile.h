@@ -0,0 +1,201 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_CACHEINDEXFILE_H
+#define NATRON_ENGINE_CACHEINDEXFILE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include <QtCore/QMutex>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/MemoryFile.h"
+
+#include "Engine/EngineFwd.h"
+
+// Name of the index file, in the folder of the cache
+#define NATRON_CACHE_INDEX_FILE_NAME "index." NATRON_CACHE_FILE_EXT
+
+// The index is compacted when it holds more than this many bytes of removed records, and more removed than live records
+#define NATRON_CACHE_INDEX_COMPACTION_MIN_BYTES (1024 * 1024)
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The table of contents of a disk cache, stored in an append-only file that is memory-mapped.
+ * Each time an entry is written to the disk portion of the cache, a record holding its hash, backing file and
+ * serialized key is appended. Each time its backing file is removed, a removal record is appended. The file is never
+ * rewritten as a whole, so that it survives a crash: a record partially written is detected by its checksum and
+ * ignored.
+ * When the index is opened, only the fixed-size part and the file path of the records are read and checked: the entries
+ * are not created. The cache calls takeUnloadedRecords() when an entry is looked up, which checks the serialized key of
+ * the entry with a separate checksum, so that the cache is usable right away whatever its size.
+ * When too many records were removed, compact() rewrites the live records to a new file.
+ * This class is MT-safe.
+ **/
+class CacheIndexFile
+{
+public:
+
+    struct Record
+    {
+        U64 hash;
+        U64 dataSize;
+        U64 dataOffsetInFile;
+        std::string filePath;
+
+        // The serialized key and parameters of the entry
+        std::string payload;
+
+        Record()
+            : hash(0)
+            , dataSize(0)
+            , dataOffsetInFile(0)
+            , filePath()
+            , payload()
+        {
+        }
+    };
+
+    /**
+     * @brief Opens the index at the given path, creating it if needed.
+     * If the index was written by another version of the cache or is corrupted, it is emptied and wasReset() returns true.
+     * This function throws a std::runtime_error if the file cannot be opened.
+     **/
+    CacheIndexFile(const std::string& filePath,
+                   unsigned int cacheVersion);
+
+    ~CacheIndexFile();
+
+    bool wasReset() const
+    {
+        return _wasReset;
+    }
+
+    /**
+     * @brief Returns the records of the given hash whose entry was not created yet by the cache, and considers them
+     * created from now on. The payload of a record that does not match its checksum is left empty.
+     **/
+    void takeUnloadedRecords(U64 hash, std::list<Record>* records);
+
+    /**
+     * @brief Returns the total size of the data of the entries not created yet by the cache
+     **/
+    U64 getUnloadedDataSize() const;
+
+    /**
+     * @brief Records that an entry is stored on disk. Does nothing if it is already recorded.
+     **/
+    void recordAdd(const Record& record);
+
+    /**
+     * @brief Records that the backing file of an entry was removed. Does nothing if it is not recorded.
+     **/
+    void recordRemove(U64 hash, const std::string& filePath, U64 dataOffsetInFile);
+
+    /**
+     * @brief Records the removal of the oldest entry not created yet by the cache, so that the cache can remove its file.
+     * Returns false if all the recorded entries were created.
+     **/
+    bool removeOldestUnloadedRecord(Record* record);
+
+    /**
+     * @brief Same as removeOldestUnloadedRecord() but does not write to the index: the caller must call recordRemove()
+     * with the returned record later on. Until then, the record is not returned by takeUnloadedRecords().
+     **/
+    bool takeOldestUnloadedRecord(Record* record);
+
+    /**
+     * @brief Adds to filePaths the backing files of the recorded entries
+     **/
+    void getFilePaths(std::set<std::string>* filePaths) const;
+
+    std::size_t getRecordsCount() const;
+
+    bool needsCompaction() const;
+
+    /**
+     * @brief Rewrites the live records to a new file which then replaces the index.
+     **/
+    void compact();
+
+    /**
+     * @brief Flushes the index to the disk
+     **/
+    void sync();
+
+private:
+
+    struct LiveRecord
+    {
+        U64 recordOffset;
+        U64 recordSize;
+        U64 dataSize;
+        U64 dataOffsetInFile;
+        std::string filePath;
+        bool loaded;
+    };
+
+    typedef std::map<U64, std::list<LiveRecord> > LiveRecordsMap;
+
+    void openFile();
+
+    void initHeader();
+
+    void scan();
+
+    void append(int type, const Record& record, U64* recordOffset, U64* recordSize);
+
+    void eraseLiveRecord(LiveRecordsMap::iterator it, std::list<LiveRecord>::iterator it2);
+
+    mutable QMutex _lock;
+    std::string _filePath;
+    unsigned int _cacheVersion;
+    MemoryFile _file;
+
+    // Number of bytes of the file holding valid records, the rest of the file is zeroes
+    U64 _usedSize;
+
+    // Bytes of the records that were removed, and of the removal records
+    U64 _deadSize;
+    LiveRecordsMap _liveRecords;
+
+    // The records not created by the cache yet: record offset -> hash
+    std::map<U64, U64> _unloadedRecords;
+    U64 _unloadedDataSize;
+    std::size_t _recordsCount;
+    bool _wasReset;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEINDEXFILE_H
@@ -31,7 +31,9 @@
 #include <list>
 #include <set>
 #include <cstddef>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
@@ -76,10 +78,18 @@ void
 Cache<EntryType>::save(CacheTOC* tableOfContents)
 {
     clearInMemoryPortion(false);
-    {
-        QMutexLocker l(&_lock);     // must be locked
+    if (_index) {
+        // Every entry moved to the disk portion is already recorded in the index
+        _writeBehindQueue.waitForPendingWrites();
+        _index->sync();
+
+        return;
+    }
+    for (std::size_t i = 0; i < _shards.size(); ++i) {
+        CacheShard& shard = *_shards[i];
+        QMutexLocker l(&shard.lock);     // must be locked
 
-        for (ConstCacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
+        for (ConstCacheIterator it = shard.diskCache.begin(); it != shard.diskCache.end(); ++it) {
             const std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
             for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
                 if ( (*it2)->isStoredOnDisk() ) {
@@ -154,8 +164,21 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         const std::string& filePath = value->getFilePath();
         usedFilePaths.insert(QString::fromUtf8(filePath.c_str()));
         {
-            QMutexLocker locker(&_lock);
-            sealEntry(EntryTypePtr(value), false /*inMemory*/);
+            EntryTypePtr entry(value);
+            CacheShard& shard = getShard( entry->getHashKey() );
+            QMutexLocker locker(&shard.lock);
+            sealEntry(shard, entry, false /*inMemory*/);
+
+            // The table of contents was written by a version without index: record the entry from now on
+            addToIndex(entry, it->size);
+        }
+    }
+
+    if (_index) {
+        std::set<std::string> indexedFilePaths;
+        _index->getFilePaths(&indexedFilePaths);
+        for (std::set<std::string>::const_iterator it = indexedFilePaths.begin(); it != indexedFilePaths.end(); ++it) {
+            usedFilePaths.insert( QString::fromUtf8( it->c_str() ) );
         }
     }
 
@@ -230,6 +253,53 @@ struct Cache<EntryType>::SerializedEntry
     }
 };
 
+template<typename EntryType>
+class Cache<EntryType>::IndexSerializer
+    : public Cache<EntryType>::IndexSerializerBase
+{
+public:
+
+    IndexSerializer()
+    {
+    }
+
+    virtual ~IndexSerializer()
+    {
+    }
+
+    virtual void serialize(const key_t& key,
+                           const ParamsTypePtr& params,
+                           std::string* payload) const OVERRIDE FINAL
+    {
+        std::ostringstream ss;
+        {
+            // The version is in the header of the index, no need to repeat the archive header in each record
+            boost::archive::binary_oarchive oArchive(ss, boost::archive::no_header);
+            oArchive << key;
+            oArchive << params;
+        }
+        *payload = ss.str();
+    }
+
+    virtual bool deserialize(const std::string& payload,
+                             key_t* key,
+                             ParamsTypePtr* params) const OVERRIDE FINAL
+    {
+        try {
+            std::istringstream ss(payload);
+            boost::archive::binary_iarchive iArchive(ss, boost::archive::no_header);
+            iArchive >> *key;
+            iArchive >> *params;
+        } catch (const std::exception & e) {
+            qDebug() << "Exception when reading a cache index record:" << e.what();
+
+            return false;
+        }
+
+        return true;
+    }
+};
+
 NATRON_NAMESPACE_EXIT
 
 
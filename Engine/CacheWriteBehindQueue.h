@@ -0,0 +1,291 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_CACHEWRITEBEHINDQUEUE_H
+#define NATRON_ENGINE_CACHEWRITEBEHINDQUEUE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <list>
+#include <vector>
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/Timer.h"
+
+#include "Engine/EngineFwd.h"
+
+// Number of threads writing the entries evicted from the in-memory portion of a cache to their backing file
+#define NATRON_CACHE_WRITE_BEHIND_THREADS 2
+
+// Maximum number of entries waiting to be written: past this, the thread evicting an entry writes it itself
+#define NATRON_CACHE_WRITE_BEHIND_MAX_PENDING 64
+
+// Maximum number of entries a writer thread takes from the queue at once
+#define NATRON_CACHE_WRITE_BEHIND_BATCH 8
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Statistics of a CacheWriteBehindQueue, see CacheWriteBehindQueue::getStats()
+ **/
+struct CacheWriteBehindStats
+{
+    // Number of entries waiting to be written or being written
+    std::size_t queueDepth;
+
+    // Number of entries and bytes written so far, and time in seconds spent writing them
+    U64 writtenEntries;
+    U64 writtenBytes;
+    double writeTime;
+
+    CacheWriteBehindStats()
+        : queueDepth(0)
+        , writtenEntries(0)
+        , writtenBytes(0)
+        , writeTime(0.)
+    {
+    }
+
+    double getThroughput() const
+    {
+        return writeTime <= 0. ? 0. : writtenBytes / writeTime;
+    }
+};
+
+/**
+ * @brief When an entry stored on disk is evicted from the in-memory portion of a cache, its mapping must be flushed
+ * and closed, which calls msync and may block for a long time on slow storage. Instead of doing so on the render thread
+ * evicting the entry, the cache hands the entry over to this queue: a few writer threads call T::writeBehind() on it.
+ * Until then the entry stays mapped, so that a hit on it just cancels the write, see CacheEntryHelper::cancelPendingWrite().
+ * The writer threads never lock the cache shards. The queue is bounded: appendToQueue() returns false when full and the
+ * caller must write the entry itself.
+ **/
+template <typename T>
+class CacheWriteBehindQueue
+{
+    typedef boost::shared_ptr<T> TPtr;
+
+    class WriterThread
+        : public QThread
+    {
+        CacheWriteBehindQueue* _queue;
+
+    public:
+
+        WriterThread(CacheWriteBehindQueue* queue)
+            : QThread()
+            , _queue(queue)
+        {
+            setObjectName( QString::fromUtf8("CacheWriteBehind") );
+        }
+
+    private:
+
+        virtual void run() OVERRIDE FINAL
+        {
+            _queue->runWriter();
+        }
+    };
+
+    typedef boost::shared_ptr<WriterThread> WriterThreadPtr;
+
+    mutable QMutex _queueMutex;
+    std::list<TPtr> _queue;
+    QWaitCondition _queueNotEmptyCond;
+    QWaitCondition _queueEmptyCond;
+
+    // Number of entries taken from the queue by the writer threads and not written yet
+    std::size_t _nWriting;
+    bool _mustQuit;
+    std::vector<WriterThreadPtr> _threads;
+    std::atomic<U64> _writtenEntries;
+    std::atomic<U64> _writtenBytes;
+    std::atomic<U64> _writeMicroSeconds;
+
+public:
+
+    CacheWriteBehindQueue()
+        : _queueMutex()
+        , _queue()
+        , _queueNotEmptyCond()
+        , _queueEmptyCond()
+        , _nWriting(0)
+        , _mustQuit(false)
+        , _threads()
+        , _writtenEntries(0)
+        , _writtenBytes(0)
+        , _writeMicroSeconds(0)
+    {
+    }
+
+    ~CacheWriteBehindQueue()
+    {
+        quitThreads();
+    }
+
+    /**
+     * @brief Appends an entry on which T::setPendingWrite() was called. Returns false if the queue is full,
+     * in which case the entry was not appended.
+     **/
+    bool appendToQueue(const TPtr& entry)
+    {
+        QMutexLocker k(&_queueMutex);
+
+        if (_mustQuit || _queue.size() + _nWriting >= NATRON_CACHE_WRITE_BEHIND_MAX_PENDING) {
+            return false;
+        }
+        if ( _threads.empty() ) {
+            for (int i = 0; i < NATRON_CACHE_WRITE_BEHIND_THREADS; ++i) {
+                WriterThreadPtr thread(new WriterThread(this));
+                thread->start();
+                _threads.push_back(thread);
+            }
+        }
+        _queue.push_back(entry);
+        _queueNotEmptyCond.wakeOne();
+
+        return true;
+    }
+
+    /**
+     * @brief Blocks until all the entries appended so far are written.
+     **/
+    void waitForPendingWrites()
+    {
+        QMutexLocker k(&_queueMutex);
+
+        while ( !_queue.empty() || (_nWriting > 0) ) {
+            _queueEmptyCond.wait(k.mutex());
+        }
+    }
+
+    /**
+     * @brief Writes the remaining entries and stops the writer threads.
+     **/
+    void quitThreads()
+    {
+        std::vector<WriterThreadPtr> threads;
+        {
+            QMutexLocker k(&_queueMutex);
+            _mustQuit = true;
+            _queueNotEmptyCond.wakeAll();
+            threads.swap(_threads);
+        }
+        for (std::size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->wait();
+        }
+        QMutexLocker k(&_queueMutex);
+        _mustQuit = false;
+    }
+
+    void getStats(CacheWriteBehindStats* stats) const
+    {
+        {
+            QMutexLocker k(&_queueMutex);
+            stats->queueDepth = _queue.size() + _nWriting;
+        }
+        stats->writtenEntries = _writtenEntries;
+        stats->writtenBytes = _writtenBytes;
+        stats->writeTime = _writeMicroSeconds / 1000000.;
+    }
+
+private:
+
+    static bool compareEntriesLocation(const TPtr& a,
+                                       const TPtr& b)
+    {
+        int c = a->getFilePath().compare( b->getFilePath() );
+
+        return c < 0 || ( c == 0 && a->getOffsetInFile() < b->getOffsetInFile() );
+    }
+
+    void runWriter()
+    {
+        for (;; ) {
+            std::vector<TPtr> batch;
+            {
+                QMutexLocker k(&_queueMutex);
+                while ( _queue.empty() && !_mustQuit ) {
+                    _queueNotEmptyCond.wait(k.mutex());
+                }
+                if ( _queue.empty() ) {
+                    // _mustQuit is set and everything was written
+                    return;
+                }
+                while ( !_queue.empty() && batch.size() < NATRON_CACHE_WRITE_BEHIND_BATCH ) {
+                    batch.push_back( _queue.front() );
+                    _queue.pop_front();
+                }
+                _nWriting += batch.size();
+            }
+
+            // Write entries in file order, so that tiles adjacent in the same file are flushed one after the other
+            std::sort(batch.begin(), batch.end(), compareEntriesLocation);
+
+            TimeLapse timer;
+            U64 bytes = 0;
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                try {
+                    bytes += batch[i]->writeBehind();
+                } catch (const std::exception & e) {
+                    qDebug() << "Error while writing a cache entry to disk: " << e.what();
+                }
+            }
+            _writeMicroSeconds += (U64)(timer.getTimeSinceCreation() * 1000000.);
+            _writtenBytes += bytes;
+            _writtenEntries += batch.size();
+
+            // Release the entries before telling waitForPendingWrites() they are written, so that they can be evicted
+            std::size_t nWritten = batch.size();
+            batch.clear();
+            {
+                QMutexLocker k(&_queueMutex);
+                _nWriting -= nWritten;
+                if ( _queue.empty() && (_nWriting == 0) ) {
+                    _queueEmptyCond.wakeAll();
+                }
+            }
+        }
+    }
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEWRITEBEHINDQUEUE_H
@@ -76,6 +76,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/ReadNode.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
+#include "Engine/TraceRecorder.h"
 #include "Engine/Transform.h"
 #include "Engine/UndoCommand.h"
 #include "Engine/ViewIdx.h"
@@ -1664,6 +1665,10 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
         // For textures, we lookup for a RAM image, if found we convert it to a texture
         if ( (storage == eStorageModeRAM) || (storage == eStorageModeGLTex) ) {
             isCached = appPTR->getImage(key, &cachedImages);
+            if (!isCached) {
+                // Another process of this computer may have rendered it already
+                isCached = appPTR->getImageFromSharedCache(key, &cachedImages);
+            }
         } else if (storage == eStorageModeDisk) {
             isCached = appPTR->getImage_diskCache(key, &cachedImages);
         }
@@ -1737,6 +1742,8 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
 
 
             if (imageToConvert->getMipMapLevel() != mipMapLevel) {
+                appPTR->notifyNodeCacheHitNeedingDownscale(key);
+
                 ImageParamsPtr oldParams = imageToConvert->getParams();
 
                 assert(imageToConvert->getMipMapLevel() < mipMapLevel);
@@ -2160,6 +2167,10 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
         appPTR->getAppTLS()->copyTLS(callingThread, curThread);
     }
 
+    TraceScope trace("render", "tile", _publicInterface, args.time);
+    if ( trace.isActive() ) {
+        trace.setRect(specificData.rect);
+    }
 
     EffectInstance::RenderingFunctorRetEnum ret = tiledRenderingFunctor(specificData,
                                                                         args.renderFullScaleThenDownscale,
@@ -2181,8 +2192,11 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
                                                                         args.processChannels,
                                                                         args.planes);
 
-    //Exit of the host frame threading thread
-    appPTR->getAppTLS()->cleanupTLSForThread();
+    //Exit of the host frame threading thread. The calling thread may render some of the tiles itself while it
+    //waits for the others, it must keep its TLS.
+    if (callingThread != curThread) {
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
 
     return ret;
 }
@@ -2407,13 +2421,10 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                                               const ImagePremultiplicationEnum originalImagePremultiplication,
                                               ImagePlanesToRender & planes)
 {
-    TimeLapsePtr timeRecorder;
+    // Always timed: the render time is also recorded on the images for the cost-aware cache eviction
+    TimeLapsePtr timeRecorder = boost::make_shared<TimeLapse>();
     const ParallelRenderArgsPtr& frameArgs = tls->frameArgs.back();
 
-    if (frameArgs->stats) {
-        timeRecorder = boost::make_shared<TimeLapse>();
-    }
-
     const EffectInstance::PlaneToRender & firstPlane = planes.planes.begin()->second;
     const double time = tls->currentRenderArgs.time;
     const ViewIdx view = tls->currentRenderArgs.view;
@@ -2757,6 +2768,22 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
 
     assert(!renderAborted);
 
+    const double renderTime = timeRecorder->getTimeSinceCreation();
+    if (!planes.useOpenGL) {
+        recordRenderCost(renderMappedRectToRender, renderTime);
+    }
+
+    // Split the time spent rendering this rectangle between the planes, the images accumulate it over all rectangles
+    const double renderCost = renderTime / std::max( (std::size_t)1, outputPlanes.size() );
+    for (std::map<ImagePlaneDesc, EffectInstance::PlaneToRender>::const_iterator it = outputPlanes.begin(); it != outputPlanes.end(); ++it) {
+        if (it->second.fullscaleImage) {
+            it->second.fullscaleImage->addRenderCost(renderCost);
+        }
+        if ( it->second.downscaleImage && (it->second.downscaleImage != it->second.fullscaleImage) ) {
+            it->second.downscaleImage->addRenderCost(renderCost);
+        }
+    }
+
     bool unPremultIfNeeded = planes.outputPremult == eImagePremultiplicationPremultiplied;
     bool useMaskMix = _publicInterface->isHostMaskingEnabled() || _publicInterface->isHostMixingEnabled();
     double mix = useMaskMix ? _publicInterface->getNode()->getHostMixingValue(time, view) : 1.;
@@ -2833,10 +2860,8 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                 }
 
                 if (mappedOriginalInputImage) {
-                    it->second.tmpImage->copyUnProcessedChannels(renderMappedRectToRender, planes.outputPremult, originalImagePremultiplication, processChannels, mappedOriginalInputImage, true);
-                    if (useMaskMix) {
-                        it->second.tmpImage->applyMaskMix(renderMappedRectToRender, maskImage.get(), mappedOriginalInputImage.get(), doMask, false, mix);
-                    }
+                    it->second.tmpImage->copyUnProcessedChannelsMaskMixAndPremult(renderMappedRectToRender, planes.outputPremult, originalImagePremultiplication, processChannels, mappedOriginalInputImage, true,
+                                                                                  useMaskMix, maskImage.get(), doMask, false, mix, false);
                 }
                 if ( ( it->second.fullscaleImage->getComponents() != it->second.tmpImage->getComponents() ) ||
                      ( it->second.fullscaleImage->getBitDepth() != it->second.tmpImage->getBitDepth() ) ) {
@@ -2885,6 +2910,18 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
 
 
             } else { // if (renderFullScaleThenDownscale) {
+                /*
+                 * When only the bit depth differs (e.g: the image is cached at half precision), the unprocessed channels and the mask
+                 * are applied on the temporary image, which has the same depth as the original input image.
+                 */
+                bool processTmpImage = it->second.tmpImage != it->second.downscaleImage &&
+                                       it->second.downscaleImage->getComponents() == it->second.tmpImage->getComponents() &&
+                                       it->second.downscaleImage->getBitDepth() != it->second.tmpImage->getBitDepth();
+                if (processTmpImage) {
+                    it->second.tmpImage->copyUnProcessedChannelsMaskMixAndPremult(actionArgs.roi, planes.outputPremult, originalImagePremultiplication, processChannels, originalInputImage, true,
+                                                                                  useMaskMix, maskImage.get(), doMask, false, mix, false);
+                }
+
                 ///Copy the rectangle rendered in the downscaled image
                 if (it->second.tmpImage != it->second.downscaleImage) {
                     // We cannot be rendering using OpenGL in this case
@@ -2910,9 +2947,9 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                     }
                 }
 
-                it->second.downscaleImage->copyUnProcessedChannels(actionArgs.roi, planes.outputPremult, originalImagePremultiplication, processChannels, originalInputImage, true, glContext);
-                if (useMaskMix) {
-                    it->second.downscaleImage->applyMaskMix(actionArgs.roi, maskImage.get(), originalInputImage.get(), doMask, false, mix, glContext);
+                if (!processTmpImage) {
+                    it->second.downscaleImage->copyUnProcessedChannelsMaskMixAndPremult(actionArgs.roi, planes.outputPremult, originalImagePremultiplication, processChannels, originalInputImage, true,
+                                                                                        useMaskMix, maskImage.get(), doMask, false, mix, false, glContext);
                 }
             } // if (renderFullScaleThenDownscale) {
         } // if (it->second.isAllocatedOnTheFly) {
@@ -2956,6 +2993,12 @@ EffectInstance::allocateImagePlaneAndSetInThreadLocalStorage(const ImagePlaneDes
     }
     const ImagePtr & img = firstPlane.fullscaleImage->usesBitMap() ? firstPlane.fullscaleImage : firstPlane.downscaleImage;
     ImageParamsPtr params = img->getParams();
+
+    // The plug-in renders directly in planes allocated on the fly, never at the half precision used by the cache
+    ImageBitDepthEnum planeDepth = img->getBitDepth();
+    if (planeDepth == eImageBitDepthHalf) {
+        planeDepth = getBitDepth(-1);
+    }
     EffectInstance::PlaneToRender p;
     bool ok = allocateImagePlane(img->getKey(),
                                  tls->currentRenderArgs.rod,
@@ -2963,7 +3006,7 @@ EffectInstance::allocateImagePlaneAndSetInThreadLocalStorage(const ImagePlaneDes
                                  tls->currentRenderArgs.renderWindowPixel,
                                  false /*isProjectFormat*/,
                                  plane,
-                                 img->getBitDepth(),
+                                 planeDepth,
                                  img->getPremultiplication(),
                                  img->getFieldingOrder(),
                                  img->getPixelAspectRatio(),
@@ -434,6 +434,8 @@ EffectInstance::Implementation::Implementation(EffectInstance* publicInterface)
     , renderClonesMutex()
     , renderClonesPool()
     , mustSyncPrivateData(false)
+    , renderCostMutex()
+    , renderCostPerPixel(0.)
 {
     tlsData = boost::make_shared<TLSHolder<EffectTLSData> >();
     actionsCache = boost::make_shared<ActionsCache>(appPTR->getHardwareIdealThreadCount() * 2);
@@ -467,10 +469,43 @@ EffectInstance::Implementation::Implementation(const Implementation& other)
 , isDoingInstanceSafeRender(false)
 , renderClonesMutex()
 , renderClonesPool()
+, renderCostMutex()
+, renderCostPerPixel(0.)
 {
 
 }
 
+void
+EffectInstance::Implementation::recordRenderCost(const RectI& rect,
+                                                 double seconds)
+{
+    if (mainInstance) {
+        mainInstance->_imp->recordRenderCost(rect, seconds);
+
+        return;
+    }
+    const double area = (double)rect.width() * rect.height();
+    if (area <= 0.) {
+        return;
+    }
+    const double cost = seconds * 1e9 / area;
+
+    QMutexLocker k(&renderCostMutex);
+    // Moving average: the cost depends on the parameters, the recent renders are the best estimate
+    renderCostPerPixel = (renderCostPerPixel == 0.) ? cost : renderCostPerPixel * 0.75 + cost * 0.25;
+}
+
+double
+EffectInstance::Implementation::getRenderCostPerPixel() const
+{
+    if (mainInstance) {
+        return mainInstance->_imp->getRenderCostPerPixel();
+    }
+    QMutexLocker k(&renderCostMutex);
+
+    return renderCostPerPixel;
+}
+
 void
 EffectInstance::Implementation::runChangedParamCallback(KnobI* k,
                                                         bool userEdited,
@@ -246,11 +246,24 @@ public:
     bool mustSyncPrivateData; //!< true if the effect's knobs were changed but instanceChanged could not be called (e.g. when loading a PyPlug), so that syncPrivateData should be called in getPreferredMetadata_public before calling getPreferredMetadata
     mutable QMutex mustSyncPrivateDataMutex; //!< protects mustSyncPrivateData
 
+    ///Average time spent by the render action per pixel in nanoseconds, 0 until a render was timed.
+    ///It decides how finely the render window of eRenderSafetyFullySafeFrame effects is split.
+    mutable QMutex renderCostMutex;
+    double renderCostPerPixel;
+
 public:
     void runChangedParamCallback(KnobI* k, bool userEdited, const std::string & callback);
 
     void setDuringInteractAction(bool b);
 
+    /**
+     * @brief Accounts the time spent rendering rect in the average cost per pixel of the effect.
+     * Render clones account it in their main instance.
+     **/
+    void recordRenderCost(const RectI& rect, double seconds);
+
+    double getRenderCostPerPixel() const;
+
 #if NATRON_ENABLE_TRIMAP
     void markImageAsBeingRendered(const ImagePtr & img, const RectI& roi, std::list<RectI>* restToRender, bool *renderedElsewhere);
 
@@ -36,11 +36,9 @@
 
 #include <boost/scoped_ptr.hpp>
 
-#include <QtCore/QThreadPool>
+#include <QtCore/QThread>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QCoreApplication>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
-#include <QtConcurrentRun> // QtCore on Qt4, QtConcurrent on Qt5
 
 #if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
@@ -71,10 +69,13 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/PluginMemory.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RoISplitter.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Timer.h"
+#include "Engine/TraceRecorder.h"
 #include "Engine/Transform.h"
 #include "Engine/ThreadPool.h"
 #include "Engine/ViewIdx.h"
@@ -343,6 +344,11 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         return _imp->mainInstance->renderRoI(args, outputPlanes);
     }
 
+    TraceScope trace("render", "renderRoI", this, args.time);
+    if ( trace.isActive() ) {
+        trace.setRect(args.roi);
+    }
+
     //Create the TLS data for this node if it did not exist yet
     EffectTLSDataPtr tls = _imp->tlsData->getOrCreateTLSData();
     assert(tls);
@@ -926,6 +932,17 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
      * that the plug-in expects.
      */
     ImageBitDepthEnum outputDepth = getBitDepth(-1);
+
+    /*
+     * Floating point images may be kept in the RAM cache at half precision: the plug-in still renders in a temporary
+     * floating point image (see tiledRenderingFunctor) and the result is converted back to args.bitdepth before returning.
+     * Nodes painting over themselves render directly in the cached image, hence they keep the requested depth.
+     */
+    ImageBitDepthEnum cacheDepth = args.bitdepth;
+    if ( (args.bitdepth == eImageBitDepthFloat) && (storage == eStorageModeRAM) && !isDuringPaintStroke &&
+         !isPaintingOverItselfEnabled() && appPTR->getCurrentSettings()->isHalfFloatCachingEnabled() ) {
+        cacheDepth = eImageBitDepthHalf;
+    }
     ImagePlaneDesc outputClipPrefComps, outputClipPrefCompsPaired;
     getMetadataComponents(-1, &outputClipPrefComps, &outputClipPrefCompsPaired);
     ImagePlanesToRenderPtr planesToRender = boost::make_shared<ImagePlanesToRender>();
@@ -965,6 +982,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
             //For writers, we always want to call the render action when doing a sequential render, but we still want to use the cache for nodes upstream
             bool doCacheLookup = !isWriter() || !frameArgs->isSequentialRender;
             if (doCacheLookup) {
+                TraceScope cacheTrace("cache", "lookup", this, args.time);
                 int nLookups = draftModeSupported && frameArgs->draftMode ? 2 : 1;
 
                 // If the node doesn't support render scale, first lookup the cache with requested level, if not cached then lookup
@@ -974,7 +992,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                     getImageFromCacheAndConvertIfNeeded(createInCache, storage, args.returnStorage, n == 0 ? *nonDraftKey : *key, lookupMipMapLevel,
                                                         &downscaledImageBounds,
                                                         &rod, args.roi,
-                                                        args.bitdepth, *it,
+                                                        cacheDepth, *it,
                                                         args.inputImagesList,
                                                         frameArgs->stats,
                                                         glContextLocker,
@@ -1006,7 +1024,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                         getImageFromCacheAndConvertIfNeeded(createInCache, storage, args.returnStorage, n == 0 ? *nonDraftKey : *key, renderMappedMipMapLevel,
                                                             &upscaledImageBounds,
                                                             &rod, roi,
-                                                            args.bitdepth, *it,
+                                                            cacheDepth, *it,
                                                             args.inputImagesList,
                                                             frameArgs->stats,
                                                             glContextLocker,
@@ -1269,8 +1287,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         // but if the effect doesn't support tiles it won't work.
         // Also check that the number of threads indicating by the settings are appropriate for this render mode.
         if ( !frameArgs->tilesSupported || (nbThreads == -1) || (nbThreads == 1) ||
-            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ||
-            ( QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount() )) {
+            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ) {
             safety = eRenderSafetyFullySafe;
         }
     }
@@ -1279,24 +1296,24 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
     if (tryIdentityOptim) {
         optimizeRectsToRender(this, inputsRoDIntersectionPixel, rectsLeftToRender, args.time, args.view, renderMappedScale, &planesToRender->rectsToRender);
     } else {
-        // If plug-in wants host frame threading and there is only 1 rect to render, split it
-        /*if (safety == eRenderSafetyFullySafeFrame && rectsLeftToRender.size() == 1 && frameArgs->tilesSupported) {
-            QThreadPool* tp = QThreadPool::globalInstance();
-            int nThreads = (tp->maxThreadCount() - tp->activeThreadCount());
-
-            std::vector<RectI> splits;
-            if (nThreads > 1) {
-                splits = rectsLeftToRender.front().splitIntoSmallerRects(nThreads);
-            } else {
-                splits.push_back(rectsLeftToRender.front());
+        // If plug-in wants host frame threading and there is only 1 rect to render, split it so that the idle threads work on it
+        if ( (safety == eRenderSafetyFullySafeFrame) && (rectsLeftToRender.size() == 1) && !planesToRender->useOpenGL ) {
+            int nThreadsToRender, nThreadsPerEffect;
+            appPTR->getNThreadsSettings(&nThreadsToRender, &nThreadsPerEffect);
+
+            RoISplitParams splitParams;
+            splitParams.threadsCount = TaskScheduler::instance()->getIdleWorkersCount() + 1;
+            if (nThreadsPerEffect > 0) {
+                splitParams.threadsCount = std::min(splitParams.threadsCount, nThreadsPerEffect);
             }
-            for (std::vector<RectI>::iterator it = splits.begin(); it != splits.end(); ++it) {
-                RectToRender r;
-                r.rect = *it;
-                r.isIdentity = false;
-                planesToRender->rectsToRender.push_back(r);
-            }
-        }*/
+            splitParams.bytesPerPixel = std::max( 1, outputClipPrefComps.getNumComponents() * getSizeOfForBitDepth(outputDepth) );
+            splitParams.minTileSize = appPTR->getCurrentSettings()->getHostFrameThreadingMinTileSize();
+            splitParams.costPerPixel = _imp->getRenderCostPerPixel();
+
+            std::vector<RectI> splits = splitRoIForThreads(rectsLeftToRender.front(), splitParams);
+            rectsLeftToRender.clear();
+            rectsLeftToRender.insert( rectsLeftToRender.end(), splits.begin(), splits.end() );
+        }
         for (std::list<RectI>::iterator it = rectsLeftToRender.begin(); it != rectsLeftToRender.end(); ++it) {
             RectToRender r;
             r.rect = *it;
@@ -1328,6 +1345,8 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         }
         RenderRoIRetCode inputCode;
         {
+            // Time spent waiting for the input images to be rendered or fetched from the cache
+            TraceScope inputsTrace("render", "inputs", this, args.time);
             RectD canonicalRoI;
             if (renderFullScaleThenDownscale) {
                 it->rect.toCanonical(0, par, rod, &canonicalRoI);
@@ -1422,7 +1441,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                                    upscaledImageBounds,
                                    isProjectFormat,
                                    *components,
-                                   args.bitdepth,
+                                   cacheDepth,
                                    planesToRender->outputPremult,
                                    fieldingOrder,
                                    par,
@@ -1491,7 +1510,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                                                                           downscaledImageBounds,
                                                                           args.mipMapLevel,
                                                                           it->second.fullscaleImage->getPixelAspectRatio(),
-                                                                          outputDepth,
+                                                                          it->second.fullscaleImage->getBitDepth(),
                                                                           planesToRender->outputPremult,
                                                                           fieldingOrder,
                                                                           true);
@@ -1753,6 +1772,11 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
             }
         }
 
+        // Let the other processes of this computer read what was rendered, see SharedImageCache
+        if ( createInCache && !renderAborted && (renderRetCode == eRenderRoIStatusImageRendered) ) {
+            appPTR->publishImageToSharedCache(it->second.fullscaleImage);
+        }
+
         //We have to return the downscale image, so make sure it has been computed
         if ( (renderRetCode != eRenderRoIStatusRenderFailed) &&
              renderFullScaleThenDownscale &&
@@ -1997,14 +2021,16 @@ EffectInstance::renderRoIInternal(EffectInstance* self,
 #else
 
 
-            QFuture<RenderingFunctorRetEnum> ret = QtConcurrent::mapped( planesToRender->rectsToRender,
-                                                                         boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
-                                                                                     self->_imp.get(),
-                                                                                     *tiledArgs,
-                                                                                     _1,
-                                                                                     currentThread) );
-            ret.waitForFinished();
-            QFuture<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
+            // The current thread renders tiles too while waiting, see TaskGroup::wait()
+            std::vector<EffectInstance::RenderingFunctorRetEnum> ret;
+            TaskScheduler::blockingMapped( planesToRender->rectsToRender,
+                                           boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
+                                                       self->_imp.get(),
+                                                       *tiledArgs,
+                                                       _1,
+                                                       currentThread),
+                                           &ret );
+            std::vector<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
 
 #endif
             for (it2 = ret.begin(); it2 != ret.end(); ++it2) {
@@ -79,6 +79,9 @@ SOURCES += \
     BlockingBackgroundRender.cpp \
     CLArgs.cpp \
     Cache.cpp \
+    CacheCompression.cpp \
+    CacheHolderStats.cpp \
+    CacheIndexFile.cpp \
     CoonsRegularization.cpp \
     CreateNodeArgs.cpp \
     Curve.cpp \
@@ -102,16 +105,19 @@ SOURCES += \
     GenericSchedulerThreadWatcher.cpp \
     GroupInput.cpp \
     GroupOutput.cpp \
+    Half.cpp \
     Hash64.cpp \
     HistogramCPU.cpp \
     HostOverlaySupport.cpp \
     Image.cpp \
     ImageConvert.cpp \
+    ImageConvertKernels.cpp \
     ImageCopyChannels.cpp \
     ImageKey.cpp \
     ImageMaskMix.cpp \
     ImageParamsSerialization.cpp \
     ImagePlaneDesc.cpp \
+    ImageStatistics.cpp \
     Interpolation.cpp \
     JoinViewsNode.cpp \
     Knob.cpp \
@@ -123,6 +129,7 @@ SOURCES += \
     Log.cpp \
     Lut.cpp \
     Markdown.cpp \
+    MemoryAllocator.cpp \
     MemoryFile.cpp \
     MemoryInfo.cpp \
     NoOpBase.cpp \
@@ -153,6 +160,7 @@ SOURCES += \
     OneViewNode.cpp \
     OutputEffectInstance.cpp \
     OutputSchedulerThread.cpp \
+    ParallelFramesController.cpp \
     ParallelRenderArgs.cpp \
     Plugin.cpp \
     PluginMemory.cpp \
@@ -172,7 +180,9 @@ SOURCES += \
     ReadNode.cpp \
     RectD.cpp \
     RectI.cpp \
+    RenderPlan.cpp \
     RenderStats.cpp \
+    RoISplitter.cpp \
     RotoContext.cpp \
     RotoDrawableItem.cpp \
     RotoItem.cpp \
@@ -184,15 +194,19 @@ SOURCES += \
     RotoUndoCommand.cpp \
     ScriptObject.cpp \
     Settings.cpp \
+    SharedImageCache.cpp \
     Smooth1D.cpp \
     StandardPaths.cpp \
     StringAnimationManager.cpp \
+    TaskScheduler.cpp \
     TLSHolder.cpp \
     Texture.cpp \
     TextureRect.cpp \
     ThreadPool.cpp \
+    TileCacheFile.cpp \
     TimeLine.cpp \
     Timer.cpp \
+    TraceRecorder.cpp \
     TrackMarker.cpp \
     TrackerContext.cpp \
     TrackerContextPrivate.cpp \
@@ -228,9 +242,14 @@ HEADERS += \
     BufferableObject.h \
     CLArgs.h \
     Cache.h \
+    CacheCompression.h \
     CacheEntry.h \
     CacheEntryHolder.h \
+    CacheEvictionPolicy.h \
+    CacheHolderStats.h \
+    CacheIndexFile.h \
     CacheSerialization.h \
+    CacheWriteBehindQueue.h \
     ChoiceOption.h \
     CoonsRegularization.h \
     CreateNodeArgs.h \
@@ -262,16 +281,19 @@ HEADERS += \
     GenericSchedulerThreadWatcher.h \
     GroupInput.h \
     GroupOutput.h \
+    Half.h \
     Hash64.h \
     HistogramCPU.h \
     HostOverlaySupport.h \
     Image.h \
+    ImageConvertKernels.h \
     ImageKey.h \
     ImageLocker.h \
     ImageParams.h \
     ImageParamsSerialization.h \
     ImagePlaneDesc.h \
     ImageSerialization.h \
+    ImageStatistics.h \
     Interpolation.h \
     JoinViewsNode.h \
     KeyHelper.h \
@@ -288,6 +310,7 @@ HEADERS += \
     LogEntry.h \
     Lut.h \
     Markdown.h \
+    MemoryAllocator.h \
     MemoryFile.h \
     MemoryInfo.h \
     MergingEnum.h \
@@ -320,6 +343,7 @@ HEADERS += \
     OutputEffectInstance.h \
     OutputSchedulerThread.h \
     OverlaySupport.h \
+    ParallelFramesController.h \
     ParallelRenderArgs.h \
     Plugin.h \
     PluginActionShortcut.h \
@@ -342,7 +366,9 @@ HEADERS += \
     RectDSerialization.h \
     RectI.h \
     RectISerialization.h \
+    RenderPlan.h \
     RenderStats.h \
+    RoISplitter.h \
     RotoContext.h \
     RotoContextPrivate.h \
     RotoContextSerialization.h \
@@ -361,10 +387,12 @@ HEADERS += \
     RotoUndoCommand.h \
     ScriptObject.h \
     Settings.h \
+    SharedImageCache.h \
     Singleton.h \
     Smooth1D.h \
     StandardPaths.h \
     StringAnimationManager.h \
+    TaskScheduler.h \
     TLSHolder.h \
     TLSHolderImpl.h \
     Texture.h \
@@ -372,9 +400,11 @@ HEADERS += \
     TextureRectSerialization.h \
     ThreadPool.h \
     ThreadStorage.h \
+    TileCacheFile.h \
     TimeLine.h \
     TimeLineKeyFrames.h \
     Timer.h \
+    TraceRecorder.h \
     TrackMarker.h \
     TrackerContext.h \
     TrackerContextPrivate.h \
@@ -165,6 +165,8 @@ class Image;
 class ImageKey;
 class ImageParams;
 class ImagePlaneDesc;
+struct ImageStatistics;
+struct ImageStatisticsRequest;
 class KeyFrame;
 class KnobBool;
 class KnobButton;
@@ -248,8 +250,11 @@ class RotoPoint;
 class RotoStrokeItem;
 class RotoStrokeItemSerialization;
 class Settings;
+class SharedImageCache;
 class StringAnimationManager;
 class TLSHolderBase;
+class TaskGroup;
+class TaskScheduler;
 class Texture;
 class TextureRect;
 class TileCacheFile;
@@ -413,6 +418,7 @@ typedef boost::shared_ptr<RotoPaintInteract> RotoPaintInteractPtr;
 typedef boost::shared_ptr<RotoStrokeItem> RotoStrokeItemPtr;
 typedef boost::shared_ptr<RotoStrokeItemSerialization> RotoStrokeItemSerializationPtr;
 typedef boost::shared_ptr<Settings> SettingsPtr;
+typedef boost::shared_ptr<SharedImageCache> SharedImageCachePtr;
 typedef boost::shared_ptr<TLSHolderBase const> TLSHolderBaseConstPtr;
 typedef boost::shared_ptr<Texture> GLTexturePtr;
 typedef boost::shared_ptr<Texture> TexturePtr;
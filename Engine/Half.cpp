@@ -0,0 +1,145 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Half.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define NATRON_HALF_F16C
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+#ifdef NATRON_HALF_F16C
+bool
+detectF16C()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if ( !__get_cpuid(1, &eax, &ebx, &ecx, &edx) ) {
+        return false;
+    }
+    // F16C instructions are VEX-encoded: the OS must also save the AVX registers (OSXSAVE, then XCR0 bits 1 and 2)
+    const unsigned int osxsave = 1U << 27;
+    const unsigned int avx = 1U << 28;
+    const unsigned int f16c = 1U << 29;
+    if ( (ecx & (osxsave | avx | f16c)) != (osxsave | avx | f16c) ) {
+        return false;
+    }
+    unsigned int xcr0Low, xcr0High;
+    __asm__ ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+
+    return (xcr0Low & 0x6) == 0x6;
+}
+
+const bool hasF16C = detectF16C();
+
+__attribute__((target("avx,f16c")))
+void
+convertToFloatF16C(const Half* src,
+                   float* dst,
+                   std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm256_storeu_ps( dst + i, _mm256_cvtph_ps(h) );
+    }
+    for (; i < count; ++i) {
+        dst[i] = Half::bitsToFloat( src[i].bits() );
+    }
+}
+
+__attribute__((target("avx,f16c")))
+void
+convertFromFloatF16C(const float* src,
+                     Half* dst,
+                     std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 f = _mm256_loadu_ps(src + i);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT) );
+    }
+    for (; i < count; ++i) {
+        dst[i] = Half::fromBits( Half::floatToBits(src[i]) );
+    }
+}
+#endif // NATRON_HALF_F16C
+} // anon namespace
+
+void
+Half::convertToFloat(const Half* src,
+                     float* dst,
+                     std::size_t count)
+{
+#ifdef NATRON_HALF_F16C
+    if (hasF16C) {
+        convertToFloatF16C(src, dst, count);
+
+        return;
+    }
+#endif
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = bitsToFloat(src[i]._bits);
+    }
+}
+
+void
+Half::convertFromFloat(const float* src,
+                       Half* dst,
+                       std::size_t count)
+{
+#ifdef NATRON_HALF_F16C
+    if (hasF16C) {
+        convertFromFloatF16C(src, dst, count);
+
+        return;
+    }
+#endif
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i]._bits = floatToBits(src[i]);
+    }
+}
+
+bool
+Half::isHardwareConversionSupported()
+{
+#ifdef NATRON_HALF_F16C
+
+    return hasF16C;
+#else
+
+    return false;
+#endif
+}
+
+NATRON_NAMESPACE_EXIT
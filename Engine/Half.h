@@ -0,0 +1,199 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_HALF_H
+#define NATRON_ENGINE_HALF_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A 16-bit floating point number (IEEE 754 binary16: 1 sign bit, 5 exponent bits, 10 mantissa bits),
+ * the same format as OpenEXR's half and OpenGL's GL_HALF_FLOAT.
+ * This is the pixel type of images of depth eImageBitDepthHalf. It converts implicitly from and to float,
+ * so that the image processing templates written for float pixels also work on half pixels: all arithmetic
+ * is done in float and the result is rounded to the nearest half when stored.
+ * To convert whole rows of pixels, prefer convertToFloat() and convertFromFloat() which use the F16C
+ * instructions when the processor has them.
+ **/
+class Half
+{
+public:
+
+    Half()
+        : _bits(0)
+    {
+    }
+
+    Half(float f)
+        : _bits( floatToBits(f) )
+    {
+    }
+
+    operator float() const
+    {
+        return bitsToFloat(_bits);
+    }
+
+    Half& operator+=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) + f);
+
+        return *this;
+    }
+
+    Half& operator-=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) - f);
+
+        return *this;
+    }
+
+    Half& operator*=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) * f);
+
+        return *this;
+    }
+
+    Half& operator/=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) / f);
+
+        return *this;
+    }
+
+    U16 bits() const
+    {
+        return _bits;
+    }
+
+    static Half fromBits(U16 bits)
+    {
+        Half h;
+
+        h._bits = bits;
+
+        return h;
+    }
+
+    /**
+     * @brief Rounds f to the nearest half, ties to even. Values too large for a half become infinite.
+     **/
+    static U16 floatToBits(float f)
+    {
+        U32 x;
+
+        std::memcpy( &x, &f, sizeof(x) );
+
+        const U32 sign = x & 0x80000000U;
+        x ^= sign;
+
+        U16 ret;
+        if ( x >= (143U << 23) ) {
+            // Larger than the largest half (65504) once rounded, infinite or NaN
+            ret = x > (255U << 23) ? 0x7e00 : 0x7c00;
+        } else if ( x < (113U << 23) ) {
+            // The result is a denormal or zero: let the FPU do the rounding by adding 0.5,
+            // which aligns the mantissa on the denormal half mantissa
+            const U32 denormMagic = 126U << 23;
+            float fx, magic;
+            std::memcpy( &fx, &x, sizeof(fx) );
+            std::memcpy( &magic, &denormMagic, sizeof(magic) );
+            fx += magic;
+            std::memcpy( &x, &fx, sizeof(x) );
+            ret = (U16)(x - denormMagic);
+        } else {
+            // Normal number: rebias the exponent and round the mantissa to nearest even
+            const U32 mantissaOdd = (x >> 13) & 1;
+            x -= (112U << 23);
+            x += 0xfff + mantissaOdd;
+            ret = (U16)(x >> 13);
+        }
+
+        return ret | (U16)(sign >> 16);
+    }
+
+    static float bitsToFloat(U16 h)
+    {
+        const U32 shiftedExponent = 0x7c00U << 13;
+        U32 x = (h & 0x7fffU) << 13;
+        const U32 exponent = x & shiftedExponent;
+
+        x += (112U << 23); // rebias the exponent
+        if (exponent == shiftedExponent) {
+            // Infinite or NaN
+            x += (112U << 23);
+        } else if (exponent == 0) {
+            // Zero or denormal: renormalize
+            const U32 magicBits = 113U << 23;
+            float fx, magic;
+            x += (1U << 23);
+            std::memcpy( &fx, &x, sizeof(fx) );
+            std::memcpy( &magic, &magicBits, sizeof(magic) );
+            fx -= magic;
+            std::memcpy( &x, &fx, sizeof(x) );
+        }
+        x |= (U32)(h & 0x8000U) << 16;
+
+        float ret;
+        std::memcpy( &ret, &x, sizeof(ret) );
+
+        return ret;
+    }
+
+    /**
+     * @brief Converts count halfs to floats. This uses the F16C instructions if the processor has them.
+     **/
+    static void convertToFloat(const Half* src, float* dst, std::size_t count);
+
+    /**
+     * @brief Converts count floats to halfs, rounding to nearest even. This uses the F16C instructions
+     * if the processor has them.
+     **/
+    static void convertFromFloat(const float* src, Half* dst, std::size_t count);
+
+    /**
+     * @brief Returns true if convertToFloat() and convertFromFloat() use the F16C instructions
+     **/
+    static bool isHardwareConversionSupported();
+
+private:
+
+    U16 _bits;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_HALF_H
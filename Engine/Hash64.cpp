@@ -25,7 +25,6 @@
 
 #include "Hash64.h"
 
-#include <algorithm>  // for std::for_each
 #include <cassert>
 #include <stdexcept>
 
@@ -41,21 +40,33 @@ NATRON_NAMESPACE_ENTER
 void
 Hash64::computeHash()
 {
-    if ( node_values.empty() ) {
+    if (_count == 0) {
         return;
     }
 
-    const unsigned char* data = reinterpret_cast<const unsigned char*>( &node_values.front() );
-    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64;
-    crc_64 = std::for_each( data, data + node_values.size() * sizeof(node_values[0]), crc_64 );
-    hash = crc_64();
+    if (_algorithm == eHashAlgorithmStreaming) {
+        // mix the number of values too, so that trailing zeros are not ignored
+        hash = multiplyAndFold(_state ^ 0x8ebc6af09c88c6e3ULL, _count ^ 0x589965cc75374cc3ULL);
+    } else {
+        hash = _state;
+    }
+}
+
+void
+Hash64::appendCRC64(U64 value)
+{
+    // The remainder is the checksum, since the CRC has no final xor and no reflection
+    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64(_state);
+    crc_64.process_bytes( &value, sizeof(value) );
+    _state = crc_64.checksum();
 }
 
 void
 Hash64::reset()
 {
-    node_values.clear();
     hash = 0;
+    _state = 0;
+    _count = 0;
 }
 
 void
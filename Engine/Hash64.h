@@ -28,7 +28,6 @@
 
 #include "Global/Macros.h"
 
-#include <vector>
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/static_assert.hpp>
 #endif
@@ -39,7 +38,7 @@
 
 NATRON_NAMESPACE_ENTER
 
-/*The hash of a Node is the checksum of the vector of data containing:
+/*The hash of a Node is the checksum of the data containing:
     - the values of the current knob for this node + the name of the node
     - the hash values for the  tree upstream
  */
@@ -47,14 +46,24 @@ NATRON_NAMESPACE_ENTER
 class Hash64
 {
 public:
-    Hash64()
+    /**
+     * @brief The algorithms used to hash the values. In both cases the values are hashed as soon as they are appended.
+     * eHashAlgorithmStreaming mixes the values 8 bytes at a time (a multiply-and-fold mix, as in wyhash) and is the fastest.
+     * eHashAlgorithmCRC64 is the byte-wise CRC-64 used by previous versions: it must be used for the hashes that are
+     * stored on disk, such as the keys of the disk cache entries, so that they remain valid across versions.
+     **/
+    enum HashAlgorithmEnum
     {
-        hash = 0;
-    }
+        eHashAlgorithmStreaming = 0,
+        eHashAlgorithmCRC64
+    };
 
-    ~Hash64()
+    explicit Hash64(HashAlgorithmEnum algorithm = eHashAlgorithmStreaming)
+        : hash(0)
+        , _algorithm(algorithm)
+        , _state(0)
+        , _count(0)
     {
-        node_values.clear();
     }
 
     U64 value() const
@@ -87,7 +96,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
     template<typename T>
     void append(T value)
     {
-        node_values.push_back( toU64(value) );
+        appendU64( toU64(value) );
     }
 
     bool operator== (const Hash64 & h) const
@@ -116,8 +125,44 @@ private:
         };
     };
 
+    void appendU64(U64 value)
+    {
+        if (_algorithm == eHashAlgorithmStreaming) {
+            _state = multiplyAndFold(_state ^ 0xa0761d6478bd642fULL, value ^ 0xe7037ed1a0b428dbULL);
+        } else {
+            appendCRC64(value);
+        }
+        ++_count;
+    }
+
+    void appendCRC64(U64 value);
+
+    // The 128 bits product of a and b folded to 64 bits
+    static U64 multiplyAndFold(U64 a,
+                               U64 b)
+    {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 r = (unsigned __int128)a * b;
+
+        return (U64)r ^ (U64)(r >> 64);
+#else
+        U64 ha = a >> 32, hb = b >> 32, la = (U32)a, lb = (U32)b;
+        U64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        U64 t = rl + (rm0 << 32);
+        U64 carry = t < rl;
+        U64 lo = t + (rm1 << 32);
+        carry += lo < t;
+        U64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+
+        return lo ^ hi;
+#endif
+    }
+
     U64 hash;
-    std::vector<U64> node_values;
+    HashAlgorithmEnum _algorithm;
+    // The mixed values (eHashAlgorithmStreaming) or the CRC remainder (eHashAlgorithmCRC64)
+    U64 _state;
+    U64 _count;
 };
 
 void Hash64_appendQString(Hash64* hash, const QString & str);
@@ -36,6 +36,7 @@
 #include "Global/FloatingPointExceptions.h"
 #endif
 #include "Engine/Image.h"
+#include "Engine/ImageStatistics.h"
 #include "Engine/Smooth1D.h"
 
 NATRON_NAMESPACE_ENTER
@@ -224,160 +225,86 @@ HistogramCPU::getMostRecentlyProducedHistogram(std::vector<float>* histogram1,
     return true;
 }
 
-///putting these in an anonymous namespace will yield this error on gcc 4.2:
-///"function has not external linkage"
-struct pix_red
-{
-    static float val(const float *pix)
-    {
-        return pix[0];
-    }
-};
-
-struct pix_green
-{
-    static float val(const float *pix)
-    {
-        return pix[1];
-    }
-};
-
-struct pix_blue
-{
-    static float val(const float *pix)
-    {
-        return pix[2];
-    }
-};
-
-struct pix_alpha
-{
-    static float val(const float *pix)
-    {
-        return pix[3];
-    }
-};
-
-struct pix_lum
+// Smooths a histogram of upscale times request.binsCount bins and downsamples it to obtain the final histogram
+static void
+smoothAndDownsampleHistogram(const HistogramRequest & request,
+                             int upscale,
+                             std::vector<float>& histo_upscaled,
+                             std::vector<float> *histo)
 {
-    static float val(const float *pix)
-    {
-        return 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+    double sigma = upscale;
+    if (request.smoothingKernelSize > 1) {
+        sigma *= request.smoothingKernelSize;
     }
-};
-
-
-template <float pix_func(const float*)>
-void
-computeHisto(const HistogramRequest & request,
-             int upscale,
-             std::vector<float> *histo)
-{
-    assert(histo);
-    histo->resize(request.binsCount * upscale);
-    std::fill(histo->begin(), histo->end(), 0.f);
-    double binSize = (request.vmax - request.vmin) / histo->size();
-
-    ///Images come from the viewer which is in float.
-    assert(request.image->getBitDepth() == eImageBitDepthFloat);
-
-    Image::ReadAccess acc = request.image->getReadRights();
+    // smooth the upscaled histogram
+    Smooth1D::iir_gaussianFilter1D(histo_upscaled, sigma);
 
-    for (int y = request.rect.bottom(); y < request.rect.top(); ++y) {
-        for (int x = request.rect.left(); x < request.rect.right(); ++x) {
-            const float *pix = (const float*)acc.pixelAt(x, y);
-            float v = pix_func(pix);
-            if ( (request.vmin <= v) && (v < request.vmax) ) {
-                int index = (int)( (v - request.vmin) / binSize );
-                assert( 0 <= index && index < (int)histo->size() );
-                (*histo)[index] += 1.f;
-            }
+    // downsample to obtain the final histogram
+    histo->resize(request.binsCount);
+    assert(histo_upscaled.size() == histo->size() * upscale);
+    std::vector<float>::const_iterator it_in = histo_upscaled.begin();
+    std::advance(it_in, (upscale - 1) / 2);
+    std::vector<float>::iterator it_out = histo->begin();
+    while ( it_out != histo->end() ) {
+        *it_out = *it_in * upscale;
+        ++it_out;
+        if ( it_out != histo->end() ) {
+            std::advance (it_in, upscale);
         }
     }
 }
 
-
-
 static void
-computeHistogramStatic(const HistogramRequest & request,
-                       FinishedHistogramPtr ret,
-                       int histogramIndex)
+computeHistogramsStatic(const HistogramRequest & request,
+                        FinishedHistogramPtr ret)
 {
     const int upscale = 5;
-    std::vector<float> *histo = 0;
-
-    switch (histogramIndex) {
-    case 1:
-        histo = &ret->histogram1;
-        break;
-    case 2:
-        histo = &ret->histogram2;
-        break;
-    case 3:
-        histo = &ret->histogram3;
-        break;
-    default:
-        break;
-    }
-    assert(histo);
-    if (!histo) {
-        return;
-    }
+    ImageStatisticsRequest statsRequest;
 
     /// keep the mode parameter in sync with Histogram::DisplayModeEnum
-
-    int mode = request.mode;
-
-    ///if the mode is RGB, adjust the mode to either R,G or B depending on the histogram index
-    if (mode == 0) {
-        mode = histogramIndex + 2;
-    }
-
-    ret->pixelsCount = request.rect.area();
-    // a histogram with upscale more bins
-    std::vector<float> histo_upscaled;
-    switch (mode) {
+    switch (request.mode) {
+    case 0:     //< RGB: the 3 histograms are computed in a single pass on the image
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel0);
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel1);
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel2);
+        break;
     case 1:     //< A
-        computeHisto<&pix_alpha::val>(request, upscale, &histo_upscaled);
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel3);
         break;
     case 2:     //<Y
-        computeHisto<&pix_lum::val>(request, upscale, &histo_upscaled);
+        statsRequest.histograms.push_back(eImageStatisticsValueLuminance);
         break;
     case 3:     //< R
-        computeHisto<&pix_red::val>(request, upscale, &histo_upscaled);
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel0);
         break;
     case 4:     //< G
-        computeHisto<&pix_green::val>(request, upscale, &histo_upscaled);
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel1);
         break;
     case 5:     //< B
-        computeHisto<&pix_blue::val>(request, upscale, &histo_upscaled);
+        statsRequest.histograms.push_back(eImageStatisticsValueChannel2);
         break;
-
     default:
-        assert(false);
-        break;
-    }
-    double sigma = upscale;
-    if (request.smoothingKernelSize > 1) {
-        sigma *= request.smoothingKernelSize;
+        assert(false);     //< unknown case.
+
+        return;
     }
-    // smooth the upscaled histogram
-    Smooth1D::iir_gaussianFilter1D(histo_upscaled, sigma);
+    // histograms with upscale more bins
+    statsRequest.histogramBins = request.binsCount * upscale;
+    statsRequest.histogramMin = request.vmin;
+    statsRequest.histogramMax = request.vmax;
 
-    // downsample to obtain the final histogram
-    histo->resize(request.binsCount);
-    assert(histo_upscaled.size() == histo->size() * upscale);
-    std::vector<float>::const_iterator it_in = histo_upscaled.begin();
-    std::advance(it_in, (upscale - 1) / 2);
-    std::vector<float>::iterator it_out = histo->begin();
-    while ( it_out != histo->end() ) {
-        *it_out = *it_in * upscale;
-        ++it_out;
-        if ( it_out != histo->end() ) {
-            std::advance (it_in, upscale);
-        }
+    ///Images come from the viewer which is in float.
+    assert(request.image->getBitDepth() == eImageBitDepthFloat);
+
+    ImageStatistics stats;
+    request.image->computeStatistics(request.rect, statsRequest, &stats);
+
+    ret->pixelsCount = request.rect.area();
+    std::vector<float>* histos[3] = { &ret->histogram1, &ret->histogram2, &ret->histogram3 };
+    for (std::size_t i = 0; i < stats.histograms.size() && i < 3; ++i) {
+        smoothAndDownsampleHistogram(request, upscale, stats.histograms[i], histos[i]);
     }
-} // computeHistogramStatic
+} // computeHistogramsStatic
 
 void
 HistogramCPU::run()
@@ -420,23 +347,7 @@ HistogramCPU::run()
         ret->mipMapLevel = request.image->getMipMapLevel();
 
 
-        switch (request.mode) {
-        case 0:     //< RGB
-            computeHistogramStatic(request, ret, 1);
-            computeHistogramStatic(request, ret, 2);
-            computeHistogramStatic(request, ret, 3);
-            break;
-        case 1:
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-            computeHistogramStatic(request, ret, 1);
-            break;
-        default:
-            assert(false);     //< unknown case.
-            break;
-        }
+        computeHistogramsStatic(request, ret);
 
 
         {
@@ -33,28 +33,98 @@
 #if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 #include <boost/math/special_functions/fpclassify.hpp>
+// /usr/local/include/boost/bind/arg.hpp:37:9: warning: unused typedef 'boost_static_assert_typedef_37' [-Wunused-local-typedef]
+#include <boost/bind/bind.hpp>
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #endif
 
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageConvertKernels.h"
+#include "Engine/ImageStatistics.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/GPUContextPool.h"
 #include "Engine/OSGLContext.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/GLShader.h"
 
+using namespace boost::placeholders;
+
 NATRON_NAMESPACE_ENTER
 
 #define BM_GET(i, j) (&_map[( i - _bounds.bottom() ) * _bounds.width() + ( j - _bounds.left() )])
 
 #define PIXEL_UNAVAILABLE 2
 
+#define BITMAP_TILE_SIZE 64
+
+/*
+ * From the uniform value of a row or a column segment given by Bitmap::getUniformValue(), returns 1 if the
+ * segment has no pixel left to render (only 1s, or also PIXEL_UNAVAILABLE for the trimap), 0 if it has one,
+ * or -1 if its pixels have to be looked at.
+ */
+template <int trimap>
+int
+isSegmentMarked(int uniformValue,
+                bool* metUnavailablePixel)
+{
+    switch (uniformValue) {
+    case 0:
+
+        return 0;
+    case 1:
+
+        return 1;
+    case PIXEL_UNAVAILABLE:
+        if (trimap) {
+            *metUnavailablePixel = true;
+
+            return 1;
+        }
+
+        return 0;
+    default:
+
+        return -1;
+    }
+}
+
+/*
+ * Same as isSegmentMarked, but returns 1 if the segment only has pixels left to render (no 1, nor PIXEL_UNAVAILABLE for the trimap).
+ */
+template <int trimap>
+int
+isSegmentNonMarked(int uniformValue,
+                   bool* metUnavailablePixel)
+{
+    switch (uniformValue) {
+    case 0:
+
+        return 1;
+    case 1:
+
+        return 0;
+    case PIXEL_UNAVAILABLE:
+        if (trimap) {
+            *metUnavailablePixel = true;
+
+            return 0;
+        }
+
+        return 1;
+    default:
+
+        return -1;
+    }
+}
+
 template <int trimap>
 RectI
 minimalNonMarkedBbox_internal(const RectI& roi,
                               const RectI& _bounds,
                               const std::vector<char>& _map,
+                              const Bitmap& bitmap,
                               bool* isBeingRenderedElsewhere)
 {
     RectI bbox;
@@ -64,6 +134,18 @@ minimalNonMarkedBbox_internal(const RectI& roi,
 
     //find bottom
     for (int i = bbox.bottom(); i < bbox.top(); ++i) {
+        bool metUnavailableTile = false;
+        int marked = isSegmentMarked<trimap>(bitmap.getUniformValue( RectI(bbox.left(), i, bbox.right(), i + 1) ), &metUnavailableTile);
+        if (marked == 0) {
+            break;
+        } else if (marked == 1) {
+            if (metUnavailableTile) {
+                *isBeingRenderedElsewhere = true;
+            }
+            ++bbox.y1;
+            continue;
+        }
+
         const char* buf = BM_GET( i, bbox.left() );
 
         if (trimap) {
@@ -105,6 +187,18 @@ minimalNonMarkedBbox_internal(const RectI& roi,
 
     //find top (will do zero iteration if the bbox is already empty)
     for (int i = bbox.top() - 1; i >= bbox.bottom(); --i) {
+        bool metUnavailableTile = false;
+        int marked = isSegmentMarked<trimap>(bitmap.getUniformValue( RectI(bbox.left(), i, bbox.right(), i + 1) ), &metUnavailableTile);
+        if (marked == 0) {
+            break;
+        } else if (marked == 1) {
+            if (metUnavailableTile) {
+                *isBeingRenderedElsewhere = true;
+            }
+            --bbox.y2;
+            continue;
+        }
+
         const char* buf = BM_GET( i, bbox.left() );
 
         if (trimap) {
@@ -151,6 +245,18 @@ minimalNonMarkedBbox_internal(const RectI& roi,
 
     //find left
     for (int j = bbox.left(); j < bbox.right(); ++j) {
+        bool metUnavailableTile = false;
+        int marked = isSegmentMarked<trimap>(bitmap.getUniformValue( RectI(j, bbox.bottom(), j + 1, bbox.top()) ), &metUnavailableTile);
+        if (marked == 0) {
+            break;
+        } else if (marked == 1) {
+            if (metUnavailableTile) {
+                *isBeingRenderedElsewhere = true;
+            }
+            ++bbox.x1;
+            continue;
+        }
+
         const char* pix = BM_GET(bbox.bottom(), j);
         bool metUnavailablePixel = false;
 
@@ -179,6 +285,18 @@ minimalNonMarkedBbox_internal(const RectI& roi,
 
     //find right
     for (int j = bbox.right() - 1; j >= bbox.left(); --j) {
+        bool metUnavailableTile = false;
+        int marked = isSegmentMarked<trimap>(bitmap.getUniformValue( RectI(j, bbox.bottom(), j + 1, bbox.top()) ), &metUnavailableTile);
+        if (marked == 0) {
+            break;
+        } else if (marked == 1) {
+            if (metUnavailableTile) {
+                *isBeingRenderedElsewhere = true;
+            }
+            --bbox.x2;
+            continue;
+        }
+
         const char* pix = BM_GET(bbox.bottom(), j);
         bool metUnavailablePixel = false;
 
@@ -214,6 +332,7 @@ void
 minimalNonMarkedRects_internal(const RectI & roi,
                                const RectI& _bounds,
                                const std::vector<char>& _map,
+                               const Bitmap& bitmap,
                                std::list<RectI>& ret,
                                bool* isBeingRenderedElsewhere)
 {
@@ -251,7 +370,7 @@ minimalNonMarkedRects_internal(const RectI & roi,
         return;
     }
 
-    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, _bounds, _map, isBeingRenderedElsewhere);
+    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, _bounds, _map, bitmap, isBeingRenderedElsewhere);
     assert( (trimap && isBeingRenderedElsewhere) || (!trimap && !isBeingRenderedElsewhere) );
 
     //#define NATRON_BITMAP_DISABLE_OPTIMIZATION
@@ -291,6 +410,19 @@ minimalNonMarkedRects_internal(const RectI & roi,
     RectI bboxA = bboxX;
     bboxA.set_top( bboxX.bottom() );
     for (int i = bboxX.bottom(); i < bboxX.top(); ++i) {
+        bool metUnavailableTile = false;
+        int nonMarked = isSegmentNonMarked<trimap>(bitmap.getUniformValue( RectI(bboxX.left(), i, bboxX.right(), i + 1) ), &metUnavailableTile);
+        if (nonMarked == 1) {
+            ++bboxX.y1;
+            bboxA.y2 = bboxX.y1;
+            continue;
+        } else if (nonMarked == 0) {
+            if (metUnavailableTile) {
+                *isBeingRenderedElsewhere = true;
+            }
+            break;
+        }
+
         const char* buf = BM_GET( i, bboxX.left() );
         if (trimap) {
             const char* lineEnd = buf + bboxX.width();
@@ -333,6 +465,19 @@ minimalNonMarkedRects_internal(const RectI & roi,
     RectI bboxB = bboxX;
     bboxB.set_bottom( bboxX.top() );
     for (int i = bboxX.top() - 1; i >= bboxX.bottom(); --i) {
+        bool metUnavailableTile = false;
+        int nonMarked = isSegmentNonMarked<trimap>(bitmap.getUniformValue( RectI(bboxX.left(), i, bboxX.right(), i + 1) ), &metUnavailableTile);
+        if (nonMarked == 1) {
+            --bboxX.y2;
+            bboxB.y1 = bboxX.y2;
+            continue;
+        } else if (nonMarked == 0) {
+            if (metUnavailableTile) {
+                *isBeingRenderedElsewhere = true;
+            }
+            break;
+        }
+
         const char* buf = BM_GET( i, bboxX.left() );
 
         if (trimap) {
@@ -376,6 +521,19 @@ minimalNonMarkedRects_internal(const RectI & roi,
     bboxC.set_right( bboxX.left() );
     if ( bboxX.bottom() < bboxX.top() ) {
         for (int j = bboxX.left(); j < bboxX.right(); ++j) {
+            bool metUnavailableTile = false;
+            int nonMarked = isSegmentNonMarked<trimap>(bitmap.getUniformValue( RectI(j, bboxX.bottom(), j + 1, bboxX.top()) ), &metUnavailableTile);
+            if (nonMarked == 1) {
+                ++bboxX.x1;
+                bboxC.x2 = bboxX.x1;
+                continue;
+            } else if (nonMarked == 0) {
+                if (metUnavailableTile) {
+                    *isBeingRenderedElsewhere = true;
+                }
+                break;
+            }
+
             const char* pix = BM_GET(bboxX.bottom(), j);
             bool metUnavailablePixel = false;
 
@@ -409,6 +567,19 @@ minimalNonMarkedRects_internal(const RectI & roi,
     bboxD.set_left( bboxX.right() );
     if ( bboxX.bottom() < bboxX.top() ) {
         for (int j = bboxX.right() - 1; j >= bboxX.left(); --j) {
+            bool metUnavailableTile = false;
+            int nonMarked = isSegmentNonMarked<trimap>(bitmap.getUniformValue( RectI(j, bboxX.bottom(), j + 1, bboxX.top()) ), &metUnavailableTile);
+            if (nonMarked == 1) {
+                --bboxX.x2;
+                bboxD.x1 = bboxX.x2;
+                continue;
+            } else if (nonMarked == 0) {
+                if (metUnavailableTile) {
+                    *isBeingRenderedElsewhere = true;
+                }
+                break;
+            }
+
             const char* pix = BM_GET(bboxX.bottom(), j);
             bool metUnavailablePixel = false;
 
@@ -458,7 +629,7 @@ minimalNonMarkedRects_internal(const RectI & roi,
     assert( bboxD.bottom() == bboxX.bottom() );
 
     // get the bounding box of what's left (the X rectangle in the drawing above)
-    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX, _bounds, _map, isBeingRenderedElsewhere);
+    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX, _bounds, _map, bitmap, isBeingRenderedElsewhere);
 
     if ( !bboxX.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxX);
@@ -476,9 +647,9 @@ Bitmap::minimalNonMarkedBbox(const RectI & roi) const
             return RectI();
         }
 
-        return minimalNonMarkedBbox_internal<0>(realRoi, _bounds, _map, NULL);
+        return minimalNonMarkedBbox_internal<0>(realRoi, _bounds, _map, *this, NULL);
     } else {
-        return minimalNonMarkedBbox_internal<0>(roi, _bounds, _map, NULL);
+        return minimalNonMarkedBbox_internal<0>(roi, _bounds, _map, *this, NULL);
     }
 }
 
@@ -491,9 +662,9 @@ Bitmap::minimalNonMarkedRects(const RectI & roi,
         if ( !roi.intersect(_dirtyZone, &realRoi) ) {
             return;
         }
-        minimalNonMarkedRects_internal<0>(realRoi, _bounds, _map, ret, NULL);
+        minimalNonMarkedRects_internal<0>(realRoi, _bounds, _map, *this, ret, NULL);
     } else {
-        minimalNonMarkedRects_internal<0>(roi, _bounds, _map, ret, NULL);
+        minimalNonMarkedRects_internal<0>(roi, _bounds, _map, *this, ret, NULL);
     }
 }
 
@@ -510,9 +681,9 @@ Bitmap::minimalNonMarkedBbox_trimap(const RectI & roi,
             return RectI();
         }
 
-        return minimalNonMarkedBbox_internal<1>(realRoi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBbox_internal<1>(realRoi, _bounds, _map, *this, isBeingRenderedElsewhere);
     } else {
-        return minimalNonMarkedBbox_internal<1>(roi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBbox_internal<1>(roi, _bounds, _map, *this, isBeingRenderedElsewhere);
     }
 }
 
@@ -528,9 +699,9 @@ Bitmap::minimalNonMarkedRects_trimap(const RectI & roi,
 
             return;
         }
-        minimalNonMarkedRects_internal<1>(realRoi, _bounds, _map, ret, isBeingRenderedElsewhere);
+        minimalNonMarkedRects_internal<1>(realRoi, _bounds, _map, *this, ret, isBeingRenderedElsewhere);
     } else {
-        minimalNonMarkedRects_internal<1>(roi, _bounds, _map, ret, isBeingRenderedElsewhere);
+        minimalNonMarkedRects_internal<1>(roi, _bounds, _map, *this, ret, isBeingRenderedElsewhere);
     }
 }
 
@@ -551,6 +722,82 @@ Bitmap::markFor(const RectI & roi, char value)
     for (int i = y1; i < y2; ++i, buf += w) {
         std::memset( buf, value, roiw);
     }
+    setTilesState(RectI(x1, y1, x2, y2), value);
+}
+
+void
+Bitmap::initializeTiles(char value)
+{
+    if ( _bounds.isNull() ) {
+        _nTilesX = 0;
+        _tiles.clear();
+
+        return;
+    }
+    _nTilesX = (_bounds.width() + BITMAP_TILE_SIZE - 1) / BITMAP_TILE_SIZE;
+    int nTilesY = (_bounds.height() + BITMAP_TILE_SIZE - 1) / BITMAP_TILE_SIZE;
+    _tiles.assign( (std::size_t)_nTilesX * nTilesY, (signed char)value );
+}
+
+void
+Bitmap::setTilesState(const RectI& roi,
+                      int value)
+{
+    RectI rect;
+
+    if ( _tiles.empty() || !roi.intersect(_bounds, &rect) ) {
+        return;
+    }
+
+    // the tiles start at the bottom-left corner of the bounds
+    int tx1 = (rect.x1 - _bounds.x1) / BITMAP_TILE_SIZE;
+    int tx2 = (rect.x2 - 1 - _bounds.x1) / BITMAP_TILE_SIZE;
+    int ty1 = (rect.y1 - _bounds.y1) / BITMAP_TILE_SIZE;
+    int ty2 = (rect.y2 - 1 - _bounds.y1) / BITMAP_TILE_SIZE;
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        int tileY1 = _bounds.y1 + ty * BITMAP_TILE_SIZE;
+        int tileY2 = std::min(tileY1 + BITMAP_TILE_SIZE, _bounds.y2);
+        signed char* tile = &_tiles[(std::size_t)ty * _nTilesX + tx1];
+        for (int tx = tx1; tx <= tx2; ++tx, ++tile) {
+            int tileX1 = _bounds.x1 + tx * BITMAP_TILE_SIZE;
+            int tileX2 = std::min(tileX1 + BITMAP_TILE_SIZE, _bounds.x2);
+            bool covered = rect.x1 <= tileX1 && tileX2 <= rect.x2 && rect.y1 <= tileY1 && tileY2 <= rect.y2;
+            if ( (value >= 0) && (covered || *tile == value) ) {
+                *tile = (signed char)value;
+            } else {
+                *tile = -1;
+            }
+        }
+    }
+}
+
+int
+Bitmap::getUniformValue(const RectI& roi) const
+{
+    RectI rect;
+
+    if ( _tiles.empty() || !roi.intersect(_bounds, &rect) ) {
+        return -1;
+    }
+
+    int tx1 = (rect.x1 - _bounds.x1) / BITMAP_TILE_SIZE;
+    int tx2 = (rect.x2 - 1 - _bounds.x1) / BITMAP_TILE_SIZE;
+    int ty1 = (rect.y1 - _bounds.y1) / BITMAP_TILE_SIZE;
+    int ty2 = (rect.y2 - 1 - _bounds.y1) / BITMAP_TILE_SIZE;
+    int value = _tiles[(std::size_t)ty1 * _nTilesX + tx1];
+    if (value < 0) {
+        return -1;
+    }
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        const signed char* tile = &_tiles[(std::size_t)ty * _nTilesX + tx1];
+        for (int tx = tx1; tx <= tx2; ++tx, ++tile) {
+            if (*tile != value) {
+                return -1;
+            }
+        }
+    }
+
+    return value;
 }
 
 bool
@@ -561,6 +808,11 @@ Bitmap::isNonMarked(const RectI & roi) const
     int x2 = std::min(roi.x2, _bounds.x2);
     int y2 = std::min(roi.y2, _bounds.y2);
 
+    int uniformValue = getUniformValue( RectI(x1, y1, x2, y2) );
+    if (uniformValue >= 0) {
+        return uniformValue == 0;
+    }
+
     const char* buf = BM_GET(y1, x1);
     int w = _bounds.width();
     int roiw = x2 - x1;
@@ -588,6 +840,8 @@ void
 Bitmap::swap(Bitmap& other)
 {
     _map.swap(other._map);
+    _tiles.swap(other._tiles);
+    std::swap(_nTilesX, other._nTilesX);
     _bounds = other._bounds;
     _dirtyZone.clear(); //merge(other._dirtyZone);
     _dirtyZoneSet = false;
@@ -917,7 +1171,7 @@ Image::pasteFromForDepth(const Image & srcImg,
     ///Cannot copy images with different bit depth, this is not the purpose of this function.
     ///@see convert
     assert( getBitDepth() == srcImg.getBitDepth() );
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
     // NOTE: before removing the following asserts, please explain why an empty image may happen
 
     QWriteLocker k(&_entryLock);
@@ -947,6 +1201,10 @@ Image::pasteFromForDepth(const Image & srcImg,
 
     assert( getComponents() == srcImg.getComponents() );
 
+    if ( sharePixelsFrom(srcImg, roi, copyBitmap) ) {
+        return;
+    }
+
     if (copyBitmap && _useBitmap) {
         copyBitmapPortion(roi, srcImg);
     }
@@ -973,6 +1231,27 @@ Image::pasteFromForDepth(const Image & srcImg,
     }
 } // Image::pasteFromForDepth
 
+bool
+Image::sharePixelsFrom(const Image & src,
+                       const RectI & roi,
+                       bool copyBitmap)
+{
+    if ( (&src == this) || (_bounds != src._bounds) || !roi.contains(_bounds) ||
+         ( getBitDepth() != src.getBitDepth() ) || ( getComponents() != src.getComponents() ) ) {
+        return false;
+    }
+
+    // The buffer this image had is freed, or returned to the memory pool
+    if ( !shareData(src) ) {
+        return false;
+    }
+    if (copyBitmap && _useBitmap) {
+        copyBitmapPortion(_bounds, src);
+    }
+
+    return true;
+}
+
 void
 Image::setRoD(const RectD& rod)
 {
@@ -982,6 +1261,68 @@ Image::setRoD(const RectD& rod)
     _params->setRoD(rod);
 }
 
+namespace {
+
+// When an image has to grow, its new bounds are extended to this grid of tiles, within its region of definition
+const int kBoundsGrowthTileSize = 128;
+
+inline int
+floorToTile(int x)
+{
+    return x >= 0 ? (x / kBoundsGrowthTileSize) * kBoundsGrowthTileSize : -( (-x + kBoundsGrowthTileSize - 1) / kBoundsGrowthTileSize ) * kBoundsGrowthTileSize;
+}
+
+inline int
+ceilToTile(int x)
+{
+    return -floorToTile(-x);
+}
+
+/**
+ * @brief Rounds [x1, x2) outwards to the tile grid. Ranges smaller than a tile are not rounded, and the padding
+ * of each side is capped to a quarter of the range, so that small images do not grow to a whole tile.
+ **/
+void
+growToTiles(int x1,
+            int x2,
+            int* grownX1,
+            int* grownX2)
+{
+    int length = x2 - x1;
+
+    if (length < kBoundsGrowthTileSize) {
+        *grownX1 = x1;
+        *grownX2 = x2;
+
+        return;
+    }
+    int maxPadding = length / 4;
+    *grownX1 = std::max(floorToTile(x1), x1 - maxPadding);
+    *grownX2 = std::min(ceilToTile(x2), x2 + maxPadding);
+}
+} // anon namespace
+
+RectI
+Image::getGrownBounds(const RectI& newBounds) const
+{
+    RectI merge = newBounds;
+
+    merge.merge(_bounds);
+
+    RectI rodBounds;
+    _rod.toPixelEnclosing(getMipMapLevel(), _par, &rodBounds);
+
+    RectI grown;
+    growToTiles(merge.x1, merge.x2, &grown.x1, &grown.x2);
+    growToTiles(merge.y1, merge.y2, &grown.y1, &grown.y2);
+    if ( !grown.intersect(rodBounds, &grown) ) {
+        return merge;
+    }
+    grown.merge(merge);
+
+    return grown;
+}
+
 void
 Image::resizeInternal(const Image* srcImg,
                       const RectI& srcBounds,
@@ -1049,6 +1390,8 @@ Image::resizeInternal(const Image* srcImg,
 
         Image::WriteAccess wacc( outputImage->get() );
         std::size_t pixelSize = srcImg->getComponentsCount() * getSizeOfForBitDepth(depth);
+        // markForRendered also keeps the state of the bitmap tiles up to date
+        Bitmap* bitmap = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? &(*outputImage)->_bitmap : 0;
 
         if ( !aRect.isNull() ) {
             char* pix = (char*)wacc.pixelAt(aRect.x1, aRect.y1);
@@ -1056,10 +1399,8 @@ Image::resizeInternal(const Image* srcImg,
             U64 a = aRect.area();
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
-            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = wacc.bitmapAt(aRect.x1, aRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+            if (bitmap) {
+                bitmap->markForRendered(aRect);
             }
         }
         if ( !cRect.isNull() ) {
@@ -1068,10 +1409,8 @@ Image::resizeInternal(const Image* srcImg,
             U64 a = cRect.area();
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
-            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = (char*)wacc.bitmapAt(cRect.x1, cRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+            if (bitmap) {
+                bitmap->markForRendered(cRect);
             }
         }
         if ( !bRect.isNull() ) {
@@ -1081,13 +1420,11 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t rowsize = mw * pixelSize;
             int bw = bRect.width();
             std::size_t rectRowSize = bw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(bRect.x1, bRect.y1) : 0;
             for (int y = bRect.y1; y < bRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, bw);
-                    bm += mw;
-                }
+            }
+            if (bitmap) {
+                bitmap->markForRendered(bRect);
             }
         }
         if ( !dRect.isNull() ) {
@@ -1097,13 +1434,11 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t rowsize = mw * pixelSize;
             int dw = dRect.width();
             std::size_t rectRowSize = dw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(dRect.x1, dRect.y1) : 0;
             for (int y = dRect.y1; y < dRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, dw);
-                    bm += mw;
-                }
+            }
+            if (bitmap) {
+                bitmap->markForRendered(dRect);
             }
         }
     } // fillWithBlackAndTransparent
@@ -1117,7 +1452,7 @@ Image::resizeInternal(const Image* srcImg,
         (*outputImage)->pasteFromForDepth<unsigned short>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        (*outputImage)->pasteFromForDepth<Half>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
         break;
     case eImageBitDepthFloat:
         (*outputImage)->pasteFromForDepth<float>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
@@ -1140,8 +1475,7 @@ Image::copyAndResizeIfNeeded(const RectI& newBounds,
     assert(output);
 
     QReadLocker k(&_entryLock);
-    RectI merge = newBounds;
-    merge.merge(_bounds);
+    RectI merge = getGrownBounds(newBounds);
 
     resizeInternal(this, _bounds, merge, fillWithBlackAndTransparent, setBitmapTo1, usesBitMap(), output);
 
@@ -1160,8 +1494,7 @@ Image::ensureBounds(const RectI& newBounds,
     }
 
     QWriteLocker k(&_entryLock);
-    RectI merge = newBounds;
-    merge.merge(_bounds);
+    RectI merge = getGrownBounds(newBounds);
 
     ImagePtr tmpImg;
     resizeInternal(this, _bounds, merge, fillWithBlackAndTransparent, setBitmapTo1, false, &tmpImg);
@@ -1398,7 +1731,7 @@ Image::pasteFrom(const Image & src,
             pasteFromForDepth<unsigned short>(src, srcRoi, copyBitmap, true);
             break;
         case eImageBitDepthHalf:
-            assert(false);
+            pasteFromForDepth<Half>(src, srcRoi, copyBitmap, true);
             break;
         case eImageBitDepthFloat:
             pasteFromForDepth<float>(src, srcRoi, copyBitmap, true);
@@ -1417,7 +1750,7 @@ Image::fillForDepthForComponents(const RectI & roi_,
                                  float b,
                                  float a)
 {
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     RectI roi = roi_;
     bool doInteresect = roi.intersect(_bounds, &roi);
@@ -1537,7 +1870,7 @@ Image::fill(const RectI & roi,
         fillForDepth<unsigned short, 65535>(roi, r, g, b, a);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        fillForDepth<Half, 1>(roi, r, g, b, a);
         break;
     case eImageBitDepthFloat:
         fillForDepth<float, 1>(roi, r, g, b, a);
@@ -1636,7 +1969,7 @@ Image::pixelAt(int x,
     if ( ( x < _bounds.x1 ) || ( x >= _bounds.x2 ) || ( y < _bounds.y1 ) || ( y >= _bounds.y2 ) ) {
         return NULL;
     } else {
-        unsigned char* ret =  (unsigned char*)this->_data.writable();
+        unsigned char* ret =  (unsigned char*)writableData();
         if (!ret) {
             return 0;
         }
@@ -1817,29 +2150,142 @@ Image::getRowElements() const
     return getComponentsCount() * _bounds.width();
 }
 
-// code proofread and fixed by @devernay on 4/12/2014
-template <typename PIX, int maxValue>
-void
-Image::halveRoIForDepth(const RectI & roi,
-                        bool copyBitMap,
-                        Image* output) const
+namespace {
+
+// Below this number of pixels per thread, processing rows is faster without splitting them across threads
+const std::size_t kMinPixelsPerThread = 256 * 256;
+
+// ceil(x / 2.) and floor(x / 2.), also for negative coordinates
+inline int
+ceilHalf(int x)
 {
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) ||
-            (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) ||
-            (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    return x >= 0 ? (x + 1) / 2 : -( (-x) / 2 );
+}
 
-    ///handle case where there is only 1 column/row
-    if ( (roi.width() == 1) || (roi.height() == 1) ) {
-        assert( !(roi.width() == 1 && roi.height() == 1) ); /// can't be 1x1
-        halve1DImage(roi, output);
+inline int
+floorHalf(int x)
+{
+    return x >= 0 ? x / 2 : -( (-x + 1) / 2 );
+}
 
-        return;
+/**
+ * @brief The destination rectangle written by Image::halveRoI() for the given roi of an image of the given bounds.
+ **/
+RectI
+getHalvedRoI(const RectI & roi,
+             const RectI & srcBounds)
+{
+    RectI srcRoI = roi;
+
+    srcRoI.intersect(srcBounds, &srcRoI); // intersect srcRoI with the region of definition
+
+    RectI dstRoI;
+    dstRoI.x1 = (srcRoI.x1 + 1) / 2; // equivalent to ceil(srcRoI.x1/2.0)
+    dstRoI.y1 = (srcRoI.y1 + 1) / 2; // equivalent to ceil(srcRoI.y1/2.0)
+    dstRoI.x2 = srcRoI.x2 / 2; // equivalent to floor(srcRoI.x2/2.0)
+    dstRoI.y2 = srcRoI.y2 / 2; // equivalent to floor(srcRoI.y2/2.0)
+
+    return dstRoI;
+}
+
+// The interior of the rows, where each destination pixel has its 4 source pixels, is computed by the row kernels
+inline void
+halveRowWithKernels(const unsigned char* row0,
+                    const unsigned char* row1,
+                    unsigned char* dst,
+                    int count,
+                    int nComps,
+                    std::vector<float>* /*floatBuffer*/)
+{
+    ImageConvertKernels::halveRowsByte(row0, row1, dst, count, nComps);
+}
+
+inline void
+halveRowWithKernels(const unsigned short* row0,
+                    const unsigned short* row1,
+                    unsigned short* dst,
+                    int count,
+                    int nComps,
+                    std::vector<float>* /*floatBuffer*/)
+{
+    ImageConvertKernels::halveRowsShort(row0, row1, dst, count, nComps);
+}
+
+inline void
+halveRowWithKernels(const float* row0,
+                    const float* row1,
+                    float* dst,
+                    int count,
+                    int nComps,
+                    std::vector<float>* /*floatBuffer*/)
+{
+    ImageConvertKernels::halveRowsFloat(row0, row1, dst, count, nComps);
+}
+
+// Half pixels are averaged in float and rounded once, like the generic code does
+inline void
+halveRowWithKernels(const Half* row0,
+                    const Half* row1,
+                    Half* dst,
+                    int count,
+                    int nComps,
+                    std::vector<float>* floatBuffer)
+{
+    const std::size_t srcCount = (std::size_t)count * 2 * nComps;
+    const std::size_t dstCount = (std::size_t)count * nComps;
+
+    floatBuffer->resize(srcCount * 2 + dstCount);
+    float* floatRow0 = &floatBuffer->front();
+    float* floatRow1 = floatRow0 + srcCount;
+    float* floatDst = floatRow1 + srcCount;
+    Half::convertToFloat(row0, floatRow0, srcCount);
+    Half::convertToFloat(row1, floatRow1, srcCount);
+    ImageConvertKernels::halveRowsFloat(floatRow0, floatRow1, floatDst, count, nComps);
+    Half::convertFromFloat(floatDst, dst, dstCount);
+}
+} // anon namespace
+
+std::vector<std::pair<int, int> >
+Image::splitRowsAcrossThreads(int y1,
+                              int y2,
+                              std::size_t pixelsPerRow)
+{
+    std::vector<std::pair<int, int> > bands;
+    const int nRows = y2 - y1;
+
+    if (nRows <= 0) {
+        return bands;
     }
 
-    /// Take the lock for both bitmaps since we're about to read/write from them!
-    QWriteLocker k1(&output->_entryLock);
-    QReadLocker k2(&_entryLock);
+    // The rows are processed serially when the scheduler is already saturated: when called from one of its tasks
+    // (e.g. a tile of the viewer), the other tiles keep the other workers busy
+    TaskScheduler* scheduler = TaskScheduler::instance();
+    if ( scheduler->isWorkerThread() || (scheduler->getIdleWorkersCount() == 0) ) {
+        bands.push_back( std::make_pair(y1, y2) );
+
+        return bands;
+    }
+
+    // Otherwise the thread waiting for the bands runs those that no other thread took
+    std::size_t nBandsForWork = ( (std::size_t)nRows * pixelsPerRow ) / kMinPixelsPerThread;
+    int nBands = (int)std::min( nBandsForWork, (std::size_t)scheduler->getMaxThreadsCount() );
+    nBands = std::max( 1, std::min(nBands, nRows) );
+    for (int i = 0; i < nBands; ++i) {
+        bands.push_back( std::make_pair( y1 + (int)( (long long)nRows * i / nBands ),
+                                         y1 + (int)( (long long)nRows * (i + 1) / nBands ) ) );
+    }
 
+    return bands;
+}
+
+// code proofread and fixed by @devernay on 4/12/2014
+template <typename PIX, int maxValue>
+void
+Image::halveRowsForDepth(const RectI & roi,
+                         bool copyBitMap,
+                         Image* output,
+                         const std::pair<int, int>& rows) const
+{
     ///The source rectangle, intersected to this image region of definition in pixels
     const RectI &srcBounds = _bounds;
     const RectI &dstBounds = output->_bounds;
@@ -1858,17 +2304,14 @@ Image::halveRoIForDepth(const RectI & roi,
     //           dstRoD.height()*2 <= roi.height());
     assert( getComponents() == output->getComponents() );
 
-    RectI dstRoI;
-    RectI srcRoI = roi;
-    srcRoI.intersect(srcBounds, &srcRoI); // intersect srcRoI with the region of definition
+    const RectI dstRoI = getHalvedRoI(roi, srcBounds);
 #ifdef DEBUG_NAN
+    RectI srcRoI = roi;
+    srcRoI.intersect(srcBounds, &srcRoI);
     assert(!checkForNaNsNoLock(srcRoI));
 #endif
-    dstRoI.x1 = (srcRoI.x1 + 1) / 2; // equivalent to ceil(srcRoI.x1/2.0)
-    dstRoI.y1 = (srcRoI.y1 + 1) / 2; // equivalent to ceil(srcRoI.y1/2.0)
-    dstRoI.x2 = srcRoI.x2 / 2; // equivalent to floor(srcRoI.x2/2.0)
-    dstRoI.y2 = srcRoI.y2 / 2; // equivalent to floor(srcRoI.y2/2.0)
-
+    const int y1 = std::max(dstRoI.y1, rows.first);
+    const int y2 = std::min(dstRoI.y2, rows.second);
 
     const PIX* const srcPixels      = (const PIX*)pixelAt(srcBounds.x1,   srcBounds.y1);
     const char* const srcBmPixels   = _bitmap.getBitmapAt(srcBmBounds.x1, srcBmBounds.y1);
@@ -1885,7 +2328,14 @@ Image::halveRoIForDepth(const RectI & roi,
     const char* const srcBmData = srcBmPixels - (srcBmBounds.x1 + srcBmRowSize * srcBmBounds.y1);
     char* const dstBmData       = dstBmPixels - (dstBmBounds.x1 + dstBmRowSize * dstBmBounds.y1);
 
-    for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
+    // The columns [fastX1, fastX2[ cover 2 source columns within srcBounds: on the rows that also cover 2 source rows
+    // they are computed by the row kernels, the code below only handles the borders
+    const int fastX1 = std::max( dstRoI.x1, ceilHalf(srcBounds.x1) );
+    const int fastX2 = std::min( dstRoI.x2, floorHalf(srcBounds.x2) );
+    const bool useKernels = ImageConvertKernels::isEnabled() && fastX1 < fastX2;
+    std::vector<float> floatBuffer;
+
+    for (int y = y1; y < y2; ++y) {
         const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
         PIX* const dstLineStart          = dstData + y     * dstRowSize;
         const char* const srcBmLineStart = srcBmData + y * 2 * srcBmRowSize;
@@ -1899,7 +2349,20 @@ Image::halveRoIForDepth(const RectI & roi,
         int sumH = (int)pickNextRow + (int)pickThisRow;
         assert(sumH == 1 || sumH == 2);
 
+        const bool rowUsesKernels = useKernels && sumH == 2;
+        if (rowUsesKernels) {
+            const PIX* const srcPixStart = srcLineStart + fastX1 * 2 * _nbComponents;
+            halveRowWithKernels(srcPixStart, srcPixStart + srcRowSize, dstLineStart + fastX1 * _nbComponents,
+                                fastX2 - fastX1, _nbComponents, &floatBuffer);
+        }
+
         for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
+            const bool pixelDone = rowUsesKernels && fastX1 <= x && x < fastX2;
+            if (pixelDone && !copyBitMap) {
+                x = fastX2 - 1;
+                continue;
+            }
+
             const PIX* const srcPixStart    = srcLineStart   + x * 2 * _nbComponents;
             const char* const srcBmPixStart = srcBmLineStart + x * 2;
             PIX* const dstPixStart          = dstLineStart   + x * _nbComponents;
@@ -1925,23 +2388,25 @@ Image::halveRoIForDepth(const RectI & roi,
                 continue;
             }
 
-            for (int k = 0; k < _nbComponents; ++k) {
-                ///a b
-                ///c d
+            if (!pixelDone) {
+                for (int k = 0; k < _nbComponents; ++k) {
+                    ///a b
+                    ///c d
 
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : 0;
+                    const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : PIX(0);
+                    const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : PIX(0);
+                    const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : PIX(0);
+                    const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : PIX(0);
 #ifdef DEBUG_NAN
-                assert( !(boost::math::isnan)(a) ); // check for NaN
-                assert( !(boost::math::isnan)(b) ); // check for NaN
-                assert( !(boost::math::isnan)(c) ); // check for NaN
-                assert( !(boost::math::isnan)(d) ); // check for NaN
+                    assert( !(boost::math::isnan)(a) ); // check for NaN
+                    assert( !(boost::math::isnan)(b) ); // check for NaN
+                    assert( !(boost::math::isnan)(c) ); // check for NaN
+                    assert( !(boost::math::isnan)(d) ); // check for NaN
 #endif
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
-                dstPixStart[k] = (a + b + c + d) / sum;
+                    assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
+                    assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
+                    dstPixStart[k] = (a + b + c + d) / sum;
+                }
             }
 
             if (copyBitMap) {
@@ -1979,7 +2444,43 @@ Image::halveRoIForDepth(const RectI & roi,
             }
         }
     }
-} // halveRoIForDepth
+} // halveRowsForDepth
+
+template <typename PIX, int maxValue>
+void
+Image::halveRoIForDepth(const RectI & roi,
+                        bool copyBitMap,
+                        Image* output) const
+{
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) ||
+            (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) ||
+            (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) ||
+            (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+
+    ///handle case where there is only 1 column/row
+    if ( (roi.width() == 1) || (roi.height() == 1) ) {
+        assert( !(roi.width() == 1 && roi.height() == 1) ); /// can't be 1x1
+        halve1DImage(roi, output);
+
+        return;
+    }
+
+    /// Take the lock for both bitmaps since we're about to read/write from them!
+    QWriteLocker k1(&output->_entryLock);
+    QReadLocker k2(&_entryLock);
+    const RectI dstRoI = getHalvedRoI(roi, _bounds);
+    std::vector<std::pair<int, int> > bands = splitRowsAcrossThreads( dstRoI.y1, dstRoI.y2, std::max(0, dstRoI.width()) );
+
+    if (copyBitMap) {
+        output->_bitmap.invalidateTiles(dstRoI);
+    }
+    if (bands.size() <= 1) {
+        halveRowsForDepth<PIX, maxValue>( roi, copyBitMap, output, std::make_pair(dstRoI.y1, dstRoI.y2) );
+    } else {
+        // The bands write distinct rows of output: no further locking is needed
+        TaskScheduler::blockingMap( bands, boost::bind(&Image::halveRowsForDepth<PIX, maxValue>, this, roi, copyBitMap, output, _1) );
+    }
+}
 
 // code proofread and fixed by @devernay on 8/8/2014
 void
@@ -1995,7 +2496,7 @@ Image::halveRoI(const RectI & roi,
         halveRoIForDepth<unsigned short, 65535>(roi, copyBitMap, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        halveRoIForDepth<Half, 1>(roi, copyBitMap, output);
         break;
     case eImageBitDepthFloat:
         halveRoIForDepth<float, 1>(roi, copyBitMap, output);
@@ -2005,6 +2506,30 @@ Image::halveRoI(const RectI & roi,
     }
 }
 
+void
+Image::halveRows(const RectI & roi,
+                 bool copyBitMap,
+                 Image* output,
+                 const std::pair<int, int>& rows) const
+{
+    switch ( getBitDepth() ) {
+    case eImageBitDepthByte:
+        halveRowsForDepth<unsigned char, 255>(roi, copyBitMap, output, rows);
+        break;
+    case eImageBitDepthShort:
+        halveRowsForDepth<unsigned short, 65535>(roi, copyBitMap, output, rows);
+        break;
+    case eImageBitDepthHalf:
+        halveRowsForDepth<Half, 1>(roi, copyBitMap, output, rows);
+        break;
+    case eImageBitDepthFloat:
+        halveRowsForDepth<float, 1>(roi, copyBitMap, output, rows);
+        break;
+    case eImageBitDepthNone:
+        break;
+    }
+}
+
 // code proofread and fixed by @devernay on 8/8/2014
 template <typename PIX, int maxValue>
 void
@@ -2062,14 +2587,15 @@ Image::halve1DImageForDepth(const RectI & roi,
                 assert( !(boost::math::isnan)(*src) ); // check for NaN
                 assert( !(boost::math::isnan)(*(src + rowSize)) ); // check for NaN
 #endif
-                *dst = PIX( (float)( *src + (*src + rowSize) ) / 2. );
+                *dst = PIX( (float)( *src + *(src + rowSize) ) / 2. );
 #ifdef DEBUG_NAN
                 assert( !(boost::math::isnan)(*dst) ); // check for NaN
 #endif
                 ++dst;
                 ++src;
             }
-            src += rowSize;
+            // skip the next row, src was already moved to the next pixel
+            src += 2 * rowSize - _nbComponents;
         }
     }
 }
@@ -2087,7 +2613,7 @@ Image::halve1DImage(const RectI & roi,
         halve1DImageForDepth<unsigned short, 65535>(roi, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        halve1DImageForDepth<Half, 1>(roi, output);
         break;
     case eImageBitDepthFloat:
         halve1DImageForDepth<float, 1>(roi, output);
@@ -2147,27 +2673,17 @@ Image::checkForNaNsAndFix(const RectI& roi)
         return false;
     }
 
-    QWriteLocker k(&_entryLock);
-    unsigned int compsCount = getComponentsCount();
-    bool hasnan = false;
-    for (int y = roi.y1; y < roi.y2; ++y) {
-        float* pix = (float*)pixelAt(roi.x1, y);
-        float* const end = pix +  compsCount * roi.width();
-
-        for (; pix < end; ++pix) {
-            // we remove NaNs, but infinity values should pose no problem
-            // (if they do, please explain here which ones)
+    // we remove NaNs, but infinity values should pose no problem
+    // (if they do, please explain here which ones)
+    ImageStatisticsRequest request;
+    request.fixNaNs = true;
+    ImageStatistics stats;
+    computeStatistics(roi, request, &stats);
 #ifdef DEBUG_NAN
-            assert( !(boost::math::isnan)(*pix) ); // check for NaN
+    assert(stats.getNaNsCount() == 0);
 #endif
-            if ( (boost::math::isnan)(*pix) ) { // check for NaN ((boost::math::isnan)(x) is not slower than x != x and works with -Ofast)
-                *pix = 1.;
-                hasnan = true;
-            }
-        }
-    }
 
-    return hasnan;
+    return stats.getNaNsCount() > 0;
 }
 
 bool
@@ -2211,7 +2727,7 @@ Image::upscaleMipMapForDepth(const RectI & roi,
                              Image* output) const
 {
     assert( getBitDepth() == output->getBitDepth() );
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     ///You should not call this function with a level equal to 0.
     assert(fromLevel > toLevel);
@@ -2306,7 +2822,7 @@ Image::upscaleMipMap(const RectI & roi,
         upscaleMipMapForDepth<unsigned short, 65535>(roi, fromLevel, toLevel, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        upscaleMipMapForDepth<Half, 1>(roi, fromLevel, toLevel, output);
         break;
     case eImageBitDepthFloat:
         upscaleMipMapForDepth<float, 1>(roi, fromLevel, toLevel, output);
@@ -2339,44 +2855,68 @@ Image::buildMipMapLevel(const RectD& dstRoD,
         return;
     }
 
-    const Image* srcImg = this;
-    Image* dstImg = NULL;
-    bool mustFreeSrc = false;
-    RectI previousRoI = roi;
-    ///Build all the mipmap levels until we reach the one we are interested in
+    ///Halve the smallest enclosing po2 rect of each level as we need to render a minimum of the renderWindow
+    std::vector<RectI> levelRoIs(level + 1);
+    levelRoIs[0] = roi;
+    bool hasOneDimensionalLevel = false;
     for (unsigned int i = 1; i <= level; ++i) {
-        ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        RectI halvedRoI = previousRoI.downscalePowerOfTwoSmallestEnclosing(1);
-
-        ///Allocate an image with half the size of the source image
-        dstImg = new Image( getComponents(), dstRoD, halvedRoI, getMipMapLevel() + i, getPixelAspectRatio(), getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
+        hasOneDimensionalLevel |= (levelRoIs[i - 1].width() == 1 || levelRoIs[i - 1].height() == 1);
+        levelRoIs[i] = levelRoIs[i - 1].downscalePowerOfTwoSmallestEnclosing(1);
+    }
 
-        ///Half the source image into dstImg.
-        ///We pass the closestPo2 roi which might not be the entire size of the source image
-        ///If the source image'sroi was originally a po2.
-        srcImg->halveRoI(previousRoI, copyBitMap, dstImg);
+    ///Allocate an image for each level, levelImages[0] is unused: level 0 is this image
+    std::vector<ImagePtr> levelImages(level + 1);
+    for (unsigned int i = 1; i <= level; ++i) {
+        levelImages[i].reset( new Image( getComponents(), dstRoD, levelRoIs[i], getMipMapLevel() + i, getPixelAspectRatio(), getBitDepth(), getPremultiplication(), getFieldingOrder(), true) );
+    }
 
-        ///Clean-up, we should use shared_ptrs for safety
-        if (mustFreeSrc) {
-            delete srcImg;
+    if (hasOneDimensionalLevel) {
+        ///Build all the mipmap levels one after the other until we reach the one we are interested in
+        for (unsigned int i = 1; i <= level; ++i) {
+            const Image* srcImg = (i == 1) ? this : levelImages[i - 1].get();
+            srcImg->halveRoI(levelRoIs[i - 1], copyBitMap, levelImages[i].get());
+        }
+    } else {
+        ///Each band of rows of the last level only depends on the corresponding rows of the previous levels:
+        ///the bands are built concurrently through all the levels at once, while their rows are still in the processor caches.
+        ///The images of the intermediate levels are only accessed here, only this image has to be locked.
+        QReadLocker k(&_entryLock);
+        const RectI & lastRoI = levelRoIs[level];
+        const std::size_t pixelsPerBandRow = (std::size_t)levelRoIs[1].width() << (level - 1);
+        std::vector<std::pair<int, int> > bands = splitRowsAcrossThreads(lastRoI.y1, lastRoI.y2, pixelsPerBandRow);
+        if (copyBitMap) {
+            for (unsigned int i = 1; i <= level; ++i) {
+                levelImages[i]->_bitmap.invalidateTiles(levelRoIs[i]);
+            }
+        }
+        if (bands.size() <= 1) {
+            halveBandOfMipMapLevels( levelRoIs, levelImages, copyBitMap, std::make_pair(lastRoI.y1, lastRoI.y2) );
+        } else {
+            TaskScheduler::blockingMap( bands, boost::bind(&Image::halveBandOfMipMapLevels, this, boost::cref(levelRoIs), boost::cref(levelImages), copyBitMap, _1) );
         }
-
-        ///Switch for next pass
-        previousRoI = halvedRoI;
-        srcImg = dstImg;
-        mustFreeSrc = true;
     }
 
-    assert(srcImg->getBounds() == lastLevelRoI);
+    assert(levelImages[level]->getBounds() == lastLevelRoI);
 
     ///Finally copy the last mipmap level into output.
-    output->pasteFrom( *srcImg, srcImg->getBounds(), copyBitMap);
+    output->pasteFrom( *levelImages[level], levelImages[level]->getBounds(), copyBitMap);
+} // buildMipMapLevel
+
+void
+Image::halveBandOfMipMapLevels(const std::vector<RectI>& levelRoIs,
+                               const std::vector<ImagePtr>& levelImages,
+                               bool copyBitMap,
+                               const std::pair<int, int>& band) const
+{
+    const int lastLevel = (int)levelRoIs.size() - 1;
 
-    ///Clean-up, we should use shared_ptrs for safety
-    if (mustFreeSrc) {
-        delete srcImg;
+    for (int i = 1; i <= lastLevel; ++i) {
+        // The rows [y1, y2[ of the last level come from the rows [y1 * 2^(lastLevel - i), y2 * 2^(lastLevel - i)[ of level i
+        const int scale = 1 << (lastLevel - i);
+        const Image* srcImg = (i == 1) ? this : levelImages[i - 1].get();
+        srcImg->halveRows( levelRoIs[i - 1], copyBitMap, levelImages[i].get(), std::make_pair(band.first * scale, band.second * scale) );
     }
-} // buildMipMapLevel
+}
 
 double
 Image::getScaleFromMipMapLevel(unsigned int level)
@@ -2422,6 +2962,7 @@ Bitmap::copyRowPortion(int x1,
         ++dstBitmap;
         ++srcBitmap;
     }
+    invalidateTiles( RectI(x1, y, x2, y + 1) );
 }
 
 void
@@ -2455,6 +2996,7 @@ Bitmap::copyBitmapPortion(const RectI& roi,
             ++dstCur;
         }
     }
+    invalidateTiles(roi);
 }
 
 template <typename PIX, bool doPremult>
@@ -2501,6 +3043,19 @@ Image::premultForDepth(const RectI& roi)
     if (getComponentsCount() != 4) {
         return;
     }
+    {
+        WriteAccess acc(this);
+        RectI renderWindow;
+        roi.intersect(_bounds, &renderWindow);
+        if ( canProcessRenderedRows(renderWindow, NULL, NULL) ) {
+            RenderedRowsOps ops;
+            ops.premult = doPremult;
+            ops.unpremult = !doPremult;
+            processRenderedRows(renderWindow, NULL, NULL, ops);
+
+            return;
+        }
+    }
     ImageBitDepthEnum depth = getBitDepth();
     switch (depth) {
     case eImageBitDepthByte:
@@ -2509,6 +3064,9 @@ Image::premultForDepth(const RectI& roi)
     case eImageBitDepthShort:
         premultInternal<unsigned short, doPremult>(roi);
         break;
+    case eImageBitDepthHalf:
+        premultInternal<Half, doPremult>(roi);
+        break;
     case eImageBitDepthFloat:
         premultInternal<float, doPremult>(roi);
         break;
@@ -31,6 +31,8 @@
 #include <list>
 #include <map>
 #include <algorithm> // min, max
+#include <utility> // pair
+#include <vector>
 #include <bitset>
 
 #include "Global/GlobalDefines.h"
@@ -40,6 +42,7 @@ CLANG_DIAG_OFF(deprecated)
 CLANG_DIAG_ON(deprecated)
 #include <QtCore/QReadWriteLock>
 
+#include "Engine/Half.h"
 #include "Engine/ImageKey.h"
 #include "Engine/ImagePlaneDesc.h"
 #include "Engine/ImageParams.h"
@@ -70,6 +73,8 @@ public:
     Bitmap(const RectI & bounds)
         : _bounds(bounds)
         , _map( bounds.area() )
+        , _tiles()
+        , _nTilesX(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
@@ -78,11 +83,14 @@ public:
         // "!!!Note that if isIdentity is true it will allocate an empty image object with 0 bytes of data."
         //assert(!rod.isNull());
         std::fill(_map.begin(), _map.end(), 0);
+        initializeTiles(0);
     }
 
     Bitmap()
         : _bounds()
         , _map()
+        , _tiles()
+        , _nTilesX(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
@@ -94,6 +102,7 @@ public:
         _map.resize( _bounds.area() );
 
         std::fill(_map.begin(), _map.end(), 0);
+        initializeTiles(0);
     }
 
     ~Bitmap()
@@ -103,6 +112,7 @@ public:
     void setTo1()
     {
         std::fill(_map.begin(), _map.end(), 1);
+        initializeTiles(1);
     }
 
     const RectI & getBounds() const
@@ -138,6 +148,10 @@ public:
         return &_map.front();
     }
 
+    /**
+     * @brief The non-const accessors give direct access to the pixels: the caller must then call
+     * invalidateTiles() on the region it modifies.
+     **/
     char* getBitmap()
     {
         return &_map.front();
@@ -146,6 +160,18 @@ public:
     const char* getBitmapAt(int x, int y) const;
     char* getBitmapAt(int x, int y);
 
+    /**
+     * @brief Forgets the state of the tiles of the given region, which will be scanned pixel by pixel.
+     * Must be called after modifying the bitmap through getBitmap() or getBitmapAt().
+     **/
+    void invalidateTiles(const RectI& roi) { setTilesState(roi, -1); }
+
+    /**
+     * @brief If all the pixels of the given region, clipped to the bounds, are known to have the same value from the
+     * state of their tiles, returns that value, otherwise returns -1.
+     **/
+    int getUniformValue(const RectI& roi) const;
+
     void copyRowPortion(int x1, int x2, int y, const Bitmap& other);
 
     void copyBitmapPortion(const RectI& roi, const Bitmap& other);
@@ -159,10 +185,24 @@ public:
 private:
     void markFor(const RectI & roi, char value);
 
+    void initializeTiles(char value);
+
+    // Sets the state of the tiles entirely covered by roi to value and forgets the state of the partially covered ones.
+    // A negative value forgets the state of all the tiles covered by roi.
+    void setTilesState(const RectI& roi, int value);
+
 private:
     RectI _bounds;
     std::vector<char> _map;
 
+    /**
+     * The render state is also kept per tile of 64x64 pixels: either the value shared by all the pixels
+     * of the tile (0, 1 or 2) or -1 if they differ or are unknown. This lets the searches for the pixels left
+     * to render skip the rows and columns that cross uniform tiles without looking at their pixels.
+     **/
+    std::vector<signed char> _tiles;
+    int _nTilesX;
+
     /**
      * This represents the zone that has potentially something to render. In minimalNonMarkedRects
      * we intersect the region of interest with the dirty zone. This is useful to optimize the bitmap checking
@@ -247,6 +287,9 @@ public:
     /**
      * @brief Resizes this image so it contains newBounds, copying all the content of the current bounds of the image into
      * a new buffer. This is not thread-safe and should be called only while under an ImageLocker
+     * The new bounds of large images are rounded to a grid of tiles within the region of definition (see getGrownBounds()),
+     * so that requests for slightly bigger bounds, e.g from the successive ticks of a paint stroke, do not
+     * reallocate the image every time.
      **/
     bool ensureBounds(const RectI& newBounds, bool fillWithBlackAndTransparent = false, bool setBitmapTo1 = false);
 
@@ -261,6 +304,13 @@ public:
 
 private:
 
+    /**
+     * @brief The bounds of this image once grown to contain newBounds: the union of both, rounded outwards
+     * to a grid of 128x128 pixel tiles but kept within the region of definition.
+     * Only the dimensions already spanning a tile are rounded, by at most a quarter of their size on each side.
+     **/
+    RectI getGrownBounds(const RectI& newBounds) const;
+
     static void resizeInternal(const Image* srcImg,
                                const RectI& srcBounds,
                                const RectI& merge,
@@ -746,10 +796,21 @@ public:
 
     /**
      * @brief Copies the content of the portion defined by roi of the other image pixels into this image.
-     * The internal bitmap will be copied as well
+     * The internal bitmap will be copied as well.
+     * If roi covers both images, which have the same bounds and format and are in RAM, the pixels are not copied:
+     * the images share them until one of them is written (see isSharingPixels()).
      **/
     void pasteFrom( const Image & src, const RectI & srcRoi, bool copyBitmap = true, const OSGLContextPtr& glContext = OSGLContextPtr() );
 
+    /**
+     * @brief Returns true if the pixels of this image are currently shared with another image.
+     * The first of them to be written through the non-const pixelAt() gets its own copy.
+     **/
+    bool isSharingPixels() const
+    {
+        return _data.isSharingRAM();
+    }
+
     /**
      * @brief Downscales a portion of this image into output.
      * This function will adjust roi to the largest enclosed rectangle for the
@@ -831,6 +892,19 @@ private:
                                bool requiresUnpremult,
                                Image* dstImg) const;
 
+    /**
+     * @brief Converts whole rows with the vectorized kernels of ImageConvertKernels when there is one for this conversion.
+     * @returns False if the conversion must be done by the generic per-pixel code instead.
+     **/
+    bool convertToFormatWithKernels(const RectI & renderWindow,
+                                    ViewerColorSpaceEnum srcColorSpace,
+                                    ViewerColorSpaceEnum dstColorSpace,
+                                    int channelForAlpha,
+                                    bool useAlpha0,
+                                    bool copyBitMap,
+                                    bool requiresUnpremult,
+                                    Image* dstImg) const;
+
     template <typename PIX, bool doPremult>
     void premultInternal(const RectI& roi);
     template <bool doPremult>
@@ -875,12 +949,39 @@ public:
                        float mix,
                        const OSGLContextPtr& glContext = OSGLContextPtr() );
 
+    /**
+     * @brief Same as copyUnProcessedChannels(), followed by applyMaskMix() if useMaskMix is true and by premultImage()
+     * if premult is true. For float RGBA images, they are applied in a single pass over each row, with the vectorized
+     * kernels of ImageConvertKernels, and large RoIs are split across the threads of the TaskScheduler.
+     **/
+    void copyUnProcessedChannelsMaskMixAndPremult( const RectI& roi,
+                                                   ImagePremultiplicationEnum outputPremult,
+                                                   ImagePremultiplicationEnum originalImagePremult,
+                                                   std::bitset<4> processChannels,
+                                                   const ImagePtr& originalImage,
+                                                   bool ignorePremult,
+                                                   bool useMaskMix,
+                                                   const Image* maskImg,
+                                                   bool masked,
+                                                   bool maskInvert,
+                                                   float mix,
+                                                   bool premult,
+                                                   const OSGLContextPtr& glContext = OSGLContextPtr() );
+
     /**
      * @brief Eeturns true if image contains NaNs or infinite values, and fix them.
      * Currently, no OpenGL implementation is provided.
      */
     bool checkForNaNsAndFix(const RectI& roi) WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Computes the statistics of the pixels of this float image in roi in a single pass, see ImageStatistics.
+     * The rows of large RoIs are split across the threads of the TaskScheduler. If request.fixNaNs is true,
+     * the NaNs are replaced by 1 during the same pass.
+     * Currently, no OpenGL implementation is provided.
+     **/
+    void computeStatistics(const RectI& roi, const ImageStatisticsRequest& request, ImageStatistics* stats);
+
     void copyBitmapRowPortion(int x1, int x2, int y, const Image& other);
 
     void copyBitmapPortion(const RectI& roi, const Image& other);
@@ -897,6 +998,55 @@ public:
 
 private:
 
+    /**
+     * @brief The operations applied by processRenderedRows() to each row of a float RGBA image, in this order.
+     **/
+    struct RenderedRowsOps
+    {
+        // Bit c is set if channel c is copied from the original image
+        unsigned int copyChannels;
+        bool maskMix;
+        bool maskInvert;
+        float mix;
+        bool premult;
+        bool unpremult;
+
+        RenderedRowsOps()
+            : copyChannels(0)
+            , maskMix(false)
+            , maskInvert(false)
+            , mix(1.f)
+            , premult(false)
+            , unpremult(false)
+        {
+        }
+    };
+
+    /**
+     * @brief Returns true if processRenderedRows() can be used on roi: this image and originalImg are float RGBA images
+     * in RAM, maskImg is a float alpha image and both contain roi. originalImg and maskImg may be NULL.
+     **/
+    bool canProcessRenderedRows(const RectI& roi, const Image* originalImg, const Image* maskImg) const;
+
+    /**
+     * @brief Applies ops to the rows of roi, split in bands processed concurrently if roi is large enough.
+     * All the images must be locked by the caller.
+     **/
+    void processRenderedRows(const RectI& roi, const Image* originalImg, const Image* maskImg, const RenderedRowsOps& ops);
+
+    void processRenderedRowsBand(const RectI& roi,
+                                 const Image* originalImg,
+                                 const Image* maskImg,
+                                 const RenderedRowsOps& ops,
+                                 const std::pair<int, int>& rows);
+
+    /**
+     * @brief Splits the rows [y1, y2[ in bands of consecutive rows to be processed concurrently by the TaskScheduler.
+     * A single band is returned if there is not enough work for several threads, if the current thread is a worker
+     * of the TaskScheduler or if the TaskScheduler has no idle worker.
+     **/
+    static std::vector<std::pair<int, int> > splitRowsAcrossThreads(int y1, int y2, std::size_t pixelsPerRow);
+
     template<int srcNComps, int dstNComps, typename PIX, int maxValue, bool masked, bool maskInvert>
     void applyMaskMixForMaskInvert(const RectI& roi,
                                    const Image* maskImg,
@@ -1003,6 +1153,27 @@ private:
                           bool copyBitMap,
                           Image* output) const;
 
+    /**
+     * @brief Same as halveRoI but only for the rows [rows.first, rows.second[ of output, without taking any lock.
+     * Distinct rows of output may be halved concurrently.
+     **/
+    void halveRows(const RectI & roi, bool copyBitMap, Image* output, const std::pair<int, int>& rows) const;
+
+    template <typename PIX, int maxValue>
+    void halveRowsForDepth(const RectI & roi,
+                           bool copyBitMap,
+                           Image* output,
+                           const std::pair<int, int>& rows) const;
+
+    /**
+     * @brief Halves this image successively into each of the levelImages, but only the rows of each level
+     * that are needed by the rows [band.first, band.second[ of the last level. Used by buildMipMapLevel().
+     **/
+    void halveBandOfMipMapLevels(const std::vector<RectI>& levelRoIs,
+                                 const std::vector<ImagePtr>& levelImages,
+                                 bool copyBitMap,
+                                 const std::pair<int, int>& band) const;
+
     /**
      * @brief Same as halveRoI but for 1D only (either width == 1 or height == 1)
      **/
@@ -1017,6 +1188,12 @@ private:
     template<typename PIX>
     void pasteFromForDepth(const Image & src, const RectI & srcRoi, bool copyBitmap = true, bool takeSrcLock = true);
 
+    /**
+     * @brief Shares the pixels of src instead of copying them if roi covers this image and src has the same
+     * bounds and format. Both images must be locked. Returns false if the pixels must be copied.
+     **/
+    bool sharePixelsFrom(const Image & src, const RectI & roi, bool copyBitmap);
+
     template <typename PIX, int maxValue>
     void fillForDepth(const RectI & roi, float r, float g, float b, float a);
 
@@ -1073,6 +1250,10 @@ template<>
 inline float
 Image::clampIfInt(float v) { return v; }
 
+template<>
+inline Half
+Image::clampIfInt(float v) { return v; }
+
 NATRON_NAMESPACE_EXIT
 
 #endif // NATRON_ENGINE_IMAGE_H
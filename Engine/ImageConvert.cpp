@@ -38,6 +38,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageConvertKernels.h"
 #include "Engine/Lut.h"
 
 NATRON_NAMESPACE_ENTER
@@ -109,6 +110,55 @@ Image::convertPixelDepth(float pix)
     return pix;
 }
 
+template <>
+Half
+Image::convertPixelDepth(unsigned char pix)
+{
+    return Color::intToFloat<256>(pix);
+}
+
+template <>
+Half
+Image::convertPixelDepth(unsigned short pix)
+{
+    return Color::intToFloat<65536>(pix);
+}
+
+template <>
+Half
+Image::convertPixelDepth(float pix)
+{
+    return pix;
+}
+
+template <>
+Half
+Image::convertPixelDepth(Half pix)
+{
+    return pix;
+}
+
+template <>
+unsigned char
+Image::convertPixelDepth(Half pix)
+{
+    return (unsigned char)Color::floatToInt<256>(pix);
+}
+
+template <>
+unsigned short
+Image::convertPixelDepth(Half pix)
+{
+    return (unsigned short)Color::floatToInt<65536>(pix);
+}
+
+template <>
+float
+Image::convertPixelDepth(Half pix)
+{
+    return pix;
+}
+
 static const Color::Lut*
 lutFromColorspace(ViewerColorSpaceEnum cs)
 {
@@ -207,7 +257,7 @@ Image::convertToFormatInternal_sameComps(const RectI & renderWindow,
                                                              Color::floatToInt<0xff01>(pixFloat) );
                             pix = error[k] >> 8;
                         } else if (dstDepth == eImageBitDepthShort) {
-                            pix = dstLutOp ? dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
+                            pix = dstLutOp ? DSTPIX( dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) ) :
                                   convertPixelDepth<float, DSTPIX>(pixFloat);
                         } else {
                             if (dstLutOp) {
@@ -343,11 +393,11 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                         break;
                     case 3:
                         // RGB is opaque, so no alpha, unless channelForAlpha is 0-2
-                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? 0. : srcPixels[channelForAlpha]);
+                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? SRCPIX(0) : srcPixels[channelForAlpha]);
                         break;
                     case 2:
                         // XY is opaque unless channelForAlpha is  0-1
-                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? 0. : srcPixels[channelForAlpha]);
+                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? SRCPIX(0) : srcPixels[channelForAlpha]);
                         break;
                     case 1:
                         // just copy alpha disregarding channelForAlpha
@@ -429,7 +479,7 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                                                                      Color::floatToInt<0xff01>(pixFloat) );
                                     pix = error[k] >> 8;
                                 } else if (dstMaxValue == 65535) {
-                                    pix = dstLutOp ? dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
+                                    pix = dstLutOp ? DSTPIX( dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) ) :
                                           convertPixelDepth<float, DSTPIX>(pixFloat);
                                 } else {
                                     if (dstLutOp) {
@@ -671,6 +721,153 @@ Image::convertToFormatInternalForDepth(const RectI & renderWindow,
     } // switch
 } // Image::convertToFormatInternalForDepth
 
+namespace {
+
+enum RowConversionEnum
+{
+    eRowConversionNone = 0,
+    eRowConversionFloatToHalf,
+    eRowConversionHalfToFloat,
+    eRowConversionFloatToByte,
+    eRowConversionFloatToShort,
+    eRowConversionByteToFloat,
+    eRowConversionByteToFloatWithLut,
+    eRowConversionShortToFloat,
+    eRowConversionRGBAToRGB,
+    eRowConversionRGBToRGBA,
+    eRowConversionRGBAToAlpha
+};
+
+} // anon namespace
+
+bool
+Image::convertToFormatWithKernels(const RectI & renderWindow,
+                                  ViewerColorSpaceEnum srcColorSpace,
+                                  ViewerColorSpaceEnum dstColorSpace,
+                                  int channelForAlpha,
+                                  bool useAlpha0,
+                                  bool copyBitmap,
+                                  bool requiresUnpremult,
+                                  Image* dstImg) const
+{
+    const int srcNComps = (int)getComponentsCount();
+    const int dstNComps = (int)dstImg->getComponentsCount();
+    const ImageBitDepthEnum srcDepth = getBitDepth();
+    const ImageBitDepthEnum dstDepth = dstImg->getBitDepth();
+    const Color::Lut* srcLut = 0;
+    RowConversionEnum conversion = eRowConversionNone;
+
+    if (srcNComps == dstNComps) {
+        // Same results as convertToFormatInternal_sameComps, which applies no color-space conversion when the color-spaces
+        // are the same and does not dither when converting linear data to 8-bit
+        if (srcColorSpace == dstColorSpace) {
+            if ( (srcDepth == eImageBitDepthFloat) && (dstDepth == eImageBitDepthHalf) ) {
+                // This is what happens when images are cached at half precision: Half uses the F16C instructions when available
+                conversion = eRowConversionFloatToHalf;
+            } else if ( (srcDepth == eImageBitDepthHalf) && (dstDepth == eImageBitDepthFloat) ) {
+                conversion = eRowConversionHalfToFloat;
+            } else if ( ImageConvertKernels::isEnabled() ) {
+                if (srcDepth == eImageBitDepthFloat) {
+                    if (dstDepth == eImageBitDepthByte) {
+                        conversion = eRowConversionFloatToByte;
+                    } else if (dstDepth == eImageBitDepthShort) {
+                        conversion = eRowConversionFloatToShort;
+                    }
+                } else if (dstDepth == eImageBitDepthFloat) {
+                    if (srcDepth == eImageBitDepthByte) {
+                        conversion = eRowConversionByteToFloat;
+                    } else if (srcDepth == eImageBitDepthShort) {
+                        conversion = eRowConversionShortToFloat;
+                    }
+                }
+            }
+        } else if ( ImageConvertKernels::isEnabled() && (srcDepth == eImageBitDepthByte) && (dstDepth == eImageBitDepthFloat) &&
+                    (dstColorSpace == eViewerColorSpaceLinear) ) {
+            // Linearizing 8-bit images, e.g the ones read from files, is a table look-up
+            srcLut = lutFromColorspace(srcColorSpace);
+            if (srcLut) {
+                conversion = eRowConversionByteToFloatWithLut;
+            }
+        }
+    } else if ( ImageConvertKernels::isEnabled() && (srcDepth == eImageBitDepthFloat) && (dstDepth == eImageBitDepthFloat) &&
+                (srcColorSpace == eViewerColorSpaceLinear) && (dstColorSpace == eViewerColorSpaceLinear) && !requiresUnpremult ) {
+        // Same results as convertToFormatInternalForColorSpace for float images without color-space conversion
+        if ( (srcNComps == 4) && (dstNComps == 3) ) {
+            conversion = eRowConversionRGBAToRGB;
+        } else if ( (srcNComps == 3) && (dstNComps == 4) ) {
+            conversion = eRowConversionRGBToRGBA;
+        } else if ( (srcNComps == 4) && (dstNComps == 1) && (channelForAlpha >= -1) && (channelForAlpha <= 3) ) {
+            conversion = eRowConversionRGBAToAlpha;
+            if (channelForAlpha == -1) {
+                channelForAlpha = 3;
+            }
+        }
+    }
+
+    if (conversion == eRowConversionNone) {
+        return false;
+    }
+
+    RectI intersection;
+    if ( !renderWindow.intersect(_bounds, &intersection) ) {
+        return true;
+    }
+    const std::size_t width = (std::size_t)intersection.width();
+    const std::size_t rowElements = width * srcNComps;
+    for (int y = intersection.y1; y < intersection.y2; ++y) {
+        const unsigned char* srcPixels = pixelAt(intersection.x1, y);
+        unsigned char* dstPixels = dstImg->pixelAt(intersection.x1, y);
+
+        switch (conversion) {
+        case eRowConversionFloatToHalf:
+            Half::convertFromFloat( (const float*)srcPixels, (Half*)dstPixels, rowElements );
+            break;
+        case eRowConversionHalfToFloat:
+            Half::convertToFloat( (const Half*)srcPixels, (float*)dstPixels, rowElements );
+            break;
+        case eRowConversionFloatToByte:
+            ImageConvertKernels::convertFloatToByte( (const float*)srcPixels, dstPixels, rowElements );
+            break;
+        case eRowConversionFloatToShort:
+            ImageConvertKernels::convertFloatToShort( (const float*)srcPixels, (unsigned short*)dstPixels, rowElements );
+            break;
+        case eRowConversionByteToFloat:
+            ImageConvertKernels::convertByteToFloat( srcPixels, (float*)dstPixels, rowElements );
+            break;
+        case eRowConversionByteToFloatWithLut: {
+            float* dstFloat = (float*)dstPixels;
+            srcLut->fromColorSpaceUint8ToLinearFloatFast(srcPixels, dstFloat, rowElements);
+            if (srcNComps == 4) {
+                // alpha is linear
+                for (std::size_t x = 0; x < width; ++x) {
+                    dstFloat[x * 4 + 3] = Color::intToFloat<256>(srcPixels[x * 4 + 3]);
+                }
+            }
+            break;
+        }
+        case eRowConversionShortToFloat:
+            ImageConvertKernels::convertShortToFloat( (const unsigned short*)srcPixels, (float*)dstPixels, rowElements );
+            break;
+        case eRowConversionRGBAToRGB:
+            ImageConvertKernels::convertRGBAToRGB( (const float*)srcPixels, (float*)dstPixels, width );
+            break;
+        case eRowConversionRGBToRGBA:
+            ImageConvertKernels::convertRGBToRGBA( (const float*)srcPixels, (float*)dstPixels, width, useAlpha0 ? 0.f : 1.f );
+            break;
+        case eRowConversionRGBAToAlpha:
+            ImageConvertKernels::convertRGBAToAlpha( (const float*)srcPixels, (float*)dstPixels, width, channelForAlpha );
+            break;
+        case eRowConversionNone:
+            break;
+        }
+        if (copyBitmap) {
+            dstImg->copyBitmapRowPortion(intersection.x1, intersection.x2, y, *this);
+        }
+    }
+
+    return true;
+} // Image::convertToFormatWithKernels
+
 void
 Image::convertToFormatCommon(const RectI & renderWindow,
                              ViewerColorSpaceEnum srcColorSpace,
@@ -686,7 +883,19 @@ Image::convertToFormatCommon(const RectI & renderWindow,
 
     assert( _bounds.contains(renderWindow) &&  dstImg->_bounds.contains(renderWindow) );
 
-    if ( dstImg->getComponents().getNumComponents() == getComponents().getNumComponents() ) {
+    ///Same format and no color conversion: this is a plain copy, share the pixels if the whole image is converted
+    if ( ( dstImg->getComponents() == getComponents() ) && ( dstImg->getBitDepth() == getBitDepth() ) &&
+         ( srcColorSpace == dstColorSpace ) && !requiresUnpremult &&
+         dstImg->sharePixelsFrom(*this, renderWindow, copyBitmap) ) {
+        return;
+    }
+
+    if ( convertToFormatWithKernels(renderWindow, srcColorSpace, dstColorSpace, channelForAlpha, useAlpha0, copyBitmap, requiresUnpremult, dstImg) ) {
+        return;
+    }
+
+    bool sameComps = dstImg->getComponents().getNumComponents() == getComponents().getNumComponents();
+    if (sameComps) {
         switch ( dstImg->getBitDepth() ) {
         case eImageBitDepthByte: {
             switch ( getBitDepth() ) {
@@ -702,6 +911,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                              dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
+                                                                               srcColorSpace,
+                                                                               dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternal_sameComps<float, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
@@ -728,6 +940,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                                 dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
+                                                                                  srcColorSpace,
+                                                                                  dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternal_sameComps<float, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
@@ -740,8 +955,34 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             break;
         }
 
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            switch ( getBitDepth() ) {
+            case eImageBitDepthByte:
+                convertToFormatInternal_sameComps<unsigned char, Half, 255, 1>(renderWindow, *this, *dstImg,
+                                                                               srcColorSpace,
+                                                                               dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthShort:
+                convertToFormatInternal_sameComps<unsigned short, Half, 65535, 1>(renderWindow, *this, *dstImg,
+                                                                                  srcColorSpace,
+                                                                                  dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthHalf:
+                ///Same as a copy
+                convertToFormatInternal_sameComps<Half, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                    srcColorSpace,
+                                                                    dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthFloat:
+                convertToFormatInternal_sameComps<float, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                     srcColorSpace,
+                                                                     dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
             break;
+        }
 
         case eImageBitDepthFloat: {
             switch ( getBitDepth() ) {
@@ -756,6 +997,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                    dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, float, 1, 1>(renderWindow, *this, *dstImg,
+                                                                     srcColorSpace,
+                                                                     dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 ///Same as a copy
@@ -793,6 +1037,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                            copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
+                                                                             srcColorSpace,
+                                                                             dstColorSpace,
+                                                                             channelForAlpha,
+                                                                             useAlpha0,
+                                                                             copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
@@ -801,13 +1051,13 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                               channelForAlpha,
                                                                               useAlpha0,
                                                                               copyBitmap, requiresUnpremult);
-
                 break;
             case eImageBitDepthNone:
                 break;
             }
             break;
         }
+
         case eImageBitDepthShort: {
             switch ( getBitDepth() ) {
             case eImageBitDepthByte:
@@ -817,7 +1067,6 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                            channelForAlpha,
                                                                                            useAlpha0,
                                                                                            copyBitmap, requiresUnpremult);
-
                 break;
             case eImageBitDepthShort:
                 convertToFormatInternalForDepth<unsigned short, unsigned short, 65535, 65535>(renderWindow, *this, *dstImg,
@@ -826,9 +1075,14 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                               channelForAlpha,
                                                                                               useAlpha0,
                                                                                               copyBitmap, requiresUnpremult);
-
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
+                                                                                srcColorSpace,
+                                                                                dstColorSpace,
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
@@ -843,8 +1097,47 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             }
             break;
         }
-        case eImageBitDepthHalf:
+
+        case eImageBitDepthHalf: {
+            switch ( getBitDepth() ) {
+            case eImageBitDepthByte:
+                convertToFormatInternalForDepth<unsigned char, Half, 255, 1>(renderWindow, *this, *dstImg,
+                                                                             srcColorSpace,
+                                                                             dstColorSpace,
+                                                                             channelForAlpha,
+                                                                             useAlpha0,
+                                                                             copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthShort:
+                convertToFormatInternalForDepth<unsigned short, Half, 65535, 1>(renderWindow, *this, *dstImg,
+                                                                                srcColorSpace,
+                                                                                dstColorSpace,
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                  srcColorSpace,
+                                                                  dstColorSpace,
+                                                                  channelForAlpha,
+                                                                  useAlpha0,
+                                                                  copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthFloat:
+                convertToFormatInternalForDepth<float, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                   srcColorSpace,
+                                                                   dstColorSpace,
+                                                                   channelForAlpha,
+                                                                   useAlpha0,
+                                                                   copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
             break;
+        }
+
         case eImageBitDepthFloat: {
             switch ( getBitDepth() ) {
             case eImageBitDepthByte:
@@ -862,9 +1155,14 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                  channelForAlpha,
                                                                                  useAlpha0,
                                                                                  copyBitmap, requiresUnpremult);
-
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, float, 1, 1>(renderWindow, *this, *dstImg,
+                                                                   srcColorSpace,
+                                                                   dstColorSpace,
+                                                                   channelForAlpha,
+                                                                   useAlpha0,
+                                                                   copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, float, 1, 1>(renderWindow, *this, *dstImg,
@@ -880,7 +1178,7 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             break;
         }
 
-        default:
+        case eImageBitDepthNone:
             break;
         } // switch
     }
@@ -0,0 +1,1251 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageConvertKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define NATRON_CONVERT_KERNELS_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "Engine/Lut.h"
+
+NATRON_NAMESPACE_ENTER
+
+namespace ImageConvertKernels {
+
+namespace {
+
+struct KernelTable
+{
+    void (*floatToByte)(const float*, unsigned char*, std::size_t);
+    void (*floatToShort)(const float*, unsigned short*, std::size_t);
+    void (*byteToFloat)(const unsigned char*, float*, std::size_t);
+    void (*shortToFloat)(const unsigned short*, float*, std::size_t);
+    void (*byteToFloatWithTable)(const unsigned char*, float*, std::size_t, const float*);
+    void (*rgbaToRGB)(const float*, float*, std::size_t);
+    void (*rgbToRGBA)(const float*, float*, std::size_t, float);
+    void (*rgbaToAlpha)(const float*, float*, std::size_t, int);
+    void (*halveRowsFloat)(const float*, const float*, float*, std::size_t, int);
+    void (*halveRowsShort)(const unsigned short*, const unsigned short*, unsigned short*, std::size_t, int);
+    void (*halveRowsByte)(const unsigned char*, const unsigned char*, unsigned char*, std::size_t, int);
+    void (*premultRGBA)(float*, std::size_t);
+    void (*unpremultRGBA)(float*, std::size_t);
+    void (*copyChannelsRGBA)(const float*, float*, std::size_t, unsigned int);
+    void (*maskMixRGBA)(const float*, const float*, float*, std::size_t, float, bool);
+    void (*reduceRow)(const float*, float*, std::size_t, int, RowStatistics*);
+};
+
+///////////////////////////////////// Scalar /////////////////////////////////////
+
+void
+floatToByteScalar(const float* src,
+                  unsigned char* dst,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = (unsigned char)Color::floatToInt<256>(src[i]);
+    }
+}
+
+void
+floatToShortScalar(const float* src,
+                   unsigned short* dst,
+                   std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = (unsigned short)Color::floatToInt<65536>(src[i]);
+    }
+}
+
+void
+byteToFloatScalar(const unsigned char* src,
+                  float* dst,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = Color::intToFloat<256>(src[i]);
+    }
+}
+
+void
+shortToFloatScalar(const unsigned short* src,
+                   float* dst,
+                   std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = Color::intToFloat<65536>(src[i]);
+    }
+}
+
+void
+byteToFloatWithTableScalar(const unsigned char* src,
+                           float* dst,
+                           std::size_t count,
+                           const float* table)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = table[src[i]];
+    }
+}
+
+void
+rgbaToRGBScalar(const float* src,
+                float* dst,
+                std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i, src += 4, dst += 3) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+void
+rgbToRGBAScalar(const float* src,
+                float* dst,
+                std::size_t count,
+                float alphaValue)
+{
+    for (std::size_t i = 0; i < count; ++i, src += 3, dst += 4) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = alphaValue;
+    }
+}
+
+void
+rgbaToAlphaScalar(const float* src,
+                  float* dst,
+                  std::size_t count,
+                  int channel)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = src[i * 4 + channel];
+    }
+}
+
+// Same expression as Image::halveRoIForDepth(): for integer types the sum is done on int and truncated
+template <typename PIX>
+void
+halveRowsScalar(const PIX* row0,
+                const PIX* row1,
+                PIX* dst,
+                std::size_t count,
+                int nComps)
+{
+    for (std::size_t i = 0; i < count; ++i, row0 += 2 * nComps, row1 += 2 * nComps, dst += nComps) {
+        for (int k = 0; k < nComps; ++k) {
+            dst[k] = (row0[k] + row0[k + nComps] + row1[k] + row1[k + nComps]) / 4;
+        }
+    }
+}
+
+// Same expressions as Image::premultInternal()
+void
+premultRGBAScalar(float* pix,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i, pix += 4) {
+        for (int c = 0; c < 3; ++c) {
+            pix[c] = pix[c] * pix[3];
+        }
+    }
+}
+
+void
+unpremultRGBAScalar(float* pix,
+                    std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i, pix += 4) {
+        if (pix[3] != 0) {
+            for (int c = 0; c < 3; ++c) {
+                pix[c] = pix[c] / pix[3];
+            }
+        }
+    }
+}
+
+void
+copyChannelsRGBAScalar(const float* src,
+                       float* dst,
+                       std::size_t count,
+                       unsigned int channels)
+{
+    for (std::size_t i = 0; i < count; ++i, src += 4, dst += 4) {
+        for (int c = 0; c < 4; ++c) {
+            if ( channels & (1U << c) ) {
+                dst[c] = src[c];
+            }
+        }
+    }
+}
+
+// Same expressions as Image::applyMaskMixForMaskInvert()
+inline float
+maskMixAlpha(const float* mask,
+             std::size_t i,
+             float mix,
+             bool maskInvert)
+{
+    if (!mask) {
+        return mix;
+    }
+    float maskScale = mask[i];
+    if (maskInvert) {
+        maskScale = 1.f - maskScale;
+    }
+
+    return mix * maskScale;
+}
+
+void
+maskMixRGBAScalar(const float* src,
+                  const float* mask,
+                  float* dst,
+                  std::size_t count,
+                  float mix,
+                  bool maskInvert)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const float alpha = maskMixAlpha(mask, i, mix, maskInvert);
+        for (int c = 0; c < 4; ++c) {
+            dst[i * 4 + c] = dst[i * 4 + c] * alpha + (1.f - alpha) * src[i * 4 + c];
+        }
+    }
+}
+
+void
+reduceRowScalar(const float* src,
+                float* fixedDst,
+                std::size_t count,
+                int nComps,
+                RowStatistics* stats)
+{
+    const std::size_t n = count * nComps;
+
+    for (std::size_t i = 0, c = 0; i < n; ++i) {
+        float v = src[i];
+        if ( (boost::math::isnan)(v) ) {
+            ++stats->nans[c];
+            if (fixedDst) {
+                v = 1.f;
+                fixedDst[i] = v;
+            }
+        }
+        if ( !(boost::math::isnan)(v) ) {
+            stats->min[c] = std::min(stats->min[c], v);
+            stats->max[c] = std::max(stats->max[c], v);
+            stats->sum[c] += v;
+        }
+        if ( ++c == (std::size_t)nComps ) {
+            c = 0;
+        }
+    }
+}
+
+const KernelTable scalarKernels = {
+    floatToByteScalar,
+    floatToShortScalar,
+    byteToFloatScalar,
+    shortToFloatScalar,
+    byteToFloatWithTableScalar,
+    rgbaToRGBScalar,
+    rgbToRGBAScalar,
+    rgbaToAlphaScalar,
+    halveRowsScalar<float>,
+    halveRowsScalar<unsigned short>,
+    halveRowsScalar<unsigned char>,
+    premultRGBAScalar,
+    unpremultRGBAScalar,
+    copyChannelsRGBAScalar,
+    maskMixRGBAScalar,
+    reduceRowScalar
+};
+
+#ifdef NATRON_CONVERT_KERNELS_X86
+
+///////////////////////////////////// SSE4.1 /////////////////////////////////////
+
+// Same operations as Color::floatToInt: clamp to [0,1] (NaN gives 0), scale, add 0.5 and truncate.
+// Multiplication and addition must not be fused, hence no FMA in the target instruction sets.
+__attribute__((target("sse4.1")))
+inline __m128i
+quantizeSSE41(__m128 v,
+              __m128 scale)
+{
+    v = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) );
+
+    return _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps(v, scale), _mm_set1_ps(0.5f) ) );
+}
+
+__attribute__((target("sse4.1")))
+void
+floatToByteSSE41(const float* src,
+                 unsigned char* dst,
+                 std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = quantizeSSE41(_mm_loadu_ps(src + i), scale);
+        __m128i b = quantizeSSE41(_mm_loadu_ps(src + i + 4), scale);
+        __m128i c = quantizeSSE41(_mm_loadu_ps(src + i + 8), scale);
+        __m128i d = quantizeSSE41(_mm_loadu_ps(src + i + 12), scale);
+        __m128i bytes = _mm_packus_epi16( _mm_packus_epi32(a, b), _mm_packus_epi32(c, d) );
+        _mm_storeu_si128( (__m128i*)(dst + i), bytes );
+    }
+    floatToByteScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void
+floatToShortSSE41(const float* src,
+                  unsigned short* dst,
+                  std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = quantizeSSE41(_mm_loadu_ps(src + i), scale);
+        __m128i b = quantizeSSE41(_mm_loadu_ps(src + i + 4), scale);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(a, b) );
+    }
+    floatToShortScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void
+byteToFloatSSE41(const unsigned char* src,
+                 float* dst,
+                 std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_ps( dst + i, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu8_epi32(bytes) ), scale) );
+        _mm_storeu_ps( dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu8_epi32( _mm_srli_si128(bytes, 4) ) ), scale) );
+        _mm_storeu_ps( dst + i + 8, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu8_epi32( _mm_srli_si128(bytes, 8) ) ), scale) );
+        _mm_storeu_ps( dst + i + 12, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu8_epi32( _mm_srli_si128(bytes, 12) ) ), scale) );
+    }
+    byteToFloatScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void
+shortToFloatSSE41(const unsigned short* src,
+                  float* dst,
+                  std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i shorts = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_ps( dst + i, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu16_epi32(shorts) ), scale) );
+        _mm_storeu_ps( dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu16_epi32( _mm_srli_si128(shorts, 8) ) ), scale) );
+    }
+    shortToFloatScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void
+rgbaToRGBSSE41(const float* src,
+               float* dst,
+               std::size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    // Each store writes one float too many, which is overwritten by the next pixel: the last pixel is done separately
+    for (std::size_t i = 0; i < count - 1; ++i) {
+        _mm_storeu_ps( dst + i * 3, _mm_loadu_ps(src + i * 4) );
+    }
+    rgbaToRGBScalar(src + (count - 1) * 4, dst + (count - 1) * 3, 1);
+}
+
+__attribute__((target("sse4.1")))
+void
+rgbToRGBASSE41(const float* src,
+               float* dst,
+               std::size_t count,
+               float alphaValue)
+{
+    if (count == 0) {
+        return;
+    }
+    const __m128 alpha = _mm_set1_ps(alphaValue);
+    // Each load reads the first float of the next pixel: the last pixel is done separately
+    for (std::size_t i = 0; i < count - 1; ++i) {
+        _mm_storeu_ps( dst + i * 4, _mm_blend_ps(_mm_loadu_ps(src + i * 3), alpha, 0x8) );
+    }
+    rgbToRGBAScalar(src + (count - 1) * 3, dst + (count - 1) * 4, 1, alphaValue);
+}
+
+__attribute__((target("sse4.1")))
+void
+rgbaToAlphaSSE41(const float* src,
+                 float* dst,
+                 std::size_t count,
+                 int channel)
+{
+    assert(channel >= 0 && channel < 4);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 channels[4] = {
+            _mm_loadu_ps(src + i * 4), _mm_loadu_ps(src + i * 4 + 4), _mm_loadu_ps(src + i * 4 + 8), _mm_loadu_ps(src + i * 4 + 12)
+        };
+        _MM_TRANSPOSE4_PS(channels[0], channels[1], channels[2], channels[3]);
+        _mm_storeu_ps(dst + i, channels[channel]);
+    }
+    rgbaToAlphaScalar(src + i * 4, dst + i, count - i, channel);
+}
+
+// The additions are done in the same order as the generic code, ((a + b) + c) + d, and multiplying by 0.25
+// is exact like the division by 4: the results are identical.
+__attribute__((target("sse4.1")))
+void
+halveRowsFloatSSE41(const float* row0,
+                    const float* row1,
+                    float* dst,
+                    std::size_t count,
+                    int nComps)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    std::size_t i = 0;
+
+    if (nComps == 4) {
+        for (; i < count; ++i) {
+            const float* a = row0 + i * 8;
+            const float* c = row1 + i * 8;
+            __m128 sum = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_loadu_ps(a), _mm_loadu_ps(a + 4) ), _mm_loadu_ps(c) ), _mm_loadu_ps(c + 4) );
+            _mm_storeu_ps( dst + i * 4, _mm_mul_ps(sum, quarter) );
+        }
+    } else if (nComps == 1) {
+        for (; i + 4 <= count; i += 4) {
+            __m128 ab0 = _mm_loadu_ps(row0 + i * 2);
+            __m128 ab1 = _mm_loadu_ps(row0 + i * 2 + 4);
+            __m128 cd0 = _mm_loadu_ps(row1 + i * 2);
+            __m128 cd1 = _mm_loadu_ps(row1 + i * 2 + 4);
+            __m128 a = _mm_shuffle_ps( ab0, ab1, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 b = _mm_shuffle_ps( ab0, ab1, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m128 c = _mm_shuffle_ps( cd0, cd1, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 d = _mm_shuffle_ps( cd0, cd1, _MM_SHUFFLE(3, 1, 3, 1) );
+            _mm_storeu_ps( dst + i, _mm_mul_ps(_mm_add_ps( _mm_add_ps( _mm_add_ps(a, b), c ), d ), quarter) );
+        }
+    }
+    halveRowsScalar<float>(row0 + i * 2 * nComps, row1 + i * 2 * nComps, dst + i * nComps, count - i, nComps);
+}
+
+// Byte shuffle that makes the components of 2 horizontally adjacent pixels adjacent, for 1, 2 or 4 components
+// of 1 byte (elementSize = 1) or 2 bytes (elementSize = 2).
+__attribute__((target("sse4.1")))
+inline __m128i
+pairShuffleMaskSSE41(int nComps,
+                     int elementSize)
+{
+    if (elementSize == 1) {
+        if (nComps == 4) {
+            return _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+        } else if (nComps == 2) {
+            return _mm_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+        }
+    } else {
+        if (nComps == 4) {
+            return _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+        } else if (nComps == 2) {
+            return _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+        }
+    }
+
+    return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+__attribute__((target("sse4.1")))
+void
+halveRowsShortSSE41(const unsigned short* row0,
+                    const unsigned short* row1,
+                    unsigned short* dst,
+                    std::size_t count,
+                    int nComps)
+{
+    std::size_t i = 0;
+
+    if (nComps != 3) {
+        // 8 source values per row give 4 destination values: the sums need 32 bits
+        const __m128i mask = pairShuffleMaskSSE41(nComps, 2);
+        const __m128i low16 = _mm_set1_epi32(0xFFFF);
+        const std::size_t nValues = count * nComps;
+        std::size_t v = 0;
+        for (; v + 4 <= nValues; v += 4) {
+            __m128i ab = _mm_shuffle_epi8(_mm_loadu_si128( (const __m128i*)(row0 + v * 2) ), mask);
+            __m128i cd = _mm_shuffle_epi8(_mm_loadu_si128( (const __m128i*)(row1 + v * 2) ), mask);
+            __m128i sum = _mm_add_epi32( _mm_add_epi32( _mm_and_si128(ab, low16), _mm_srli_epi32(ab, 16) ),
+                                         _mm_add_epi32( _mm_and_si128(cd, low16), _mm_srli_epi32(cd, 16) ) );
+            sum = _mm_srli_epi32(sum, 2);
+            _mm_storel_epi64( (__m128i*)(dst + v), _mm_packus_epi32(sum, sum) );
+        }
+        i = v / nComps;
+    }
+    halveRowsScalar<unsigned short>(row0 + i * 2 * nComps, row1 + i * 2 * nComps, dst + i * nComps, count - i, nComps);
+}
+
+__attribute__((target("sse4.1")))
+void
+halveRowsByteSSE41(const unsigned char* row0,
+                   const unsigned char* row1,
+                   unsigned char* dst,
+                   std::size_t count,
+                   int nComps)
+{
+    std::size_t i = 0;
+
+    if (nComps != 3) {
+        // 16 source values per row give 8 destination values, the sums of pairs fit in 16 bits
+        const __m128i mask = pairShuffleMaskSSE41(nComps, 1);
+        const __m128i ones = _mm_set1_epi8(1);
+        const std::size_t nValues = count * nComps;
+        std::size_t v = 0;
+        for (; v + 8 <= nValues; v += 8) {
+            __m128i ab = _mm_shuffle_epi8(_mm_loadu_si128( (const __m128i*)(row0 + v * 2) ), mask);
+            __m128i cd = _mm_shuffle_epi8(_mm_loadu_si128( (const __m128i*)(row1 + v * 2) ), mask);
+            __m128i sum = _mm_add_epi16( _mm_maddubs_epi16(ab, ones), _mm_maddubs_epi16(cd, ones) );
+            sum = _mm_srli_epi16(sum, 2);
+            _mm_storel_epi64( (__m128i*)(dst + v), _mm_packus_epi16(sum, sum) );
+        }
+        i = v / nComps;
+    }
+    halveRowsScalar<unsigned char>(row0 + i * 2 * nComps, row1 + i * 2 * nComps, dst + i * nComps, count - i, nComps);
+}
+
+// The color channels are multiplied or divided by the alpha of the pixel, which is left untouched
+__attribute__((target("sse4.1")))
+void
+premultRGBASSE41(float* pix,
+                 std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i, pix += 4) {
+        __m128 v = _mm_loadu_ps(pix);
+        __m128 alpha = _mm_shuffle_ps( v, v, _MM_SHUFFLE(3, 3, 3, 3) );
+        _mm_storeu_ps( pix, _mm_blend_ps(_mm_mul_ps(v, alpha), v, 0x8) );
+    }
+}
+
+__attribute__((target("sse4.1")))
+void
+unpremultRGBASSE41(float* pix,
+                   std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i, pix += 4) {
+        __m128 v = _mm_loadu_ps(pix);
+        __m128 alpha = _mm_shuffle_ps( v, v, _MM_SHUFFLE(3, 3, 3, 3) );
+        __m128 divided = _mm_blendv_ps( v, _mm_div_ps(v, alpha), _mm_cmpneq_ps( alpha, _mm_setzero_ps() ) );
+        _mm_storeu_ps( pix, _mm_blend_ps(divided, v, 0x8) );
+    }
+}
+
+__attribute__((target("sse4.1")))
+inline __m128
+channelsMaskSSE41(unsigned int channels)
+{
+    return _mm_castsi128_ps( _mm_setr_epi32( (channels & 1) ? -1 : 0, (channels & 2) ? -1 : 0, (channels & 4) ? -1 : 0, (channels & 8) ? -1 : 0 ) );
+}
+
+__attribute__((target("sse4.1")))
+void
+copyChannelsRGBASSE41(const float* src,
+                      float* dst,
+                      std::size_t count,
+                      unsigned int channels)
+{
+    const __m128 mask = channelsMaskSSE41(channels);
+
+    for (std::size_t i = 0; i < count; ++i, src += 4, dst += 4) {
+        _mm_storeu_ps( dst, _mm_blendv_ps( _mm_loadu_ps(dst), _mm_loadu_ps(src), mask ) );
+    }
+}
+
+// Multiplications and additions in the same order as the generic code, without FMA: the results are identical.
+__attribute__((target("sse4.1")))
+void
+maskMixRGBASSE41(const float* src,
+                 const float* mask,
+                 float* dst,
+                 std::size_t count,
+                 float mix,
+                 bool maskInvert)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const float alpha = maskMixAlpha(mask, i, mix, maskInvert);
+        __m128 mixed = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps(dst + i * 4), _mm_set1_ps(alpha) ),
+                                   _mm_mul_ps( _mm_set1_ps(1.f - alpha), _mm_loadu_ps(src + i * 4) ) );
+        _mm_storeu_ps(dst + i * 4, mixed);
+    }
+}
+
+// The values are accumulated in vectors of 4 components: for 3 components, lane l of the k-th vector of each group
+// of 3 vectors holds component (4 * k + l) % 3. The sums are accumulated in double precision.
+__attribute__((target("sse4.1")))
+void
+reduceRowSSE41(const float* src,
+               float* fixedDst,
+               std::size_t count,
+               int nComps,
+               RowStatistics* stats)
+{
+    const int period = (nComps == 3) ? 3 : 1;
+    const std::size_t n = count * nComps;
+    const __m128 infinity = _mm_set1_ps( std::numeric_limits<float>::infinity() );
+    const __m128 minusInfinity = _mm_set1_ps( -std::numeric_limits<float>::infinity() );
+    __m128 mins[3], maxs[3];
+    __m128d sumsLow[3], sumsHigh[3];
+    __m128i nans[3];
+
+    for (int k = 0; k < period; ++k) {
+        mins[k] = infinity;
+        maxs[k] = minusInfinity;
+        sumsLow[k] = sumsHigh[k] = _mm_setzero_pd();
+        nans[k] = _mm_setzero_si128();
+    }
+    std::size_t i = 0;
+    for (; i + 4 * period <= n; i += 4 * period) {
+        for (int k = 0; k < period; ++k) {
+            __m128 v = _mm_loadu_ps(src + i + 4 * k);
+            __m128 isNaN = _mm_cmpunord_ps(v, v);
+            // the comparison gives -1 in the lanes that are NaN
+            nans[k] = _mm_sub_epi32( nans[k], _mm_castps_si128(isNaN) );
+            if ( fixedDst && _mm_movemask_ps(isNaN) ) {
+                v = _mm_blendv_ps(v, _mm_set1_ps(1.f), isNaN);
+                _mm_storeu_ps(fixedDst + i + 4 * k, v);
+                isNaN = _mm_setzero_ps();
+            }
+            mins[k] = _mm_min_ps( mins[k], _mm_blendv_ps(v, infinity, isNaN) );
+            maxs[k] = _mm_max_ps( maxs[k], _mm_blendv_ps(v, minusInfinity, isNaN) );
+            v = _mm_andnot_ps(isNaN, v);
+            sumsLow[k] = _mm_add_pd( sumsLow[k], _mm_cvtps_pd(v) );
+            sumsHigh[k] = _mm_add_pd( sumsHigh[k], _mm_cvtps_pd( _mm_movehl_ps(v, v) ) );
+        }
+    }
+    for (int k = 0; k < period; ++k) {
+        float laneMins[4], laneMaxs[4];
+        double laneSums[4];
+        int laneNaNs[4];
+        _mm_storeu_ps(laneMins, mins[k]);
+        _mm_storeu_ps(laneMaxs, maxs[k]);
+        _mm_storeu_pd(laneSums, sumsLow[k]);
+        _mm_storeu_pd(laneSums + 2, sumsHigh[k]);
+        _mm_storeu_si128( (__m128i*)laneNaNs, nans[k] );
+        for (int l = 0; l < 4; ++l) {
+            const int c = (4 * k + l) % nComps;
+            stats->min[c] = std::min(stats->min[c], laneMins[l]);
+            stats->max[c] = std::max(stats->max[c], laneMaxs[l]);
+            stats->sum[c] += laneSums[l];
+            stats->nans[c] += laneNaNs[l];
+        }
+    }
+    // i is a multiple of the number of components: the remaining pixels start with the first component
+    reduceRowScalar(src + i, fixedDst ? fixedDst + i : NULL, (n - i) / nComps, nComps, stats);
+}
+
+const KernelTable sse41Kernels = {
+    floatToByteSSE41,
+    floatToShortSSE41,
+    byteToFloatSSE41,
+    shortToFloatSSE41,
+    byteToFloatWithTableScalar, // no gather instruction before AVX2
+    rgbaToRGBSSE41,
+    rgbToRGBASSE41,
+    rgbaToAlphaSSE41,
+    halveRowsFloatSSE41,
+    halveRowsShortSSE41,
+    halveRowsByteSSE41,
+    premultRGBASSE41,
+    unpremultRGBASSE41,
+    copyChannelsRGBASSE41,
+    maskMixRGBASSE41,
+    reduceRowSSE41
+};
+
+///////////////////////////////////// AVX2 /////////////////////////////////////
+
+__attribute__((target("avx2")))
+inline __m256i
+quantizeAVX2(__m256 v,
+             __m256 scale)
+{
+    v = _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) );
+
+    return _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps(v, scale), _mm256_set1_ps(0.5f) ) );
+}
+
+__attribute__((target("avx2")))
+void
+floatToByteAVX2(const float* src,
+                unsigned char* dst,
+                std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(255.f);
+    // The packs work within each 128-bit lane: this puts the 32-bit groups of 4 bytes back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    std::size_t i = 0;
+
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = quantizeAVX2(_mm256_loadu_ps(src + i), scale);
+        __m256i b = quantizeAVX2(_mm256_loadu_ps(src + i + 8), scale);
+        __m256i c = quantizeAVX2(_mm256_loadu_ps(src + i + 16), scale);
+        __m256i d = quantizeAVX2(_mm256_loadu_ps(src + i + 24), scale);
+        __m256i bytes = _mm256_packus_epi16( _mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d) );
+        _mm256_storeu_si256( (__m256i*)(dst + i), _mm256_permutevar8x32_epi32(bytes, order) );
+    }
+    floatToByteSSE41(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void
+floatToShortAVX2(const float* src,
+                 unsigned short* dst,
+                 std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = quantizeAVX2(_mm256_loadu_ps(src + i), scale);
+        __m256i b = quantizeAVX2(_mm256_loadu_ps(src + i + 8), scale);
+        // The pack works within each 128-bit lane: put the 64-bit groups of 4 shorts back in order
+        __m256i shorts = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256( (__m256i*)(dst + i), shorts );
+    }
+    floatToShortSSE41(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void
+byteToFloatAVX2(const unsigned char* src,
+                float* dst,
+                std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i ints = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(ints), scale) );
+    }
+    byteToFloatScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void
+shortToFloatAVX2(const unsigned short* src,
+                 float* dst,
+                 std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i ints = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(ints), scale) );
+    }
+    shortToFloatScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void
+byteToFloatWithTableAVX2(const unsigned char* src,
+                         float* dst,
+                         std::size_t count,
+                         const float* table)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i indices = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_i32gather_ps(table, indices, 4) );
+    }
+    byteToFloatWithTableScalar(src + i, dst + i, count - i, table);
+}
+
+__attribute__((target("avx2")))
+void
+halveRowsFloatAVX2(const float* row0,
+                   const float* row1,
+                   float* dst,
+                   std::size_t count,
+                   int nComps)
+{
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    std::size_t i = 0;
+
+    if (nComps == 4) {
+        for (; i + 2 <= count; i += 2) {
+            const float* ab = row0 + i * 8;
+            const float* cd = row1 + i * 8;
+            __m256 ab0 = _mm256_loadu_ps(ab);
+            __m256 ab1 = _mm256_loadu_ps(ab + 8);
+            __m256 cd0 = _mm256_loadu_ps(cd);
+            __m256 cd1 = _mm256_loadu_ps(cd + 8);
+            __m256 a = _mm256_permute2f128_ps(ab0, ab1, 0x20);
+            __m256 b = _mm256_permute2f128_ps(ab0, ab1, 0x31);
+            __m256 c = _mm256_permute2f128_ps(cd0, cd1, 0x20);
+            __m256 d = _mm256_permute2f128_ps(cd0, cd1, 0x31);
+            _mm256_storeu_ps( dst + i * 4, _mm256_mul_ps(_mm256_add_ps( _mm256_add_ps( _mm256_add_ps(a, b), c ), d ), quarter) );
+        }
+    } else if (nComps == 1) {
+        for (; i + 8 <= count; i += 8) {
+            __m256 ab0 = _mm256_loadu_ps(row0 + i * 2);
+            __m256 ab1 = _mm256_loadu_ps(row0 + i * 2 + 8);
+            __m256 cd0 = _mm256_loadu_ps(row1 + i * 2);
+            __m256 cd1 = _mm256_loadu_ps(row1 + i * 2 + 8);
+            // The shuffles work within each 128-bit lane: the result is put back in order at the end
+            __m256 a = _mm256_shuffle_ps( ab0, ab1, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m256 b = _mm256_shuffle_ps( ab0, ab1, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m256 c = _mm256_shuffle_ps( cd0, cd1, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m256 d = _mm256_shuffle_ps( cd0, cd1, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m256 result = _mm256_mul_ps(_mm256_add_ps( _mm256_add_ps( _mm256_add_ps(a, b), c ), d ), quarter);
+            result = _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd(result), _MM_SHUFFLE(3, 1, 2, 0) ) );
+            _mm256_storeu_ps(dst + i, result);
+        }
+    }
+    halveRowsFloatSSE41(row0 + i * 2 * nComps, row1 + i * 2 * nComps, dst + i * nComps, count - i, nComps);
+}
+
+__attribute__((target("avx2")))
+void
+halveRowsShortAVX2(const unsigned short* row0,
+                   const unsigned short* row1,
+                   unsigned short* dst,
+                   std::size_t count,
+                   int nComps)
+{
+    std::size_t i = 0;
+
+    if (nComps != 3) {
+        const __m256i mask = _mm256_broadcastsi128_si256( pairShuffleMaskSSE41(nComps, 2) );
+        const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+        const std::size_t nValues = count * nComps;
+        std::size_t v = 0;
+        for (; v + 8 <= nValues; v += 8) {
+            __m256i ab = _mm256_shuffle_epi8(_mm256_loadu_si256( (const __m256i*)(row0 + v * 2) ), mask);
+            __m256i cd = _mm256_shuffle_epi8(_mm256_loadu_si256( (const __m256i*)(row1 + v * 2) ), mask);
+            __m256i sum = _mm256_add_epi32( _mm256_add_epi32( _mm256_and_si256(ab, low16), _mm256_srli_epi32(ab, 16) ),
+                                            _mm256_add_epi32( _mm256_and_si256(cd, low16), _mm256_srli_epi32(cd, 16) ) );
+            sum = _mm256_srli_epi32(sum, 2);
+            // The pack works within each 128-bit lane: gather the 2 useful 64-bit halves
+            __m256i packed = _mm256_permute4x64_epi64( _mm256_packus_epi32(sum, sum), _MM_SHUFFLE(3, 1, 2, 0) );
+            _mm_storeu_si128( (__m128i*)(dst + v), _mm256_castsi256_si128(packed) );
+        }
+        i = v / nComps;
+    }
+    halveRowsShortSSE41(row0 + i * 2 * nComps, row1 + i * 2 * nComps, dst + i * nComps, count - i, nComps);
+}
+
+__attribute__((target("avx2")))
+void
+halveRowsByteAVX2(const unsigned char* row0,
+                  const unsigned char* row1,
+                  unsigned char* dst,
+                  std::size_t count,
+                  int nComps)
+{
+    std::size_t i = 0;
+
+    if (nComps != 3) {
+        const __m256i mask = _mm256_broadcastsi128_si256( pairShuffleMaskSSE41(nComps, 1) );
+        const __m256i ones = _mm256_set1_epi8(1);
+        const std::size_t nValues = count * nComps;
+        std::size_t v = 0;
+        for (; v + 16 <= nValues; v += 16) {
+            __m256i ab = _mm256_shuffle_epi8(_mm256_loadu_si256( (const __m256i*)(row0 + v * 2) ), mask);
+            __m256i cd = _mm256_shuffle_epi8(_mm256_loadu_si256( (const __m256i*)(row1 + v * 2) ), mask);
+            __m256i sum = _mm256_add_epi16( _mm256_maddubs_epi16(ab, ones), _mm256_maddubs_epi16(cd, ones) );
+            sum = _mm256_srli_epi16(sum, 2);
+            __m256i packed = _mm256_permute4x64_epi64( _mm256_packus_epi16(sum, sum), _MM_SHUFFLE(3, 1, 2, 0) );
+            _mm_storeu_si128( (__m128i*)(dst + v), _mm256_castsi256_si128(packed) );
+        }
+        i = v / nComps;
+    }
+    halveRowsByteSSE41(row0 + i * 2 * nComps, row1 + i * 2 * nComps, dst + i * nComps, count - i, nComps);
+}
+
+// 2 pixels at a time, see the SSE4.1 versions
+__attribute__((target("avx2")))
+void
+premultRGBAAVX2(float* pix,
+                std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m256 v = _mm256_loadu_ps(pix + i * 4);
+        __m256 alpha = _mm256_permute_ps( v, _MM_SHUFFLE(3, 3, 3, 3) );
+        _mm256_storeu_ps( pix + i * 4, _mm256_blend_ps(_mm256_mul_ps(v, alpha), v, 0x88) );
+    }
+    premultRGBASSE41(pix + i * 4, count - i);
+}
+
+__attribute__((target("avx2")))
+void
+unpremultRGBAAVX2(float* pix,
+                  std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m256 v = _mm256_loadu_ps(pix + i * 4);
+        __m256 alpha = _mm256_permute_ps( v, _MM_SHUFFLE(3, 3, 3, 3) );
+        __m256 divided = _mm256_blendv_ps( v, _mm256_div_ps(v, alpha), _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_NEQ_UQ) );
+        _mm256_storeu_ps( pix + i * 4, _mm256_blend_ps(divided, v, 0x88) );
+    }
+    unpremultRGBASSE41(pix + i * 4, count - i);
+}
+
+__attribute__((target("avx2")))
+void
+maskMixRGBAAVX2(const float* src,
+                const float* mask,
+                float* dst,
+                std::size_t count,
+                float mix,
+                bool maskInvert)
+{
+    std::size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        const float alpha0 = maskMixAlpha(mask, i, mix, maskInvert);
+        const float alpha1 = maskMixAlpha(mask, i + 1, mix, maskInvert);
+        __m256 alpha = _mm256_setr_ps(alpha0, alpha0, alpha0, alpha0, alpha1, alpha1, alpha1, alpha1);
+        __m256 oneMinusAlpha = _mm256_setr_ps(1.f - alpha0, 1.f - alpha0, 1.f - alpha0, 1.f - alpha0,
+                                              1.f - alpha1, 1.f - alpha1, 1.f - alpha1, 1.f - alpha1);
+        __m256 mixed = _mm256_add_ps( _mm256_mul_ps(_mm256_loadu_ps(dst + i * 4), alpha),
+                                      _mm256_mul_ps( oneMinusAlpha, _mm256_loadu_ps(src + i * 4) ) );
+        _mm256_storeu_ps(dst + i * 4, mixed);
+    }
+    maskMixRGBASSE41(src + i * 4, mask ? mask + i : NULL, dst + i * 4, count - i, mix, maskInvert);
+}
+
+const KernelTable avx2Kernels = {
+    floatToByteAVX2,
+    floatToShortAVX2,
+    byteToFloatAVX2,
+    shortToFloatAVX2,
+    byteToFloatWithTableAVX2,
+    rgbaToRGBSSE41, // these are bound by the memory bandwidth: 128-bit shuffles are enough
+    rgbToRGBASSE41,
+    rgbaToAlphaSSE41,
+    halveRowsFloatAVX2,
+    halveRowsShortAVX2,
+    halveRowsByteAVX2,
+    premultRGBAAVX2,
+    unpremultRGBAAVX2,
+    copyChannelsRGBASSE41, // bound by the memory bandwidth as well
+    maskMixRGBAAVX2,
+    reduceRowSSE41 // bound by the memory bandwidth as well
+};
+
+InstructionSetEnum
+detectInstructionSet()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if ( !__get_cpuid(1, &eax, &ebx, &ecx, &edx) ) {
+        return eInstructionSetScalar;
+    }
+    const unsigned int sse41 = 1U << 19;
+    if ( !(ecx & sse41) ) {
+        return eInstructionSetScalar;
+    }
+
+    // AVX2 instructions are VEX-encoded: the OS must also save the AVX registers (OSXSAVE, then XCR0 bits 1 and 2)
+    const unsigned int osxsave = 1U << 27;
+    const unsigned int avx = 1U << 28;
+    if ( (ecx & (osxsave | avx)) != (osxsave | avx) ) {
+        return eInstructionSetSSE41;
+    }
+    unsigned int xcr0Low, xcr0High;
+    __asm__ ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+    if ( (xcr0Low & 0x6) != 0x6 ) {
+        return eInstructionSetSSE41;
+    }
+    const unsigned int avx2 = 1U << 5;
+    if ( !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & avx2) ) {
+        return eInstructionSetSSE41;
+    }
+
+    return eInstructionSetAVX2;
+}
+
+#else // !NATRON_CONVERT_KERNELS_X86
+
+InstructionSetEnum
+detectInstructionSet()
+{
+    return eInstructionSetScalar;
+}
+
+#endif // NATRON_CONVERT_KERNELS_X86
+
+const KernelTable*
+kernelsForInstructionSet(InstructionSetEnum set)
+{
+    switch (set) {
+#ifdef NATRON_CONVERT_KERNELS_X86
+    case eInstructionSetAVX2:
+
+        return &avx2Kernels;
+    case eInstructionSetSSE41:
+
+        return &sse41Kernels;
+#endif
+    default:
+
+        return &scalarKernels;
+    }
+}
+
+const InstructionSetEnum supportedInstructionSet = detectInstructionSet();
+InstructionSetEnum currentInstructionSet = supportedInstructionSet;
+const KernelTable* currentKernels = kernelsForInstructionSet(supportedInstructionSet);
+} // anon namespace
+
+InstructionSetEnum
+getSupportedInstructionSet()
+{
+    return supportedInstructionSet;
+}
+
+InstructionSetEnum
+getInstructionSet()
+{
+    return currentInstructionSet;
+}
+
+void
+setInstructionSet(InstructionSetEnum set)
+{
+    if (set > supportedInstructionSet) {
+        set = supportedInstructionSet;
+    }
+    currentInstructionSet = set;
+    currentKernels = kernelsForInstructionSet(set);
+}
+
+const char*
+getInstructionSetName(InstructionSetEnum set)
+{
+    switch (set) {
+    case eInstructionSetNone:
+
+        return "none";
+    case eInstructionSetScalar:
+
+        return "scalar";
+    case eInstructionSetSSE41:
+
+        return "SSE4.1";
+    case eInstructionSetAVX2:
+
+        return "AVX2";
+    }
+
+    return "";
+}
+
+bool
+isEnabled()
+{
+    return currentInstructionSet != eInstructionSetNone;
+}
+
+void
+convertFloatToByte(const float* src,
+                   unsigned char* dst,
+                   std::size_t count)
+{
+    currentKernels->floatToByte(src, dst, count);
+}
+
+void
+convertFloatToShort(const float* src,
+                    unsigned short* dst,
+                    std::size_t count)
+{
+    currentKernels->floatToShort(src, dst, count);
+}
+
+void
+convertByteToFloat(const unsigned char* src,
+                   float* dst,
+                   std::size_t count)
+{
+    currentKernels->byteToFloat(src, dst, count);
+}
+
+void
+convertShortToFloat(const unsigned short* src,
+                    float* dst,
+                    std::size_t count)
+{
+    currentKernels->shortToFloat(src, dst, count);
+}
+
+void
+convertByteToFloatWithTable(const unsigned char* src,
+                            float* dst,
+                            std::size_t count,
+                            const float* table)
+{
+    currentKernels->byteToFloatWithTable(src, dst, count, table);
+}
+
+void
+convertRGBAToRGB(const float* src,
+                 float* dst,
+                 std::size_t count)
+{
+    currentKernels->rgbaToRGB(src, dst, count);
+}
+
+void
+convertRGBToRGBA(const float* src,
+                 float* dst,
+                 std::size_t count,
+                 float alphaValue)
+{
+    currentKernels->rgbToRGBA(src, dst, count, alphaValue);
+}
+
+void
+convertRGBAToAlpha(const float* src,
+                   float* dst,
+                   std::size_t count,
+                   int channel)
+{
+    currentKernels->rgbaToAlpha(src, dst, count, channel);
+}
+
+void
+halveRowsFloat(const float* row0,
+               const float* row1,
+               float* dst,
+               std::size_t count,
+               int nComps)
+{
+    currentKernels->halveRowsFloat(row0, row1, dst, count, nComps);
+}
+
+void
+halveRowsShort(const unsigned short* row0,
+               const unsigned short* row1,
+               unsigned short* dst,
+               std::size_t count,
+               int nComps)
+{
+    currentKernels->halveRowsShort(row0, row1, dst, count, nComps);
+}
+
+void
+halveRowsByte(const unsigned char* row0,
+              const unsigned char* row1,
+              unsigned char* dst,
+              std::size_t count,
+              int nComps)
+{
+    currentKernels->halveRowsByte(row0, row1, dst, count, nComps);
+}
+
+void
+premultRGBA(float* pix,
+            std::size_t count)
+{
+    currentKernels->premultRGBA(pix, count);
+}
+
+void
+unpremultRGBA(float* pix,
+              std::size_t count)
+{
+    currentKernels->unpremultRGBA(pix, count);
+}
+
+void
+copyChannelsRGBA(const float* src,
+                 float* dst,
+                 std::size_t count,
+                 unsigned int channels)
+{
+    currentKernels->copyChannelsRGBA(src, dst, count, channels);
+}
+
+void
+maskMixRGBA(const float* src,
+            const float* mask,
+            float* dst,
+            std::size_t count,
+            float mix,
+            bool maskInvert)
+{
+    currentKernels->maskMixRGBA(src, mask, dst, count, mix, maskInvert);
+}
+
+RowStatistics::RowStatistics()
+{
+    for (int c = 0; c < 4; ++c) {
+        min[c] = std::numeric_limits<float>::infinity();
+        max[c] = -std::numeric_limits<float>::infinity();
+        sum[c] = 0.;
+        nans[c] = 0;
+    }
+}
+
+void
+reduceRow(const float* src,
+          float* fixedDst,
+          std::size_t count,
+          int nComps,
+          RowStatistics* stats)
+{
+    assert(nComps >= 1 && nComps <= 4);
+    assert(!fixedDst || fixedDst == src);
+    currentKernels->reduceRow(src, fixedDst, count, nComps, stats);
+}
+
+} // namespace ImageConvertKernels
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,160 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_IMAGECONVERTKERNELS_H
+#define NATRON_ENGINE_IMAGECONVERTKERNELS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Vectorized row kernels for the most frequent pixel conversions done by Image::convertToFormat(),
+ * for the 2x2 box filter of Image::halveRoI(), for the operations done on float RGBA images after a render
+ * (Image::copyUnProcessedChannels(), Image::applyMaskMix() and Image::premultImage()) and for Image::computeStatistics().
+ * Each kernel has a scalar, an SSE4.1 and an AVX2 implementation: the best one supported by the processor
+ * is selected when the application starts. All implementations give exactly the same results as
+ * Color::floatToInt() and Color::intToFloat(), which are used by the generic per-pixel code.
+ **/
+namespace ImageConvertKernels {
+
+enum InstructionSetEnum
+{
+    eInstructionSetNone = 0, // kernels are not used: Image converts and halves with its generic per-pixel code
+    eInstructionSetScalar,
+    eInstructionSetSSE41,
+    eInstructionSetAVX2
+};
+
+/**
+ * @brief The best instruction set supported by this processor.
+ **/
+InstructionSetEnum getSupportedInstructionSet();
+
+/**
+ * @brief The instruction set used by the kernels, by default the one returned by getSupportedInstructionSet().
+ **/
+InstructionSetEnum getInstructionSet();
+
+/**
+ * @brief Use another instruction set, e.g to compare them. An instruction set that is not supported by the
+ * processor falls back to the best supported one. This is not thread-safe and should not be called during a render.
+ **/
+void setInstructionSet(InstructionSetEnum set);
+
+const char* getInstructionSetName(InstructionSetEnum set);
+
+/**
+ * @brief Whether Image::convertToFormat() uses the kernels, i.e: getInstructionSet() != eInstructionSetNone
+ **/
+bool isEnabled();
+
+/**
+ * @brief Depth conversions of count linear values, same as Color::floatToInt<256> and Color::floatToInt<65536>.
+ **/
+void convertFloatToByte(const float* src, unsigned char* dst, std::size_t count);
+void convertFloatToShort(const float* src, unsigned short* dst, std::size_t count);
+
+/**
+ * @brief Depth conversions of count linear values, same as Color::intToFloat<256> and Color::intToFloat<65536>.
+ **/
+void convertByteToFloat(const unsigned char* src, float* dst, std::size_t count);
+void convertShortToFloat(const unsigned short* src, float* dst, std::size_t count);
+
+/**
+ * @brief Converts count bytes with a look-up table of 256 floats, e.g the one of a Color::Lut.
+ **/
+void convertByteToFloatWithTable(const unsigned char* src, float* dst, std::size_t count, const float* table);
+
+/**
+ * @brief Component conversions of count float pixels. The alpha image receives the given channel of the RGBA image
+ * and the alpha of the RGBA image is set to alphaValue.
+ **/
+void convertRGBAToRGB(const float* src, float* dst, std::size_t count);
+void convertRGBToRGBA(const float* src, float* dst, std::size_t count, float alphaValue);
+void convertRGBAToAlpha(const float* src, float* dst, std::size_t count, int channel);
+
+/**
+ * @brief Computes count pixels of a mipmap level from 2 rows of the previous level: each destination pixel is
+ * the average of 2 adjacent pixels of row0 and of the 2 pixels below them in row1, the same as Image::halveRoI().
+ * nComps is the number of components per pixel.
+ **/
+void halveRowsFloat(const float* row0, const float* row1, float* dst, std::size_t count, int nComps);
+void halveRowsShort(const unsigned short* row0, const unsigned short* row1, unsigned short* dst, std::size_t count, int nComps);
+void halveRowsByte(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, std::size_t count, int nComps);
+
+/**
+ * @brief Multiplies or divides the RGB channels of count RGBA pixels by their alpha, in place, same as Image::premultImage()
+ * and Image::unpremultImage(). Pixels with a zero alpha are not unpremultiplied.
+ **/
+void premultRGBA(float* pix, std::size_t count);
+void unpremultRGBA(float* pix, std::size_t count);
+
+/**
+ * @brief Copies the channels of count RGBA pixels of src into dst. Bit c of channels is set if channel c is copied.
+ **/
+void copyChannelsRGBA(const float* src, float* dst, std::size_t count, unsigned int channels);
+
+/**
+ * @brief Mixes count RGBA pixels of dst with src, same as Image::applyMaskMix(): dst = dst * a + (1 - a) * src,
+ * where a is mix multiplied by the value of the mask (or 1 - the mask if maskInvert is true).
+ * If mask is NULL, a is mix.
+ **/
+void maskMixRGBA(const float* src, const float* mask, float* dst, std::size_t count, float mix, bool maskInvert);
+
+/**
+ * @brief Statistics of each component of rows of float pixels, accumulated by reduceRow().
+ * NaNs are counted in nans and are not taken into account by min, max and sum.
+ * The sums are accumulated in double precision, but not in the same order by all implementations.
+ **/
+struct RowStatistics
+{
+    float min[4];
+    float max[4];
+    double sum[4];
+    std::size_t nans[4];
+
+    RowStatistics();
+};
+
+/**
+ * @brief Accumulates in stats the statistics of count pixels of nComps float components.
+ * If fixedDst is not NULL, it must point to src: the NaNs are then replaced by 1, as Image::checkForNaNsAndFix() does,
+ * and are taken into account as 1 by the statistics.
+ **/
+void reduceRow(const float* src, float* fixedDst, std::size_t count, int nComps, RowStatistics* stats);
+
+} // namespace ImageConvertKernels
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_IMAGECONVERTKERNELS_H
@@ -31,12 +31,16 @@
 #if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 #include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #endif
 
 #include <QtCore/QDebug>
 
+#include "Engine/ImageConvertKernels.h"
 #include "Engine/OSGLContext.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/GLShader.h"
 
 
@@ -52,6 +56,8 @@ GCC_DIAG_OFF(unused-but-set-variable) // only on gcc >= 4.6
 // to get the values from input instead.
 //#define NATRON_COPY_CHANNELS_UNPREMULT
 
+using namespace boost::placeholders;
+
 NATRON_NAMESPACE_ENTER
 
 template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool doR, bool doG, bool doB, bool doA, bool premult, bool originalPremult, bool ignorePremult>
@@ -126,7 +132,7 @@ Image::copyUnProcessedChannelsForPremult(const std::bitset<4> processChannels,
                // Just copy the channels, after all if the user unchecked a channel,
                // we do not want to change the values behind his back.
                // Rather we display a warning in  the GUI.
-#           define DOCHANNEL(c) dst_pixels[c] = (!src_pixels || c >= srcNComps) ? 0 : src_pixels[c];
+#           define DOCHANNEL(c) dst_pixels[c] = (!src_pixels || c >= srcNComps) ? PIX(0) : src_pixels[c];
 #         endif // !NATRON_COPY_CHANNELS_UNPREMULT
 
             if ( (dstNComps == 1) || (dstNComps == 4) ) {
@@ -626,6 +632,24 @@ Image::copyUnProcessedChannels(const RectI& roi,
     RectI srcRoi;
     roi.intersect(_bounds, &srcRoi);
 
+#ifndef NATRON_COPY_CHANNELS_UNPREMULT
+    if ( originalImage && canProcessRenderedRows( srcRoi, originalImage.get(), NULL ) ) {
+        boost::scoped_ptr<QReadLocker> originalLock;
+        if (originalImage.get() != this) {
+            originalLock.reset( new QReadLocker(&originalImage->_entryLock) );
+        }
+        RenderedRowsOps ops;
+        for (int c = 0; c < 4; ++c) {
+            if (!processChannels[c]) {
+                ops.copyChannels |= 1U << c;
+            }
+        }
+        processRenderedRows(srcRoi, originalImage.get(), NULL, ops);
+
+        return;
+    }
+#endif
+
     if (getStorageMode() == eStorageModeGLTex) {
         assert(glContext);
         assert(originalImage->getStorageMode() == eStorageModeGLTex);
@@ -690,6 +714,9 @@ Image::copyUnProcessedChannels(const RectI& roi,
     case eImageBitDepthShort:
         copyUnProcessedChannelsForDepth<unsigned short, 65535>(premult, roi, processChannels, originalImage, originalPremult, ignorePremult);
         break;
+    case eImageBitDepthHalf:
+        copyUnProcessedChannelsForDepth<Half, 1>(premult, roi, processChannels, originalImage, originalPremult, ignorePremult);
+        break;
     case eImageBitDepthFloat:
         copyUnProcessedChannelsForDepth<float, 1>(premult, roi, processChannels, originalImage, originalPremult, ignorePremult);
         break;
@@ -699,4 +726,134 @@ Image::copyUnProcessedChannels(const RectI& roi,
     }
 } // copyUnProcessedChannels
 
+void
+Image::copyUnProcessedChannelsMaskMixAndPremult(const RectI& roi,
+                                                const ImagePremultiplicationEnum outputPremult,
+                                                const ImagePremultiplicationEnum originalImagePremult,
+                                                const std::bitset<4> processChannels,
+                                                const ImagePtr& originalImage,
+                                                bool ignorePremult,
+                                                bool useMaskMix,
+                                                const Image* maskImg,
+                                                bool masked,
+                                                bool maskInvert,
+                                                float mix,
+                                                bool premult,
+                                                const OSGLContextPtr& glContext)
+{
+    useMaskMix = useMaskMix && ( masked || (mix != 1) );
+
+#ifndef NATRON_COPY_CHANNELS_UNPREMULT
+    if ( originalImage && ( getMipMapLevel() == originalImage->getMipMapLevel() ) ) {
+        QWriteLocker k(&_entryLock);
+        boost::scoped_ptr<QReadLocker> originalLock;
+        boost::scoped_ptr<QReadLocker> maskLock;
+        if (originalImage.get() != this) {
+            originalLock.reset( new QReadLocker(&originalImage->_entryLock) );
+        }
+        const Image* mixMaskImg = (useMaskMix && masked) ? maskImg : NULL;
+        if (mixMaskImg) {
+            maskLock.reset( new QReadLocker(&mixMaskImg->_entryLock) );
+        }
+        RectI realRoI;
+        roi.intersect(_bounds, &realRoI);
+        if ( canProcessRenderedRows(realRoI, originalImage.get(), mixMaskImg) ) {
+            RenderedRowsOps ops;
+            if ( canCallCopyUnProcessedChannels(processChannels) ) {
+                for (int c = 0; c < 4; ++c) {
+                    if (!processChannels[c]) {
+                        ops.copyChannels |= 1U << c;
+                    }
+                }
+            }
+            ops.maskMix = useMaskMix;
+            ops.maskInvert = maskInvert;
+            // Without a mask image, a masked image is mixed with a mask of 0 (or 1 if inverted), as in applyMaskMix()
+            ops.mix = (masked && !mixMaskImg) ? mix * (maskInvert ? 1.f : 0.f) : mix;
+            ops.premult = premult;
+            processRenderedRows(realRoI, originalImage.get(), mixMaskImg, ops);
+
+            return;
+        }
+    }
+#endif
+
+    copyUnProcessedChannels(roi, outputPremult, originalImagePremult, processChannels, originalImage, ignorePremult, glContext);
+    if (useMaskMix) {
+        applyMaskMix(roi, maskImg, originalImage.get(), masked, maskInvert, mix, glContext);
+    }
+    if (premult) {
+        premultImage(roi);
+    }
+} // copyUnProcessedChannelsMaskMixAndPremult
+
+bool
+Image::canProcessRenderedRows(const RectI& roi,
+                              const Image* originalImg,
+                              const Image* maskImg) const
+{
+    if ( !ImageConvertKernels::isEnabled() || roi.isNull() ||
+         (getStorageMode() == eStorageModeGLTex) || ( getBitDepth() != eImageBitDepthFloat ) || (getComponentsCount() != 4) ) {
+        return false;
+    }
+    if ( originalImg && ( (originalImg->getStorageMode() == eStorageModeGLTex) || ( originalImg->getBitDepth() != eImageBitDepthFloat ) ||
+                          (originalImg->getComponentsCount() != 4) || !originalImg->_bounds.contains(roi) ) ) {
+        return false;
+    }
+    if ( maskImg && ( (maskImg->getStorageMode() == eStorageModeGLTex) || ( maskImg->getBitDepth() != eImageBitDepthFloat ) ||
+                      (maskImg->getComponentsCount() != 1) || !maskImg->_bounds.contains(roi) ) ) {
+        return false;
+    }
+
+    return true;
+}
+
+void
+Image::processRenderedRows(const RectI& roi,
+                           const Image* originalImg,
+                           const Image* maskImg,
+                           const RenderedRowsOps& ops)
+{
+    if ( !ops.copyChannels && !ops.maskMix && !ops.premult && !ops.unpremult ) {
+        return;
+    }
+    std::vector<std::pair<int, int> > bands = splitRowsAcrossThreads( roi.y1, roi.y2, roi.width() );
+
+    if (bands.size() <= 1) {
+        processRenderedRowsBand( roi, originalImg, maskImg, ops, std::make_pair(roi.y1, roi.y2) );
+    } else {
+        // The bands write distinct rows: no further locking is needed
+        TaskScheduler::blockingMap( bands, boost::bind(&Image::processRenderedRowsBand, this, roi, originalImg, maskImg, boost::cref(ops), _1) );
+    }
+}
+
+void
+Image::processRenderedRowsBand(const RectI& roi,
+                               const Image* originalImg,
+                               const Image* maskImg,
+                               const RenderedRowsOps& ops,
+                               const std::pair<int, int>& rows)
+{
+    const std::size_t width = roi.width();
+
+    // All the operations are done on a row while it is in the processor caches
+    for (int y = rows.first; y < rows.second; ++y) {
+        float* dst = (float*)pixelAt(roi.x1, y);
+        const float* src = originalImg ? (const float*)originalImg->pixelAt(roi.x1, y) : NULL;
+        const float* mask = maskImg ? (const float*)maskImg->pixelAt(roi.x1, y) : NULL;
+        assert( dst && ( src || (!ops.copyChannels && !ops.maskMix) ) );
+        if (ops.copyChannels) {
+            ImageConvertKernels::copyChannelsRGBA(src, dst, width, ops.copyChannels);
+        }
+        if (ops.maskMix) {
+            ImageConvertKernels::maskMixRGBA(src, mask, dst, width, ops.mix, ops.maskInvert);
+        }
+        if (ops.premult) {
+            ImageConvertKernels::premultRGBA(dst, width);
+        } else if (ops.unpremult) {
+            ImageConvertKernels::unpremultRGBA(dst, width);
+        }
+    }
+}
+
 NATRON_NAMESPACE_EXIT
@@ -143,6 +143,9 @@ Image::applyMaskMixForDstComponents(const RectI& roi,
     case eImageBitDepthShort:
         applyMaskMixForDepth<srcNComps, dstNComps, unsigned short, 65535>(roi, maskImg, originalImg, masked, maskInvert, mix);
         break;
+    case eImageBitDepthHalf:
+        applyMaskMixForDepth<srcNComps, dstNComps, Half, 1>(roi, maskImg, originalImg, masked, maskInvert, mix);
+        break;
     case eImageBitDepthFloat:
         applyMaskMixForDepth<srcNComps, dstNComps, float, 1>(roi, maskImg, originalImg, masked, maskInvert, mix);
         break;
@@ -275,6 +278,18 @@ Image::applyMaskMix(const RectI& roi,
         return;
     }
 
+    const Image* mixMaskImg = masked ? maskImg : NULL;
+    if ( originalImg && canProcessRenderedRows(realRoI, originalImg, mixMaskImg) ) {
+        RenderedRowsOps ops;
+        ops.maskMix = true;
+        ops.maskInvert = maskInvert;
+        // Without a mask image, a masked image is mixed with a mask of 0 (or 1 if inverted)
+        ops.mix = (masked && !maskImg) ? mix * (maskInvert ? 1.f : 0.f) : mix;
+        processRenderedRows(realRoI, originalImg, mixMaskImg, ops);
+
+        return;
+    }
+
     int srcNComps = originalImg ? (int)originalImg->getComponentsCount() : 0;
     //assert(0 < srcNComps && srcNComps <= 4);
     switch (srcNComps) {
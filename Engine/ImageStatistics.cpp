@@ -0,0 +1,249 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+#include "ImageStatistics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/bind/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#endif
+
+#include "Engine/Image.h"
+#include "Engine/ImageConvertKernels.h"
+#include "Engine/TaskScheduler.h"
+
+using namespace boost::placeholders;
+
+NATRON_NAMESPACE_ENTER
+
+ImageStatistics::ImageStatistics()
+    : nComps(0)
+    , pixelsCount(0)
+    , luminanceMin( std::numeric_limits<double>::infinity() )
+    , luminanceMax( -std::numeric_limits<double>::infinity() )
+    , histograms()
+{
+    for (int c = 0; c < 4; ++c) {
+        min[c] = std::numeric_limits<double>::infinity();
+        max[c] = -std::numeric_limits<double>::infinity();
+        sum[c] = 0.;
+        nans[c] = 0;
+    }
+}
+
+void
+ImageStatistics::merge(const ImageStatistics& other)
+{
+    pixelsCount += other.pixelsCount;
+    for (int c = 0; c < 4; ++c) {
+        min[c] = std::min(min[c], other.min[c]);
+        max[c] = std::max(max[c], other.max[c]);
+        sum[c] += other.sum[c];
+        nans[c] += other.nans[c];
+    }
+    luminanceMin = std::min(luminanceMin, other.luminanceMin);
+    luminanceMax = std::max(luminanceMax, other.luminanceMax);
+    assert( histograms.size() == other.histograms.size() );
+    for (std::size_t h = 0; h < histograms.size() && h < other.histograms.size(); ++h) {
+        assert( histograms[h].size() == other.histograms[h].size() );
+        for (std::size_t i = 0; i < histograms[h].size() && i < other.histograms[h].size(); ++i) {
+            histograms[h][i] += other.histograms[h][i];
+        }
+    }
+}
+
+double
+ImageStatistics::getMean(int channel) const
+{
+    assert(channel >= 0 && channel < 4);
+    if ( (channel < 0) || (channel >= 4) ) {
+        return 0.;
+    }
+    std::size_t valuesCount = pixelsCount - nans[channel];
+
+    return valuesCount ? sum[channel] / valuesCount : 0.;
+}
+
+std::size_t
+ImageStatistics::getNaNsCount() const
+{
+    return nans[0] + nans[1] + nans[2] + nans[3];
+}
+
+namespace {
+
+struct StatisticsBand
+{
+    const float* pixels; // the first pixel of the band
+    float* fixedPixels; // the same pixels if the NaNs are fixed, NULL otherwise
+    int rowsCount;
+    ImageStatistics stats;
+
+    StatisticsBand()
+        : pixels(NULL)
+        , fixedPixels(NULL)
+        , rowsCount(0)
+        , stats()
+    {
+    }
+};
+
+// Same as ViewerInstance's auto-contrast: the missing components are 0
+inline double
+pixelLuminance(const float* pix,
+               int nComps)
+{
+    switch (nComps) {
+    case 1:
+        return 0.;
+    case 2:
+        return 0.299 * pix[0] + 0.587 * pix[1];
+    default:
+        return 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+    }
+}
+
+void
+computeBandStatistics(std::size_t rowElements,
+                      int width,
+                      int nComps,
+                      const ImageStatisticsRequest& request,
+                      StatisticsBand& band)
+{
+    ImageStatistics& stats = band.stats;
+    const std::size_t nHistograms = request.histograms.size();
+    const bool perPixel = request.luminance || nHistograms > 0;
+    const bool needsLuminance = request.luminance ||
+                                std::find(request.histograms.begin(), request.histograms.end(), eImageStatisticsValueLuminance) != request.histograms.end();
+    const double binSize = (request.histogramMax - request.histogramMin) / request.histogramBins;
+    ImageConvertKernels::RowStatistics rowStats;
+
+    stats.nComps = nComps;
+    stats.pixelsCount = (std::size_t)width * band.rowsCount;
+    stats.histograms.assign( nHistograms, std::vector<float>(request.histogramBins, 0.f) );
+
+    for (int y = 0; y < band.rowsCount; ++y) {
+        const float* row = band.pixels + y * rowElements;
+        ImageConvertKernels::reduceRow(row, band.fixedPixels ? band.fixedPixels + y * rowElements : NULL, width, nComps, &rowStats);
+        if (!perPixel) {
+            continue;
+        }
+        // The row is still in the processor caches and its NaNs are already fixed if requested
+        for (int x = 0; x < width; ++x) {
+            const float* pix = row + x * nComps;
+            const double luminance = needsLuminance ? pixelLuminance(pix, nComps) : 0.;
+            if (request.luminance) {
+                stats.luminanceMin = std::min(stats.luminanceMin, luminance);
+                stats.luminanceMax = std::max(stats.luminanceMax, luminance);
+            }
+            for (std::size_t h = 0; h < nHistograms; ++h) {
+                const ImageStatisticsValueEnum value = request.histograms[h];
+                if ( (value != eImageStatisticsValueLuminance) && ( (int)value >= nComps ) ) {
+                    continue;
+                }
+                const float v = (value == eImageStatisticsValueLuminance) ? (float)luminance : pix[value];
+                if ( (request.histogramMin <= v) && (v < request.histogramMax) ) {
+                    int index = (int)( (v - request.histogramMin) / binSize );
+                    assert( 0 <= index && index < request.histogramBins );
+                    stats.histograms[h][index] += 1.f;
+                }
+            }
+        }
+    }
+    for (int c = 0; c < nComps; ++c) {
+        stats.min[c] = rowStats.min[c];
+        stats.max[c] = rowStats.max[c];
+        stats.sum[c] = rowStats.sum[c];
+        stats.nans[c] = rowStats.nans[c];
+    }
+}
+} // anon namespace
+
+void
+Image::computeStatistics(const RectI& roi,
+                         const ImageStatisticsRequest& request,
+                         ImageStatistics* stats)
+{
+    assert(stats);
+    const int nComps = getComponentsCount();
+    *stats = ImageStatistics();
+    stats->nComps = nComps;
+    stats->histograms.assign( request.histograms.size(), std::vector<float>(request.histogramBins, 0.f) );
+#ifndef NDEBUG
+    for (std::size_t h = 0; h < request.histograms.size(); ++h) {
+        assert(request.histograms[h] == eImageStatisticsValueLuminance || (int)request.histograms[h] < nComps);
+    }
+#endif
+
+    if ( ( getBitDepth() != eImageBitDepthFloat ) || ( getStorageMode() == eStorageModeGLTex ) ) {
+        return;
+    }
+
+    // Only fixing the NaNs writes to the image: otherwise pixels shared with other images stay shared
+    boost::scoped_ptr<QWriteLocker> writeLock;
+    boost::scoped_ptr<QReadLocker> readLock;
+    if (request.fixNaNs) {
+        writeLock.reset( new QWriteLocker(&_entryLock) );
+    } else {
+        readLock.reset( new QReadLocker(&_entryLock) );
+    }
+
+    RectI realRoI;
+    if ( !roi.intersect(_bounds, &realRoI) ) {
+        return;
+    }
+    float* fixedPixels = request.fixNaNs ? (float*)pixelAt(realRoI.x1, realRoI.y1) : NULL;
+    const float* pixels = fixedPixels ? fixedPixels : (const float*)static_cast<const Image*>(this)->pixelAt(realRoI.x1, realRoI.y1);
+    assert(pixels);
+    if (!pixels) {
+        return;
+    }
+    const std::size_t rowElements = (std::size_t)_bounds.width() * nComps;
+    const std::vector<std::pair<int, int> > rows = splitRowsAcrossThreads( realRoI.y1, realRoI.y2, realRoI.width() );
+    std::vector<StatisticsBand> bands( rows.size() );
+
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        const std::size_t offset = (std::size_t)(rows[i].first - realRoI.y1) * rowElements;
+        bands[i].pixels = pixels + offset;
+        bands[i].fixedPixels = fixedPixels ? fixedPixels + offset : NULL;
+        bands[i].rowsCount = rows[i].second - rows[i].first;
+    }
+    if (bands.size() == 1) {
+        computeBandStatistics(rowElements, realRoI.width(), nComps, request, bands[0]);
+    } else {
+        // The bands read and fix distinct rows: no further locking is needed
+        TaskScheduler::blockingMap( bands, boost::bind(&computeBandStatistics, rowElements, realRoI.width(), nComps, boost::cref(request), _1) );
+    }
+    for (std::size_t i = 0; i < bands.size(); ++i) {
+        stats->merge(bands[i].stats);
+    }
+} // Image::computeStatistics
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,124 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_IMAGESTATISTICS_H
+#define NATRON_ENGINE_IMAGESTATISTICS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The values of the pixels a histogram may be computed on by Image::computeStatistics().
+ * The channels are indices in the components of the image.
+ **/
+enum ImageStatisticsValueEnum
+{
+    eImageStatisticsValueChannel0 = 0,
+    eImageStatisticsValueChannel1,
+    eImageStatisticsValueChannel2,
+    eImageStatisticsValueChannel3,
+    eImageStatisticsValueLuminance // 0.299 * r + 0.587 * g + 0.114 * b
+};
+
+/**
+ * @brief What Image::computeStatistics() computes in addition to the minimum, maximum, sum and NaNs count
+ * of each channel, which are always computed.
+ **/
+struct ImageStatisticsRequest
+{
+    // Replace the NaNs by 1 in the image, as Image::checkForNaNsAndFix() does
+    bool fixNaNs;
+
+    // Compute the range of the luminance. The missing components are taken as 0 as in the viewer:
+    // r and g are 0 for alpha images and b is 0 for 2 components images.
+    bool luminance;
+
+    // One histogram of histogramBins bins covering [histogramMin, histogramMax[ is computed for each value
+    std::vector<ImageStatisticsValueEnum> histograms;
+    int histogramBins;
+    double histogramMin;
+    double histogramMax;
+
+    ImageStatisticsRequest()
+        : fixNaNs(false)
+        , luminance(false)
+        , histograms()
+        , histogramBins(0)
+        , histogramMin(0.)
+        , histogramMax(1.)
+    {
+    }
+};
+
+/**
+ * @brief The result of Image::computeStatistics(). NaNs are not taken into account by the minimum, maximum,
+ * sum and mean of a channel, unless they were fixed.
+ **/
+struct ImageStatistics
+{
+    int nComps;
+    std::size_t pixelsCount;
+    double min[4];
+    double max[4];
+    double sum[4];
+    std::size_t nans[4];
+
+    // Only computed if requested, infinity and -infinity otherwise
+    double luminanceMin;
+    double luminanceMax;
+
+    // One histogram for each value of ImageStatisticsRequest::histograms, in the same order
+    std::vector<std::vector<float> > histograms;
+
+    ImageStatistics();
+
+    /**
+     * @brief Accumulates the statistics of another part of the same image, computed with the same request.
+     **/
+    void merge(const ImageStatistics& other);
+
+    /**
+     * @brief Returns the mean of the non NaN values of the given channel, or 0 if there are none.
+     **/
+    double getMean(int channel) const;
+
+    /**
+     * @brief Returns the number of NaN values found in all the channels.
+     **/
+    std::size_t getNaNsCount() const;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_IMAGESTATISTICS_H
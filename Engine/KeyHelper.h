@@ -134,7 +134,8 @@ protected:
 private:
     void computeHashKey() const
     {
-        Hash64 hash;
+        // The keys of the disk cache entries are stored on disk
+        Hash64 hash(Hash64::eHashAlgorithmCRC64);
 
         fillHash(&hash);
         hash.computeHash();
@@ -56,6 +56,7 @@
 #include "Engine/StringAnimationManager.h"
 #include "Engine/TLSHolder.h"
 #include "Engine/TimeLine.h"
+#include "Engine/TraceRecorder.h"
 #include "Engine/TrackMarker.h"
 #include "Engine/TrackerContext.h"
 #include "Engine/Transform.h"
@@ -3076,6 +3077,12 @@ KnobHelper::executeExpression(double time,
 
     ss << expr << '(' << time << ", " <<  view << ")\n";
 
+    TraceScope trace("python", "expression");
+    if ( trace.isActive() ) {
+        trace.setLabel( getName() );
+        trace.setTime(time);
+    }
+
     return executeExpression(ss.str(), ret, error);
 }
 
@@ -220,6 +220,48 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    /**
+     * @brief Among the nSamples least recently used values that can be evicted, evicts the one for which
+     * priority(value) is the lowest. With nSamples == 1 this is the same as evict().
+     **/
+    template <typename PRIORITY>
+    std::pair<key_type, V> evictLowestPriority(const PRIORITY& priority,
+                                               int nSamples)
+    {
+        typename key_to_value_type::iterator found = _key_to_value.end();
+        typename std::list<V>::iterator foundValue;
+        double foundPriority = 0.;
+        int nSampled = 0;
+
+        for (typename key_tracker_type::iterator k = _key_tracker.begin(); k != _key_tracker.end() && nSampled < nSamples; ++k) {
+            typename key_to_value_type::iterator it = _key_to_value.find(*k);
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end() && nSampled < nSamples;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double p = priority(*it2);
+                    if ( ( found == _key_to_value.end() ) || (p < foundPriority) ) {
+                        found = it;
+                        foundValue = it2;
+                        foundPriority = p;
+                    }
+                    ++nSampled;
+                }
+            }
+        }
+        if ( found == _key_to_value.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(found->first, *foundValue);
+        if (found->second.first.size() == 1) {
+            erase(found);
+        } else {
+            found->second.first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -333,6 +375,45 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    /**
+     * @brief Among the nSamples least recently used values that can be evicted, evicts the one for which
+     * priority(value) is the lowest. With nSamples == 1 this is the same as evict().
+     **/
+    template <typename PRIORITY>
+    std::pair<key_type, V> evictLowestPriority(const PRIORITY& priority,
+                                               int nSamples)
+    {
+        typename container_type::right_iterator found = _container.right.end();
+        typename std::list<V>::iterator foundValue;
+        double foundPriority = 0.;
+        int nSampled = 0;
+
+        for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end() && nSampled < nSamples; ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end() && nSampled < nSamples; ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double p = priority(*it2);
+                    if ( ( found == _container.right.end() ) || (p < foundPriority) ) {
+                        found = it;
+                        foundValue = it2;
+                        foundPriority = p;
+                    }
+                    ++nSampled;
+                }
+            }
+        }
+        if ( found == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(found->second, *foundValue);
+        if (found->first.size() == 1) {
+            _container.right.erase(found);
+        } else {
+            found->first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -454,6 +535,48 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    /**
+     * @brief Among the nSamples least recently used values that can be evicted, evicts the one for which
+     * priority(value) is the lowest. With nSamples == 1 this is the same as evict().
+     **/
+    template <typename PRIORITY>
+    std::pair<key_type, V> evictLowestPriority(const PRIORITY& priority,
+                                               int nSamples)
+    {
+        typename key_to_value_type::iterator found = _key_to_value.end();
+        typename std::list<V>::iterator foundValue;
+        double foundPriority = 0.;
+        int nSampled = 0;
+
+        for (typename key_tracker_type::iterator k = _key_tracker.begin(); k != _key_tracker.end() && nSampled < nSamples; ++k) {
+            typename key_to_value_type::iterator it = _key_to_value.find(*k);
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end() && nSampled < nSamples;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double p = priority(*it2);
+                    if ( ( found == _key_to_value.end() ) || (p < foundPriority) ) {
+                        found = it;
+                        foundValue = it2;
+                        foundPriority = p;
+                    }
+                    ++nSampled;
+                }
+            }
+        }
+        if ( found == _key_to_value.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(found->first, *foundValue);
+        if (found->second.first.size() == 1) {
+            erase(found);
+        } else {
+            found->second.first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _key_to_value.size();
@@ -561,6 +684,45 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    /**
+     * @brief Among the nSamples least recently used values that can be evicted, evicts the one for which
+     * priority(value) is the lowest. With nSamples == 1 this is the same as evict().
+     **/
+    template <typename PRIORITY>
+    std::pair<key_type, V> evictLowestPriority(const PRIORITY& priority,
+                                               int nSamples)
+    {
+        typename container_type::right_iterator found = _container.right.end();
+        typename std::list<V>::iterator foundValue;
+        double foundPriority = 0.;
+        int nSampled = 0;
+
+        for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end() && nSampled < nSamples; ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end() && nSampled < nSamples; ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double p = priority(*it2);
+                    if ( ( found == _container.right.end() ) || (p < foundPriority) ) {
+                        found = it;
+                        foundValue = it2;
+                        foundPriority = p;
+                    }
+                    ++nSampled;
+                }
+            }
+        }
+        if ( found == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(found->second, *foundValue);
+        if (found->first.size() == 1) {
+            _container.right.erase(found);
+        } else {
+            found->first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -663,6 +825,45 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    /**
+     * @brief Among the nSamples least recently used values that can be evicted, evicts the one for which
+     * priority(value) is the lowest. With nSamples == 1 this is the same as evict().
+     **/
+    template <typename PRIORITY>
+    std::pair<key_type, V> evictLowestPriority(const PRIORITY& priority,
+                                               int nSamples)
+    {
+        typename container_type::right_iterator found = _container.right.end();
+        typename std::list<V>::iterator foundValue;
+        double foundPriority = 0.;
+        int nSampled = 0;
+
+        for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end() && nSampled < nSamples; ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end() && nSampled < nSamples; ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double p = priority(*it2);
+                    if ( ( found == _container.right.end() ) || (p < foundPriority) ) {
+                        found = it;
+                        foundValue = it2;
+                        foundPriority = p;
+                    }
+                    ++nSampled;
+                }
+            }
+        }
+        if ( found == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(found->second, *foundValue);
+        if (found->first.size() == 1) {
+            _container.right.erase(found);
+        } else {
+            found->first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -30,6 +30,7 @@
 #include <cassert>
 #include <stdexcept>
 
+#include "Engine/ImageConvertKernels.h"
 #include "Engine/RectI.h"
 
 /*
@@ -304,6 +305,16 @@ Lut::toColorSpaceUint16FromLinearFloatFast(float v) const
     return (v8u_prev << 8) + v8u_prev + (v - v32f_prev) * ( ( (v8u_next - v8u_prev) << 8 ) + (v8u_next + v8u_prev) ) / (v32f_next - v32f_prev) + 0.5;
 }
 
+void
+Lut::fromColorSpaceUint8ToLinearFloatFast(const unsigned char* from,
+                                         float* to,
+                                         std::size_t count) const
+{
+    assert(init_);
+
+    ImageConvertKernels::convertByteToFloatWithTable(from, to, count, fromFunc_uint8_to_float);
+}
+
 float
 Lut::fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const
 {
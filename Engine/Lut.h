@@ -34,6 +34,7 @@
 
 
 #include <cmath>
+#include <cstddef>
 #include <map>
 #include <string>
 
@@ -231,6 +232,11 @@ public:
      */
     float fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const;
 
+    /* @brief Converts count bytes ranging in [0 - 255] in the destination color-space using the look-up tables.
+     * Same as fromColorSpaceUint8ToLinearFloatFast(unsigned char) on each byte, using the vectorized kernels.
+     */
+    void fromColorSpaceUint8ToLinearFloatFast(const unsigned char* from, float* to, std::size_t count) const;
+
 
     /////@TODO the following functions expects a float input buffer, one could extend it to cover all bitdepths.
 
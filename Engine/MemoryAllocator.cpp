@@ -0,0 +1,687 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "MemoryAllocator.h"
+
+#include <cstdlib> // malloc, calloc, free
+#include <cstring> // memset
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThreadStorage>
+
+#if defined(__NATRON_UNIX__)
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <unistd.h> // sysconf
+#endif
+#if defined(__NATRON_LINUX__)
+#include <sys/syscall.h> // SYS_getcpu
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+QAtomicInt hugePagesMode(eMemoryHugePagesModeNone);
+QAtomicInt accessHintsEnabled(1);
+
+std::size_t
+roundUp(std::size_t size,
+        std::size_t alignment)
+{
+    return ( (size + alignment - 1) / alignment ) * alignment;
+}
+
+#if defined(__NATRON_UNIX__)
+std::size_t
+getPageSize()
+{
+    static const std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+
+    return pageSize;
+}
+
+#endif
+
+#if defined(__NATRON_LINUX__)
+std::size_t
+readHugePageSize()
+{
+    // The line is "Hugepagesize:       2048 kB"
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+
+    while ( std::getline(meminfo, line) ) {
+        if (line.compare(0, 13, "Hugepagesize:") == 0) {
+            std::istringstream ss( line.substr(13) );
+            std::size_t kb = 0;
+            ss >> kb;
+
+            return kb * 1024;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Maps size bytes, a multiple of hugePageSize, at an address aligned on hugePageSize so that the kernel
+ * can back the whole buffer with transparent huge pages, and not only the huge pages that happen to be
+ * aligned inside it.
+ */
+void*
+mapForTransparentHugePages(std::size_t size,
+                           std::size_t hugePageSize)
+{
+    std::size_t mappedSize = size + hugePageSize;
+    void* mapped = ::mmap(0, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapped == MAP_FAILED) {
+        return 0;
+    }
+    char* begin = (char*)mapped;
+    char* aligned = (char*)roundUp( (std::size_t)begin, hugePageSize );
+    char* end = begin + mappedSize;
+    if (aligned > begin) {
+        ::munmap(begin, aligned - begin);
+    }
+    if (end > aligned + size) {
+        ::munmap(aligned + size, end - (aligned + size));
+    }
+#ifdef MADV_HUGEPAGE
+    ::madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+    return aligned;
+}
+
+#endif // __NATRON_LINUX__
+
+void*
+allocateFromSystem(std::size_t size,
+                   MemoryAllocationTypeEnum* type,
+                   bool zeroed)
+{
+    *type = eMemoryAllocationTypeMalloc;
+#if defined(__NATRON_LINUX__)
+    MemoryHugePagesModeEnum mode = (MemoryHugePagesModeEnum)(int)hugePagesMode;
+    std::size_t hugePageSize = MemoryAllocator::getHugePageSize();
+    if ( (mode != eMemoryHugePagesModeNone) && (hugePageSize > 0) && (size >= NATRON_HUGE_PAGES_MIN_ALLOCATION_SIZE) ) {
+        std::size_t mappedSize = roundUp(size, hugePageSize);
+        void* ptr = 0;
+#ifdef MAP_HUGETLB
+        if (mode == eMemoryHugePagesModeExplicit) {
+            ptr = ::mmap(0, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr == MAP_FAILED) {
+                // No reserved huge pages left
+                ptr = 0;
+            }
+        }
+#endif
+        if (!ptr) {
+            ptr = mapForTransparentHugePages(mappedSize, hugePageSize);
+        }
+        if (ptr) {
+            // Anonymous mappings are already made of zeros
+            *type = eMemoryAllocationTypeMap;
+
+            return ptr;
+        }
+    }
+#endif // __NATRON_LINUX__
+
+    // calloc does not touch the pages of the large blocks it maps, they are already zeros
+    return zeroed ? std::calloc(1, size) : std::malloc(size);
+}
+
+void
+deallocateToSystem(void* ptr,
+                   std::size_t size,
+                   MemoryAllocationTypeEnum type)
+{
+    switch (type) {
+    case eMemoryAllocationTypeMalloc:
+        std::free(ptr);
+        break;
+    case eMemoryAllocationTypeMap:
+#if defined(__NATRON_UNIX__)
+        ::munmap( ptr, roundUp( size, MemoryAllocator::getHugePageSize() ) );
+#endif
+        break;
+    }
+}
+
+/*
+ * Fills a buffer that was taken from the pool with zeros. The pages of a mapped buffer are given back to the kernel,
+ * which maps zero pages again the next time they are touched.
+ */
+void
+zeroPooledBuffer(void* ptr,
+                 std::size_t size,
+                 MemoryAllocationTypeEnum type)
+{
+#if defined(__NATRON_UNIX__)
+    if ( (type == eMemoryAllocationTypeMap) &&
+         (::madvise( ptr, roundUp( size, MemoryAllocator::getHugePageSize() ), MADV_DONTNEED ) == 0) ) {
+        return;
+    }
+#endif
+    std::memset(ptr, 0, size);
+}
+
+// The capacity and the statistics of the pool, protected by mutex
+struct PoolCounters
+{
+    QMutex mutex;
+    std::size_t capacity;
+    std::size_t idleBytes;
+    std::size_t idleBuffers;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long overflows;
+    unsigned long long released;
+
+    PoolCounters()
+        : mutex()
+        , capacity(0)
+        , idleBytes(0)
+        , idleBuffers(0)
+        , hits(0)
+        , misses(0)
+        , overflows(0)
+        , released(0)
+    {
+    }
+};
+
+// Never destroyed, as the node pools
+PoolCounters&
+getPoolCounters()
+{
+    static PoolCounters* counters = new PoolCounters;
+
+    return *counters;
+}
+
+struct PooledBuffer
+{
+    void* ptr;
+    std::size_t size;
+    MemoryAllocationTypeEnum type;
+};
+
+/*
+ * Returns the size actually allocated for a buffer of the given size: sizes that may be pooled are rounded up
+ * to their size class, so that a buffer of the pool can serve any allocation of the same class.
+ * Returns 0 if buffers of that size are not pooled.
+ */
+std::size_t
+getPoolSizeClass(std::size_t size)
+{
+    if (size < NATRON_MEMORY_POOL_MIN_ALLOCATION_SIZE) {
+        return 0;
+    }
+    std::size_t powerOfTwo = NATRON_MEMORY_POOL_MIN_ALLOCATION_SIZE;
+    while (powerOfTwo <= size / 2) {
+        powerOfTwo *= 2;
+    }
+
+    return roundUp(size, powerOfTwo / NATRON_MEMORY_POOL_SIZE_CLASSES_PER_POWER_OF_TWO);
+}
+
+// The pool of a NUMA node, buffers by size class
+struct NodePool
+{
+    QMutex mutex;
+    std::map<std::size_t, std::vector<PooledBuffer> > buffers;
+};
+
+// Never destroyed: the thread caches of the threads that exit after the static destructors still give their buffers back
+NodePool*
+getNodePools()
+{
+    static NodePool* pools = new NodePool[NATRON_MEMORY_POOL_MAX_NUMA_NODES];
+
+    return pools;
+}
+
+// Only called once per thread, by its ThreadCache: a thread rarely moves to another node
+int
+readCurrentNumaNode()
+{
+#if defined(__NATRON_LINUX__) && defined(SYS_getcpu)
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    if (::syscall(SYS_getcpu, &cpu, &node, (void*)0) == 0) {
+        return (int)(node % NATRON_MEMORY_POOL_MAX_NUMA_NODES);
+    }
+#endif
+
+    return 0;
+}
+
+bool
+takeFromNodePool(int node,
+                 std::size_t sizeClass,
+                 PooledBuffer* buffer)
+{
+    NodePool& pool = getNodePools()[node];
+    QMutexLocker k(&pool.mutex);
+    std::map<std::size_t, std::vector<PooledBuffer> >::iterator found = pool.buffers.find(sizeClass);
+
+    if ( ( found == pool.buffers.end() ) || found->second.empty() ) {
+        return false;
+    }
+    *buffer = found->second.back();
+    found->second.pop_back();
+
+    return true;
+}
+
+void
+giveToNodePool(int node,
+               const PooledBuffer& buffer)
+{
+    NodePool& pool = getNodePools()[node];
+    QMutexLocker k(&pool.mutex);
+
+    pool.buffers[buffer.size].push_back(buffer);
+}
+
+class ThreadCache;
+
+QMutex&
+getThreadCachesMutex()
+{
+    static QMutex* mutex = new QMutex;
+
+    return *mutex;
+}
+
+std::vector<ThreadCache*>&
+getThreadCaches()
+{
+    static std::vector<ThreadCache*>* caches = new std::vector<ThreadCache*>;
+
+    return *caches;
+}
+
+/*
+ * The buffers freed by a thread, that it reuses first. They are registered so that releasePool() can free them:
+ * the mutex is only contended by releasePool().
+ * The NUMA node of the thread is read when the cache is created.
+ */
+class ThreadCache
+{
+public:
+    QMutex mutex;
+    std::vector<PooledBuffer> buffers;
+    const int node;
+
+    ThreadCache()
+        : mutex()
+        , buffers()
+        , node( readCurrentNumaNode() )
+    {
+        QMutexLocker k( &getThreadCachesMutex() );
+
+        getThreadCaches().push_back(this);
+    }
+
+    ~ThreadCache()
+    {
+        {
+            QMutexLocker k( &getThreadCachesMutex() );
+            std::vector<ThreadCache*>& caches = getThreadCaches();
+            for (std::size_t i = 0; i < caches.size(); ++i) {
+                if (caches[i] == this) {
+                    caches.erase(caches.begin() + i);
+                    break;
+                }
+            }
+        }
+        QMutexLocker k(&mutex);
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+            giveToNodePool(node, buffers[i]);
+        }
+    }
+};
+
+// Never destroyed: QThreadStorage deletes the cache of each thread when it exits
+ThreadCache&
+getThreadCache()
+{
+    static QThreadStorage<ThreadCache*>* storage = new QThreadStorage<ThreadCache*>;
+
+    if ( !storage->hasLocalData() ) {
+        storage->setLocalData(new ThreadCache);
+    }
+
+    return *storage->localData();
+}
+
+bool
+takeFromPool(std::size_t sizeClass,
+             PooledBuffer* buffer)
+{
+    ThreadCache& threadCache = getThreadCache();
+    bool found = false;
+    {
+        QMutexLocker k(&threadCache.mutex);
+        std::vector<PooledBuffer>& buffers = threadCache.buffers;
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+            if (buffers[i].size == sizeClass) {
+                *buffer = buffers[i];
+                buffers[i] = buffers.back();
+                buffers.pop_back();
+                found = true;
+                break;
+            }
+        }
+    }
+    if ( !found && !takeFromNodePool(threadCache.node, sizeClass, buffer) ) {
+        return false;
+    }
+
+    return true;
+}
+
+bool
+giveToPool(const PooledBuffer& buffer)
+{
+    {
+        PoolCounters& counters = getPoolCounters();
+        QMutexLocker k(&counters.mutex);
+        if (counters.capacity == 0) {
+            return false;
+        }
+        if (counters.idleBytes + buffer.size > counters.capacity) {
+            ++counters.overflows;
+
+            return false;
+        }
+        counters.idleBytes += buffer.size;
+        ++counters.idleBuffers;
+    }
+    ThreadCache& threadCache = getThreadCache();
+    {
+        QMutexLocker k(&threadCache.mutex);
+        if (threadCache.buffers.size() < NATRON_MEMORY_POOL_THREAD_CACHE_BUFFERS) {
+            threadCache.buffers.push_back(buffer);
+
+            return true;
+        }
+    }
+    giveToNodePool(threadCache.node, buffer);
+
+    return true;
+}
+
+} // anon namespace
+
+namespace MemoryAllocator {
+
+void
+setHugePagesMode(MemoryHugePagesModeEnum mode)
+{
+    if ( hugePagesMode.fetchAndStoreAcquire( (int)mode ) != (int)mode ) {
+        // The pooled buffers were allocated with the previous mode
+        releasePool();
+    }
+}
+
+MemoryHugePagesModeEnum
+getHugePagesMode()
+{
+    return (MemoryHugePagesModeEnum)(int)hugePagesMode;
+}
+
+void
+setAccessHintsEnabled(bool enabled)
+{
+    accessHintsEnabled = enabled ? 1 : 0;
+}
+
+bool
+isAccessHintsEnabled()
+{
+    return (int)accessHintsEnabled != 0;
+}
+
+std::size_t
+getHugePageSize()
+{
+#if defined(__NATRON_LINUX__)
+    static const std::size_t hugePageSize = readHugePageSize();
+
+    return hugePageSize;
+#else
+
+    // Huge pages need privileges on Windows (MEM_LARGE_PAGES) and are not exposed on macOS
+    return 0;
+#endif
+}
+
+void*
+allocate(std::size_t size,
+         MemoryAllocationTypeEnum* type,
+         bool zeroed)
+{
+    std::size_t sizeClass = getPoolSizeClass(size);
+
+    if ( (sizeClass > 0) && (getPoolCapacity() > 0) ) {
+        PooledBuffer buffer;
+        bool found = takeFromPool(sizeClass, &buffer);
+        {
+            PoolCounters& counters = getPoolCounters();
+            QMutexLocker k(&counters.mutex);
+            if (found) {
+                counters.idleBytes -= sizeClass;
+                --counters.idleBuffers;
+                ++counters.hits;
+            } else {
+                ++counters.misses;
+            }
+        }
+        if (found) {
+            if (zeroed) {
+                zeroPooledBuffer(buffer.ptr, buffer.size, buffer.type);
+            }
+            *type = buffer.type;
+
+            return buffer.ptr;
+        }
+    }
+
+    return allocateFromSystem(sizeClass > 0 ? sizeClass : size, type, zeroed);
+}
+
+void
+deallocate(void* ptr,
+           std::size_t size,
+           MemoryAllocationTypeEnum type)
+{
+    if (!ptr) {
+        return;
+    }
+    std::size_t sizeClass = getPoolSizeClass(size);
+    if (sizeClass > 0) {
+        PooledBuffer buffer;
+        buffer.ptr = ptr;
+        buffer.size = sizeClass;
+        buffer.type = type;
+        if ( giveToPool(buffer) ) {
+            return;
+        }
+    }
+    deallocateToSystem(ptr, sizeClass > 0 ? sizeClass : size, type);
+}
+
+void
+setPoolCapacity(std::size_t capacity)
+{
+    bool mustRelease;
+    {
+        PoolCounters& counters = getPoolCounters();
+        QMutexLocker k(&counters.mutex);
+        counters.capacity = capacity;
+        mustRelease = counters.idleBytes > capacity;
+    }
+    if (mustRelease) {
+        releasePool();
+    }
+}
+
+std::size_t
+getPoolCapacity()
+{
+    PoolCounters& counters = getPoolCounters();
+    QMutexLocker k(&counters.mutex);
+
+    return counters.capacity;
+}
+
+void
+releasePool()
+{
+    std::vector<PooledBuffer> buffers;
+    {
+        QMutexLocker k( &getThreadCachesMutex() );
+        std::vector<ThreadCache*>& caches = getThreadCaches();
+        for (std::size_t i = 0; i < caches.size(); ++i) {
+            QMutexLocker k2(&caches[i]->mutex);
+            buffers.insert( buffers.end(), caches[i]->buffers.begin(), caches[i]->buffers.end() );
+            caches[i]->buffers.clear();
+        }
+    }
+    NodePool* pools = getNodePools();
+    for (int i = 0; i < NATRON_MEMORY_POOL_MAX_NUMA_NODES; ++i) {
+        QMutexLocker k(&pools[i].mutex);
+        for (std::map<std::size_t, std::vector<PooledBuffer> >::iterator it = pools[i].buffers.begin(); it != pools[i].buffers.end(); ++it) {
+            buffers.insert( buffers.end(), it->second.begin(), it->second.end() );
+        }
+        pools[i].buffers.clear();
+    }
+
+    std::size_t releasedBytes = 0;
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+        deallocateToSystem(buffers[i].ptr, buffers[i].size, buffers[i].type);
+        releasedBytes += buffers[i].size;
+    }
+
+    PoolCounters& counters = getPoolCounters();
+    QMutexLocker k(&counters.mutex);
+    counters.idleBytes -= releasedBytes;
+    counters.idleBuffers -= buffers.size();
+    counters.released += buffers.size();
+}
+
+MemoryPoolStats
+getPoolStats()
+{
+    MemoryPoolStats stats;
+    PoolCounters& counters = getPoolCounters();
+    QMutexLocker k(&counters.mutex);
+
+    stats.hits = counters.hits;
+    stats.misses = counters.misses;
+    stats.overflows = counters.overflows;
+    stats.released = counters.released;
+    stats.idleBytes = counters.idleBytes;
+    stats.idleBuffers = counters.idleBuffers;
+    stats.capacity = counters.capacity;
+
+    return stats;
+}
+
+void
+resetPoolStats()
+{
+    PoolCounters& counters = getPoolCounters();
+    QMutexLocker k(&counters.mutex);
+
+    counters.hits = 0;
+    counters.misses = 0;
+    counters.overflows = 0;
+    counters.released = 0;
+}
+
+bool
+advise(void* ptr,
+       std::size_t size,
+       MemoryAccessHintEnum hint)
+{
+    if ( !ptr || (size == 0) || !isAccessHintsEnabled() ) {
+        return false;
+    }
+#if defined(__NATRON_UNIX__)
+    std::size_t pageSize = getPageSize();
+    std::size_t begin = (std::size_t)ptr;
+    std::size_t end = begin + size;
+    if (hint == eMemoryAccessHintDontNeed) {
+        // Never release a page that is partly used by something else
+        begin = roundUp(begin, pageSize);
+        end = (end / pageSize) * pageSize;
+    } else {
+        begin = (begin / pageSize) * pageSize;
+        end = roundUp(end, pageSize);
+    }
+    if (end <= begin) {
+        return false;
+    }
+    int advice = MADV_NORMAL;
+    switch (hint) {
+    case eMemoryAccessHintNormal:
+        advice = MADV_NORMAL;
+        break;
+    case eMemoryAccessHintSequential:
+        advice = MADV_SEQUENTIAL;
+        break;
+    case eMemoryAccessHintWillNeed:
+        advice = MADV_WILLNEED;
+        break;
+    case eMemoryAccessHintDontNeed:
+        // Not posix_madvise(): the glibc ignores POSIX_MADV_DONTNEED
+        advice = MADV_DONTNEED;
+        break;
+    }
+
+    return ::madvise( (void*)begin, end - begin, advice ) == 0;
+#else
+
+    return false;
+#endif
+}
+
+} // namespace MemoryAllocator
+
+NATRON_NAMESPACE_EXIT
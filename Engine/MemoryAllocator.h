@@ -0,0 +1,206 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_MEMORYALLOCATOR_H
+#define NATRON_ENGINE_MEMORYALLOCATOR_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+// Buffers smaller than this are always allocated with malloc: huge pages only pay off for large images
+#define NATRON_HUGE_PAGES_MIN_ALLOCATION_SIZE (8 * 1024 * 1024)
+
+// Buffers smaller than this are never pooled: malloc recycles them cheaply already
+#define NATRON_MEMORY_POOL_MIN_ALLOCATION_SIZE (256 * 1024)
+
+// Number of size classes of the pool between two powers of two: a pooled buffer is at most 1/8th larger than requested
+#define NATRON_MEMORY_POOL_SIZE_CLASSES_PER_POWER_OF_TWO 8
+
+// Number of freed buffers each thread keeps for itself before giving them to the pool of its NUMA node
+#define NATRON_MEMORY_POOL_THREAD_CACHE_BUFFERS 4
+
+// Maximum number of NUMA nodes that get their own pool, nodes beyond share the pools
+#define NATRON_MEMORY_POOL_MAX_NUMA_NODES 8
+
+// Part of the RAM given to the image cache that is set aside for the buffers kept in the pool
+#define NATRON_MEMORY_POOL_CACHE_FRACTION 0.0625
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Whether large pixel buffers are backed by huge pages, which reduces the number of TLB misses
+ * when processing them.
+ **/
+enum MemoryHugePagesModeEnum
+{
+    // Large buffers are allocated with malloc
+    eMemoryHugePagesModeNone = 0,
+
+    // Large buffers are mapped and the kernel is asked to back them with transparent huge pages
+    // if it can (madvise(MADV_HUGEPAGE)).
+    eMemoryHugePagesModeTransparent,
+
+    // Large buffers are taken from the huge pages reserved by the administrator (hugetlbfs, MAP_HUGETLB).
+    // If none are available, transparent huge pages are used instead.
+    eMemoryHugePagesModeExplicit
+};
+
+/**
+ * @brief How a memory range is about to be accessed, see MemoryAllocator::advise()
+ **/
+enum MemoryAccessHintEnum
+{
+    eMemoryAccessHintNormal = 0,
+
+    // The range is going to be read once from start to end: read ahead aggressively
+    eMemoryAccessHintSequential,
+
+    // The range is going to be accessed soon: start reading it from disk now
+    eMemoryAccessHintWillNeed,
+
+    // The content of the range is not needed anymore: its pages may be released
+    eMemoryAccessHintDontNeed
+};
+
+/**
+ * @brief How a buffer returned by MemoryAllocator::allocate() was obtained, this must be passed back to deallocate().
+ **/
+enum MemoryAllocationTypeEnum
+{
+    eMemoryAllocationTypeMalloc = 0,
+    eMemoryAllocationTypeMap
+};
+
+/**
+ * @brief Counters of the pool of freed buffers, see MemoryAllocator::getPoolStats()
+ **/
+struct MemoryPoolStats
+{
+    // Allocations of a poolable size that were served by a buffer of the pool, or that had to be allocated
+    unsigned long long hits;
+    unsigned long long misses;
+
+    // Buffers freed while the pool was full, and buffers released by releasePool()
+    unsigned long long overflows;
+    unsigned long long released;
+
+    // Memory currently held by the pool, in the thread caches and the NUMA node pools
+    std::size_t idleBytes;
+    std::size_t idleBuffers;
+    std::size_t capacity;
+
+    MemoryPoolStats()
+        : hits(0)
+        , misses(0)
+        , overflows(0)
+        , released(0)
+        , idleBytes(0)
+        , idleBuffers(0)
+        , capacity(0)
+    {
+    }
+
+    double getHitRate() const
+    {
+        return (hits + misses) == 0 ? 0. : (double)hits / (hits + misses);
+    }
+};
+
+/**
+ * @brief Allocation policy of the pixel buffers and access hints for the cache files.
+ * The policy is global to the process and set from the Settings. All functions are thread-safe.
+ *
+ * Freed buffers of NATRON_MEMORY_POOL_MIN_ALLOCATION_SIZE bytes or more are kept in a pool, up to its capacity,
+ * so that the temporary images of each render do not map and fault in new pages every time.
+ * The pool is made of size classes: the first NATRON_MEMORY_POOL_THREAD_CACHE_BUFFERS buffers freed by a thread
+ * are kept for that thread only, the others go to the pool of the NUMA node the thread ran on when it first used
+ * the pool.
+ **/
+namespace MemoryAllocator {
+
+/**
+ * @brief Set how large buffers allocated from now on are backed. This is a no-op on systems without huge pages support.
+ **/
+void setHugePagesMode(MemoryHugePagesModeEnum mode);
+
+MemoryHugePagesModeEnum getHugePagesMode();
+
+/**
+ * @brief When disabled, advise() does nothing.
+ **/
+void setAccessHintsEnabled(bool enabled);
+
+bool isAccessHintsEnabled();
+
+/**
+ * @brief Returns the size of the huge pages of the system, or 0 if it does not have any.
+ **/
+std::size_t getHugePageSize();
+
+/**
+ * @brief Allocates size bytes according to the huge pages mode, or takes them from the pool.
+ * If zeroed is true the buffer is filled with zeros, otherwise its content is undefined.
+ * Returns NULL if the allocation failed.
+ **/
+void* allocate(std::size_t size, MemoryAllocationTypeEnum* type, bool zeroed = false);
+
+/**
+ * @brief Frees a buffer returned by allocate(), size and type must be the ones of the allocation.
+ * The buffer is kept in the pool if it has room for it.
+ **/
+void deallocate(void* ptr, std::size_t size, MemoryAllocationTypeEnum type);
+
+/**
+ * @brief Set the maximum number of bytes held by the pool. 0 disables the pool.
+ * The pool is released if it holds more than the new capacity.
+ **/
+void setPoolCapacity(std::size_t capacity);
+
+std::size_t getPoolCapacity();
+
+/**
+ * @brief Frees all the buffers held by the pool, e.g when the system is running out of memory.
+ **/
+void releasePool();
+
+MemoryPoolStats getPoolStats();
+
+void resetPoolStats();
+
+/**
+ * @brief Tells the system how the given range of memory, either allocated or a mapped file,
+ * is about to be accessed. The range is extended to the enclosing pages, except for eMemoryAccessHintDontNeed
+ * which only releases the pages entirely contained in the range.
+ * Returns false if the hint was not applied.
+ **/
+bool advise(void* ptr, std::size_t size, MemoryAccessHintEnum hint);
+
+} // namespace MemoryAllocator
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_MEMORYALLOCATOR_H
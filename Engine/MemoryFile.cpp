@@ -413,6 +413,15 @@ MemoryFile::flush(FlushTypeEnum type, void* data, std::size_t size)
     return false;
 }
 
+bool
+MemoryFile::advise(MemoryAccessHintEnum hint, void* data, std::size_t size)
+{
+    void* ptr = data ? data : _imp->data;
+    std::size_t n = data ? size : _imp->size;
+
+    return MemoryAllocator::advise(ptr, n, hint);
+}
+
 MemoryFile::~MemoryFile()
 {
     if (_imp->data) {
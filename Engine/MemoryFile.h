@@ -32,6 +32,7 @@
 
 #include "Global/GlobalDefines.h"
 #include "Global/Enums.h"
+#include "Engine/MemoryAllocator.h"
 #include "Engine/EngineFwd.h"
 
 NATRON_NAMESPACE_ENTER
@@ -146,6 +147,13 @@ public:
      **/
     bool flush(FlushTypeEnum type, void* data, std::size_t size);
 
+    /**
+     * @brief Tells the system how the mapping is about to be accessed, see MemoryAllocator::advise()
+     * @param data If non null, only the portion starting at data and spanning size bytes
+     * is concerned
+     **/
+    bool advise(MemoryAccessHintEnum hint, void* data, std::size_t size);
+
     /**
      * @brief Returns the filepath of the backing file.
      **/
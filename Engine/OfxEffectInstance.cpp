@@ -67,6 +67,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 #include "Engine/ReadNode.h"
 #include "Engine/RotoLayer.h"
 #include "Engine/TimeLine.h"
+#include "Engine/TraceRecorder.h"
 #include "Engine/Transform.h"
 #include "Engine/UndoCommand.h"
 #include "Engine/ViewIdx.h"
@@ -1393,6 +1394,8 @@ OfxEffectInstance::getRegionOfDefinition(U64 /*hash*/,
         return eStatusFailed;
     }
 
+    TraceScope trace("ofx", "getRegionOfDefinition", this, time);
+
     assert(_imp->effect);
 
     unsigned int mipMapLevel = Image::getLevelFromScale(scale.x);
@@ -1592,6 +1595,8 @@ OfxEffectInstance::getRegionsOfInterest(double time,
     if (!_imp->initialized) {
         return;
     }
+
+    TraceScope trace("ofx", "getRegionsOfInterest", this, time);
     assert(outputRoD.x2 >= outputRoD.x1 && outputRoD.y2 >= outputRoD.y1);
     Q_UNUSED(outputRoD);
     assert(renderWindow.x2 >= renderWindow.x1 && renderWindow.y2 >= renderWindow.y1);
@@ -1660,6 +1665,7 @@ OfxEffectInstance::getFramesNeeded(double time,
         return ret;
     }
     assert(_imp->effect);
+    TraceScope trace("ofx", "getFramesNeeded", this, time);
     OfxStatus stat;
 
     if ( isViewAware() ) {
@@ -1817,6 +1823,8 @@ OfxEffectInstance::isIdentity(double time,
         return false;
     }
 
+    TraceScope trace("ofx", "isIdentity", this, time);
+
     assert(_imp->context != eContextNone);
     const std::string field = kOfxImageFieldNone; // TODO: support interlaced data
     std::string inputclip;
@@ -2027,6 +2035,11 @@ OfxEffectInstance::render(const RenderActionArgs& args)
         return eStatusFailed;
     }
 
+    TraceScope trace("ofx", "render", this, args.time);
+    if ( trace.isActive() ) {
+        trace.setRect(args.roi);
+    }
+
     assert( !args.outputPlanes.empty() );
 
     const std::pair<ImagePlaneDesc, ImagePtr>& firstPlane = args.outputPlanes.front();
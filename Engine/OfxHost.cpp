@@ -50,7 +50,6 @@ CLANG_DIAG_ON(deprecated-register)
 #ifdef OFX_SUPPORTS_MULTITHREAD
 #include <QtCore/QThread>
 #include <QtCore/QThreadStorage>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 // /usr/local/include/boost/bind/arg.hpp:37:9: warning: unused typedef 'boost_static_assert_typedef_37' [-Wunused-local-typedef]
 #include <boost/bind/bind.hpp>
@@ -108,6 +107,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 #include "Engine/Project.h"
 #include "Engine/Settings.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TLSHolder.h"
 #include "Engine/ThreadPool.h"
 
@@ -1368,13 +1368,12 @@ OfxHost::multiThread(OfxThreadFunctionV1 func,
         }
 
         /// DON'T set the maximum thread count, this is a global application setting, and see the documentation excerpt above
-        //QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
-        QFuture<OfxStatus> future = QtConcurrent::mapped( threadIndexes, boost::bind(threadFunctionWrapper, func, _1, nThreads, spawnerThread, customArg) );
-        future.waitForFinished();
-        ///DON'T reset back to the original value the maximum thread count
-        //QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+        /// The spawner thread runs some of the indexes itself while it waits: a plug-in calling multiThread
+        /// from a tile rendered by the TaskScheduler does not need more threads than the workers.
+        std::vector<OfxStatus> status;
+        TaskScheduler::blockingMapped( threadIndexes, boost::bind(threadFunctionWrapper, func, _1, nThreads, spawnerThread, customArg), &status );
 
-        for (QFuture<OfxStatus>::const_iterator it = future.begin(); it != future.end(); ++it) {
+        for (std::vector<OfxStatus>::const_iterator it = status.begin(); it != status.end(); ++it) {
             OfxStatus stat = *it;
             if (stat != kOfxStatOK) {
                 return stat;
@@ -1445,6 +1444,13 @@ OfxHost::multiThreadNumCPUS(unsigned int *nCPUs) const
 
     if (nThreadsToRender == -1) {
         *nCPUs = 1;
+    } else if ( appPTR->getUseThreadPool() ) {
+        // The threads of the TaskScheduler are shared by all the renders and the thread calling multiThread
+        // runs some of the indexes too, so there is no need to leave out the threads that are already busy.
+        if (nThreadsPerEffect == 0) {
+            nThreadsPerEffect = std::max( 1, appPTR->getMaxThreadCount() );
+        }
+        *nCPUs = std::max( 1, std::min(TaskScheduler::instance()->getMaxThreadsCount(), nThreadsPerEffect) );
     } else {
         // activeThreadCount may be negative (for example if releaseThread() is called)
         int activeThreadsCount = QThreadPool::globalInstance()->activeThreadCount();
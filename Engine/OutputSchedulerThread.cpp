@@ -40,6 +40,7 @@
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
 #include <QtCore/QString>
 #include <QtCore/QThreadPool>
 #include <QtCore/QDebug>
@@ -55,16 +56,20 @@
 #include "Engine/EffectInstance.h"
 #include "Engine/Image.h"
 #include "Engine/KnobFile.h"
+#include "Engine/MemoryInfo.h" // printAsRAM
 #include "Engine/Node.h"
 #include "Engine/OpenGLViewerI.h"
+#include "Engine/ParallelFramesController.h"
 #include "Engine/GenericSchedulerThreadWatcher.h"
 #include "Engine/Project.h"
+#include "Engine/RenderPlan.h"
 #include "Engine/RenderStats.h"
 #include "Engine/RotoContext.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
 #include "Engine/TimeLine.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/TraceRecorder.h"
 #include "Engine/UpdateViewerParams.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
@@ -220,6 +225,10 @@ struct OutputSchedulerThreadPrivate
     ///Render threads wait in this condition and the scheduler wake them when it needs to render some frames
     QWaitCondition framesToRenderNotEmptyCond;
 
+    ///Decides how many frames are rendered in parallel when the user lets the number of parallel renders automatic
+    ParallelFramesController parallelFrames;
+    TimeLapse parallelFramesTimer;
+
 #endif
 
     ///Work queue filled by the scheduler thread when in playback/render on disk
@@ -269,6 +278,8 @@ struct OutputSchedulerThreadPrivate
         , allRenderThreadsQuitCond()
         , framesToRender()
         , framesToRenderNotEmptyCond()
+        , parallelFrames()
+        , parallelFramesTimer()
 #endif
         , framesToRenderMutex()
         , lastFramePushedIndex(0)
@@ -1058,6 +1069,8 @@ OutputSchedulerThread::startRender()
     _imp->engine->s_renderStarted(forward);
 
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+    _imp->parallelFrames.reset();
+
     int nThreads;
     {
         QMutexLocker l(&_imp->renderThreadsMutex);
@@ -1163,6 +1176,41 @@ OutputSchedulerThread::stopRender()
 
     ///If the output effect is sequential (only WriteFFMPEG for now)
     EffectInstancePtr effect = _imp->outputEffect.lock();
+
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+    // Only report it for the renders of writers, not for each viewer playback
+    if ( effect && effect->isWriter() ) {
+        ParallelFramesLimitEnum limit;
+        int parallelFrames = _imp->parallelFrames.getPeakParallelFrames(&limit);
+        if (parallelFrames > 0) {
+            QString limitStr;
+            switch (limit) {
+            case eParallelFramesLimitThreads:
+                limitStr = tr("the number of threads");
+                break;
+            case eParallelFramesLimitMemory:
+                limitStr = tr("the cache size");
+                break;
+            case eParallelFramesLimitThroughput:
+                limitStr = tr("the throughput");
+                break;
+            case eParallelFramesLimitRampUp:
+                limitStr = tr("the length of the render");
+                break;
+            }
+            QString message = tr("Rendered up to %1 frame(s) in parallel, limited by %2. Estimated memory per frame: %3.")
+                              .arg(parallelFrames)
+                              .arg(limitStr)
+                              .arg( printAsRAM( _imp->parallelFrames.getFrameFootprint() ) );
+            double fps = _imp->parallelFrames.getFramesPerSecond(parallelFrames);
+            if (fps > 0.) {
+                message += QLatin1Char(' ') + tr("%1 fps with %2 frame(s) in parallel.").arg(fps, 0, 'f', 1).arg(parallelFrames);
+            }
+            appPTR->writeToErrorLog_mt_safe(QString::fromUtf8( effect->getScriptName_mt_safe().c_str() ), QDateTime::currentDateTime(), message);
+        }
+    }
+#endif
+
     WriteNode* isWriteNode = dynamic_cast<WriteNode*>( effect.get() );
     if (isWriteNode) {
         NodePtr embeddedWriter = isWriteNode->getEmbeddedWriter();
@@ -1520,10 +1568,14 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads,
 
     *lastNThreads = currentParallelRenders;
 
+    ///Whether the count is lowered because of the memory used by the frames or because it does not render faster
+    bool limitedByCost = false;
     if (userSettingParallelThreads == 0) {
-        ///User wants it to be automatically computed, do a simple heuristic: launch as many parallel renders
-        ///as there are cores
-        optimalNThreads = appPTR->getHardwareIdealThreadCount();
+        ///User wants it to be automatically computed: launch at most as many parallel renders as there are cores,
+        ///as long as the frames rendered in parallel fit in the cache and more of them render more frames per second
+        int nCores = std::max(1, appPTR->getHardwareIdealThreadCount());
+        optimalNThreads = _imp->parallelFrames.getMaxParallelFrames( nCores, appPTR->getCachesMaximumMemorySize() );
+        limitedByCost = optimalNThreads < nCores;
     } else {
         optimalNThreads = userSettingParallelThreads;
     }
@@ -1537,7 +1589,7 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads,
 
         _imp->appendRunnable( createRunnable() );
         *newNThreads = currentParallelRenders +  1;
-    } else if ( (runningThreads > optimalNThreads) && (currentParallelRenders > optimalNThreads) ) {
+    } else if ( (currentParallelRenders > optimalNThreads) && ( (runningThreads > optimalNThreads) || limitedByCost ) ) {
         ////////
         ///Stop 1 thread
         stopRenderThreads(1);
@@ -1549,6 +1601,20 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads,
     }
 }
 
+void
+OutputSchedulerThread::recordFrameCost(U64 cacheSizeBeforeFrame)
+{
+    U64 cacheSize = appPTR->getCachesTotalMemorySize();
+    U64 cacheMaximumSize = appPTR->getCachesMaximumMemorySize();
+    // Past 95%, the cache evicts entries to make room for new ones
+    bool cacheFull = cacheMaximumSize > 0 && cacheSize >= cacheMaximumSize * 0.95;
+
+    _imp->parallelFrames.recordFrame(_imp->parallelFramesTimer.getTimeSinceCreation(),
+                                     cacheSize > cacheSizeBeforeFrame ? cacheSize - cacheSizeBeforeFrame : 0,
+                                     getNRenderThreads(),
+                                     cacheFull);
+}
+
 #endif // ifndef NATRON_PLAYBACK_USES_THREAD_POOL
 
 void
@@ -2069,13 +2135,19 @@ RenderThreadTask::run()
 #ifdef TRACE_SCHEDULER
         qDebug() << "Parallel Render Thread: Picking frame to render: " << time;
 #endif
-        renderFrame(time, viewsToRender, enableRenderStats);
+        U64 cacheSizeBeforeFrame = appPTR->getCachesTotalMemorySize();
+        {
+            TraceScope trace("scheduler", "frame");
+            trace.setTime(time);
+            renderFrame(time, viewsToRender, enableRenderStats);
+        }
 
         appPTR->getAppTLS()->cleanupTLSForThread();
 
         if ( mustQuit() ) {
             break;
         }
+        _imp->scheduler->recordFrameCost(cacheSizeBeforeFrame);
     }
 
     {
@@ -2333,6 +2405,13 @@ private:
                         return;
                     }
                     frameRenderArgs.updateNodesRequest(request);
+
+                    // Errors are reported by the render of the root below
+                    if (RenderPlan::preRender(activeInputNode, time, viewsToRender[view], mipMapLevel, request) == EffectInstance::eRenderRoIRetCodeAborted) {
+                        _imp->scheduler->notifyRenderFailure("Render aborted");
+
+                        return;
+                    }
                 }
                 RenderingFlagSetter flagIsRendering( activeInputToRender->getNode() );
                 std::map<ImagePlaneDesc, ImagePtr> planes;
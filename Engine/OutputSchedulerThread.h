@@ -455,6 +455,12 @@ private:
      * @param optimalNThreads[out] Will be set to the new number of threads
      **/
     void adjustNumberOfThreads(int* newNThreads, int *lastNThreads);
+
+    /**
+     * @brief Called by a render thread when it rendered a frame, to measure the memory and the throughput of the
+     * parallel renders, see adjustNumberOfThreads()
+     **/
+    void recordFrameCost(U64 cacheSizeBeforeFrame);
 #else
     void startTasksFromLastStartedFrame();
     void startTasks(int startingFrame);
@@ -0,0 +1,198 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ParallelFramesController.h"
+
+#include <algorithm> // min, max
+
+#include <QtCore/QMutexLocker>
+
+// The frames in flight may use this fraction of the in-memory node cache, the rest is left to the images they share
+// and to the frames already rendered
+#define NATRON_PARALLEL_FRAMES_MEMORY_FRACTION 0.5
+
+// Weight of the previous estimate when a frame used less memory than estimated
+#define NATRON_PARALLEL_FRAMES_FOOTPRINT_DECAY 0.75
+
+// The throughput of a number of parallel frames is measured over as many frames, and at least this many
+#define NATRON_PARALLEL_FRAMES_MIN_WINDOW 2
+
+// One more parallel frame must render at least that many more frames per second
+#define NATRON_PARALLEL_FRAMES_MIN_GAIN 0.05
+
+// Number of throughput windows measured at a count limited by the throughput before trying one more frame
+#define NATRON_PARALLEL_FRAMES_REPROBE_WINDOWS 8
+
+NATRON_NAMESPACE_ENTER
+
+ParallelFramesController::ParallelFramesController()
+    : _lock()
+    , _frameFootprint(0.)
+    , _windowParallelFrames(0)
+    , _windowStart(0.)
+    , _windowFrames(0)
+    , _framesPerSecond()
+    , _targetParallelFrames(0)
+    , _throughputLimited(false)
+    , _probing(false)
+    , _windowsAtTarget(0)
+    , _peakParallelFrames(0)
+    , _lastLimit(eParallelFramesLimitThreads)
+{
+}
+
+void
+ParallelFramesController::reset()
+{
+    QMutexLocker k(&_lock);
+
+    _windowParallelFrames = 0;
+    _windowStart = 0.;
+    _windowFrames = 0;
+    _framesPerSecond.clear();
+    _targetParallelFrames = 0;
+    _throughputLimited = false;
+    _probing = false;
+    _windowsAtTarget = 0;
+    _peakParallelFrames = 0;
+    _lastLimit = eParallelFramesLimitThreads;
+}
+
+void
+ParallelFramesController::recordFrame(double now,
+                                      std::size_t cacheGrowth,
+                                      int parallelFrames,
+                                      bool cacheFull)
+{
+    QMutexLocker k(&_lock);
+
+    parallelFrames = std::max(1, parallelFrames);
+
+    // The other frames rendered at the same time also grew the cache. Follow the peaks immediately, and forget them slowly.
+    if ( !cacheFull && (cacheGrowth > 0) ) {
+        double footprint = (double)cacheGrowth / parallelFrames;
+        _frameFootprint = std::max( footprint, NATRON_PARALLEL_FRAMES_FOOTPRINT_DECAY * _frameFootprint + (1. - NATRON_PARALLEL_FRAMES_FOOTPRINT_DECAY) * footprint );
+    }
+
+    if (parallelFrames != _windowParallelFrames) {
+        _windowParallelFrames = parallelFrames;
+        _windowStart = now;
+        _windowFrames = 0;
+
+        return;
+    }
+    ++_windowFrames;
+    if ( (_windowFrames < NATRON_PARALLEL_FRAMES_MIN_WINDOW) || (_windowFrames < parallelFrames) || (now <= _windowStart) ) {
+        return;
+    }
+
+    double fps = _windowFrames / (now - _windowStart);
+    _framesPerSecond[parallelFrames] = fps;
+    _windowStart = now;
+    _windowFrames = 0;
+
+    std::map<int, double>::const_iterator fewer = _framesPerSecond.lower_bound(parallelFrames);
+    bool gained = true;
+    if ( fewer != _framesPerSecond.begin() ) {
+        --fewer;
+        gained = fps >= fewer->second * (1. + NATRON_PARALLEL_FRAMES_MIN_GAIN);
+    }
+    if (!gained) {
+        // Go back towards the smaller count, halving the distance each time
+        _targetParallelFrames = fewer->first + (parallelFrames - fewer->first) / 2;
+        _throughputLimited = true;
+        _probing = false;
+        _windowsAtTarget = 0;
+    } else if (parallelFrames != _targetParallelFrames) {
+        // Bounded by the threads or the memory: nothing learnt about the target
+    } else if (!_throughputLimited || _probing) {
+        // Still ramping up, or one more frame helped again
+        _targetParallelFrames = 2 * parallelFrames;
+        _throughputLimited = false;
+        _probing = false;
+    } else if (++_windowsAtTarget >= NATRON_PARALLEL_FRAMES_REPROBE_WINDOWS) {
+        _targetParallelFrames = parallelFrames + 1;
+        _probing = true;
+        _windowsAtTarget = 0;
+    }
+}
+
+int
+ParallelFramesController::getMaxParallelFrames(int threadsLimit,
+                                               std::size_t memoryBudget)
+{
+    QMutexLocker k(&_lock);
+    int ret = std::max(1, threadsLimit);
+
+    _lastLimit = eParallelFramesLimitThreads;
+    if ( (_frameFootprint > 0.) && (memoryBudget > 0) ) {
+        double memoryLimit = std::max(1., NATRON_PARALLEL_FRAMES_MEMORY_FRACTION * memoryBudget / _frameFootprint);
+        if (memoryLimit < ret) {
+            ret = (int)memoryLimit;
+            _lastLimit = eParallelFramesLimitMemory;
+        }
+    }
+    if (_targetParallelFrames == 0) {
+        _targetParallelFrames = std::max(1, (ret + 1) / 2);
+    }
+    if (_targetParallelFrames < ret) {
+        ret = _targetParallelFrames;
+        _lastLimit = _throughputLimited ? eParallelFramesLimitThroughput : eParallelFramesLimitRampUp;
+    }
+    _peakParallelFrames = std::max(_peakParallelFrames, ret);
+
+    return ret;
+}
+
+std::size_t
+ParallelFramesController::getFrameFootprint() const
+{
+    QMutexLocker k(&_lock);
+
+    return (std::size_t)_frameFootprint;
+}
+
+int
+ParallelFramesController::getPeakParallelFrames(ParallelFramesLimitEnum* limit) const
+{
+    QMutexLocker k(&_lock);
+
+    if (limit) {
+        *limit = _lastLimit;
+    }
+
+    return _peakParallelFrames;
+}
+
+double
+ParallelFramesController::getFramesPerSecond(int parallelFrames) const
+{
+    QMutexLocker k(&_lock);
+    std::map<int, double>::const_iterator found = _framesPerSecond.find(parallelFrames);
+
+    return found == _framesPerSecond.end() ? 0. : found->second;
+}
+
+NATRON_NAMESPACE_EXIT
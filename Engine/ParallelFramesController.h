@@ -0,0 +1,132 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_PARALLELFRAMESCONTROLLER_H
+#define NATRON_ENGINE_PARALLELFRAMESCONTROLLER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <map>
+
+#include <QtCore/QMutex>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief What bounds the number of frames rendered in parallel, see ParallelFramesController.
+ **/
+enum ParallelFramesLimitEnum
+{
+    eParallelFramesLimitThreads = 0, // the number of cores or of parallel renders set by the user
+    eParallelFramesLimitMemory, // the memory used by a frame times the number of frames would not fit in the cache
+    eParallelFramesLimitThroughput, // rendering more frames in parallel did not render more frames per second
+    eParallelFramesLimitRampUp // the throughput of the current count is not measured yet
+};
+
+/**
+ * @brief Decides how many frames an OutputSchedulerThread renders in parallel from what the previous frames cost.
+ *
+ * Each rendered frame is recorded with the growth of the node cache while it rendered: the largest recent growth
+ * per frame is the memory footprint of a frame. The frames in flight must fit in a fraction of the in-memory cache,
+ * otherwise the images needed by a frame are evicted by the others before it is done.
+ * The count starts at half of what the threads and the memory allow, the footprint being kept from the previous render,
+ * and doubles once the throughput of the current count has been measured over as many frames. When a count does not
+ * render more frames per second than the closest smaller count measured, the count goes back towards the smaller one,
+ * halving the distance each time. Once settled, one more frame is tried from time to time, so that the count grows again
+ * if the frames got cheaper.
+ * All functions are thread-safe.
+ **/
+class ParallelFramesController
+{
+public:
+
+    ParallelFramesController();
+
+    /**
+     * @brief Forgets the throughput measured by the previous render, called when a render starts.
+     * The memory footprint of a frame is kept, so that the first frames in flight fit in the cache.
+     **/
+    void reset();
+
+    /**
+     * @brief Records a frame rendered by a render thread.
+     * @param now Time in seconds since a fixed origin, the same for all calls since reset()
+     * @param cacheGrowth The size by which the in-memory portion of the node cache grew while the frame was rendered
+     * @param parallelFrames The number of frames that were rendered in parallel, including this one
+     * @param cacheFull True if the cache was evicting entries: the growth does not tell what the frame used then
+     **/
+    void recordFrame(double now, std::size_t cacheGrowth, int parallelFrames, bool cacheFull);
+
+    /**
+     * @brief Returns how many frames to render in parallel, at most threadsLimit.
+     * @param memoryBudget The maximum size of the in-memory portion of the node cache, 0 if unknown
+     **/
+    int getMaxParallelFrames(int threadsLimit, std::size_t memoryBudget);
+
+    /**
+     * @brief The memory footprint of a frame estimated so far, 0 if unknown
+     **/
+    std::size_t getFrameFootprint() const;
+
+    /**
+     * @brief The maximum value returned by getMaxParallelFrames() since reset(), and what bounded it the last time
+     **/
+    int getPeakParallelFrames(ParallelFramesLimitEnum* limit) const;
+
+    /**
+     * @brief The frames per second measured with the given number of parallel frames, 0 if not measured
+     **/
+    double getFramesPerSecond(int parallelFrames) const;
+
+private:
+
+    mutable QMutex _lock;
+    double _frameFootprint;
+
+    // The current throughput window
+    int _windowParallelFrames;
+    double _windowStart;
+    int _windowFrames;
+    std::map<int, double> _framesPerSecond;
+
+    // The number of parallel frames to try, 0 until the first call to getMaxParallelFrames()
+    int _targetParallelFrames;
+    bool _throughputLimited; // the target was lowered because more frames did not render faster
+    bool _probing; // the target was raised by one to check if the throughput limit still holds
+    int _windowsAtTarget;
+
+    int _peakParallelFrames;
+    ParallelFramesLimitEnum _lastLimit;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_PARALLELFRAMESCONTROLLER_H
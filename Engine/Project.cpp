@@ -576,7 +576,8 @@ Project::saveProjectInternal(const QString & path,
         }
         if (!isRenderSave) {
             if (appendTimeHash) {
-                Hash64 timeHash;
+                // The hash is part of the file name: keep the same one as previous versions
+                Hash64 timeHash(Hash64::eHashAlgorithmCRC64);
 
                 Q_FOREACH(QChar ch, timeStr) {
                     timeHash.append<unsigned short>( ch.unicode() );
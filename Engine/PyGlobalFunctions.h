@@ -33,7 +33,13 @@
  * doesn't generate the Natron namespace
  **/
 
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "Engine/AppManager.h"
+#include "Engine/CacheHolderStats.h"
 #include "Engine/MemoryInfo.h" // isApplication32Bits
 #include "Engine/PyAppInstance.h"
 
@@ -190,6 +196,65 @@ public:
         return appPTR->getHardwareIdealThreadCount();
     }
 
+    inline QStringList getCacheNames() const
+    {
+        QStringList ret;
+        std::list<std::string> list = appPTR->getCacheNames();
+
+        for (std::list<std::string>::iterator it = list.begin(); it != list.end(); ++it) {
+            ret.push_back( QString::fromUtf8( it->c_str() ) );
+        }
+
+        return ret;
+    }
+
+    inline QStringList getCacheHolderIDs(const QString& cacheName) const
+    {
+        QStringList ret;
+        CacheHolderStatsMap stats;
+
+        appPTR->getCacheStatistics(cacheName.toStdString(), &stats);
+        for (CacheHolderStatsMap::iterator it = stats.begin(); it != stats.end(); ++it) {
+            ret.push_back( QString::fromUtf8( it->first.c_str() ) );
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Returns the statistics of the given holder in the given cache, or the total of the cache
+     * if holderID is empty.
+     **/
+    inline std::map<QString, double> getCacheStatistics(const QString& cacheName,
+                                                        const QString& holderID = QString()) const
+    {
+        std::map<QString, double> ret;
+        CacheHolderStatsMap stats;
+
+        if ( !appPTR->getCacheStatistics(cacheName.toStdString(), &stats) ) {
+            return ret;
+        }
+        CacheHolderStats holderStats;
+        std::string id = holderID.toStdString();
+        for (CacheHolderStatsMap::iterator it = stats.begin(); it != stats.end(); ++it) {
+            if ( id.empty() || (it->first == id) ) {
+                holderStats.merge(it->second);
+            }
+        }
+        std::vector<std::pair<std::string, double> > values;
+        holderStats.getValues(&values);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            ret[QString::fromUtf8( values[i].first.c_str() )] = values[i].second;
+        }
+
+        return ret;
+    }
+
+    inline void resetCacheStatistics()
+    {
+        appPTR->resetCacheStatistics();
+    }
+
     inline App* getInstance(int idx) const
     {
         AppInstancePtr app = appPTR->getAppInstance(idx);
@@ -27,6 +27,8 @@
 
 #include <cassert>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include "Engine/Node.h"
 #include "Engine/KnobTypes.h"
@@ -1105,5 +1107,26 @@ Effect::setPagesOrder(const QStringList& pages)
     getInternalNode()->setPagesOrder(order);
 }
 
+std::map<QString, double>
+Effect::getCacheStatistics() const
+{
+    std::map<QString, double> ret;
+    NodePtr node = getInternalNode();
+
+    if (!node) {
+        return ret;
+    }
+
+    CacheHolderStats stats;
+    appPTR->getCacheStatisticsForHolder(node->getCacheID(), &stats);
+    std::vector<std::pair<std::string, double> > values;
+    stats.getValues(&values);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        ret[QString::fromUtf8( values[i].first.c_str() )] = values[i].second;
+    }
+
+    return ret;
+}
+
 NATRON_PYTHON_NAMESPACE_EXIT
 NATRON_NAMESPACE_EXIT
@@ -34,6 +34,7 @@
  **/
 
 #include <list>
+#include <map>
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
 #endif
@@ -390,6 +391,11 @@ public:
     NATRON_ENUM::ImagePremultiplicationEnum getPremult() const;
 
     void setPagesOrder(const QStringList& pages);
+
+    /**
+     * @brief Returns the statistics of the images of this node in all the caches, see PyCoreApplication::getCacheStatistics()
+     **/
+    std::map<QString, double> getCacheStatistics() const;
 };
 
 NATRON_PYTHON_NAMESPACE_EXIT
@@ -0,0 +1,658 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RenderPlan.h"
+
+#include <algorithm> // max, sort, find
+#include <bitset>
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QThread>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/bind/bind.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#endif
+
+#include "Global/FStreamsSupport.h"
+#include "Global/StrUtils.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/Image.h"
+#include "Engine/ImageKey.h"
+#include "Engine/Node.h"
+#include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
+#include "Engine/TLSHolder.h"
+#include "Engine/TraceRecorder.h"
+
+NATRON_NAMESPACE_ENTER
+
+using namespace boost::placeholders;
+
+RenderPlanStep::RenderPlanStep()
+    : node()
+    , time(0.)
+    , view(0)
+    , mipMapLevel(0)
+    , canonicalRoI()
+    , roi()
+    , rod()
+    , planes()
+    , bitdepth(eImageBitDepthNone)
+    , isIdentity(false)
+    , isCached(false)
+    , isNeeded(false)
+    , cachesOutput(false)
+    , isRotoPaintItem(false)
+    , isPreRendered(false)
+    , level(0)
+    , inputs()
+    , outputs()
+{
+}
+
+EffectInstance::RenderRoIRetCode
+RenderPlan::preRender(const NodePtr& treeRoot,
+                      double time,
+                      ViewIdx view,
+                      unsigned int mipMapLevel,
+                      const FrameRequestMap& requests)
+{
+    if ( !appPTR->getCurrentSettings()->isPreRenderSharedBranchesEnabled() ) {
+        return EffectInstance::eRenderRoIRetCodeOk;
+    }
+
+    RenderPlan plan(treeRoot, time, view, requests);
+    if ( !plan.hasSharedSteps() ) {
+        return EffectInstance::eRenderRoIRetCodeOk;
+    }
+    plan.resolve(mipMapLevel, requests);
+    plan.dumpIfRequested();
+
+    return plan.execute();
+}
+
+RenderPlan::RenderPlan(const NodePtr& treeRoot,
+                       double time,
+                       ViewIdx view,
+                       const FrameRequestMap& requests)
+    : _treeRoot(treeRoot)
+    , _time(time)
+    , _view(view)
+    , _steps()
+    , _stepsIndex()
+    , _root(-1)
+{
+    // One step per node and frame/view requested
+    for (FrameRequestMap::const_iterator it = requests.begin(); it != requests.end(); ++it) {
+        for (NodeFrameViewRequestData::const_iterator it2 = it->second->frames.begin(); it2 != it->second->frames.end(); ++it2) {
+            RenderPlanStep step;
+            step.node = it->first;
+            step.time = it2->first.time;
+            step.view = it2->first.view;
+            step.canonicalRoI = it2->second.finalData.finalRoi;
+            step.rod = it2->second.globalData.rod;
+            step.isIdentity = it2->second.globalData.isIdentity;
+            step.isRotoPaintItem = (bool)step.node->getAttachedRotoItem();
+            if ( !step.canonicalRoI.intersect(step.rod, &step.canonicalRoI) ) {
+                step.canonicalRoI.clear();
+            }
+
+            _stepsIndex[std::make_pair( step.node.get(), std::make_pair( step.time, (int)step.view ) )] = (int)_steps.size();
+            _steps.push_back(step);
+        }
+    }
+
+    _root = findStep(treeRoot, time, view);
+
+    // Link each step to the steps it reads
+    for (FrameRequestMap::const_iterator it = requests.begin(); it != requests.end(); ++it) {
+        for (NodeFrameViewRequestData::const_iterator it2 = it->second->frames.begin(); it2 != it->second->frames.end(); ++it2) {
+            addInputs(findStep(it->first, it2->first.time, it2->first.view), it2->second);
+        }
+    }
+
+    computeLevels(&_steps);
+}
+
+void
+RenderPlan::resolve(unsigned int mipMapLevel,
+                    const FrameRequestMap& requests)
+{
+    /*
+       Resolve what the renderRoI() calls made when rendering the root will find in the cache. Outputs come before inputs
+       when sorted by decreasing level, so that the mipmap level at which a step is read is known when it is visited.
+     */
+    std::vector<std::pair<int, int> > topDown;
+    for (std::size_t i = 0; i < _steps.size(); ++i) {
+        topDown.push_back( std::make_pair(-_steps[i].level, (int)i) );
+    }
+    std::sort( topDown.begin(), topDown.end() );
+
+    std::vector<unsigned int> requestedMipMapLevel( _steps.size(), mipMapLevel );
+    for (std::size_t i = 0; i < topDown.size(); ++i) {
+        RenderPlanStep& step = _steps[topDown[i].second];
+        EffectInstancePtr effect = step.node->getEffectInstance();
+
+        // The level passed to renderRoI() by the first step reading this one, see EffectInstance::treeRecurseFunctor()
+        if ( topDown[i].second != _root && !step.outputs.empty() ) {
+            const RenderPlanStep& output = _steps[step.outputs.front()];
+            bool scaleOneInputs = !output.isIdentity && ( output.node->useScaleOneImagesWhenRenderScaleSupportIsDisabled() ||
+                                                          !output.node->getEffectInstance()->supportsMultiResolution() );
+            requestedMipMapLevel[topDown[i].second] = scaleOneInputs ? 0 : requestedMipMapLevel[step.outputs.front()];
+        }
+        step.mipMapLevel = requestedMipMapLevel[topDown[i].second];
+        const unsigned int mappedMipMapLevel = effect->supportsRenderScale() ? step.mipMapLevel : 0;
+
+        const double par = effect->getAspectRatio(-1);
+        step.canonicalRoI.toPixelEnclosing(step.mipMapLevel, par, &step.roi);
+        step.bitdepth = effect->getBitDepth(-1);
+
+        FrameRequestMap::const_iterator foundRequest = requests.find(step.node);
+        assert( foundRequest != requests.end() );
+        const U64 nodeHash = foundRequest->second->nodeHash;
+        {
+            EffectInstance::ComponentsNeededMap neededComps;
+            std::list<ImagePlaneDesc> passThroughPlanes;
+            bool processAll;
+            double ptTime;
+            int ptView;
+            std::bitset<4> processChannels;
+            int ptInput;
+            effect->getComponentsNeededAndProduced_public(nodeHash, step.time, step.view, &neededComps, &passThroughPlanes, &processAll, &ptTime, &ptView, &processChannels, &ptInput);
+            EffectInstance::ComponentsNeededMap::const_iterator foundOutput = neededComps.find(-1);
+            if ( foundOutput != neededComps.end() ) {
+                step.planes = foundOutput->second;
+            }
+        }
+
+        if (step.isIdentity || step.canonicalRoI.isNull() || step.planes.empty()) {
+            continue;
+        }
+
+        const bool isFrameVaryingOrAnimated = effect->isFrameVaryingOrAnimated_Recursive();
+        ParallelRenderArgsPtr frameArgs = effect->getParallelRenderArgsTLS();
+        if (frameArgs) {
+            step.cachesOutput = effect->shouldCacheOutput(isFrameVaryingOrAnimated, step.time, step.view, frameArgs->visitsCount);
+        }
+
+        // Same key as the one renderRoI() looks up
+        const bool renderScaleOneUpstream = step.node->useScaleOneImagesWhenRenderScaleSupportIsDisabled() || !effect->supportsMultiResolution();
+        ImageKey key(step.node.get(),
+                     nodeHash,
+                     isFrameVaryingOrAnimated,
+                     step.time,
+                     step.view,
+                     1.,
+                     step.node->isDraftModeUsed() && frameArgs && frameArgs->draftMode,
+                     mappedMipMapLevel == 0 && !renderScaleOneUpstream);
+        std::list<ImagePtr> cachedImages;
+        if ( appPTR->peekImage(key, &cachedImages) ) {
+            RectI mappedRoI;
+            step.canonicalRoI.toPixelEnclosing(mappedMipMapLevel, par, &mappedRoI);
+            for (std::list<ImagePtr>::const_iterator it = cachedImages.begin(); it != cachedImages.end(); ++it) {
+                if ( (*it)->getMipMapLevel() != mappedMipMapLevel || !(*it)->getBounds().contains(mappedRoI) ) {
+                    continue;
+                }
+                std::list<RectI> rest;
+                (*it)->getRestToRender(mappedRoI, rest);
+                if ( rest.empty() ) {
+                    step.isCached = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    markPreRenderedSteps(&_steps, _root);
+} // RenderPlan::resolve
+
+int
+RenderPlan::findStep(const NodePtr& node,
+                     double time,
+                     ViewIdx view) const
+{
+    std::map<std::pair<Node*, std::pair<double, int> >, int>::const_iterator found = _stepsIndex.find( std::make_pair( node.get(), std::make_pair( time, (int)view ) ) );
+    if ( found == _stepsIndex.end() ) {
+        return -1;
+    }
+
+    return found->second;
+}
+
+void
+RenderPlan::addEdge(std::vector<RenderPlanStep>* steps,
+                    int input,
+                    int output)
+{
+    if ( (input == -1) || (output == -1) || (input == output) ) {
+        return;
+    }
+    std::vector<int>& inputs = (*steps)[output].inputs;
+    if ( std::find(inputs.begin(), inputs.end(), input) != inputs.end() ) {
+        return;
+    }
+    inputs.push_back(input);
+    (*steps)[input].outputs.push_back(output);
+}
+
+void
+RenderPlan::addInputs(int step,
+                      const FrameViewRequest& frameView)
+{
+    if (step == -1) {
+        return;
+    }
+    const NodePtr& node = _steps[step].node;
+    EffectInstancePtr effect = node->getEffectInstance();
+    const FrameViewRequestGlobalData& data = frameView.globalData;
+
+    // Identities only read the step they are identity of, see EffectInstance::getInputsRoIsFunctor()
+    if (data.identityInputNb == -2) {
+        ViewIdx inputView = (_steps[step].view != 0 && effect->isViewInvariant() == eViewInvarianceAllViewsInvariant) ? ViewIdx(0) : _steps[step].view;
+        addEdge(&_steps, findStep(node, data.inputIdentityTime, inputView), step);
+
+        return;
+    } else if (data.identityInputNb != -1) {
+        EffectInstancePtr input = effect->getInput(data.identityInputNb);
+        if (input) {
+            addEdge(&_steps, findStep(input->getNode(), data.inputIdentityTime, data.identityView), step);
+        }
+
+        return;
+    }
+
+    // Same frames as the ones pre-fetched by EffectInstance::treeRecurseFunctor()
+    for (FramesNeededMap::const_iterator it = data.frameViewsNeeded.begin(); it != data.frameViewsNeeded.end(); ++it) {
+        EffectInstancePtr input;
+        if (data.reroutesMap) {
+            std::map<int, EffectInstancePtr>::const_iterator foundReroute = data.reroutesMap->find(it->first);
+            if ( foundReroute != data.reroutesMap->end() ) {
+                input = foundReroute->second;
+            }
+        }
+        if (!input) {
+            input = effect->getInput(it->first);
+        }
+        if (!input) {
+            continue;
+        }
+        NodePtr inputNode = input->getNode();
+        for (FrameRangesMap::const_iterator viewIt = it->second.begin(); viewIt != it->second.end(); ++viewIt) {
+            for (std::size_t range = 0; range < viewIt->second.size(); ++range) {
+                const OfxRangeD& r = viewIt->second[range];
+                if ( (r.min != (int)r.min) || (r.max != (int)r.max) ) {
+                    continue;
+                }
+                int nbFrames = 0;
+                for (double f = r.min; f <= r.max && nbFrames < NATRON_MAX_FRAMES_NEEDED_PRE_FETCHING; f += 1., ++nbFrames) {
+                    addEdge(&_steps, findStep(inputNode, f, viewIt->first), step);
+                }
+            }
+        }
+    }
+} // RenderPlan::addInputs
+
+static void
+markNeeded(std::vector<RenderPlanStep>* steps,
+           int step)
+{
+    RenderPlanStep& s = (*steps)[step];
+
+    if (s.isNeeded) {
+        return;
+    }
+    s.isNeeded = true;
+    if (s.isCached) {
+        // The inputs of a cached image are not rendered
+        return;
+    }
+    for (std::size_t i = 0; i < s.inputs.size(); ++i) {
+        markNeeded(steps, s.inputs[i]);
+    }
+}
+
+static int
+computeLevel(std::vector<RenderPlanStep>* steps,
+             int step,
+             std::vector<int>* visiting)
+{
+    // 0: not visited, 1: being visited, 2: done
+    int& state = (*visiting)[step];
+
+    if (state == 2) {
+        return (*steps)[step].level;
+    } else if (state == 1) {
+        // A cycle through time offsets: ignore the edge, the step is rendered by its consumer anyway
+        return -1;
+    }
+    state = 1;
+    int level = 0;
+    for (std::size_t i = 0; i < (*steps)[step].inputs.size(); ++i) {
+        level = std::max(level, computeLevel(steps, (*steps)[step].inputs[i], visiting) + 1);
+    }
+    (*steps)[step].level = level;
+    (*visiting)[step] = 2;
+
+    return level;
+}
+
+void
+RenderPlan::computeLevels(std::vector<RenderPlanStep>* steps)
+{
+    std::vector<int> visiting(steps->size(), 0);
+
+    for (std::size_t i = 0; i < steps->size(); ++i) {
+        computeLevel(steps, i, &visiting);
+    }
+}
+
+// The number of steps other than the root reading the given step
+static int
+getNonRootOutputsCount(const RenderPlanStep& step,
+                       int root)
+{
+    int count = 0;
+
+    for (std::size_t i = 0; i < step.outputs.size(); ++i) {
+        if (step.outputs[i] != root) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+bool
+RenderPlan::hasSharedSteps(const std::vector<RenderPlanStep>& steps,
+                           int root)
+{
+    for (std::size_t i = 0; i < steps.size(); ++i) {
+        if (getNonRootOutputsCount(steps[i], root) > 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+RenderPlan::markPreRenderedSteps(std::vector<RenderPlanStep>* steps,
+                                 int root)
+{
+    if (root != -1) {
+        markNeeded(steps, root);
+    }
+
+    for (std::size_t i = 0; i < steps->size(); ++i) {
+        RenderPlanStep& step = (*steps)[i];
+        // The steps only read by the root are rendered by the root with the planes it needs.
+        // Steps of the internal rotopaint tree are rendered by the RotoPaint node itself.
+        step.isPreRendered = (int)i != root && getNonRootOutputsCount(step, root) > 0 && step.isNeeded && !step.isCached &&
+                             !step.isIdentity && step.cachesOutput && !step.roi.isNull() && !step.isRotoPaintItem;
+    }
+}
+
+EffectInstance::RenderRoIRetCode
+RenderPlan::renderStep(int index,
+                       QThread* spawnerThread) const
+{
+    QThread* curThread = QThread::currentThread();
+
+    if (curThread != spawnerThread) {
+        appPTR->getAppTLS()->copyTLS(spawnerThread, curThread);
+    }
+
+    const RenderPlanStep& step = _steps[index];
+    EffectInstancePtr effect = step.node->getEffectInstance();
+    EffectInstancePtr caller = step.outputs.empty() ? effect : _steps[step.outputs.front()].node->getEffectInstance();
+    EffectInstance::RenderRoIRetCode ret = EffectInstance::eRenderRoIRetCodeOk;
+    try {
+        EffectInstance::RenderRoIArgs args( step.time,
+                                            RenderScale( Image::getScaleFromMipMapLevel(step.mipMapLevel) ),
+                                            step.mipMapLevel,
+                                            step.view,
+                                            false, // byPassCache
+                                            step.roi,
+                                            step.rod,
+                                            step.planes,
+                                            step.bitdepth,
+                                            false, // calledFromGetImage
+                                            caller.get(),
+                                            eStorageModeRAM,
+                                            _time );
+        std::map<ImagePlaneDesc, ImagePtr> planes;
+        ret = effect->renderRoI(args, &planes);
+    } catch (const std::exception& e) {
+        qDebug() << "Error while pre-rendering" << step.node->getFullyQualifiedName().c_str() << ":" << e.what();
+        ret = EffectInstance::eRenderRoIRetCodeFailed;
+    }
+
+    if (curThread != spawnerThread) {
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
+
+    return ret;
+}
+
+EffectInstance::RenderRoIRetCode
+RenderPlan::execute()
+{
+    // Pre-rendered steps grouped by level
+    std::map<int, std::vector<int> > levels;
+
+    for (std::size_t i = 0; i < _steps.size(); ++i) {
+        if (_steps[i].isPreRendered) {
+            levels[_steps[i].level].push_back(i);
+        }
+    }
+
+    if ( levels.empty() ) {
+        return EffectInstance::eRenderRoIRetCodeOk;
+    }
+
+    TraceScope trace("scheduler", "render plan");
+    trace.setTime(_time);
+
+    QThread* spawnerThread = QThread::currentThread();
+    for (std::map<int, std::vector<int> >::const_iterator it = levels.begin(); it != levels.end(); ++it) {
+        std::vector<EffectInstance::RenderRoIRetCode> rets;
+        TaskScheduler::blockingMapped(it->second, boost::bind(&RenderPlan::renderStep, this, _1, spawnerThread), &rets);
+        for (std::size_t i = 0; i < rets.size(); ++i) {
+            if (rets[i] == EffectInstance::eRenderRoIRetCodeAborted) {
+                return rets[i];
+            }
+        }
+        for (std::size_t i = 0; i < rets.size(); ++i) {
+            if (rets[i] == EffectInstance::eRenderRoIRetCodeFailed) {
+                return rets[i];
+            }
+        }
+    }
+
+    return EffectInstance::eRenderRoIRetCodeOk;
+}
+
+static const char*
+getBitDepthName(ImageBitDepthEnum bitdepth)
+{
+    switch (bitdepth) {
+    case eImageBitDepthByte:
+        return "byte";
+    case eImageBitDepthShort:
+        return "short";
+    case eImageBitDepthHalf:
+        return "half";
+    case eImageBitDepthFloat:
+        return "float";
+    case eImageBitDepthNone:
+        break;
+    }
+
+    return "none";
+}
+
+template <typename RECT>
+static void
+writeJSONRect(std::ostream& os,
+              const RECT& r)
+{
+    os << '[' << r.x1 << ", " << r.y1 << ", " << r.x2 << ", " << r.y2 << ']';
+}
+
+static void
+writeJSONIndexes(std::ostream& os,
+                 const std::vector<int>& indexes)
+{
+    os << '[';
+    for (std::size_t i = 0; i < indexes.size(); ++i) {
+        if (i > 0) {
+            os << ", ";
+        }
+        os << indexes[i];
+    }
+    os << ']';
+}
+
+void
+RenderPlan::writeJSON(std::ostream& os) const
+{
+    os << "{\n";
+    os << "  \"root\": " << _root << ",\n";
+    os << "  \"time\": " << _time << ",\n";
+    os << "  \"view\": " << (int)_view << ",\n";
+    os << "  \"steps\": [";
+    for (std::size_t i = 0; i < _steps.size(); ++i) {
+        const RenderPlanStep& step = _steps[i];
+        os << (i > 0 ? ",\n" : "\n");
+        os << "    {\"id\": " << i;
+        os << ", \"node\": " << StrUtils::toJSONString( step.node->getFullyQualifiedName() );
+        os << ", \"plugin\": " << StrUtils::toJSONString( step.node->getPluginID() );
+        os << ", \"time\": " << step.time;
+        os << ", \"view\": " << (int)step.view;
+        os << ", \"mipMapLevel\": " << step.mipMapLevel;
+        os << ", \"level\": " << step.level;
+        os << ", \"rod\": ";
+        writeJSONRect(os, step.rod);
+        os << ", \"canonicalRoI\": ";
+        writeJSONRect(os, step.canonicalRoI);
+        os << ", \"roi\": ";
+        writeJSONRect(os, step.roi);
+        os << ", \"planes\": [";
+        for (std::list<ImagePlaneDesc>::const_iterator it = step.planes.begin(); it != step.planes.end(); ++it) {
+            if ( it != step.planes.begin() ) {
+                os << ", ";
+            }
+            os << StrUtils::toJSONString( it->getPlaneID() + '.' + it->getChannelsLabel() );
+        }
+        os << "]";
+        os << ", \"bitDepth\": \"" << getBitDepthName(step.bitdepth) << '"';
+        os << ", \"identity\": " << (step.isIdentity ? "true" : "false");
+        os << ", \"cached\": " << (step.isCached ? "true" : "false");
+        os << ", \"needed\": " << (step.isNeeded ? "true" : "false");
+        os << ", \"cachesOutput\": " << (step.cachesOutput ? "true" : "false");
+        os << ", \"preRendered\": " << (step.isPreRendered ? "true" : "false");
+        os << ", \"inputs\": ";
+        writeJSONIndexes(os, step.inputs);
+        os << ", \"outputs\": ";
+        writeJSONIndexes(os, step.outputs);
+        os << "}";
+    }
+    os << "\n  ]\n}\n";
+} // RenderPlan::writeJSON
+
+void
+RenderPlan::writeDOT(std::ostream& os) const
+{
+    os << "digraph RenderPlan {\n";
+    os << "  rankdir=BT;\n";
+    os << "  node [shape=box, fontname=\"Helvetica\"];\n";
+    for (std::size_t i = 0; i < _steps.size(); ++i) {
+        const RenderPlanStep& step = _steps[i];
+        std::stringstream label;
+        // Script names cannot contain quotes or backslashes. Graphviz breaks lines on the escaped "\n"
+        label << step.node->getFullyQualifiedName() << "\\nt=" << step.time << " v=" << (int)step.view << " level=" << step.level
+              << "\\nroi=(" << step.roi.x1 << ',' << step.roi.y1 << ")-(" << step.roi.x2 << ',' << step.roi.y2 << ')';
+        std::string style;
+        if ( (int)i == _root ) {
+            style = ", style=\"bold,filled\", fillcolor=\"lightblue\"";
+        } else if (step.isCached) {
+            style = ", style=filled, fillcolor=\"palegreen\"";
+        } else if (!step.isNeeded) {
+            style = ", style=dashed, color=\"gray\", fontcolor=\"gray\"";
+        } else if (step.isIdentity) {
+            style = ", style=dotted";
+        } else if (step.isPreRendered) {
+            style = ", style=filled, fillcolor=\"lightyellow\"";
+        }
+        os << "  s" << i << " [label=\"" << label.str() << '"' << style << "];\n";
+    }
+    for (std::size_t i = 0; i < _steps.size(); ++i) {
+        for (std::size_t j = 0; j < _steps[i].inputs.size(); ++j) {
+            os << "  s" << _steps[i].inputs[j] << " -> s" << i << ";\n";
+        }
+    }
+    os << "}\n";
+}
+
+void
+RenderPlan::dumpIfRequested() const
+{
+    QString dirPath = QString::fromUtf8( qgetenv(NATRON_RENDER_PLAN_DUMP_PATH_ENV_VAR) );
+
+    if ( dirPath.isEmpty() || !_treeRoot ) {
+        return;
+    }
+    QDir dir(dirPath);
+    if ( !dir.exists() && !dir.mkpath( QString::fromUtf8(".") ) ) {
+        return;
+    }
+
+    std::stringstream baseName;
+    baseName << "renderplan_" << _treeRoot->getFullyQualifiedName() << "_t" << _time << "_v" << (int)_view;
+    std::string basePath = dir.absoluteFilePath( QString::fromUtf8( baseName.str().c_str() ) ).toStdString();
+    {
+        FStreamsSupport::ofstream ofile;
+        FStreamsSupport::open(&ofile, basePath + ".json");
+        if (ofile) {
+            writeJSON(ofile);
+        }
+    }
+    {
+        FStreamsSupport::ofstream ofile;
+        FStreamsSupport::open(&ofile, basePath + ".dot");
+        if (ofile) {
+            writeDOT(ofile);
+        }
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,218 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_RENDERPLAN_H
+#define NATRON_ENGINE_RENDERPLAN_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EffectInstance.h"
+#include "Engine/ImagePlaneDesc.h"
+#include "Engine/ParallelRenderArgs.h"
+#include "Engine/RectD.h"
+#include "Engine/RectI.h"
+#include "Engine/ViewIdx.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A render of a node at a given time and view in a RenderPlan.
+ **/
+struct RenderPlanStep
+{
+    NodePtr node;
+    double time;
+    ViewIdx view;
+
+    // The mipmap level the steps reading this step request it at
+    unsigned int mipMapLevel;
+
+    // The union of the regions requested by all the nodes reading this step, clipped to the region of definition
+    RectD canonicalRoI;
+    RectI roi;
+    RectD rod;
+
+    // The planes and bit depth the effect produces
+    std::list<ImagePlaneDesc> planes;
+    ImageBitDepthEnum bitdepth;
+
+    // An identity step renders nothing, its only input is the step it is identity of
+    bool isIdentity;
+
+    // The image is already in the RAM cache for the whole roi: the inputs of the step are not needed
+    bool isCached;
+
+    // The step is reached from the root through steps that are not cached
+    bool isNeeded;
+
+    // The output of the step is kept in the cache
+    bool cachesOutput;
+
+    // The node belongs to the internal tree of a RotoPaint node, which renders it itself
+    bool isRotoPaintItem;
+
+    // The step is rendered by RenderPlan::execute() before the root is rendered
+    bool isPreRendered;
+
+    // Steps of the same level do not depend on each other. The level of a step is above the levels of its inputs
+    int level;
+
+    // Indexes of the steps read by this step and of the steps reading it
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+
+    RenderPlanStep();
+};
+
+/**
+ * @brief The renders needed to produce a frame of a node, built from the request pass (see EffectInstance::computeRequestPass()).
+ *
+ * The request pass already merges the regions of interest of all the requests made to a node at a given time and view,
+ * and resolves identities. The plan turns it into a graph of steps, resolve() looks up their cache hits, and
+ * execute() renders the steps whose output is cached concurrently with the TaskScheduler, level by level, before the
+ * caller renders the root: independent branches are rendered in parallel and a step read by several others is rendered once.
+ * The steps whose output is not cached are still rendered by the steps reading them, when the root is rendered.
+ *
+ * The plan is only resolved and executed if a step is read by several steps other than the root, see preRender():
+ * otherwise the recursive render of the root already renders each step once.
+ *
+ * The resolved plans can be written as JSON or as a Graphviz graph for debugging, see NATRON_RENDER_PLAN_DUMP_PATH_ENV_VAR.
+ **/
+class RenderPlan
+{
+public:
+
+    /**
+     * @brief Builds the plan of the frame rendered by the caller and pre-renders its steps, if the corresponding
+     * preference is checked and a step is read by several steps other than the root.
+     * Must be called on the thread rendering the frame, after the frame render arguments of the nodes were set in
+     * the thread-local storage by a ParallelRenderArgsSetter and updated with the request pass.
+     **/
+    static EffectInstance::RenderRoIRetCode preRender(const NodePtr& treeRoot,
+                                                      double time,
+                                                      ViewIdx view,
+                                                      unsigned int mipMapLevel,
+                                                      const FrameRequestMap& requests);
+
+    /**
+     * @brief Builds the graph of the steps from the request pass. The cache is not looked up until resolve() is called.
+     **/
+    RenderPlan(const NodePtr& treeRoot,
+               double time,
+               ViewIdx view,
+               const FrameRequestMap& requests);
+
+    /**
+     * @brief Resolves the mipmap level, the planes and the cache hits of the steps, and which are pre-rendered.
+     * Must be called on the thread rendering the frame, see preRender().
+     **/
+    void resolve(unsigned int mipMapLevel, const FrameRequestMap& requests);
+
+    /**
+     * @brief Returns true if a step is read by several steps other than the root
+     **/
+    bool hasSharedSteps() const
+    {
+        return hasSharedSteps(_steps, _root);
+    }
+
+    const std::vector<RenderPlanStep>& getSteps() const
+    {
+        return _steps;
+    }
+
+    /**
+     * @brief Index of the step of the root node in getSteps(), or -1 if the request pass did not reach it
+     **/
+    int getRootStep() const
+    {
+        return _root;
+    }
+
+    /**
+     * @brief Renders the pre-rendered steps, level by level, on the thread rendering the frame and the TaskScheduler.
+     * The images are only kept in the cache, the caller still renders the root which finds them there.
+     **/
+    EffectInstance::RenderRoIRetCode execute();
+
+    void writeJSON(std::ostream& os) const;
+
+    void writeDOT(std::ostream& os) const;
+
+    /**
+     * @brief Writes the plan in the directory given by the NATRON_RENDER_PLAN_DUMP_PATH environment variable, if set.
+     **/
+    void dumpIfRequested() const;
+
+    /*
+     * The functions below only work on the graph of the steps, they do not need the nodes of the steps.
+     */
+
+    /**
+     * @brief Makes the step input read by the step output.
+     **/
+    static void addEdge(std::vector<RenderPlanStep>* steps, int input, int output);
+
+    /**
+     * @brief Sets the level of each step above the levels of its inputs.
+     **/
+    static void computeLevels(std::vector<RenderPlanStep>* steps);
+
+    static bool hasSharedSteps(const std::vector<RenderPlanStep>& steps, int root);
+
+    /**
+     * @brief Marks the steps that are reached from the root through steps that are not cached, and among them the
+     * ones pre-rendered by execute().
+     **/
+    static void markPreRenderedSteps(std::vector<RenderPlanStep>* steps, int root);
+
+private:
+
+    int findStep(const NodePtr& node, double time, ViewIdx view) const;
+
+    void addInputs(int step, const FrameViewRequest& frameView);
+
+    EffectInstance::RenderRoIRetCode renderStep(int step, QThread* spawnerThread) const;
+
+    NodePtr _treeRoot;
+    double _time;
+    ViewIdx _view;
+    std::vector<RenderPlanStep> _steps;
+    std::map<std::pair<Node*, std::pair<double, int> >, int> _stepsIndex;
+    int _root;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_RENDERPLAN_H
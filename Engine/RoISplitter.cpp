@@ -0,0 +1,137 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RoISplitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Below this duration, spawning a task and copying the thread-local storage of the render for it costs more than it saves
+#define NATRON_ROI_SPLIT_MIN_TASK_DURATION_NS 250000.
+
+// The window is cut in a few more rects than threads so that the threads done early can steal the work left
+#define NATRON_ROI_SPLIT_TASKS_PER_THREAD 2
+
+#define NATRON_ROI_SPLIT_CACHE_LINE_SIZE 64
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+// Rounds x to the nearest multiple of alignment, also for negative coordinates
+int
+alignCoordinate(int x,
+                int alignment)
+{
+    int q = x / alignment;
+
+    if ( (x % alignment) && (x < 0) ) {
+        --q;
+    }
+    int lower = q * alignment;
+
+    return (x - lower) * 2 < alignment ? lower : lower + alignment;
+}
+
+} // anon namespace
+
+std::vector<RectI>
+splitRoIForThreads(const RectI& roi,
+                   const RoISplitParams& params,
+                   RoISplitShapeEnum* shape)
+{
+    std::vector<RectI> ret;
+
+    if (shape) {
+        *shape = eRoISplitShapeNone;
+    }
+    if ( roi.isNull() ) {
+        return ret;
+    }
+
+    const int minTileSize = std::max(1, params.minTileSize);
+    const double area = (double)roi.width() * roi.height();
+    double minPixelsPerTask = (double)minTileSize * minTileSize;
+    if (params.costPerPixel > 0.) {
+        minPixelsPerTask = std::max(minPixelsPerTask, NATRON_ROI_SPLIT_MIN_TASK_DURATION_NS / params.costPerPixel);
+    }
+    const int tasksCount = (int)std::min( std::floor(area / minPixelsPerTask), (double)std::max(1, params.threadsCount) * NATRON_ROI_SPLIT_TASKS_PER_THREAD );
+
+    if ( (params.threadsCount <= 1) || (tasksCount <= 1) ) {
+        ret.push_back(roi);
+
+        return ret;
+    }
+
+    const int height = roi.height();
+    const int width = roi.width();
+
+    if (height / tasksCount >= minTileSize) {
+        for (int i = tasksCount - 1; i >= 0; --i) {
+            ret.push_back( RectI( roi.x1, roi.y1 + (int)( (long long)i * height / tasksCount ),
+                                  roi.x2, roi.y1 + (int)( (long long)(i + 1) * height / tasksCount ) ) );
+        }
+        if (shape) {
+            *shape = eRoISplitShapeRowBands;
+        }
+
+        return ret;
+    }
+
+    const int rowsCount = std::max( 1, std::min(tasksCount, height / minTileSize) );
+    const int colsCount = std::max( 1, std::min(tasksCount / rowsCount, width / minTileSize) );
+    if (rowsCount * colsCount <= 1) {
+        ret.push_back(roi);
+
+        return ret;
+    }
+
+    // Two threads writing the ends of the same cache line of a row would keep invalidating it in the cache of the other
+    const int alignment = std::max( 1, NATRON_ROI_SPLIT_CACHE_LINE_SIZE / std::max(1, params.bytesPerPixel) );
+    std::vector<int> columns;
+    columns.push_back(roi.x1);
+    for (int j = 1; j < colsCount; ++j) {
+        int x = alignCoordinate(roi.x1 + (int)( (long long)j * width / colsCount ), alignment);
+        if ( (x > columns.back()) && (x < roi.x2) ) {
+            columns.push_back(x);
+        }
+    }
+    columns.push_back(roi.x2);
+
+    for (int i = rowsCount - 1; i >= 0; --i) {
+        const int y1 = roi.y1 + (int)( (long long)i * height / rowsCount );
+        const int y2 = roi.y1 + (int)( (long long)(i + 1) * height / rowsCount );
+        for (std::size_t j = 0; j + 1 < columns.size(); ++j) {
+            ret.push_back( RectI(columns[j], y1, columns[j + 1], y2) );
+        }
+    }
+    if ( shape && (ret.size() > 1) ) {
+        *shape = eRoISplitShapeTiles;
+    }
+
+    return ret;
+} // splitRoIForThreads
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,88 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_ROISPLITTER_H
+#define NATRON_ENGINE_ROISPLITTER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief How splitRoIForThreads() cut the render window.
+ **/
+enum RoISplitShapeEnum
+{
+    eRoISplitShapeNone = 0, // the render window is not split
+    eRoISplitShapeRowBands, // bands of full rows
+    eRoISplitShapeTiles // a grid of tiles whose columns start on a cache line
+};
+
+struct RoISplitParams
+{
+    // The number of threads that may render the tiles: the idle workers of the TaskScheduler and the calling thread
+    int threadsCount;
+
+    // The size of a pixel of the rendered image, used to align the columns of tiles on cache lines
+    int bytesPerPixel;
+
+    // The tiles are at least minTileSize pixels wide and tall, unless the render window is smaller
+    int minTileSize;
+
+    // The average time spent by the effect to render a pixel in previous renders, in nanoseconds, or 0 if unknown
+    double costPerPixel;
+
+    RoISplitParams()
+        : threadsCount(1)
+        , bytesPerPixel(4)
+        , minTileSize(128)
+        , costPerPixel(0.)
+    {
+    }
+};
+
+/**
+ * @brief Splits the render window of an eRenderSafetyFullySafeFrame effect into the rects that are rendered
+ * concurrently by the host.
+ *
+ * The rects are never smaller than minTileSize x minTileSize pixels, nor cheaper to render than the overhead of a task
+ * when the cost of the effect is known, and there are a few more rects than threads so that idle threads can steal
+ * the work left when some rects are slower to render than the others.
+ * Bands of full rows are preferred: the rows of a band are contiguous in memory and threads only share cache lines at
+ * band boundaries. When the window is too short for a band per task, it is cut into tiles instead.
+ **/
+std::vector<RectI> splitRoIForThreads(const RectI& roi, const RoISplitParams& params, RoISplitShapeEnum* shape = 0);
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_ROISPLITTER_H
@@ -1652,10 +1652,9 @@ RotoPaint::render(const RenderActionArgs& args)
             } else {
                 plane->second->pasteFrom(*(rotoImagesIt->second), args.roi, false);
             }
-            plane->second->copyUnProcessedChannels(args.roi, outputPremult, bgImg ? bgImg->getPremultiplication() : eImagePremultiplicationOpaque, copyChannels, bgImg, false);
-            if ( premultiply && ( plane->second->getComponents() == ImagePlaneDesc::getRGBAComponents() ) ) {
-                plane->second->premultImage(args.roi);
-            }
+            plane->second->copyUnProcessedChannelsMaskMixAndPremult(args.roi, outputPremult, bgImg ? bgImg->getPremultiplication() : eImagePremultiplicationOpaque, copyChannels, bgImg, false,
+                                                                     false, NULL, false, false, 1.f,
+                                                                     premultiply && ( plane->second->getComponents() == ImagePlaneDesc::getRGBAComponents() ) );
         }
     } // RenderingFlagSetter
 
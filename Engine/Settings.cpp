@@ -339,6 +339,26 @@ Settings::initializeKnobsThreading()
     _nThreadsPerEffect->disableSlider();
     _threadingPage->addKnob(_nThreadsPerEffect);
 
+    _hostFrameThreadingMinTileSize = AppManager::createKnob<KnobInt>( this, tr("Minimum tile size for host frame threading") );
+    _hostFrameThreadingMinTileSize->setName("hostFrameThreadingMinTileSize");
+    _hostFrameThreadingMinTileSize->setHintToolTip( tr("The render window of the effects that let the host split their renders "
+                                                       "(host frame threading) is cut in bands or tiles which are rendered concurrently. "
+                                                       "This is the minimum width and height of these tiles, in pixels. "
+                                                       "Smaller tiles let more threads work on small images, but each tile "
+                                                       "has a fixed cost and the effects that read neighbouring pixels "
+                                                       "fetch the edges of each tile again.") );
+    _hostFrameThreadingMinTileSize->setMinimum(16);
+    _hostFrameThreadingMinTileSize->disableSlider();
+    _threadingPage->addKnob(_hostFrameThreadingMinTileSize);
+
+    _preRenderSharedBranches = AppManager::createKnob<KnobBool>( this, tr("Pre-render shared branches") );
+    _preRenderSharedBranches->setName("preRenderSharedBranches");
+    _preRenderSharedBranches->setHintToolTip( tr("When checked, the nodes of a frame that are read by several other nodes "
+                                                 "are rendered once, before the frame, and the independent branches "
+                                                 "leading to them are rendered in parallel. "
+                                                 "Frames without such nodes are always rendered directly.") );
+    _threadingPage->addKnob(_preRenderSharedBranches);
+
     _renderInSeparateProcess = AppManager::createKnob<KnobBool>( this, tr("Render in a separate process") );
     _renderInSeparateProcess->setName("renderNewProcess");
     _renderInSeparateProcess->setHintToolTip( tr("If true, %1 will render frames to disk in "
@@ -1278,6 +1298,64 @@ Settings::initializeKnobsCaching()
     _unreachableRAMLabel->setAsLabel();
     _cachingTab->addKnob(_unreachableRAMLabel);
 
+    _compressedCachePercent = AppManager::createKnob<KnobInt>( this, tr("Compressed RAM cache (% of the RAM cache)") );
+    _compressedCachePercent->setName("compressedCachePercent");
+    _compressedCachePercent->disableSlider();
+    _compressedCachePercent->setMinimum(0);
+    _compressedCachePercent->setMaximum(90);
+    _compressedCachePercent->setHintToolTip( tr("The part of the RAM used for caching that holds images compressed without loss "
+                                                "instead of deleting them when the cache is full. "
+                                                "Compressed images take less memory, so more images fit in the same amount of RAM, "
+                                                "but compressing and uncompressing them uses some processing time. "
+                                                "When set to 0, images are deleted when they do not fit in the cache anymore.") );
+    _cachingTab->addKnob(_compressedCachePercent);
+
+    _costAwareCacheEviction = AppManager::createKnob<KnobBool>( this, tr("Keep expensive images longer in the cache") );
+    _costAwareCacheEviction->setName("costAwareCacheEviction");
+    _costAwareCacheEviction->setHintToolTip( tr("When checked, the images that took a long time to render compared to their size "
+                                                "and that are often used are kept in the cache longer than the ones that are cheap to render again. "
+                                                "When unchecked, the least recently used images are removed first when the cache is full.") );
+    _cachingTab->addKnob(_costAwareCacheEviction);
+
+    _hugePagesMode = AppManager::createKnob<KnobChoice>( this, tr("Huge pages for large images") );
+    _hugePagesMode->setName("hugePagesMode");
+    {
+        std::vector<ChoiceOption> entries;
+        assert(entries.size() == (int)eMemoryHugePagesModeNone);
+        entries.push_back(ChoiceOption("none",
+                                       tr("Disabled").toStdString(),
+                                       tr("Images are allocated with regular memory pages.").toStdString()));
+        assert(entries.size() == (int)eMemoryHugePagesModeTransparent);
+        entries.push_back(ChoiceOption("transparent",
+                                       tr("Transparent").toStdString(),
+                                       tr("The system is asked to back large images with huge pages when it can (transparent huge pages).").toStdString()));
+        assert(entries.size() == (int)eMemoryHugePagesModeExplicit);
+        entries.push_back(ChoiceOption("explicit",
+                                       tr("Reserved").toStdString(),
+                                       tr("Large images use the huge pages reserved by the system administrator (hugetlbfs). "
+                                          "When none are left, transparent huge pages are used.").toStdString()));
+        _hugePagesMode->populateChoices(entries);
+    }
+    _hugePagesMode->setHintToolTip( tr("Whether the memory of images larger than %1 MiB is made of huge pages. "
+                                       "Huge pages make processing large images faster, but may use a bit more memory. "
+                                       "This only applies to the images allocated after the change, and only on Linux.").arg(NATRON_HUGE_PAGES_MIN_ALLOCATION_SIZE / (1024 * 1024)) );
+    _cachingTab->addKnob(_hugePagesMode);
+
+    _memoryAccessHints = AppManager::createKnob<KnobBool>( this, tr("Read disk cache ahead") );
+    _memoryAccessHints->setName("memoryAccessHints");
+    _memoryAccessHints->setHintToolTip( tr("When checked, the system is told when an image of the disk cache is about to be read, "
+                                           "so that it reads it ahead from disk, and when a tile of the playback cache is not used anymore, "
+                                           "so that its memory is released.") );
+    _cachingTab->addKnob(_memoryAccessHints);
+
+    _cacheImagesAsHalf = AppManager::createKnob<KnobBool>( this, tr("Cache floating-point images at half precision") );
+    _cacheImagesAsHalf->setName("cacheImagesAsHalf");
+    _cacheImagesAsHalf->setHintToolTip( tr("When checked, the 32-bit floating-point images rendered by the nodes are kept "
+                                           "in the RAM cache as 16-bit half floats, so that twice as many of them fit in the cache. "
+                                           "Plug-ins still render in 32-bit floating point: precision is only lost on the cached results. "
+                                           "This only applies to the images rendered after the change.") );
+    _cachingTab->addKnob(_cacheImagesAsHalf);
+
     _maxViewerDiskCacheGB = AppManager::createKnob<KnobInt>( this, tr("Maximum playback disk cache size (GiB)") );
     _maxViewerDiskCacheGB->setName("maxViewerDiskCache");
     _maxViewerDiskCacheGB->disableSlider();
@@ -1294,6 +1372,31 @@ Settings::initializeKnobsCaching()
     _maxDiskCacheNodeGB->setHintToolTip( tr("The maximum size that may be used by the DiskCache node on disk (in GiB)") );
     _cachingTab->addKnob(_maxDiskCacheNodeGB);
 
+    _sharedImageCacheGB = AppManager::createKnob<KnobInt>( this, tr("Shared image cache size (GiB)") );
+    _sharedImageCacheGB->setName("sharedImageCacheSize");
+    _sharedImageCacheGB->disableSlider();
+    _sharedImageCacheGB->setMinimum(0);
+    _sharedImageCacheGB->setMaximum(100);
+    _sharedImageCacheGB->setHintToolTip( tr("WARNING: Enabling or disabling the shared image cache requires a restart of the application. \n"
+                                            "The maximum size of the images shared by all the %1 processes running on this computer "
+                                            "with the same disk cache path, e.g. several command-line renders of the same project on a render farm node. "
+                                            "Images rendered by one process are then read by the others instead of being rendered again. "
+                                            "The size is shared by all the processes: the last one started sets it. "
+                                            "When set to 0, images are not shared.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
+    _cachingTab->addKnob(_sharedImageCacheGB);
+
+    _cacheShards = AppManager::createKnob<KnobInt>( this, tr("Cache shards") );
+    _cacheShards->setName("cacheShards");
+    _cacheShards->disableSlider();
+    _cacheShards->setMinimum(0);
+    _cacheShards->setMaximum(NATRON_CACHE_MAX_SHARDS);
+    _cacheShards->setHintToolTip( tr("WARNING: Changing this parameter requires a restart of the application. \n"
+                                     "The number of independently locked parts the node and playback caches are split into. "
+                                     "Render threads looking up images in different parts of the cache do not wait for each other, "
+                                     "which matters on computers with many cores. "
+                                     "When set to 0, %1 picks a value from the number of cores of the computer.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
+    _cachingTab->addKnob(_cacheShards);
+
 
     _diskCachePath = AppManager::createKnob<KnobPath>( this, tr("Disk cache path") );
     _diskCachePath->setName("diskCachePath");
@@ -1478,6 +1581,8 @@ Settings::setDefaultValues()
 #endif
     _useThreadPool->setDefaultValue(true);
     _nThreadsPerEffect->setDefaultValue(0);
+    _hostFrameThreadingMinTileSize->setDefaultValue(128);
+    _preRenderSharedBranches->setDefaultValue(true);
     _renderInSeparateProcess->setDefaultValue(false, 0);
     _queueRenders->setDefaultValue(false);
 
@@ -1535,6 +1640,13 @@ Settings::setDefaultValues()
     _unreachableRAMPercent->setDefaultValue(20); // see https://github.com/NatronGitHub/Natron/issues/486
     _maxViewerDiskCacheGB->setDefaultValue(5, 0);
     _maxDiskCacheNodeGB->setDefaultValue(10, 0);
+    _sharedImageCacheGB->setDefaultValue(0, 0);
+    _cacheShards->setDefaultValue(0);
+    _compressedCachePercent->setDefaultValue(0);
+    _costAwareCacheEviction->setDefaultValue(false);
+    _hugePagesMode->setDefaultValue( (int)eMemoryHugePagesModeNone );
+    _memoryAccessHints->setDefaultValue(true);
+    _cacheImagesAsHalf->setDefaultValue(false);
     //_diskCachePath
     setCachingLabels();
 
@@ -2283,11 +2395,31 @@ Settings::onKnobValueChanged(KnobI* k,
         if (!_restoringSettings) {
             appPTR->setApplicationsCachesMaximumDiskSpace( getMaximumDiskCacheNodeSize() );
         }
+    } else if ( k == _sharedImageCacheGB.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setSharedImageCacheMaximumSize( getSharedImageCacheSize() );
+        }
     } else if ( k == _maxRAMPercent.get() ) {
         if (!_restoringSettings) {
             appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
         }
         setCachingLabels();
+    } else if ( k == _compressedCachePercent.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
+        }
+    } else if ( k == _costAwareCacheEviction.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesCostAwareEviction( isCostAwareCacheEvictionEnabled() );
+        }
+    } else if ( k == _hugePagesMode.get() ) {
+        if (!_restoringSettings) {
+            MemoryAllocator::setHugePagesMode( getHugePagesMode() );
+        }
+    } else if ( k == _memoryAccessHints.get() ) {
+        if (!_restoringSettings) {
+            MemoryAllocator::setAccessHintsEnabled( isMemoryAccessHintsEnabled() );
+        }
     } else if ( k == _diskCachePath.get() ) {
         QString path = QString::fromUtf8(_diskCachePath->getValue().c_str());
         qputenv(NATRON_DISK_CACHE_PATH_ENV_VAR, path.toUtf8());
@@ -2540,6 +2672,48 @@ Settings::getMaximumDiskCacheNodeSize() const
     return (U64)( _maxDiskCacheNodeGB->getValue() ) * 1024 * 1024 * 1024;
 }
 
+U64
+Settings::getSharedImageCacheSize() const
+{
+    return (U64)( _sharedImageCacheGB->getValue() ) * 1024 * 1024 * 1024;
+}
+
+int
+Settings::getCacheShardsCount() const
+{
+    return _cacheShards->getValue();
+}
+
+double
+Settings::getCompressedCachePercent() const
+{
+    return (double)_compressedCachePercent->getValue() / 100.;
+}
+
+bool
+Settings::isCostAwareCacheEvictionEnabled() const
+{
+    return _costAwareCacheEviction->getValue();
+}
+
+MemoryHugePagesModeEnum
+Settings::getHugePagesMode() const
+{
+    return (MemoryHugePagesModeEnum)_hugePagesMode->getValue();
+}
+
+bool
+Settings::isMemoryAccessHintsEnabled() const
+{
+    return _memoryAccessHints->getValue();
+}
+
+bool
+Settings::isHalfFloatCachingEnabled() const
+{
+    return _cacheImagesAsHalf->getValue();
+}
+
 ///////////////////////////////////////////////////
 
 double
@@ -2560,6 +2734,18 @@ Settings::getNumberOfThreadsPerEffect() const
     return _nThreadsPerEffect->getValue();
 }
 
+int
+Settings::getHostFrameThreadingMinTileSize() const
+{
+    return _hostFrameThreadingMinTileSize->getValue();
+}
+
+bool
+Settings::isPreRenderSharedBranchesEnabled() const
+{
+    return _preRenderSharedBranches->getValue();
+}
+
 int
 Settings::getNumberOfThreads() const
 {
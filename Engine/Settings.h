@@ -35,6 +35,7 @@
 #include "Global/GlobalDefines.h"
 
 #include "Engine/Knob.h"
+#include "Engine/MemoryAllocator.h"
 #include "Engine/ChoiceOption.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/EngineFwd.h"
@@ -111,6 +112,21 @@ public:
 
     U64 getMaximumDiskCacheNodeSize() const;
 
+    U64 getSharedImageCacheSize() const;
+
+    int getCacheShardsCount() const;
+
+    ///The part of the node cache RAM holding compressed images, between 0 and 1
+    double getCompressedCachePercent() const;
+
+    bool isCostAwareCacheEvictionEnabled() const;
+
+    MemoryHugePagesModeEnum getHugePagesMode() const;
+
+    bool isMemoryAccessHintsEnabled() const;
+
+    bool isHalfFloatCachingEnabled() const;
+
     double getUnreachableRamPercent() const;
 
     bool getColorPickerLinear() const;
@@ -125,6 +141,10 @@ public:
 
     int getNumberOfThreadsPerEffect() const;
 
+    int getHostFrameThreadingMinTileSize() const;
+
+    bool isPreRenderSharedBranchesEnabled() const;
+
     bool useGlobalThreadPool() const;
 
     void setUseGlobalThreadPool(bool use);
@@ -443,6 +463,8 @@ private:
     KnobIntPtr _numberOfParallelRenders;
     KnobBoolPtr _useThreadPool;
     KnobIntPtr _nThreadsPerEffect;
+    KnobIntPtr _hostFrameThreadingMinTileSize;
+    KnobBoolPtr _preRenderSharedBranches;
     KnobBoolPtr _renderInSeparateProcess;
     KnobBoolPtr _queueRenders;
 
@@ -520,9 +542,30 @@ private:
     KnobIntPtr _unreachableRAMPercent;
     KnobStringPtr _unreachableRAMLabel;
 
+    ///The percentage of the RAM cache dedicated to compressed images
+    KnobIntPtr _compressedCachePercent;
+
+    ///When checked, the images that were the most expensive to render are kept longer in the cache
+    KnobBoolPtr _costAwareCacheEviction;
+
+    ///Whether the memory of large images is made of huge pages, see MemoryHugePagesModeEnum
+    KnobChoicePtr _hugePagesMode;
+
+    ///When checked, the system is told how the cache files are about to be accessed
+    KnobBoolPtr _memoryAccessHints;
+
+    ///When checked, float images are stored in the RAM cache as half floats
+    KnobBoolPtr _cacheImagesAsHalf;
+
     ///The total disk space allowed for all Natron's caches
     KnobIntPtr _maxViewerDiskCacheGB;
     KnobIntPtr _maxDiskCacheNodeGB;
+
+    ///The size of the image cache shared with the other processes, 0 disables it
+    KnobIntPtr _sharedImageCacheGB;
+
+    ///The number of independently locked shards of the node and playback caches, 0 means automatic
+    KnobIntPtr _cacheShards;
     KnobPathPtr _diskCachePath;
     KnobButtonPtr _wipeDiskCache;
 
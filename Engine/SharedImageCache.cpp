@@ -0,0 +1,849 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "SharedImageCache.h"
+
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include "Global/ProcInfo.h"
+
+#include "Engine/Cache.h"
+#include "Engine/CacheSerialization.h"
+#include "Engine/Image.h"
+#include "Engine/ImageKey.h"
+#include "Engine/MemoryFile.h"
+
+#define NATRON_SHARED_IMAGE_CACHE_FORMAT_VERSION 2
+
+// Number of processes that may read the image of a slot at the same time
+#define NATRON_SHARED_IMAGE_CACHE_READERS 4
+
+// Age in seconds past which a claim on a slot is abandoned even if its process still exists: process ids get reused
+#define NATRON_SHARED_IMAGE_CACHE_CLAIM_TIMEOUT 600
+
+// Maximum number of images waiting to be published in the background, past this they are dropped
+#define NATRON_SHARED_IMAGE_CACHE_MAX_PENDING 16
+
+// The slots live in a file mapped by several processes: their atomics must not rely on a lock private to a process
+#if ATOMIC_INT_LOCK_FREE != 2 || ATOMIC_LLONG_LOCK_FREE != 2
+#error "The shared image cache requires lock-free atomic integers"
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+const char kControlMagic[8] = { 'N', 'T', 'S', 'H', 'C', 'T', 'R', 'L' };
+const char kImageMagic[8] = { 'N', 'T', 'S', 'H', 'I', 'M', 'G', '0' };
+
+enum SlotStateEnum
+{
+    eSlotStateEmpty = 0,
+    eSlotStateWriting, // claimed by a process that is writing the image file
+    eSlotStateReady, // the image file can be read
+    eSlotStateEvicting // a process is removing the image file
+};
+
+const U64 kSlotStateMask = 3;
+const U64 kClaimTimeMask = 0x3fffffff;
+
+/**
+ * @brief Returns the claim of this process on a slot: its process id in the 32 high bits and the current time in
+ * seconds, modulo 2^30, in bits 2 to 31. The 2 low bits are left for the SlotStateEnum, see Slot::state.
+ * A claim is never 0.
+ **/
+U64
+makeClaim()
+{
+    U64 pid = (U64)ProcInfo::getCurrentProcessPID();
+    U64 seconds = (U64)std::time(NULL);
+
+    return (pid << 32) | ( (seconds & kClaimTimeMask) << 2 );
+}
+
+/**
+ * @brief Returns true if the process that made the claim died without releasing it, or made it so long ago that the
+ * process id may belong to another process now.
+ **/
+bool
+isAbandonedClaim(U64 claim)
+{
+    U64 claimTime = (claim >> 2) & kClaimTimeMask;
+    U64 age = ( (U64)std::time(NULL) - claimTime ) & kClaimTimeMask;
+
+    // A claim made in the future of this process clock is recent
+    if ( (age <= kClaimTimeMask / 2) && (age > NATRON_SHARED_IMAGE_CACHE_CLAIM_TIMEOUT) ) {
+        return true;
+    }
+
+    return !ProcInfo::isProcessAlive( (long long)(claim >> 32) );
+}
+
+// The mapping of the control file is zero-initialized by the file system: all atomics start at 0
+struct ControlHeader
+{
+    char magic[8];
+    U32 formatVersion;
+    U32 cacheVersion;
+    U32 slotsCount;
+    U32 padding;
+    std::atomic<U64> maximumSize;
+    std::atomic<U64> usedSize;
+    std::atomic<U64> entriesCount;
+    std::atomic<U64> accessClock; // incremented on each access, orders the slots for eviction
+    std::atomic<U64> nextFileId; // the image files are never reused, so that a stale read cannot see another image
+};
+
+// A slot is only changed by the process holding its claim, so that a process that dies while writing or evicting
+// an image, or while reading it, leaves enough behind for the other processes to clean up after it
+struct Slot
+{
+    std::atomic<U64> state; // SlotStateEnum, or'ed while writing or evicting with the claim of the process doing it
+    std::atomic<U64> readers[NATRON_SHARED_IMAGE_CACHE_READERS]; // claims of the processes reading the image file, or 0
+    std::atomic<U64> hash;
+    std::atomic<U64> payloadChecksum; // tells apart images with the same hash without opening their file
+    std::atomic<U64> fileSize; // 0 until the image is counted in the size of the cache
+    std::atomic<U64> fileId; // 0 if the slot has no image file
+    std::atomic<U64> lastAccess;
+};
+
+// Followed by the serialized key and parameters, then by the pixels at dataOffset
+struct ImageFileHeader
+{
+    char magic[8];
+    U64 payloadSize;
+    U64 dataOffset;
+    U64 dataSize;
+};
+
+const std::size_t kControlFileSize = sizeof(ControlHeader) + sizeof(Slot) * NATRON_SHARED_IMAGE_CACHE_SLOTS;
+
+// FNV-1a
+U64
+computeChecksum(const std::string& str)
+{
+    U64 h = 14695981039346656037ULL;
+
+    for (std::size_t i = 0; i < str.size(); ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+} // anon namespace
+
+class SharedImageCachePublisherThread
+    : public QThread
+{
+    SharedImageCachePrivate* _imp;
+
+public:
+
+    SharedImageCachePublisherThread(SharedImageCachePrivate* imp)
+        : QThread()
+        , _imp(imp)
+    {
+        setObjectName( QString::fromUtf8("SharedImageCachePublisher") );
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL;
+};
+
+struct SharedImageCachePrivate
+{
+    SharedImageCache* _publicInterface;
+    std::string directoryPath;
+    MemoryFile controlFile;
+    ControlHeader* header;
+    Slot* slots;
+    Cache<Image>::IndexSerializer serializer;
+
+    // Activity of this process, protected by statsMutex. Only the control block shared with the other processes
+    // uses lock-free atomics.
+    mutable QMutex statsMutex;
+    U64 hits;
+    U64 misses;
+    U64 publishedEntries;
+    U64 publishedBytes;
+
+    // Images waiting to be published by the publisher thread
+    QMutex publishQueueMutex;
+    std::list<ImagePtr> publishQueue;
+    QWaitCondition publishQueueNotEmptyCond;
+    QWaitCondition publishQueueEmptyCond;
+    bool publishing; // the publisher thread took an image from the queue and did not publish it yet
+    bool mustQuitPublisher;
+    boost::scoped_ptr<SharedImageCachePublisherThread> publisherThread;
+
+    SharedImageCachePrivate(SharedImageCache* publicInterface,
+                            const std::string& directoryPath)
+        : _publicInterface(publicInterface)
+        , directoryPath(directoryPath)
+        , controlFile()
+        , header(0)
+        , slots(0)
+        , serializer()
+        , statsMutex()
+        , hits(0)
+        , misses(0)
+        , publishedEntries(0)
+        , publishedBytes(0)
+        , publishQueueMutex()
+        , publishQueue()
+        , publishQueueNotEmptyCond()
+        , publishQueueEmptyCond()
+        , publishing(false)
+        , mustQuitPublisher(false)
+        , publisherThread()
+    {
+    }
+
+    void openControlFile();
+
+    std::string getImageFilePath(U64 fileId) const
+    {
+        std::stringstream ss;
+
+        ss << directoryPath << '/' << std::hex << fileId << "." NATRON_CACHE_FILE_EXT;
+
+        return ss.str();
+    }
+
+    Slot& getSlot(U64 hash,
+                  int probe) const
+    {
+        return slots[(hash + probe) & (NATRON_SHARED_IMAGE_CACHE_SLOTS - 1)];
+    }
+
+    U64 tick() const
+    {
+        return ++header->accessClock;
+    }
+
+    /**
+     * @brief Prevents the image of the slot from being evicted while it is read, by storing the claim of this process
+     * in a free reader entry of the slot. Returns the index of the entry, to pass to unpin(), or -1 if the image cannot
+     * be read, or has too many readers.
+     * The pin is taken before checking the state, and the evicting process changes the state before checking the pins,
+     * so that one of them always sees the other.
+     **/
+    int pin(Slot& slot,
+            U64 hash) const
+    {
+        U64 claim = makeClaim();
+
+        for (int i = 0; i < NATRON_SHARED_IMAGE_CACHE_READERS; ++i) {
+            U64 expected = 0;
+            if ( !slot.readers[i].compare_exchange_strong(expected, claim) ) {
+                continue;
+            }
+            if ( (slot.state.load() != eSlotStateReady) || (slot.hash.load() != hash) ) {
+                slot.readers[i] = 0;
+
+                return -1;
+            }
+
+            return i;
+        }
+
+        return -1;
+    }
+
+    void unpin(Slot& slot,
+               int reader) const
+    {
+        slot.readers[reader] = 0;
+    }
+
+    /**
+     * @brief Returns true if a live process reads the image of the slot. The pins of dead processes are dropped.
+     **/
+    bool hasReaders(Slot& slot) const;
+
+    bool evictSlot(Slot& slot) const;
+
+    /**
+     * @brief Removes the image file of a slot claimed by this process, gives back its size to the budget and frees the slot.
+     * Does nothing if another process took over the claim meanwhile.
+     **/
+    void releaseSlot(Slot& slot, U64 claim) const;
+
+    /**
+     * @brief If the process writing or evicting the image of the slot abandoned it, takes over its claim and frees the slot.
+     * @returns True if the slot was freed.
+     **/
+    bool recoverSlot(Slot& slot) const;
+
+    /**
+     * @brief Frees the slots and pins abandoned by dead processes.
+     **/
+    void recoverAbandonedClaims() const;
+
+    bool evictLeastRecentlyUsed(int firstSlot, int slotsCount) const;
+
+    void runPublisher();
+
+    ImagePtr readImage(Slot& slot, const ImageKey& key, Cache<Image>* cache) const;
+
+    bool writeImage(const std::string& filePath, const ImagePtr& image, const RectI& bounds, const std::string& payload, U64 dataOffset, U64 dataSize) const;
+};
+
+void
+SharedImageCachePrivate::openControlFile()
+{
+    QDir().mkpath( QString::fromUtf8( directoryPath.c_str() ) );
+
+    std::string filePath = directoryPath + "/control." NATRON_CACHE_FILE_EXT;
+    if ( !QFile::exists( QString::fromUtf8( filePath.c_str() ) ) ) {
+        // Initialize the file aside and move it in place, so that other processes never see it half initialized
+        std::stringstream ss;
+        ss << filePath << '.' << ProcInfo::getCurrentProcessPID();
+        std::string tmpPath = ss.str();
+        {
+            MemoryFile tmpFile(tmpPath, kControlFileSize, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+            ControlHeader* tmpHeader = reinterpret_cast<ControlHeader*>( tmpFile.data() );
+            std::memcpy( tmpHeader->magic, kControlMagic, sizeof(kControlMagic) );
+            tmpHeader->formatVersion = NATRON_SHARED_IMAGE_CACHE_FORMAT_VERSION;
+            tmpHeader->cacheVersion = NATRON_CACHE_VERSION;
+            tmpHeader->slotsCount = NATRON_SHARED_IMAGE_CACHE_SLOTS;
+            tmpFile.flush(MemoryFile::eFlushTypeSync, NULL, 0);
+        }
+        // QFile::rename does not overwrite: if another process created the file first, use it
+        if ( !QFile::rename( QString::fromUtf8( tmpPath.c_str() ), QString::fromUtf8( filePath.c_str() ) ) ) {
+            QFile::remove( QString::fromUtf8( tmpPath.c_str() ) );
+        }
+    }
+
+    controlFile.open(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
+    if ( !controlFile.data() || (controlFile.size() < kControlFileSize) ) {
+        throw std::runtime_error("The shared image cache control file is truncated");
+    }
+    header = reinterpret_cast<ControlHeader*>( controlFile.data() );
+    if ( std::memcmp( header->magic, kControlMagic, sizeof(kControlMagic) ) ||
+         (header->formatVersion != NATRON_SHARED_IMAGE_CACHE_FORMAT_VERSION) ||
+         (header->cacheVersion != NATRON_CACHE_VERSION) ||
+         (header->slotsCount != NATRON_SHARED_IMAGE_CACHE_SLOTS) ) {
+        // Do not reset it, processes of the other version may be using it
+        throw std::runtime_error("The shared image cache was created by another version");
+    }
+    slots = reinterpret_cast<Slot*>( controlFile.data() + sizeof(ControlHeader) );
+}
+
+bool
+SharedImageCachePrivate::hasReaders(Slot& slot) const
+{
+    bool found = false;
+
+    for (int i = 0; i < NATRON_SHARED_IMAGE_CACHE_READERS; ++i) {
+        U64 reader = slot.readers[i].load();
+        if (!reader) {
+            continue;
+        }
+        if ( isAbandonedClaim(reader) ) {
+            slot.readers[i].compare_exchange_strong(reader, 0);
+        } else {
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+bool
+SharedImageCachePrivate::evictSlot(Slot& slot) const
+{
+    U64 expected = eSlotStateReady;
+    U64 claim = makeClaim() | eSlotStateEvicting;
+
+    if ( !slot.state.compare_exchange_strong(expected, claim) ) {
+        return false;
+    }
+    if ( hasReaders(slot) ) {
+        // Being read by a process
+        slot.state.compare_exchange_strong(claim, eSlotStateReady);
+
+        return false;
+    }
+    releaseSlot(slot, claim);
+
+    return true;
+}
+
+void
+SharedImageCachePrivate::releaseSlot(Slot& slot,
+                                     U64 claim) const
+{
+    if (slot.state.load() != claim) {
+        return;
+    }
+    U64 fileId = slot.fileId.exchange(0);
+    if (fileId) {
+        QFile::remove( QString::fromUtf8( getImageFilePath(fileId).c_str() ) );
+    }
+    // Exchanged, so that the size is given back once even if the claim was taken over meanwhile
+    U64 fileSize = slot.fileSize.exchange(0);
+    if (fileSize) {
+        U64 used = header->usedSize.load();
+        while ( !header->usedSize.compare_exchange_weak( used, used - std::min(used, fileSize) ) ) {
+        }
+        --header->entriesCount;
+    }
+    slot.hash = 0;
+    slot.payloadChecksum = 0;
+    slot.state.compare_exchange_strong(claim, eSlotStateEmpty);
+}
+
+bool
+SharedImageCachePrivate::recoverSlot(Slot& slot) const
+{
+    U64 state = slot.state.load();
+    U64 slotState = state & kSlotStateMask;
+
+    if ( ( (slotState != eSlotStateWriting) && (slotState != eSlotStateEvicting) ) || !isAbandonedClaim(state & ~kSlotStateMask) ) {
+        return false;
+    }
+    U64 claim = makeClaim() | eSlotStateEvicting;
+    if ( !slot.state.compare_exchange_strong(state, claim) ) {
+        return false;
+    }
+    qDebug() << "Recovering a shared image cache slot abandoned by process" << (qint64)(state >> 32);
+    releaseSlot(slot, claim);
+
+    return true;
+}
+
+void
+SharedImageCachePrivate::recoverAbandonedClaims() const
+{
+    for (int i = 0; i < NATRON_SHARED_IMAGE_CACHE_SLOTS; ++i) {
+        recoverSlot(slots[i]);
+        hasReaders(slots[i]);
+    }
+}
+
+bool
+SharedImageCachePrivate::evictLeastRecentlyUsed(int firstSlot,
+                                                int slotsCount) const
+{
+    // Slots are only read here, another process may evict them meanwhile: retry on the next oldest one
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        Slot* oldest = 0;
+        U64 oldestAccess = std::numeric_limits<U64>::max();
+        for (int i = 0; i < slotsCount; ++i) {
+            Slot& slot = slots[(firstSlot + i) & (NATRON_SHARED_IMAGE_CACHE_SLOTS - 1)];
+            U64 slotState = slot.state.load() & kSlotStateMask;
+            if ( (slotState == eSlotStateWriting) || (slotState == eSlotStateEvicting) ) {
+                if ( recoverSlot(slot) ) {
+                    return true;
+                }
+                continue;
+            }
+            if ( (slotState != eSlotStateReady) || hasReaders(slot) ) {
+                continue;
+            }
+            U64 lastAccess = slot.lastAccess.load();
+            if (lastAccess < oldestAccess) {
+                oldestAccess = lastAccess;
+                oldest = &slot;
+            }
+        }
+        if (!oldest) {
+            return false;
+        }
+        if ( evictSlot(*oldest) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ImagePtr
+SharedImageCachePrivate::readImage(Slot& slot,
+                                   const ImageKey& key,
+                                   Cache<Image>* cache) const
+{
+    std::string filePath = getImageFilePath( slot.fileId.load() );
+    try {
+        MemoryFile file(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
+        const char* data = file.data();
+        if ( !data || (file.size() < sizeof(ImageFileHeader)) ) {
+            return ImagePtr();
+        }
+        const ImageFileHeader* fileHeader = reinterpret_cast<const ImageFileHeader*>(data);
+        if ( std::memcmp( fileHeader->magic, kImageMagic, sizeof(kImageMagic) ) ||
+             (sizeof(ImageFileHeader) + fileHeader->payloadSize > fileHeader->dataOffset) ||
+             (fileHeader->dataOffset + fileHeader->dataSize > file.size()) ) {
+            return ImagePtr();
+        }
+
+        ImageKey imageKey;
+        ImageParamsPtr params;
+        std::string payload(data + sizeof(ImageFileHeader), fileHeader->payloadSize);
+        if ( !serializer.deserialize(payload, &imageKey, &params) || !params || !(imageKey == key) ) {
+            return ImagePtr();
+        }
+
+        ImagePtr image;
+        if ( cache->getOrCreate(key, params, NULL, &image) ) {
+            // Another thread of this process created it meanwhile, it may not be rendered yet
+            return ImagePtr();
+        }
+        assert(image);
+        image->allocateMemory();
+
+        RectI bounds = image->getBounds();
+        U64 dataSize = (U64)bounds.area() * image->getComponentsCount() * getSizeOfForBitDepth( image->getBitDepth() );
+        if ( bounds.isNull() || (dataSize != fileHeader->dataSize) ) {
+            return ImagePtr();
+        }
+        {
+            Image::WriteAccess acc = image->getWriteRights();
+            std::memcpy(acc.pixelAt(bounds.x1, bounds.y1), data + fileHeader->dataOffset, dataSize);
+        }
+        image->markForRendered(bounds);
+
+        return image;
+    } catch (const std::exception& e) {
+        qDebug() << "Could not read image from the shared image cache:" << e.what();
+
+        return ImagePtr();
+    }
+}
+
+bool
+SharedImageCachePrivate::writeImage(const std::string& filePath,
+                                    const ImagePtr& image,
+                                    const RectI& bounds,
+                                    const std::string& payload,
+                                    U64 dataOffset,
+                                    U64 dataSize) const
+{
+    try {
+        MemoryFile file(filePath, dataOffset + dataSize, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        char* data = file.data();
+        if (!data) {
+            return false;
+        }
+        ImageFileHeader* fileHeader = reinterpret_cast<ImageFileHeader*>(data);
+        std::memcpy( fileHeader->magic, kImageMagic, sizeof(kImageMagic) );
+        fileHeader->payloadSize = payload.size();
+        fileHeader->dataOffset = dataOffset;
+        fileHeader->dataSize = dataSize;
+        std::memcpy( data + sizeof(ImageFileHeader), payload.data(), payload.size() );
+
+        Image::ReadAccess acc( image.get() );
+        std::memcpy(data + dataOffset, acc.pixelAt(bounds.x1, bounds.y1), dataSize);
+    } catch (const std::exception& e) {
+        qDebug() << "Could not write image to the shared image cache:" << e.what();
+        QFile::remove( QString::fromUtf8( filePath.c_str() ) );
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+SharedImageCachePublisherThread::run()
+{
+    _imp->runPublisher();
+}
+
+void
+SharedImageCachePrivate::runPublisher()
+{
+    for (;; ) {
+        ImagePtr image;
+        {
+            QMutexLocker k(&publishQueueMutex);
+            while ( publishQueue.empty() && !mustQuitPublisher ) {
+                publishQueueNotEmptyCond.wait(k.mutex());
+            }
+            if (mustQuitPublisher) {
+                return;
+            }
+            image = publishQueue.front();
+            publishQueue.pop_front();
+            publishing = true;
+        }
+
+        _publicInterface->publish(image);
+        image.reset();
+
+        QMutexLocker k(&publishQueueMutex);
+        publishing = false;
+        if ( publishQueue.empty() ) {
+            publishQueueEmptyCond.wakeAll();
+        }
+    }
+}
+
+SharedImageCache::SharedImageCache(const std::string& directoryPath,
+                                   U64 maximumSize)
+    : _imp( new SharedImageCachePrivate(this, directoryPath) )
+{
+    _imp->openControlFile();
+    _imp->header->maximumSize = maximumSize;
+    _imp->recoverAbandonedClaims();
+}
+
+SharedImageCache::~SharedImageCache()
+{
+    // The images not published yet are dropped
+    {
+        QMutexLocker k(&_imp->publishQueueMutex);
+        _imp->mustQuitPublisher = true;
+        _imp->publishQueue.clear();
+        _imp->publishQueueNotEmptyCond.wakeAll();
+    }
+    if (_imp->publisherThread) {
+        _imp->publisherThread->wait();
+    }
+}
+
+const std::string&
+SharedImageCache::getDirectoryPath() const
+{
+    return _imp->directoryPath;
+}
+
+void
+SharedImageCache::setMaximumSize(U64 size)
+{
+    _imp->header->maximumSize = size;
+}
+
+U64
+SharedImageCache::getMaximumSize() const
+{
+    return _imp->header->maximumSize.load();
+}
+
+bool
+SharedImageCache::get(const ImageKey& key,
+                      Cache<Image>* cache,
+                      std::list<ImagePtr>* images)
+{
+    U64 hash = key.getHash();
+    bool found = false;
+
+    for (int i = 0; i < NATRON_SHARED_IMAGE_CACHE_PROBES; ++i) {
+        Slot& slot = _imp->getSlot(hash, i);
+        if (slot.hash.load() != hash) {
+            continue;
+        }
+        int reader = _imp->pin(slot, hash);
+        if (reader < 0) {
+            continue;
+        }
+        ImagePtr image = _imp->readImage(slot, key, cache);
+        slot.lastAccess = _imp->tick();
+        _imp->unpin(slot, reader);
+        if (image) {
+            images->push_back(image);
+            found = true;
+        }
+    }
+    {
+        QMutexLocker k(&_imp->statsMutex);
+        if (found) {
+            ++_imp->hits;
+        } else {
+            ++_imp->misses;
+        }
+    }
+
+    return found;
+}
+
+bool
+SharedImageCache::publish(const ImagePtr& image)
+{
+    if ( !image || (image->getStorageMode() != eStorageModeRAM) ) {
+        return false;
+    }
+    RectI bounds = image->getBounds();
+    if ( bounds.isNull() ) {
+        return false;
+    }
+    if ( image->usesBitMap() ) {
+        std::list<RectI> restToRender;
+        image->getRestToRender(bounds, restToRender);
+        if ( !restToRender.empty() ) {
+            return false;
+        }
+    }
+
+    const ImageKey& key = image->getKey();
+    U64 hash = key.getHash();
+    std::string payload;
+    _imp->serializer.serialize(key, image->getParams(), &payload);
+    U64 checksum = computeChecksum(payload);
+    U64 dataOffset = ( (sizeof(ImageFileHeader) + payload.size() + 15) / 16 ) * 16;
+    U64 dataSize = (U64)bounds.area() * image->getComponentsCount() * getSizeOfForBitDepth( image->getBitDepth() );
+    U64 fileSize = dataOffset + dataSize;
+    if ( fileSize > _imp->header->maximumSize.load() ) {
+        return false;
+    }
+
+    // Find a free slot, unless the image is already published or being published by a process
+    U64 claim = makeClaim() | eSlotStateWriting;
+    Slot* claimed = 0;
+    for (int attempt = 0; attempt < 2 && !claimed; ++attempt) {
+        for (int i = 0; i < NATRON_SHARED_IMAGE_CACHE_PROBES; ++i) {
+            Slot& slot = _imp->getSlot(hash, i);
+            _imp->recoverSlot(slot);
+            U64 state = slot.state.load();
+            if ( (state != eSlotStateEmpty) && (slot.hash.load() == hash) && (slot.payloadChecksum.load() == checksum) ) {
+                return false;
+            }
+            if (state == eSlotStateEmpty) {
+                U64 expected = eSlotStateEmpty;
+                if ( slot.state.compare_exchange_strong(expected, claim) ) {
+                    claimed = &slot;
+                    break;
+                }
+            }
+        }
+        if ( !claimed && !_imp->evictLeastRecentlyUsed( (int)( hash & (NATRON_SHARED_IMAGE_CACHE_SLOTS - 1) ), NATRON_SHARED_IMAGE_CACHE_PROBES ) ) {
+            return false;
+        }
+    }
+    if (!claimed) {
+        return false;
+    }
+    // Record the file before creating it, so that a process recovering the slot if this one dies removes it
+    U64 fileId = ++_imp->header->nextFileId;
+    claimed->fileId = fileId;
+    claimed->hash = hash;
+    claimed->payloadChecksum = checksum;
+
+    // Make room in the budget. Processes publishing at the same time may exceed it by the size of their images.
+    while ( _imp->header->usedSize.load() + fileSize > _imp->header->maximumSize.load() ) {
+        if ( !_imp->evictLeastRecentlyUsed(0, NATRON_SHARED_IMAGE_CACHE_SLOTS) ) {
+            _imp->releaseSlot(*claimed, claim);
+
+            return false;
+        }
+    }
+    _imp->header->usedSize += fileSize;
+    ++_imp->header->entriesCount;
+    claimed->fileSize = fileSize;
+
+    if ( !_imp->writeImage(_imp->getImageFilePath(fileId), image, bounds, payload, dataOffset, dataSize) ) {
+        _imp->releaseSlot(*claimed, claim);
+
+        return false;
+    }
+    claimed->lastAccess = _imp->tick();
+    if ( !claimed->state.compare_exchange_strong(claim, eSlotStateReady) ) {
+        // This process was thought dead and the slot recovered by another one, which removed the file
+        return false;
+    }
+
+    {
+        QMutexLocker k(&_imp->statsMutex);
+        ++_imp->publishedEntries;
+        _imp->publishedBytes += fileSize;
+    }
+
+    return true;
+} // SharedImageCache::publish
+
+void
+SharedImageCache::publishInBackground(const ImagePtr& image)
+{
+    if ( !image || (image->getStorageMode() != eStorageModeRAM) ) {
+        return;
+    }
+
+    QMutexLocker k(&_imp->publishQueueMutex);
+
+    if ( _imp->mustQuitPublisher || (_imp->publishQueue.size() >= NATRON_SHARED_IMAGE_CACHE_MAX_PENDING) ) {
+        return;
+    }
+    if (!_imp->publisherThread) {
+        _imp->publisherThread.reset( new SharedImageCachePublisherThread( _imp.get() ) );
+        _imp->publisherThread->start();
+    }
+    _imp->publishQueue.push_back(image);
+    _imp->publishQueueNotEmptyCond.wakeOne();
+}
+
+void
+SharedImageCache::waitForPendingPublications()
+{
+    QMutexLocker k(&_imp->publishQueueMutex);
+
+    while ( !_imp->mustQuitPublisher && ( !_imp->publishQueue.empty() || _imp->publishing ) ) {
+        _imp->publishQueueEmptyCond.wait(k.mutex());
+    }
+}
+
+void
+SharedImageCache::clear()
+{
+    _imp->recoverAbandonedClaims();
+    for (int i = 0; i < NATRON_SHARED_IMAGE_CACHE_SLOTS; ++i) {
+        _imp->evictSlot(_imp->slots[i]);
+    }
+}
+
+SharedImageCacheStats
+SharedImageCache::getStats() const
+{
+    SharedImageCacheStats stats;
+
+    stats.sharedSize = _imp->header->usedSize.load();
+    stats.sharedEntries = (std::size_t)_imp->header->entriesCount.load();
+    QMutexLocker k(&_imp->statsMutex);
+    stats.hits = _imp->hits;
+    stats.misses = _imp->misses;
+    stats.publishedEntries = _imp->publishedEntries;
+    stats.publishedBytes = _imp->publishedBytes;
+
+    return stats;
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,155 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_SHAREDIMAGECACHE_H
+#define NATRON_ENGINE_SHAREDIMAGECACHE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+// Name of the folder of the shared image cache, in the disk cache location
+#define NATRON_SHARED_IMAGE_CACHE_DIR_NAME "SharedImageCache"
+
+// Number of images the shared image cache can hold, must be a power of 2
+#define NATRON_SHARED_IMAGE_CACHE_SLOTS 4096
+
+// Number of consecutive slots an image may be stored in, starting from the slot given by its hash
+#define NATRON_SHARED_IMAGE_CACHE_PROBES 16
+
+NATRON_NAMESPACE_ENTER
+
+template <typename EntryType>
+class Cache;
+
+struct SharedImageCacheStats
+{
+    // Bytes and images published by all the processes using the shared cache
+    U64 sharedSize;
+    std::size_t sharedEntries;
+
+    // Activity of this process
+    U64 hits;
+    U64 misses;
+    U64 publishedEntries;
+    U64 publishedBytes;
+
+    SharedImageCacheStats()
+        : sharedSize(0)
+        , sharedEntries(0)
+        , hits(0)
+        , misses(0)
+        , publishedEntries(0)
+        , publishedBytes(0)
+    {
+    }
+};
+
+struct SharedImageCachePrivate;
+
+/**
+ * @brief An image cache shared by all the processes of this computer that open the same folder, so that several
+ * NatronRenderer processes rendering the same upstream images do the work once.
+ * The folder holds a control file, mapped by every process, with a fixed table of slots indexed by the image hash,
+ * and one file per published image with its serialized key and parameters followed by its pixels.
+ * Slots are claimed and released with atomic operations on the mapping, no lock is shared between processes.
+ * A process reading an image pins its slot so that no other process evicts it meanwhile, and the images the least
+ * recently read are evicted when the total size of the images exceeds the budget stored in the control file.
+ * Claims and pins record the process id and the time they were taken: the ones of processes that died, or older than
+ * a timeout, are reclaimed by the other processes along with the share of the budget they held.
+ * Images read from the shared cache are copied to the node cache of the process.
+ * This class is MT-safe.
+ **/
+class SharedImageCache
+{
+public:
+
+    /**
+     * @brief Opens the shared cache in the given folder, creating it if needed.
+     * @param maximumSize The budget of the shared cache, in bytes. It is shared by all the processes: the last one
+     * to open the cache sets it.
+     * This function throws a std::runtime_error if the cache cannot be opened or was created by another version.
+     **/
+    SharedImageCache(const std::string& directoryPath,
+                     U64 maximumSize);
+
+    ~SharedImageCache();
+
+    const std::string& getDirectoryPath() const;
+
+    void setMaximumSize(U64 size);
+
+    U64 getMaximumSize() const;
+
+    /**
+     * @brief Looks up the images published with the given key, copies them to the given cache and returns them.
+     * @returns True if at least one image was found.
+     **/
+    bool get(const ImageKey& key,
+             Cache<Image>* cache,
+             std::list<ImagePtr>* images);
+
+    /**
+     * @brief Publishes a fully rendered RAM image so that other processes can read it.
+     * Does nothing if the image is already published, is partially rendered or does not fit in the budget.
+     * @returns True if the image was published.
+     **/
+    bool publish(const ImagePtr& image);
+
+    /**
+     * @brief Same as publish(), but the image file is written by a thread of the shared cache so that the render thread
+     * does not wait for it. The image is dropped if too many images are waiting to be published.
+     **/
+    void publishInBackground(const ImagePtr& image);
+
+    /**
+     * @brief Blocks until the images passed to publishInBackground() so far are published or dropped.
+     **/
+    void waitForPendingPublications();
+
+    /**
+     * @brief Evicts every image not read at the moment by any process.
+     **/
+    void clear();
+
+    SharedImageCacheStats getStats() const;
+
+private:
+
+    boost::scoped_ptr<SharedImageCachePrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_SHAREDIMAGECACHE_H
@@ -0,0 +1,514 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "Engine/TraceRecorder.h"
+
+// Maximum number of workers of a TaskScheduler
+#define NATRON_TASK_SCHEDULER_MAX_WORKERS 256
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+
+struct QueuedTask
+{
+    TaskScheduler::Task task;
+    TaskGroup* group;
+
+    // The worker that spawned the task, -1 for another thread
+    int spawner;
+
+    QueuedTask()
+        : task()
+        , group(NULL)
+        , spawner(-1)
+    {
+    }
+};
+
+// Each deque has its own mutex: stealing a task only contends with its owner
+struct TaskDeque
+{
+    QMutex mutex;
+    std::deque<QueuedTask> tasks;
+};
+
+class TaskSchedulerWorker
+    : public QThread
+{
+    TaskSchedulerPrivate* _scheduler;
+    int _index;
+
+public:
+
+    TaskSchedulerWorker(TaskSchedulerPrivate* scheduler,
+                        int index)
+        : QThread()
+        , _scheduler(scheduler)
+        , _index(index)
+    {
+        setObjectName( QString::fromUtf8("TaskScheduler%1").arg(index) );
+    }
+
+    TaskSchedulerPrivate* getScheduler() const
+    {
+        return _scheduler;
+    }
+
+    int getIndex() const
+    {
+        return _index;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL;
+};
+
+} // anon namespace
+
+struct TaskSchedulerPrivate
+{
+    TaskDeque deques[NATRON_TASK_SCHEDULER_MAX_WORKERS];
+
+    // The tasks spawned by the threads that are not workers
+    TaskDeque sharedQueue;
+
+    // Protects workers and running
+    QMutex workersMutex;
+    TaskSchedulerWorker* workers[NATRON_TASK_SCHEDULER_MAX_WORKERS];
+    bool running[NATRON_TASK_SCHEDULER_MAX_WORKERS];
+
+    // Workers with an index below workersCount run tasks, the others exit.
+    // The deques below dequesCount may contain tasks.
+    QAtomicInt workersCount;
+    QAtomicInt dequesCount;
+    QAtomicInt queuedTasks;
+    QAtomicInt busyWorkers;
+    QAtomicInt mustQuit;
+
+    // Protects stolenTasks, which is only updated when a task is stolen
+    QMutex statsMutex;
+    U64 stolenTasks;
+
+    QMutex sleepMutex;
+    QWaitCondition sleepCond;
+
+    TaskSchedulerPrivate()
+        : sharedQueue()
+        , workersMutex()
+        , workersCount(0)
+        , dequesCount(0)
+        , queuedTasks(0)
+        , busyWorkers(0)
+        , mustQuit(0)
+        , statsMutex()
+        , stolenTasks(0)
+        , sleepMutex()
+        , sleepCond()
+    {
+        for (int i = 0; i < NATRON_TASK_SCHEDULER_MAX_WORKERS; ++i) {
+            workers[i] = NULL;
+            running[i] = false;
+        }
+    }
+
+    ~TaskSchedulerPrivate()
+    {
+        mustQuit = 1;
+        {
+            QMutexLocker l(&sleepMutex);
+            sleepCond.wakeAll();
+        }
+        for (int i = 0; i < NATRON_TASK_SCHEDULER_MAX_WORKERS; ++i) {
+            if (workers[i]) {
+                workers[i]->wait();
+                delete workers[i];
+            }
+        }
+    }
+
+    void updateWorkers();
+
+    /*
+     * Returns the index of the worker running in the current thread, -1 if it is not a worker of this scheduler.
+     */
+    int getCurrentWorker() const
+    {
+        TaskSchedulerWorker* worker = dynamic_cast<TaskSchedulerWorker*>( QThread::currentThread() );
+
+        return (worker && worker->getScheduler() == this) ? worker->getIndex() : -1;
+    }
+
+    void wakeWorker()
+    {
+        QMutexLocker l(&sleepMutex);
+
+        sleepCond.wakeOne();
+    }
+
+    bool takeTask(int worker, TaskGroup* group, QueuedTask* task);
+
+    bool takeTaskFromDeque(TaskDeque& deque, bool newest, TaskGroup* group, QueuedTask* task);
+
+    void execute(const QueuedTask& task, int worker);
+
+    void runWorker(int index);
+};
+
+void
+TaskSchedulerWorker::run()
+{
+    _scheduler->runWorker(_index);
+}
+
+void
+TaskSchedulerPrivate::updateWorkers()
+{
+    // The thread waiting for a group runs its tasks as well
+    const int wanted = std::max( 0, std::min(QThreadPool::globalInstance()->maxThreadCount() - 1, NATRON_TASK_SCHEDULER_MAX_WORKERS) );
+
+    if ( wanted == (int)workersCount ) {
+        return;
+    }
+    QMutexLocker l(&workersMutex);
+    const int previous = (int)workersCount;
+    workersCount = wanted;
+    if ( wanted > (int)dequesCount ) {
+        dequesCount = wanted;
+    }
+    for (int i = 0; i < wanted; ++i) {
+        if (running[i]) {
+            continue;
+        }
+        if (workers[i]) {
+            // it may still be returning from run()
+            workers[i]->wait();
+        } else {
+            workers[i] = new TaskSchedulerWorker(this, i);
+        }
+        running[i] = true;
+        workers[i]->start();
+    }
+    if (wanted < previous) {
+        // the workers above wanted exit
+        QMutexLocker k(&sleepMutex);
+        sleepCond.wakeAll();
+    }
+}
+
+bool
+TaskSchedulerPrivate::takeTaskFromDeque(TaskDeque& deque,
+                                        bool newest,
+                                        TaskGroup* group,
+                                        QueuedTask* task)
+{
+    QMutexLocker l(&deque.mutex);
+
+    if ( deque.tasks.empty() ) {
+        return false;
+    }
+    if (newest) {
+        std::deque<QueuedTask>::reverse_iterator it = deque.tasks.rbegin();
+        while ( group && it != deque.tasks.rend() && it->group != group ) {
+            ++it;
+        }
+        if ( it == deque.tasks.rend() ) {
+            return false;
+        }
+        *task = *it;
+        deque.tasks.erase( --it.base() );
+    } else {
+        std::deque<QueuedTask>::iterator it = deque.tasks.begin();
+        while ( group && it != deque.tasks.end() && it->group != group ) {
+            ++it;
+        }
+        if ( it == deque.tasks.end() ) {
+            return false;
+        }
+        *task = *it;
+        deque.tasks.erase(it);
+    }
+    queuedTasks.fetchAndAddRelaxed(-1);
+
+    return true;
+}
+
+bool
+TaskSchedulerPrivate::takeTask(int worker,
+                               TaskGroup* group,
+                               QueuedTask* task)
+{
+    if ( (int)queuedTasks <= 0 ) {
+        return false;
+    }
+    // The most recent task spawned by this worker first: its data is still in the caches
+    if ( (worker >= 0) && takeTaskFromDeque(deques[worker], true, group, task) ) {
+        return true;
+    }
+    // Then the oldest tasks of the other threads, which are usually the largest ones
+    if ( takeTaskFromDeque(sharedQueue, false, group, task) ) {
+        return true;
+    }
+    const int n = (int)dequesCount;
+    for (int i = 1; i <= n; ++i) {
+        const int victim = (worker + i) % n;
+        if ( (victim != worker) && takeTaskFromDeque(deques[victim], false, group, task) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+TaskSchedulerPrivate::execute(const QueuedTask& task,
+                              int worker)
+{
+    bool stolen = (worker >= 0) && (task.spawner != worker);
+    if (stolen) {
+        QMutexLocker l(&statsMutex);
+        ++stolenTasks;
+    }
+    std::exception_ptr exception;
+    try {
+        TraceScope trace("scheduler", stolen ? "stolen task" : "task");
+        task.task();
+    } catch (const std::exception& e) {
+        qDebug() << "Exception in a TaskScheduler task:" << e.what();
+        exception = std::current_exception();
+    } catch (...) {
+        qDebug() << "Exception in a TaskScheduler task";
+        exception = std::current_exception();
+    }
+    task.group->onTaskFinished(exception);
+}
+
+void
+TaskSchedulerPrivate::runWorker(int index)
+{
+    for (;;) {
+        if ( (int)mustQuit || ( index >= (int)workersCount ) ) {
+            QMutexLocker l(&workersMutex);
+            if ( (int)mustQuit || ( index >= (int)workersCount ) ) {
+                running[index] = false;
+                break;
+            }
+        }
+        QueuedTask task;
+        if ( takeTask(index, NULL, &task) ) {
+            busyWorkers.fetchAndAddRelaxed(1);
+            execute(task, index);
+            busyWorkers.fetchAndAddRelaxed(-1);
+            continue;
+        }
+        QMutexLocker l(&sleepMutex);
+        if ( !(int)mustQuit && ( index < (int)workersCount ) && ( (int)queuedTasks <= 0 ) ) {
+            sleepCond.wait(&sleepMutex);
+        }
+    }
+
+    // Hand over the tasks left in the deque of this worker to the other threads
+    bool handedOver = false;
+    {
+        QMutexLocker l(&deques[index].mutex);
+        QMutexLocker k(&sharedQueue.mutex);
+        handedOver = !deques[index].tasks.empty();
+        sharedQueue.tasks.insert( sharedQueue.tasks.end(), deques[index].tasks.begin(), deques[index].tasks.end() );
+        deques[index].tasks.clear();
+    }
+    if (handedOver) {
+        QMutexLocker l(&sleepMutex);
+        sleepCond.wakeAll();
+    }
+}
+
+TaskScheduler::TaskScheduler()
+    : _imp( new TaskSchedulerPrivate() )
+{
+}
+
+TaskScheduler::~TaskScheduler()
+{
+}
+
+TaskScheduler*
+TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+
+    return &scheduler;
+}
+
+int
+TaskScheduler::getMaxThreadsCount() const
+{
+    _imp->updateWorkers();
+
+    return (int)_imp->workersCount + 1;
+}
+
+int
+TaskScheduler::getIdleWorkersCount() const
+{
+    _imp->updateWorkers();
+
+    // The queued tasks will keep some of the idle workers busy
+    return std::max( 0, (int)_imp->workersCount - (int)_imp->busyWorkers - (int)_imp->queuedTasks );
+}
+
+bool
+TaskScheduler::isWorkerThread() const
+{
+    return _imp->getCurrentWorker() >= 0;
+}
+
+U64
+TaskScheduler::getStolenTasksCount() const
+{
+    QMutexLocker l(&_imp->statsMutex);
+
+    return _imp->stolenTasks;
+}
+
+void
+TaskScheduler::push(const Task& task,
+                    TaskGroup* group)
+{
+    _imp->updateWorkers();
+
+    QueuedTask queued;
+    queued.task = task;
+    queued.group = group;
+    queued.spawner = _imp->getCurrentWorker();
+    {
+        TaskDeque& deque = (queued.spawner >= 0) ? _imp->deques[queued.spawner] : _imp->sharedQueue;
+        QMutexLocker l(&deque.mutex);
+        deque.tasks.push_back(queued);
+    }
+    _imp->queuedTasks.fetchAndAddRelaxed(1);
+    _imp->wakeWorker();
+}
+
+bool
+TaskScheduler::runQueuedTask(TaskGroup* group)
+{
+    QueuedTask task;
+    const int worker = _imp->getCurrentWorker();
+
+    if ( !_imp->takeTask(worker, group, &task) ) {
+        return false;
+    }
+    _imp->execute(task, worker);
+
+    return true;
+}
+
+TaskGroup::TaskGroup(TaskScheduler* scheduler)
+    : _scheduler(scheduler)
+    , _pendingTasks(0)
+    , _exception()
+    , _finishedMutex()
+    , _finishedCond()
+{
+    assert(_scheduler);
+}
+
+TaskGroup::~TaskGroup()
+{
+    try {
+        wait();
+    } catch (const std::exception& e) {
+        qDebug() << e.what();
+    }
+}
+
+void
+TaskGroup::run(const TaskScheduler::Task& task)
+{
+    _pendingTasks.fetchAndAddRelaxed(1);
+    if (_scheduler->getMaxThreadsCount() <= 1) {
+        // no worker: run the task now
+        std::exception_ptr exception;
+        try {
+            task();
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        onTaskFinished(exception);
+
+        return;
+    }
+    _scheduler->push(task, this);
+}
+
+void
+TaskGroup::wait()
+{
+    while ( (int)_pendingTasks > 0 ) {
+        // Run the tasks of this group that were not started yet, then wait for the ones running on other threads
+        if ( _scheduler->runQueuedTask(this) ) {
+            continue;
+        }
+        QMutexLocker l(&_finishedMutex);
+        if ( (int)_pendingTasks > 0 ) {
+            _finishedCond.wait(&_finishedMutex);
+        }
+    }
+    std::exception_ptr exception;
+    {
+        // The thread that finished the last task may still hold the mutex
+        QMutexLocker l(&_finishedMutex);
+        std::swap(exception, _exception);
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void
+TaskGroup::onTaskFinished(const std::exception_ptr& exception)
+{
+    QMutexLocker l(&_finishedMutex);
+
+    if (exception && !_exception) {
+        _exception = exception;
+    }
+    if (_pendingTasks.fetchAndAddRelaxed(-1) == 1) {
+        _finishedCond.wakeAll();
+    }
+}
+
+NATRON_NAMESPACE_EXIT
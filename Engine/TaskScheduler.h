@@ -0,0 +1,227 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_TASKSCHEDULER_H
+#define NATRON_ENGINE_TASKSCHEDULER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <exception>
+#include <vector>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+struct TaskSchedulerPrivate;
+
+/**
+ * @brief The work-stealing scheduler that runs the host-side parallel work: the tiles of the renders in
+ * eRenderSafetyFullySafeFrame mode, the threads of the OpenFX multi-thread suite, the tiles of the viewer and the
+ * bands of rows processed by Image.
+ *
+ * Each worker thread has its own deque of tasks: the tasks it spawns are pushed and popped at the back of its deque,
+ * while idle workers steal the oldest tasks at the front of the deques of the others. The tasks spawned by other
+ * threads (such as the render threads of the OutputSchedulerThread) go to a shared queue.
+ * The number of threads follows the maximum thread count of the global thread pool, which is set from the preferences.
+ *
+ * Tasks are spawned in a TaskGroup. A thread waiting for a group runs the tasks of the group that were not started yet
+ * instead of blocking, so that nested fork/join (a tile render calling the multi-thread suite which processes bands
+ * of rows...) never deadlocks and never needs more threads than the workers. Callers that split fine-grained work
+ * may still run it serially when isWorkerThread() or getIdleWorkersCount() tell that the workers are already busy.
+ * A waiting thread only runs the tasks of its own group: the tasks of other renders would replace its thread-local
+ * storage.
+ **/
+class TaskScheduler
+{
+    friend class TaskGroup;
+
+public:
+
+    typedef boost::function<void ()> Task;
+
+    TaskScheduler();
+
+    ~TaskScheduler();
+
+    /**
+     * @brief The scheduler shared by the whole application.
+     **/
+    static TaskScheduler* instance();
+
+    /**
+     * @brief The number of threads that may run the tasks of a group: the workers and the thread waiting for the group.
+     * This is the maximum thread count of the global thread pool, there is one worker less.
+     **/
+    int getMaxThreadsCount() const;
+
+    /**
+     * @brief The number of workers that are not running a task and would not run one of the tasks already queued.
+     **/
+    int getIdleWorkersCount() const;
+
+    /**
+     * @brief Returns true if the current thread is one of the workers of this scheduler, i.e. it runs a task.
+     **/
+    bool isWorkerThread() const;
+
+    /**
+     * @brief Returns the number of tasks run by a worker that did not spawn them, for statistics.
+     **/
+    U64 getStolenTasksCount() const;
+
+    /**
+     * @brief Calls map on each item of sequence concurrently and returns once all the calls are done,
+     * as QtConcurrent::blockingMap() does.
+     **/
+    template <typename Sequence, typename MapFunctor>
+    static void blockingMap(Sequence& sequence, MapFunctor map);
+
+    /**
+     * @brief Same as blockingMap() but the result of map for the i-th item of sequence is stored in (*results)[i],
+     * as QtConcurrent::blockingMapped() does.
+     **/
+    template <typename Sequence, typename MapFunctor, typename Result>
+    static void blockingMapped(const Sequence& sequence, MapFunctor map, std::vector<Result>* results);
+
+private:
+
+    void push(const Task& task, TaskGroup* group);
+
+    bool runQueuedTask(TaskGroup* group);
+
+    boost::scoped_ptr<TaskSchedulerPrivate> _imp;
+};
+
+/**
+ * @brief A set of tasks run by a TaskScheduler, which can be waited for. Tasks may create groups of their own.
+ * Only the thread that created the group may add tasks to it and wait for it.
+ **/
+class TaskGroup
+{
+    friend class TaskScheduler;
+    friend struct TaskSchedulerPrivate;
+
+public:
+
+    explicit TaskGroup( TaskScheduler* scheduler = TaskScheduler::instance() );
+
+    /**
+     * @brief Waits for the tasks that were not waited for.
+     **/
+    ~TaskGroup();
+
+    void run(const TaskScheduler::Task& task);
+
+    /**
+     * @brief Runs the tasks of the group that were not started yet in the current thread and waits for the others.
+     * If tasks threw exceptions, rethrows the first one.
+     **/
+    void wait();
+
+private:
+
+    void onTaskFinished(const std::exception_ptr& exception);
+
+    TaskScheduler* _scheduler;
+    QAtomicInt _pendingTasks;
+    std::exception_ptr _exception; // first exception thrown by a task, protected by _finishedMutex
+    QMutex _finishedMutex;
+    QWaitCondition _finishedCond;
+};
+
+namespace TaskSchedulerDetail {
+template <typename MapFunctor, typename Item>
+struct MapTask
+{
+    MapFunctor map;
+    Item* item;
+
+    void operator()()
+    {
+        map(*item);
+    }
+};
+
+template <typename MapFunctor, typename Item, typename Result>
+struct MappedTask
+{
+    MapFunctor map;
+    const Item* item;
+    Result* result;
+
+    void operator()()
+    {
+        *result = map(*item);
+    }
+};
+}
+
+template <typename Sequence, typename MapFunctor>
+void
+TaskScheduler::blockingMap(Sequence& sequence,
+                           MapFunctor map)
+{
+    TaskGroup group;
+
+    for (typename Sequence::iterator it = sequence.begin(); it != sequence.end(); ++it) {
+        TaskSchedulerDetail::MapTask<MapFunctor, typename Sequence::value_type> task = { map, &*it };
+        group.run(task);
+    }
+    group.wait();
+}
+
+template <typename Sequence, typename MapFunctor, typename Result>
+void
+TaskScheduler::blockingMapped(const Sequence& sequence,
+                              MapFunctor map,
+                              std::vector<Result>* results)
+{
+    results->resize( sequence.size() );
+
+    TaskGroup group;
+    typename std::vector<Result>::iterator result = results->begin();
+    for (typename Sequence::const_iterator it = sequence.begin(); it != sequence.end(); ++it, ++result) {
+        TaskSchedulerDetail::MappedTask<MapFunctor, typename Sequence::value_type, Result> task = { map, &*it, &*result };
+        group.run(task);
+    }
+    group.wait();
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_TASKSCHEDULER_H
@@ -0,0 +1,227 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "TileCacheFile.h"
+
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+// Index of the lowest set bit of a non-zero word
+static inline int
+lowestSetBit(U64 word)
+{
+    assert(word != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+
+    return (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+
+    return __builtin_ctzll(word);
+#else
+    int index = 0;
+    while ( !(word & 1) ) {
+        word >>= 1;
+        ++index;
+    }
+
+    return index;
+#endif
+}
+
+TileBitmap::TileBitmap()
+    : _levels()
+    , _nTiles(0)
+    , _nFreeTiles(0)
+{
+}
+
+void
+TileBitmap::init(std::size_t nTiles)
+{
+    _levels.clear();
+    _nTiles = nTiles;
+    _nFreeTiles = nTiles;
+
+    // Build each level from the one below until a level fits in a single word
+    std::size_t nBits = nTiles;
+    do {
+        std::size_t nWords = (nBits + 63) / 64;
+        std::vector<U64> level(nWords, 0);
+        for (std::size_t i = 0; i < nBits; ++i) {
+            level[i / 64] |= (U64)1 << (i % 64);
+        }
+        _levels.push_back(level);
+        nBits = nWords;
+    } while (nBits > 1);
+}
+
+bool
+TileBitmap::isTileUsed(std::size_t index) const
+{
+    assert(index < _nTiles);
+
+    return !( _levels[0][index / 64] & ( (U64)1 << (index % 64) ) );
+}
+
+void
+TileBitmap::setBit(std::size_t index,
+                   bool free)
+{
+    for (std::size_t l = 0; l < _levels.size(); ++l) {
+        U64& word = _levels[l][index / 64];
+        bool wasEmpty = word == 0;
+        if (free) {
+            word |= (U64)1 << (index % 64);
+            // The upper levels already flag this word as having a free tile
+            if (!wasEmpty) {
+                return;
+            }
+        } else {
+            word &= ~( (U64)1 << (index % 64) );
+            // The word still has free tiles, the upper levels are unchanged
+            if (word != 0) {
+                return;
+            }
+        }
+        index /= 64;
+    }
+}
+
+int
+TileBitmap::allocTile()
+{
+    if ( (_nFreeTiles == 0) || _levels.empty() ) {
+        return -1;
+    }
+
+    // Walk down from the top level, following the first word that has a free tile
+    std::size_t index = 0;
+    for (int l = (int)_levels.size() - 1; l >= 0; --l) {
+        U64 word = _levels[l][index];
+        assert(word != 0);
+        index = index * 64 + lowestSetBit(word);
+    }
+    assert(index < _nTiles);
+    setBit(index, false);
+    --_nFreeTiles;
+
+    return (int)index;
+}
+
+bool
+TileBitmap::markTileUsed(std::size_t index)
+{
+    if ( isTileUsed(index) ) {
+        return false;
+    }
+    setBit(index, false);
+    --_nFreeTiles;
+
+    return true;
+}
+
+bool
+TileBitmap::freeTile(std::size_t index)
+{
+    if ( !isTileUsed(index) ) {
+        return false;
+    }
+    setBit(index, true);
+    ++_nFreeTiles;
+
+    return true;
+}
+
+TileCacheFile::TileCacheFile()
+    : file()
+    , _tilesMutex()
+    , _tiles()
+{
+}
+
+void
+TileCacheFile::initTiles(std::size_t nTiles)
+{
+    QMutexLocker k(&_tilesMutex);
+
+    _tiles.init(nTiles);
+}
+
+std::size_t
+TileCacheFile::getNumTiles() const
+{
+    QMutexLocker k(&_tilesMutex);
+
+    return _tiles.getNumTiles();
+}
+
+std::size_t
+TileCacheFile::getNumFreeTiles() const
+{
+    QMutexLocker k(&_tilesMutex);
+
+    return _tiles.getNumFreeTiles();
+}
+
+bool
+TileCacheFile::isTileUsed(std::size_t index) const
+{
+    QMutexLocker k(&_tilesMutex);
+
+    return _tiles.isTileUsed(index);
+}
+
+int
+TileCacheFile::allocTile()
+{
+    QMutexLocker k(&_tilesMutex);
+
+    return _tiles.allocTile();
+}
+
+bool
+TileCacheFile::markTileUsed(std::size_t index)
+{
+    QMutexLocker k(&_tilesMutex);
+
+    return _tiles.markTileUsed(index);
+}
+
+bool
+TileCacheFile::freeTile(std::size_t index)
+{
+    QMutexLocker k(&_tilesMutex);
+
+    return _tiles.freeTile(index);
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,135 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_TILECACHEFILE_H
+#define NATRON_ENGINE_TILECACHEFILE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+#include <cstddef>
+
+#include <QtCore/QMutex>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A set of tiles where a free tile can be found in O(log64(n)).
+ * The bottom level has 1 bit per tile, set when the tile is free. Each upper level has 1 bit
+ * per 64-bit word of the level below, set when that word has at least one free tile.
+ * The top level is a single word.
+ * This is not MT-safe.
+ **/
+class TileBitmap
+{
+public:
+
+    TileBitmap();
+
+    /**
+     * @brief Resets the bitmap to nTiles free tiles
+     **/
+    void init(std::size_t nTiles);
+
+    std::size_t getNumTiles() const
+    {
+        return _nTiles;
+    }
+
+    std::size_t getNumFreeTiles() const
+    {
+        return _nFreeTiles;
+    }
+
+    bool isTileUsed(std::size_t index) const;
+
+    /**
+     * @brief Marks the first free tile as used and returns its index, or -1 if all tiles are used.
+     **/
+    int allocTile();
+
+    /**
+     * @brief Marks the given tile as used. Returns false if it was already used.
+     **/
+    bool markTileUsed(std::size_t index);
+
+    /**
+     * @brief Marks the given tile as free. Returns false if it was already free.
+     **/
+    bool freeTile(std::size_t index);
+
+private:
+
+    void setBit(std::size_t index, bool free);
+
+    // _levels[0] is the bottom level, _levels.back() is the single-word top level
+    std::vector<std::vector<U64> > _levels;
+    std::size_t _nTiles;
+    std::size_t _nFreeTiles;
+};
+
+/**
+ * @brief This is a cache file with a fixed size that is a multiple of the tileByteSize.
+ * A bitmap represents the allocated tiles in the file.
+ * Tiles are allocated and freed under a per-file mutex, so that concurrent viewer renders
+ * only contend when they allocate in the same file, and only for the duration of a few word operations.
+ **/
+class TileCacheFile
+{
+public:
+
+    TileCacheFile();
+
+    MemoryFilePtr file;
+
+    void initTiles(std::size_t nTiles);
+
+    std::size_t getNumTiles() const;
+
+    std::size_t getNumFreeTiles() const;
+
+    bool isTileUsed(std::size_t index) const;
+
+    /**
+     * @brief Returns the index of a newly allocated tile or -1 if the file is full
+     **/
+    int allocTile();
+
+    bool markTileUsed(std::size_t index);
+
+    bool freeTile(std::size_t index);
+
+private:
+
+    mutable QMutex _tilesMutex;
+    TileBitmap _tiles;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_TILECACHEFILE_H
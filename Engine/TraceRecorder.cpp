@@ -0,0 +1,322 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <vector>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include "Global/FStreamsSupport.h"
+#include "Global/StrUtils.h"
+
+#include "Engine/EffectInstance.h"
+#include "Engine/Node.h"
+
+NATRON_NAMESPACE_ENTER
+
+struct TraceEvent
+{
+    const char* category;
+    const char* name;
+    std::string label;
+    double time;
+    bool hasTime;
+    RectI rect;
+    bool hasRect;
+    long long startUS;
+    long long endUS;
+};
+
+/**
+ * @brief The events of a thread. The lock is only contended when the trace is written.
+ **/
+struct TraceThreadBuffer
+{
+    QMutex lock;
+    int tid;
+    std::string threadName;
+    std::vector<TraceEvent> events;
+    U64 droppedEvents;
+
+    // Set when the thread exited, under the buffers mutex of the recorder: the buffer is freed by the next
+    // TraceRecorder::start()
+    bool threadExited;
+
+    TraceThreadBuffer()
+        : lock()
+        , tid(0)
+        , threadName()
+        , events()
+        , droppedEvents(0)
+        , threadExited(false)
+    {
+    }
+};
+
+/**
+ * @brief Held in the thread storage of a thread that recorded events. Buffers are owned by the recorder, so that
+ * the events of a thread can be written after it exited.
+ **/
+struct TraceThreadHandle
+{
+    TraceThreadBuffer* buffer;
+    QMutex* buffersMutex;
+
+    TraceThreadHandle(TraceThreadBuffer* buffer,
+                      QMutex* buffersMutex)
+        : buffer(buffer)
+        , buffersMutex(buffersMutex)
+    {
+    }
+
+    ~TraceThreadHandle()
+    {
+        QMutexLocker k(buffersMutex);
+
+        buffer->threadExited = true;
+    }
+};
+
+QAtomicInt TraceRecorder::_enabled(0);
+
+TraceRecorder::TraceRecorder()
+    : _buffersMutex()
+    , _buffers()
+    , _nextThreadId(1)
+    , _startUS( now() )
+    , _threadHandles()
+{
+}
+
+TraceRecorder*
+TraceRecorder::instance()
+{
+    // Never destroyed: threads may still record events when the application quits
+    static TraceRecorder* recorder = new TraceRecorder();
+
+    return recorder;
+}
+
+void
+TraceRecorder::start()
+{
+    {
+        QMutexLocker k(&_buffersMutex);
+        for (std::list<TraceThreadBuffer*>::iterator it = _buffers.begin(); it != _buffers.end();) {
+            if ( (*it)->threadExited ) {
+                delete *it;
+                it = _buffers.erase(it);
+                continue;
+            }
+            QMutexLocker l(&(*it)->lock);
+            // Not clear(): a buffer may hold the events of a long trace, give its memory back
+            std::vector<TraceEvent>().swap( (*it)->events );
+            (*it)->droppedEvents = 0;
+            ++it;
+        }
+        _startUS = now();
+    }
+    _enabled = 1;
+}
+
+void
+TraceRecorder::stop()
+{
+    _enabled = 0;
+}
+
+long long
+TraceRecorder::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+TraceThreadBuffer*
+TraceRecorder::getThreadBuffer()
+{
+    if ( _threadHandles.hasLocalData() ) {
+        return _threadHandles.localData()->buffer;
+    }
+
+    TraceThreadBuffer* buffer = new TraceThreadBuffer;
+    QThread* thread = QThread::currentThread();
+    if ( qApp && (thread == qApp->thread()) ) {
+        buffer->threadName = "Main thread";
+    } else if ( thread && !thread->objectName().isEmpty() ) {
+        buffer->threadName = thread->objectName().toStdString();
+    }
+
+    {
+        QMutexLocker k(&_buffersMutex);
+        buffer->tid = _nextThreadId++;
+        if ( buffer->threadName.empty() ) {
+            buffer->threadName = "Thread " + QString::number(buffer->tid).toStdString();
+        }
+        _buffers.push_back(buffer);
+    }
+    _threadHandles.setLocalData( new TraceThreadHandle(buffer, &_buffersMutex) );
+
+    return buffer;
+}
+
+void
+TraceRecorder::record(const char* category,
+                      const char* name,
+                      const std::string& label,
+                      const double* time,
+                      const RectI* rect,
+                      long long startUS,
+                      long long endUS)
+{
+    TraceThreadBuffer* buffer = getThreadBuffer();
+    QMutexLocker k(&buffer->lock);
+
+    if (buffer->events.size() >= NATRON_TRACE_MAX_EVENTS_PER_THREAD) {
+        ++buffer->droppedEvents;
+
+        return;
+    }
+
+    TraceEvent e;
+    e.category = category;
+    e.name = name;
+    e.label = label;
+    e.time = time ? *time : 0.;
+    e.hasTime = time != 0;
+    if (rect) {
+        e.rect = *rect;
+    }
+    e.hasRect = rect != 0;
+    e.startUS = startUS;
+    e.endUS = endUS;
+    buffer->events.push_back(e);
+}
+
+void
+TraceRecorder::writeChromeTrace(std::ostream& os) const
+{
+    QMutexLocker k(&_buffersMutex);
+    bool first = true;
+
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (std::list<TraceThreadBuffer*>::const_iterator it = _buffers.begin(); it != _buffers.end(); ++it) {
+        QMutexLocker l(&(*it)->lock);
+        const TraceThreadBuffer& buffer = **it;
+
+        os << (first ? "\n" : ",\n");
+        first = false;
+        os << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer.tid
+           << ", \"args\": {\"name\": " << StrUtils::toJSONString(buffer.threadName) << "}}";
+
+        for (std::size_t i = 0; i < buffer.events.size(); ++i) {
+            const TraceEvent& e = buffer.events[i];
+            os << ",\n{\"name\": " << StrUtils::toJSONString( e.label.empty() ? std::string(e.name) : e.label + ' ' + e.name )
+               << ", \"cat\": \"" << e.category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer.tid
+               << ", \"ts\": " << (e.startUS - _startUS) << ", \"dur\": " << (e.endUS - e.startUS)
+               << ", \"args\": {";
+            bool firstArg = true;
+            if ( !e.label.empty() ) {
+                os << "\"node\": " << StrUtils::toJSONString(e.label);
+                firstArg = false;
+            }
+            if (e.hasTime) {
+                os << (firstArg ? "" : ", ") << "\"time\": " << e.time;
+                firstArg = false;
+            }
+            if (e.hasRect) {
+                os << (firstArg ? "" : ", ") << "\"rect\": [" << e.rect.x1 << ", " << e.rect.y1 << ", " << e.rect.x2 << ", " << e.rect.y2 << "]";
+            }
+            os << "}}";
+        }
+        if (buffer.droppedEvents > 0) {
+            os << ",\n{\"name\": \"dropped events\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": " << buffer.tid
+               << ", \"ts\": " << (buffer.events.empty() ? 0 : buffer.events.back().endUS - _startUS)
+               << ", \"args\": {\"count\": " << buffer.droppedEvents << "}}";
+        }
+    }
+    os << "\n]}\n";
+} // TraceRecorder::writeChromeTrace
+
+bool
+TraceRecorder::writeChromeTrace(const std::string& filePath) const
+{
+    FStreamsSupport::ofstream ofile;
+
+    FStreamsSupport::open(&ofile, filePath);
+    if (!ofile) {
+        return false;
+    }
+    writeChromeTrace(ofile);
+
+    return ofile.good();
+}
+
+TraceScope::TraceScope(const char* category,
+                       const char* name)
+    : _category(category)
+    , _name(name)
+    , _startUS( TraceRecorder::isEnabled() ? TraceRecorder::now() : -1 )
+    , _label()
+    , _time(0.)
+    , _hasTime(false)
+    , _rect()
+    , _hasRect(false)
+{
+}
+
+TraceScope::TraceScope(const char* category,
+                       const char* name,
+                       const EffectInstance* effect,
+                       double time)
+    : _category(category)
+    , _name(name)
+    , _startUS( TraceRecorder::isEnabled() ? TraceRecorder::now() : -1 )
+    , _label()
+    , _time(time)
+    , _hasTime(true)
+    , _rect()
+    , _hasRect(false)
+{
+    if ( (_startUS >= 0) && effect ) {
+        NodePtr node = effect->getNode();
+        if (node) {
+            _label = node->getFullyQualifiedName();
+        }
+    }
+}
+
+TraceScope::~TraceScope()
+{
+    if (_startUS < 0) {
+        return;
+    }
+    TraceRecorder::instance()->record(_category, _name, _label, _hasTime ? &_time : 0, _hasRect ? &_rect : 0, _startUS, TraceRecorder::now());
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,180 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef NATRON_ENGINE_TRACERECORDER_H
+#define NATRON_ENGINE_TRACERECORDER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <ostream>
+#include <string>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+//Maximum number of events recorded by a thread during a trace, the following ones are dropped
+#define NATRON_TRACE_MAX_EVENTS_PER_THREAD 1000000
+
+NATRON_NAMESPACE_ENTER
+
+struct TraceThreadBuffer;
+struct TraceThreadHandle;
+
+/**
+ * @brief Records what the threads do during renders, as a timeline that can be opened in chrome://tracing or
+ * in the Perfetto UI (https://ui.perfetto.dev): which thread rendered which node and tile when, the time spent waiting
+ * for input images, looking up the cache, in the actions of the plug-ins and evaluating Python expressions.
+ *
+ * Events are recorded with TraceScope. When the recorder is not started, a TraceScope costs an atomic load.
+ * Otherwise each thread appends its events to its own buffer, so that threads do not contend on a lock.
+ * The buffers of the threads that exited are kept until the next start(), so that their events can still be written.
+ * Enabled with the --trace command-line option, see CLArgs.
+ **/
+class TraceRecorder
+{
+public:
+
+    static TraceRecorder* instance();
+
+    static bool isEnabled()
+    {
+        return (int)_enabled != 0;
+    }
+
+    /**
+     * @brief Forgets the events recorded so far, and the buffers of the threads that exited, and records the
+     * following ones
+     **/
+    void start();
+
+    void stop();
+
+    /**
+     * @brief Writes the events recorded in the Chrome trace event format, as JSON. The recorder should be stopped.
+     **/
+    void writeChromeTrace(std::ostream& os) const;
+
+    bool writeChromeTrace(const std::string& filePath) const;
+
+    /**
+     * @brief Records an event that started and ended at the given times, as returned by now()
+     **/
+    void record(const char* category,
+                const char* name,
+                const std::string& label,
+                const double* time,
+                const RectI* rect,
+                long long startUS,
+                long long endUS);
+
+    /**
+     * @brief The current time in microseconds. The events are written relative to the time start() was called.
+     **/
+    static long long now();
+
+private:
+
+    TraceRecorder();
+
+    TraceThreadBuffer* getThreadBuffer();
+
+    static QAtomicInt _enabled;
+
+    // Protects _buffers, _nextThreadId and _startUS
+    mutable QMutex _buffersMutex;
+    std::list<TraceThreadBuffer*> _buffers;
+    int _nextThreadId;
+    long long _startUS;
+
+    // The buffer of each thread that recorded events, deleted when the thread exits
+    QThreadStorage<TraceThreadHandle*> _threadHandles;
+};
+
+/**
+ * @brief Records the time spent in a scope as an event of the TraceRecorder.
+ * The label and arguments are only used when the recorder is enabled: use isActive() to avoid computing them otherwise.
+ **/
+class TraceScope
+{
+public:
+
+    TraceScope(const char* category,
+               const char* name);
+
+    /**
+     * @brief The label is the fully qualified name of the node of the effect
+     **/
+    TraceScope(const char* category,
+               const char* name,
+               const EffectInstance* effect,
+               double time);
+
+    ~TraceScope();
+
+    bool isActive() const
+    {
+        return _startUS >= 0;
+    }
+
+    void setLabel(const std::string& label)
+    {
+        _label = label;
+    }
+
+    void setTime(double time)
+    {
+        _time = time;
+        _hasTime = true;
+    }
+
+    void setRect(const RectI& rect)
+    {
+        _rect = rect;
+        _hasRect = true;
+    }
+
+private:
+
+    const char* _category;
+    const char* _name;
+    long long _startUS;
+    std::string _label;
+    double _time;
+    bool _hasTime;
+    RectI _rect;
+    bool _hasRect;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_TRACERECORDER_H
@@ -42,18 +42,18 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QtGlobal>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 #include <QtCore/QFutureWatcher>
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QCoreApplication>
-#include <QtCore/QThreadPool>
+#include <QtCore/QThread>
 CLANG_DIAG_ON(deprecated)
 
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
 #include "Engine/Cache.h"
 #include "Engine/Image.h"
+#include "Engine/ImageStatistics.h"
 #include "Engine/Log.h"
 #include "Engine/Lut.h"
 #include "Engine/MemoryFile.h"
@@ -63,11 +63,13 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/OpenGLViewerI.h"
 #include "Engine/OutputSchedulerThread.h"
 #include "Engine/Project.h"
+#include "Engine/RenderPlan.h"
 #include "Engine/RenderStats.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TimeLine.h"
 #include "Engine/Timer.h"
 #include "Engine/UpdateViewerParams.h"
@@ -1437,6 +1439,11 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
 
 
         frameArgs->updateNodesRequest(requestPassData);
+
+        // Errors are reported by the render of the active input below
+        if (RenderPlan::preRender(getNode(), inArgs.params->time, view, inArgs.params->mipMapLevel, requestPassData) == EffectInstance::eRenderRoIRetCodeAborted) {
+            return eViewerRenderRetCodeRedraw;
+        }
     }
 
     const double par = inArgs.activeInputToRender->getAspectRatio(-1);
@@ -1898,39 +1905,15 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                               *it);
             }
         } else {
-            bool runInCurrentThread = QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount();
-            if ( !runInCurrentThread && (splitRoi.size() > 1) ) {
-                runInCurrentThread = true;
-            }
+            const bool runInCurrentThread = splitRoi.size() > 1;
 
 
             ///if autoContrast is enabled, find out the vmin/vmax before rendering and mapping against new values
             if (inArgs.autoContrast && !inArgs.isDoingPartialUpdates) {
-                double vmin = std::numeric_limits<double>::infinity();
-                double vmax = -std::numeric_limits<double>::infinity();
-
-                if (runInCurrentThread) {
-                    MinMaxVal vMinMax = findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI);
-                    vmin = vMinMax.min;
-                    vmax = vMinMax.max;
-                } else {
-                    std::vector<RectI> splitRects = viewerRenderRoI.splitIntoSmallerRects( appPTR->getMaxThreadCount() );
-                    QFuture<MinMaxVal> future = QtConcurrent::mapped( splitRects,
-                                                                                       boost::bind(findAutoContrastVminVmax,
-                                                                                                   colorImage,
-                                                                                                   inArgs.channels,
-                                                                                                   _1) );
-                    future.waitForFinished();
-                    QList<MinMaxVal> results = future.results();
-                    Q_FOREACH (const MinMaxVal &vMinMax, results) {
-                        if (vMinMax.min < vmin) {
-                            vmin = vMinMax.min;
-                        }
-                        if (vMinMax.max > vmax) {
-                            vmax = vMinMax.max;
-                        }
-                    }
-                } // runInCurrentThread
+                // Image::computeStatistics() splits the rows across the threads of the TaskScheduler
+                MinMaxVal vMinMax = findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI);
+                double vmin = vMinMax.min;
+                double vmax = vMinMax.max;
 
                 if (vmax == vmin) {
                     vmin = vmax - 1.;
@@ -1967,12 +1950,12 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                 }
             } else {
                 QReadLocker k(&_imp->gammaLookupMutex);
-                QtConcurrent::map( unCachedTiles,
-                                   boost::bind(&renderFunctor,
-                                               viewerRenderRoI,
-                                               args,
-                                               this,
-                                               _1) ).waitForFinished();
+                TaskScheduler::blockingMap( unCachedTiles,
+                                            boost::bind(&renderFunctor,
+                                                        viewerRenderRoI,
+                                                        args,
+                                                        this,
+                                                        _1) );
             }
 
             if (inArgs.isDoingPartialUpdates) {
@@ -2045,104 +2028,30 @@ renderFunctor(const RectI& roi,
     }
 }
 
-inline
-MinMaxVal
-findAutoContrastVminVmax_generic(const ImagePtr inputImage,
-                                 int nComps,
-                                 DisplayChannelsEnum channels,
-                                 const RectI & rect)
-{
-    double localVmin = std::numeric_limits<double>::infinity();
-    double localVmax = -std::numeric_limits<double>::infinity();
-    Image::ReadAccess acc = inputImage->getReadRights();
-
-    for (int y = rect.bottom(); y < rect.top(); ++y) {
-        const float* src_pixels = (const float*)acc.pixelAt(rect.left(), y);
-        ///we fill the scan-line with all the pixels of the input image
-        for (int x = rect.left(); x < rect.right(); ++x) {
-            double r = 0.;
-            double g = 0.;
-            double b = 0.;
-            double a = 0.;
-            switch (nComps) {
-            case 4:
-                r = src_pixels[0];
-                g = src_pixels[1];
-                b = src_pixels[2];
-                a = src_pixels[3];
-                break;
-            case 3:
-                r = src_pixels[0];
-                g = src_pixels[1];
-                b = src_pixels[2];
-                a = 1.;
-                break;
-            case 2:
-                r = src_pixels[0];
-                g = src_pixels[1];
-                b = 0.;
-                a = 1.;
-                break;
-            case 1:
-                a = src_pixels[0];
-                r = g = b = 0.;
-                break;
-            default:
-                r = g = b = a = 0.;
-            }
-
-            double mini, maxi;
-            switch (channels) {
-            case eDisplayChannelsRGB:
-                mini = std::min(std::min(r, g), b);
-                maxi = std::max(std::max(r, g), b);
-                break;
-            case eDisplayChannelsY:
-                mini = 0.299 * r + 0.587 * g + 0.114 * b;
-                maxi = mini;
-                break;
-            case eDisplayChannelsR:
-                mini = r;
-                maxi = mini;
-                break;
-            case eDisplayChannelsG:
-                mini = g;
-                maxi = mini;
-                break;
-            case eDisplayChannelsB:
-                mini = b;
-                maxi = mini;
-                break;
-            case eDisplayChannelsA:
-                mini = a;
-                maxi = mini;
-                break;
-            default:
-                mini = 0.;
-                maxi = 0.;
-                break;
-            }
-            if (mini < localVmin) {
-                localVmin = mini;
-            }
-            if (maxi > localVmax) {
-                localVmax = maxi;
-            }
-
-            src_pixels += nComps;
+// The range of the component c of the RGBA pixels displayed for an image of stats.nComps components:
+// the components missing in the image are constant, see Image::convertToFormat()
+static MinMaxVal
+getDisplayedComponentRange(const ImageStatistics& stats,
+                           int c)
+{
+    switch (stats.nComps) {
+    case 1:
+        // alpha image
+        return (c == 3) ? MinMaxVal(stats.min[0], stats.max[0]) : MinMaxVal(0., 0.);
+    case 2:
+    case 3:
+        if (c >= stats.nComps) {
+            return (c == 3) ? MinMaxVal(1., 1.) : MinMaxVal(0., 0.);
         }
-    }
+        break;
+    case 4:
+        break;
+    default:
 
-    return MinMaxVal(localVmin, localVmax);
-} // findAutoContrastVminVmax_generic
+        return MinMaxVal(0., 0.);
+    }
 
-template <int nComps>
-MinMaxVal
-findAutoContrastVminVmax_internal(const ImagePtr inputImage,
-                                  DisplayChannelsEnum channels,
-                                  const RectI & rect)
-{
-    return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+    return MinMaxVal(stats.min[c], stats.max[c]);
 }
 
 MinMaxVal
@@ -2150,17 +2059,44 @@ findAutoContrastVminVmax(const ImagePtr inputImage,
                          DisplayChannelsEnum channels,
                          const RectI & rect)
 {
-    int nComps = inputImage->getComponents().getNumComponents();
+    ImageStatisticsRequest request;
+    request.luminance = (channels == eDisplayChannelsY);
+    ImageStatistics stats;
+    inputImage->computeStatistics(rect, request, &stats);
 
-    if (nComps == 4) {
-        return findAutoContrastVminVmax_internal<4>(inputImage, channels, rect);
-    } else if (nComps == 3) {
-        return findAutoContrastVminVmax_internal<3>(inputImage, channels, rect);
-    } else if (nComps == 1) {
-        return findAutoContrastVminVmax_internal<1>(inputImage, channels, rect);
-    } else {
-        return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+    MinMaxVal ret( std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() );
+    if (stats.pixelsCount == 0) {
+        return ret;
+    }
+    switch (channels) {
+    case eDisplayChannelsRGB:
+        for (int c = 0; c < 3; ++c) {
+            MinMaxVal range = getDisplayedComponentRange(stats, c);
+            ret.min = std::min(ret.min, range.min);
+            ret.max = std::max(ret.max, range.max);
+        }
+        break;
+    case eDisplayChannelsY:
+        ret = MinMaxVal(stats.luminanceMin, stats.luminanceMax);
+        break;
+    case eDisplayChannelsR:
+        ret = getDisplayedComponentRange(stats, 0);
+        break;
+    case eDisplayChannelsG:
+        ret = getDisplayedComponentRange(stats, 1);
+        break;
+    case eDisplayChannelsB:
+        ret = getDisplayedComponentRange(stats, 2);
+        break;
+    case eDisplayChannelsA:
+        ret = getDisplayedComponentRange(stats, 3);
+        break;
+    default:
+        ret = MinMaxVal(0., 0.);
+        break;
     }
+
+    return ret;
 } // findAutoContrastVminVmax
 
 template <typename PIX, int maxValue, bool opaque, bool applyMatte, int rOffset, int gOffset, int bOffset>
@@ -110,6 +110,9 @@ typedef OfxRangeD RangeD;
 #define NATRON_CACHE_VERSION 4
 #define kNatronCacheVersionSettingsKey "NatronCacheVersionSettingsKey"
 
+//Maximum number of independently locked shards the hash space of a cache can be partitioned into
+#define NATRON_CACHE_MAX_SHARDS 64
+
 
 #define kNodeGraphObjectName "nodeGraph"
 #define kCurveEditorObjectName "curveEditor"
@@ -266,6 +266,8 @@ NATRON_VERSION_STRINGIZE__(major, minor)
 
 #define NATRON_PLUGIN_PATH_ENV_VAR "NATRON_PLUGIN_PATH"
 #define NATRON_DISK_CACHE_PATH_ENV_VAR "NATRON_DISK_CACHE_PATH"
+// When set, the render plan of each frame is written as JSON and DOT files in this directory, see RenderPlan
+#define NATRON_RENDER_PLAN_DUMP_PATH_ENV_VAR "NATRON_RENDER_PLAN_DUMP_PATH"
 #define NATRON_IMAGES_PATH ":/Resources/Images/"
 #define NATRON_APPLICATION_ICON_PATH NATRON_IMAGES_PATH "natronIcon256_linux.png"
 #define NATRON_PYPLUG_MAGIC "# Natron PyPlug"
@@ -33,6 +33,7 @@
 #ifdef __NATRON_UNIX__
 #include <unistd.h>
 #include <sys/stat.h>
+#include <signal.h> // kill
 #include <cerrno>
 #include <cstdlib> // malloc
 #include <string.h> // strdup
@@ -579,6 +580,29 @@ ProcInfo::getCurrentProcessPID()
 #endif
 }
 
+bool
+ProcInfo::isProcessAlive(long long pid)
+{
+    if (pid <= 0) {
+        return false;
+    }
+#if defined(__NATRON_WIN32__)
+    HANDLE processHandle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (!processHandle) {
+        // The process exists but we may not query it
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    DWORD dwExitCode = 0;
+    bool caughtExitCode = GetExitCodeProcess(processHandle, &dwExitCode);
+    CloseHandle(processHandle);
+
+    return !caughtExitCode || (dwExitCode == STILL_ACTIVE);
+#else
+    // Signal 0 only checks that the process exists
+    return (kill( (pid_t)pid, 0 ) == 0) || (errno == EPERM);
+#endif
+}
+
 bool
 ProcInfo::checkIfProcessIsRunning(const char* processAbsoluteFilePath,
                                   long long pid)
@@ -63,6 +63,12 @@ std::string applicationDirPath(const char* argv0Param);
  **/
 bool checkIfProcessIsRunning(const char* processAbsoluteFilePath, long long pid);
 
+/**
+ * @brief Returns true if a process with the given pid exists, whatever its executable and whether it is
+ * running or sleeping. Processes owned by other users are reported as alive.
+ **/
+bool isProcessAlive(long long pid);
+
 /*
  This function sets the value of the environment variable named
  varName. It will create the variable if it does not exist. It
@@ -30,6 +30,7 @@
 #include <climits>
 #endif
 
+#include <cstdio> // snprintf
 #include <vector>
 #include <algorithm>
 
@@ -423,6 +424,28 @@ namespace StrUtils {
         return ret;
     }
 
+    std::string toJSONString(const std::string &str)
+    {
+        std::string ret;
+        ret.reserve(str.size() + 2);
+        ret += '"';
+        for (std::size_t i = 0; i < str.size(); ++i) {
+            unsigned char c = (unsigned char)str[i];
+            if ( (c == '"') || (c == '\\') ) {
+                ret += '\\';
+                ret += (char)c;
+            } else if (c < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int)c);
+                ret += buf;
+            } else {
+                ret += (char)c;
+            }
+        }
+        ret += '"';
+        return ret;
+    }
+
 } // StrUtils
 
 NATRON_NAMESPACE_EXIT
@@ -85,6 +85,12 @@ std::vector<std::string> split(const std::string &text, char sep);
 
 std::string join(const std::vector<std::string> &text, char sep);
 
+/*
+ Returns \a str between double quotes, with the quotes, backslashes and
+ control characters escaped, as a string value of a JSON document.
+ */
+std::string toJSONString(const std::string &str);
+
 } // namespace StrUtils
 
 NATRON_NAMESPACE_EXIT
@@ -61,6 +61,12 @@ Gui.depends = Engine qhttpserver
 Tests.depends = Gui Engine
 App.depends = Gui Engine
 
+# the microbenchmarks are only built on demand, with CONFIG+=benchmarks
+CONFIG(benchmarks) {
+    SUBDIRS += Benchmarks
+    Benchmarks.depends = Gui Engine
+}
+
 OTHER_FILES += \
     Global/Enums.h \
     Global/GLIncludes.h \
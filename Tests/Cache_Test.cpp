@@ -0,0 +1,831 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+#include "Global/QtCompat.h" // for removeRecursively
+
+#include "Engine/Cache.h"
+#include "Engine/CacheCompression.h"
+#include "Engine/CacheEntryHolder.h"
+#include "Engine/CacheHolderStats.h"
+#include "Engine/CacheIndexFile.h"
+#include "Engine/CacheWriteBehindQueue.h"
+#include "Engine/Image.h"
+#include "Engine/ImageKey.h"
+#include "Engine/SharedImageCache.h"
+#include "Engine/TileCacheFile.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+typedef Cache<Image> ImageCache;
+} // anon namespace
+
+TEST(CacheTest, ShardedGetOrCreateFindsCreatedEntries)
+{
+    ImageCache cache("CacheTestCache", NATRON_CACHE_VERSION, 1024ULL * 1024ULL * 1024ULL, 1., 8);
+
+    EXPECT_EQ( (std::size_t)8, cache.getShardsCount() );
+
+    RectD rod(0, 0, 16, 16);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    std::vector<ImagePtr> created;
+    for (int i = 0; i < 256; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        EXPECT_FALSE( cache.getOrCreate(key, params, 0, &image) );
+        ASSERT_TRUE(image);
+        created.push_back(image);
+    }
+    for (int i = 0; i < 256; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        EXPECT_TRUE( cache.getOrCreate(key, params, 0, &image) );
+        EXPECT_EQ(created[i], image);
+    }
+    std::list<ImagePtr> copy;
+    cache.getCopy(&copy);
+    EXPECT_EQ( (std::size_t)256, copy.size() );
+    cache.waitForDeleterThread();
+}
+
+TEST(CacheTest, TileBitmapAllocatesEveryTileOnce)
+{
+    // Not a multiple of 64 and more than 64*64 tiles so that 3 levels are used
+    const std::size_t nTiles = 64 * 64 + 100;
+    TileBitmap bitmap;
+
+    bitmap.init(nTiles);
+    EXPECT_EQ(nTiles, bitmap.getNumFreeTiles());
+
+    std::vector<bool> allocated(nTiles, false);
+    for (std::size_t i = 0; i < nTiles; ++i) {
+        int index = bitmap.allocTile();
+        ASSERT_TRUE(index >= 0 && index < (int)nTiles);
+        EXPECT_FALSE(allocated[index]);
+        allocated[index] = true;
+    }
+    EXPECT_EQ(-1, bitmap.allocTile());
+    EXPECT_EQ( (std::size_t)0, bitmap.getNumFreeTiles() );
+
+    // Freed tiles are handed out again
+    EXPECT_TRUE( bitmap.freeTile(4000) );
+    EXPECT_FALSE( bitmap.freeTile(4000) );
+    EXPECT_TRUE( bitmap.freeTile(17) );
+    EXPECT_EQ(17, bitmap.allocTile());
+    EXPECT_EQ(4000, bitmap.allocTile());
+    EXPECT_EQ(-1, bitmap.allocTile());
+
+    // Tiles restored from disk are marked used explicitly
+    bitmap.init(nTiles);
+    EXPECT_TRUE( bitmap.markTileUsed(0) );
+    EXPECT_FALSE( bitmap.markTileUsed(0) );
+    EXPECT_TRUE( bitmap.isTileUsed(0) );
+    EXPECT_EQ(1, bitmap.allocTile());
+}
+
+TEST(CacheTest, CompressionRoundTrip)
+{
+    // A float gradient, which is typical of what the node cache holds
+    const int nFloats = 64 * 64 * 4;
+    std::vector<float> src(nFloats);
+
+    for (int i = 0; i < nFloats; ++i) {
+        src[i] = (float)(i / 4) / nFloats;
+    }
+    const unsigned char* srcBytes = (const unsigned char*)&src[0];
+    std::size_t nBytes = nFloats * sizeof(float);
+
+    // Sizes that are not a multiple of the element size keep their trailing bytes
+    std::vector<unsigned char> shuffled(nBytes), unshuffled(nBytes);
+    CacheCompression::shuffleBytes(srcBytes, nBytes - 3, sizeof(float), &shuffled[0]);
+    CacheCompression::unshuffleBytes(&shuffled[0], nBytes - 3, sizeof(float), &unshuffled[0]);
+    EXPECT_TRUE( std::equal(srcBytes, srcBytes + nBytes - 3, unshuffled.begin()) );
+
+    QByteArray compressed;
+    ASSERT_TRUE( CacheCompression::compress(srcBytes, nBytes, sizeof(float), &compressed) );
+    EXPECT_LT( (std::size_t)compressed.size(), nBytes );
+
+    std::vector<float> dst(nFloats);
+    ASSERT_TRUE( CacheCompression::uncompress(compressed, sizeof(float), (unsigned char*)&dst[0], nBytes) );
+    EXPECT_TRUE(src == dst);
+
+    // The size must match
+    EXPECT_FALSE( CacheCompression::uncompress(compressed, sizeof(float), (unsigned char*)&dst[0], nBytes - 4) );
+}
+
+TEST(CacheTest, CompressedTierKeepsEvictedImages)
+{
+    const int nImages = 32;
+    RectD rod(0, 0, 64, 64);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    // Each image takes 64KiB, only a few fit in the in-memory portion, but they all fit in the compressed portion
+    ImageCache cache("CacheTestCache", NATRON_CACHE_VERSION, 1024ULL * 1024ULL, 0.25, 1);
+
+    cache.setMaximumCompressedSize(1024ULL * 1024ULL);
+
+    for (int i = 0; i < nImages; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(key, params, 0, &image) );
+        image->allocateMemory();
+        Image::WriteAccess acc = image->getWriteRights();
+        float* pix = (float*)acc.pixelAt(0, 0);
+        ASSERT_TRUE(pix);
+        for (int p = 0; p < 64 * 64 * 4; ++p) {
+            pix[p] = (float)(i + p / 4) / (64 * 64);
+        }
+    }
+
+    CacheStats stats;
+    cache.getStats(&stats);
+    EXPECT_GT(stats.compressedSize, (std::size_t)0);
+    EXPECT_GT(stats.getCompressionRatio(), 1.);
+    EXPECT_LE( cache.getCompressedCacheSize(), cache.getMaximumCompressedSize() );
+
+    // The first image was evicted first: it is found compressed and uncompressed transparently
+    {
+        ImageKey key(0, (U64)0, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        ASSERT_TRUE( cache.getOrCreate(key, params, 0, &image) );
+        EXPECT_FALSE( image->isCompressed() );
+        Image::ReadAccess acc = image->getReadRights();
+        const float* pix = (const float*)acc.pixelAt(0, 0);
+        ASSERT_TRUE(pix);
+        for (int p = 0; p < 64 * 64 * 4; ++p) {
+            ASSERT_EQ( (float)(p / 4) / (64 * 64), pix[p] );
+        }
+    }
+    cache.getStats(&stats);
+    EXPECT_EQ( (U64)1, stats.hits[eCacheTierCompressed] );
+    cache.waitForDeleterThread();
+}
+
+// Compressed entries are uncompressed without the shard lock: concurrent lookups of the same key wait for the
+// lookup uncompressing it and get the same image from the in-memory portion
+TEST(CacheTest, CompressedEntryIsUncompressedOnce)
+{
+    const int nImages = 32;
+    const int nThreads = 4;
+    RectD rod(0, 0, 64, 64);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    ImageCache cache("CacheTestCache", NATRON_CACHE_VERSION, 1024ULL * 1024ULL, 0.25, 1);
+
+    cache.setMaximumCompressedSize(1024ULL * 1024ULL);
+    for (int i = 0; i < nImages; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(key, params, 0, &image) );
+        image->allocateMemory();
+    }
+
+    std::vector<ImagePtr> found(nThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) {
+        threads.push_back( std::thread([&cache, &params, &found, t]() {
+            ImageKey key(0, (U64)0, false, 0, ViewIdx(0), 1., false, false);
+            cache.getOrCreate(key, params, 0, &found[t]);
+        }) );
+    }
+    for (int t = 0; t < nThreads; ++t) {
+        threads[t].join();
+    }
+
+    for (int t = 0; t < nThreads; ++t) {
+        ASSERT_TRUE(found[t]);
+        EXPECT_FALSE( found[t]->isCompressed() );
+        EXPECT_EQ(found[0], found[t]);
+    }
+    CacheStats stats;
+    cache.getStats(&stats);
+    EXPECT_EQ( (U64)1, stats.hits[eCacheTierCompressed] );
+    EXPECT_EQ( (U64)nThreads - 1, stats.hits[eCacheTierMemory] );
+    cache.waitForDeleterThread();
+}
+
+namespace {
+
+class TestCacheHolder
+    : public CacheEntryHolder
+{
+public:
+
+    TestCacheHolder(const std::string& id)
+        : CacheEntryHolder()
+        , _id(id)
+    {
+    }
+
+    virtual std::string getCacheID() const OVERRIDE FINAL
+    {
+        return _id;
+    }
+
+private:
+
+    std::string _id;
+};
+} // anon namespace
+
+TEST(CacheTest, HolderStatsCountHitsMissesAndEvictions)
+{
+    RectD rod(0, 0, 64, 64);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    // Each image takes 64KiB and only 4 fit in the in-memory portion
+    ImageCache cache("CacheTestCache", NATRON_CACHE_VERSION, 1024ULL * 1024ULL, 0.25, 1);
+    TestCacheHolder first("first");
+    TestCacheHolder second("second");
+
+    for (int i = 0; i < 8; ++i) {
+        ImageKey key(i % 2 ? &second : &first, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(key, params, 0, &image) );
+        image->allocateMemory();
+    }
+    {
+        ImageKey key(&second, (U64)7, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        ASSERT_TRUE( cache.getOrCreate(key, params, 0, &image) );
+    }
+
+    CacheHolderStatsMap stats;
+    cache.getHolderStats(&stats);
+    ASSERT_EQ( (std::size_t)2, stats.size() );
+    const CacheHolderStats& firstStats = stats["first"];
+    const CacheHolderStats& secondStats = stats["second"];
+    EXPECT_EQ( (U64)4, firstStats.misses );
+    EXPECT_EQ( (U64)0, firstStats.hits );
+    EXPECT_EQ( (U64)4, secondStats.misses );
+    EXPECT_EQ( (U64)1, secondStats.hits );
+
+    // Every image that is not resident in memory any longer was evicted
+    U64 nEvicted = firstStats.evictions[eCacheEvictionReasonMemoryFull] + secondStats.evictions[eCacheEvictionReasonMemoryFull];
+    std::size_t nResident = firstStats.residentEntries[eCacheTierMemory] + secondStats.residentEntries[eCacheTierMemory];
+    EXPECT_GT( nEvicted, (U64)0 );
+    EXPECT_EQ( (U64)8, nEvicted + nResident );
+    EXPECT_GT( secondStats.residentSize[eCacheTierMemory], (std::size_t)0 );
+
+    // The last image is resident in memory, removing it is counted as such
+    ImageKey key(&second, (U64)7, false, 0, ViewIdx(0), 1., false, false);
+    cache.removeEntry( key.getHash() );
+    stats.clear();
+    cache.getHolderStats(&stats);
+    EXPECT_EQ( (U64)1, stats["second"].evictions[eCacheEvictionReasonRemoved] );
+
+    cache.resetStats();
+    stats.clear();
+    cache.getHolderStats(&stats);
+    EXPECT_EQ( (U64)0, stats["second"].hits );
+    EXPECT_EQ( (U64)0, stats["second"].evictions[eCacheEvictionReasonRemoved] );
+    cache.waitForDeleterThread();
+}
+
+namespace {
+
+/**
+ * @brief Stands for an image in the eviction replay: only what the eviction policies look at.
+ **/
+class FakeCacheEntry
+{
+public:
+
+    FakeCacheEntry(std::size_t size,
+                   double cost)
+        : _size(size)
+        , _cost(cost)
+        , _accessCount(0)
+        , _inflation(0.)
+    {
+    }
+
+    std::size_t getSizeInBytesFromParams() const { return _size; }
+
+    double getRenderCost() const { return _cost; }
+
+    void registerCacheAccess(double inflation)
+    {
+        ++_accessCount;
+        _inflation = inflation;
+    }
+
+    U64 getCacheAccessCount() const { return _accessCount; }
+
+    double getCacheInflation() const { return _inflation; }
+
+private:
+
+    std::size_t _size;
+    double _cost;
+    U64 _accessCount;
+    double _inflation;
+};
+
+typedef boost::shared_ptr<FakeCacheEntry> FakeCacheEntryPtr;
+
+struct ReplayResult
+{
+    int hits;
+    double recomputeTime;
+};
+
+/**
+ * @brief Replays a trace of accesses to a cache of the given capacity, like Cache::getOrCreate() does:
+ * on a miss the entry is "rendered" again and inserted, then entries are evicted until the cache fits.
+ **/
+ReplayResult
+replayTrace(const std::vector<int>& trace,
+            const std::vector<std::size_t>& sizes,
+            const std::vector<double>& costs,
+            std::size_t capacity,
+            CacheEvictionPolicyEnum policy)
+{
+    BoostLRUHashTable<U64, FakeCacheEntryPtr> table;
+    CacheCostAwarePriority<FakeCacheEntryPtr> priority;
+    double inflation = 0.;
+    std::size_t usedSize = 0;
+    ReplayResult result = {0, 0.};
+
+    for (std::size_t i = 0; i < trace.size(); ++i) {
+        int k = trace[i];
+        BoostLRUHashTable<U64, FakeCacheEntryPtr>::container_type::left_iterator found = table( (U64)k );
+        if ( found != table.end() ) {
+            ++result.hits;
+            found->second.front()->registerCacheAccess(inflation);
+            continue;
+        }
+        result.recomputeTime += costs[k];
+        {
+            FakeCacheEntryPtr entry = boost::make_shared<FakeCacheEntry>(sizes[k], costs[k]);
+            entry->registerCacheAccess(inflation);
+            table.insert( (U64)k, entry );
+        }
+        usedSize += sizes[k];
+        while (usedSize > capacity) {
+            std::pair<U64, FakeCacheEntryPtr> evicted;
+            if (policy == eCacheEvictionPolicyLRU) {
+                evicted = table.evict();
+            } else {
+                evicted = table.evictLowestPriority(priority, NATRON_CACHE_EVICTION_SAMPLES);
+                if (evicted.second) {
+                    inflation = std::max( inflation, priority(evicted.second) );
+                }
+            }
+            if (!evicted.second) {
+                break;
+            }
+            usedSize -= evicted.second->getSizeInBytesFromParams();
+        }
+    }
+
+    return result;
+}
+} // anon namespace
+
+TEST(CacheTest, CostAwareEvictionReplay)
+{
+    // A deterministic trace over images with a skewed popularity, whose render times are unrelated to their size,
+    // like a comp where a few heavy nodes (defocus, motion blur...) are mixed with cheap ones
+    const int nKeys = 2000;
+    const int nAccesses = 200000;
+    std::vector<std::size_t> sizes(nKeys);
+    std::vector<double> costs(nKeys);
+    std::size_t totalSize = 0;
+    U64 seed = 1;
+
+    for (int k = 0; k < nKeys; ++k) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        sizes[k] = (std::size_t)( 1 + (seed >> 33) % 16 ) * 1024 * 1024;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        // 10% of the images are expensive
+        costs[k] = ( (seed >> 33) % 10 == 0 ) ? 1. + ( (seed >> 40) % 300 ) / 100. : 0.01 + ( (seed >> 40) % 10 ) / 100.;
+        totalSize += sizes[k];
+    }
+    std::vector<int> trace(nAccesses);
+    for (int i = 0; i < nAccesses; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        // Zipf-like: the square of a uniform variable favors the low keys
+        double u = ( (seed >> 11) & ( (1ULL << 53) - 1 ) ) / (double)(1ULL << 53);
+        trace[i] = std::min(nKeys - 1, (int)(u * u * nKeys) );
+    }
+
+    std::size_t capacity = totalSize / 5;
+    ReplayResult lru = replayTrace(trace, sizes, costs, capacity, eCacheEvictionPolicyLRU);
+    ReplayResult costAware = replayTrace(trace, sizes, costs, capacity, eCacheEvictionPolicyCostAware);
+
+    EXPECT_LT(costAware.recomputeTime, lru.recomputeTime);
+}
+
+namespace {
+
+/**
+ * @brief Stands for an entry evicted to disk: writing it takes some time, like msync does.
+ **/
+class FakeWriteBehindEntry
+{
+public:
+
+    FakeWriteBehindEntry(int index)
+        : _path("file" + std::to_string(index % 4))
+        , _offset(index)
+        , _nWrites(0)
+    {
+    }
+
+    const std::string& getFilePath() const { return _path; }
+
+    std::size_t getOffsetInFile() const { return _offset; }
+
+    std::size_t writeBehind()
+    {
+        QThread::usleep(500);
+        ++_nWrites;
+
+        return 1024;
+    }
+
+    int getWritesCount() const { return _nWrites; }
+
+private:
+
+    std::string _path;
+    std::size_t _offset;
+    std::atomic<int> _nWrites;
+};
+} // anon namespace
+
+TEST(CacheTest, WriteBehindQueueWritesEveryEntry)
+{
+    const int nEntries = 48;
+    std::vector<boost::shared_ptr<FakeWriteBehindEntry> > entries;
+    CacheWriteBehindQueue<FakeWriteBehindEntry> queue;
+
+    for (int i = 0; i < nEntries; ++i) {
+        entries.push_back( boost::make_shared<FakeWriteBehindEntry>(i) );
+        // The queue is not full, appending does not wait for anything to be written
+        ASSERT_TRUE( queue.appendToQueue( entries.back() ) );
+    }
+    queue.waitForPendingWrites();
+
+    CacheWriteBehindStats stats;
+    queue.getStats(&stats);
+    EXPECT_EQ( (std::size_t)0, stats.queueDepth );
+    EXPECT_EQ( (U64)nEntries, stats.writtenEntries );
+    EXPECT_EQ( (U64)nEntries * 1024, stats.writtenBytes );
+    EXPECT_GT(stats.getThroughput(), 0.);
+    for (int i = 0; i < nEntries; ++i) {
+        EXPECT_EQ( 1, entries[i]->getWritesCount() );
+    }
+    queue.quitThreads();
+}
+
+namespace {
+
+/**
+ * @brief Stands for an evicted image: counts how many were destroyed.
+ **/
+class FakeDeletedEntry
+{
+public:
+
+    FakeDeletedEntry(std::atomic<int>* nDestroyed)
+        : _nDestroyed(nDestroyed)
+    {
+    }
+
+    ~FakeDeletedEntry()
+    {
+        ++(*_nDestroyed);
+    }
+
+    std::size_t size() const { return 1024 * 1024; }
+
+    bool isStoredOnDisk() const { return false; }
+
+    void scheduleForDestruction() {}
+
+private:
+
+    std::atomic<int>* _nDestroyed;
+};
+} // anon namespace
+
+TEST(CacheTest, DeleterThreadPoolFreesEveryEntry)
+{
+    const int nEntries = 1000;
+    std::atomic<int> nDestroyed(0);
+    ImageCache cache("CacheTestCache", NATRON_CACHE_VERSION, 1024ULL * 1024ULL, 1., 1);
+    DeleterThreadPool<FakeDeletedEntry> deleter(&cache);
+    {
+        std::list<boost::shared_ptr<FakeDeletedEntry> > entries;
+        for (int i = 0; i < nEntries; ++i) {
+            entries.push_back( boost::make_shared<FakeDeletedEntry>(&nDestroyed) );
+        }
+        deleter.appendToQueue(entries);
+        // The memory is accounted as being freed until the threads free it
+        EXPECT_LE( deleter.getBeingFreedSize(), (std::size_t)nEntries * 1024 * 1024 );
+    }
+    deleter.quitThread();
+    EXPECT_EQ(nEntries, nDestroyed);
+    EXPECT_FALSE( deleter.isWorking() );
+
+    CacheDeleterStats stats;
+    deleter.getStats(&stats);
+    EXPECT_EQ( (std::size_t)0, stats.beingFreedSize );
+    EXPECT_EQ( (U64)nEntries * 1024 * 1024, stats.reclaimedBytes );
+    EXPECT_GE( stats.maxReclaimTime, stats.getAverageReclaimTime() );
+    cache.waitForDeleterThread();
+}
+
+TEST(CacheTest, CacheIndexFileSurvivesReopeningAndCompaction)
+{
+    std::string indexPath = ( QDir::tempPath() + QString::fromUtf8("/NatronCacheTestIndex." NATRON_CACHE_FILE_EXT) ).toStdString();
+    const int nEntries = 600;
+    // Big enough for the removed records to trigger a compaction
+    const std::string payload(4096, 'k');
+
+    QFile::remove( QString::fromUtf8( indexPath.c_str() ) );
+    {
+        CacheIndexFile index(indexPath, NATRON_CACHE_VERSION);
+        EXPECT_FALSE( index.wasReset() );
+        for (int i = 0; i < nEntries; ++i) {
+            CacheIndexFile::Record r;
+            r.hash = (U64)i;
+            r.dataSize = 1000;
+            r.filePath = "/cache/" + std::to_string(i);
+            r.payload = payload + std::to_string(i);
+            index.recordAdd(r);
+            // Adding twice the same entry does nothing
+            index.recordAdd(r);
+        }
+        for (int i = 1; i < nEntries; i += 2) {
+            index.recordRemove( (U64)i, "/cache/" + std::to_string(i), 0 );
+        }
+        EXPECT_EQ( (std::size_t)nEntries / 2, index.getRecordsCount() );
+        // Entries recorded while the cache runs are already created
+        EXPECT_EQ( (U64)0, index.getUnloadedDataSize() );
+    }
+    {
+        // No entry is created when the index is opened, they are only counted
+        CacheIndexFile index(indexPath, NATRON_CACHE_VERSION);
+        EXPECT_EQ( (std::size_t)nEntries / 2, index.getRecordsCount() );
+        EXPECT_EQ( (U64)nEntries / 2 * 1000, index.getUnloadedDataSize() );
+
+        std::list<CacheIndexFile::Record> records;
+        index.takeUnloadedRecords(1, &records);
+        EXPECT_TRUE( records.empty() );
+        index.takeUnloadedRecords(2, &records);
+        ASSERT_EQ( (std::size_t)1, records.size() );
+        EXPECT_EQ( "/cache/2", records.front().filePath );
+        EXPECT_EQ( payload + "2", records.front().payload );
+        records.clear();
+        index.takeUnloadedRecords(2, &records);
+        EXPECT_TRUE( records.empty() );
+
+        CacheIndexFile::Record oldest;
+        ASSERT_TRUE( index.removeOldestUnloadedRecord(&oldest) );
+        EXPECT_EQ( (U64)0, oldest.hash );
+
+        ASSERT_TRUE( index.needsCompaction() );
+        index.compact();
+        EXPECT_FALSE( index.needsCompaction() );
+        EXPECT_EQ( (std::size_t)nEntries / 2 - 1, index.getRecordsCount() );
+        index.takeUnloadedRecords(4, &records);
+        ASSERT_EQ( (std::size_t)1, records.size() );
+        EXPECT_EQ( payload + "4", records.front().payload );
+    }
+    {
+        CacheIndexFile index(indexPath, NATRON_CACHE_VERSION);
+        EXPECT_EQ( (std::size_t)nEntries / 2 - 1, index.getRecordsCount() );
+        std::list<CacheIndexFile::Record> records;
+        index.takeUnloadedRecords(nEntries - 2, &records);
+        ASSERT_EQ( (std::size_t)1, records.size() );
+        EXPECT_EQ( payload + std::to_string(nEntries - 2), records.front().payload );
+    }
+    {
+        // Another version of the cache cannot use the index
+        CacheIndexFile index(indexPath, NATRON_CACHE_VERSION + 1);
+        EXPECT_TRUE( index.wasReset() );
+        EXPECT_EQ( (std::size_t)0, index.getRecordsCount() );
+    }
+    QFile::remove( QString::fromUtf8( indexPath.c_str() ) );
+}
+
+// Only the headers and the file paths of the records are checked when the index is opened, a corrupted payload
+// is detected when its entry is looked up
+TEST(CacheTest, CacheIndexFileChecksPayloadsWhenLookedUp)
+{
+    std::string indexPath = ( QDir::tempPath() + QString::fromUtf8("/NatronCacheTestPayloadIndex." NATRON_CACHE_FILE_EXT) ).toStdString();
+
+    QFile::remove( QString::fromUtf8( indexPath.c_str() ) );
+    {
+        CacheIndexFile index(indexPath, NATRON_CACHE_VERSION);
+        for (int i = 0; i < 2; ++i) {
+            CacheIndexFile::Record r;
+            r.hash = (U64)i;
+            r.dataSize = 1000;
+            r.filePath = "/cache/" + std::to_string(i);
+            r.payload = "payload" + std::to_string(i);
+            index.recordAdd(r);
+        }
+    }
+    {
+        QFile file( QString::fromUtf8( indexPath.c_str() ) );
+        ASSERT_TRUE( file.open(QIODevice::ReadWrite) );
+        int pos = file.readAll().indexOf("payload1");
+        ASSERT_GE(pos, 0);
+        ASSERT_TRUE( file.seek(pos) );
+        file.write("P", 1);
+    }
+    {
+        CacheIndexFile index(indexPath, NATRON_CACHE_VERSION);
+        EXPECT_FALSE( index.wasReset() );
+        EXPECT_EQ( (std::size_t)2, index.getRecordsCount() );
+
+        std::list<CacheIndexFile::Record> records;
+        index.takeUnloadedRecords(0, &records);
+        ASSERT_EQ( (std::size_t)1, records.size() );
+        EXPECT_EQ( "payload0", records.front().payload );
+        records.clear();
+        index.takeUnloadedRecords(1, &records);
+        ASSERT_EQ( (std::size_t)1, records.size() );
+        EXPECT_EQ( "/cache/1", records.front().filePath );
+        EXPECT_TRUE( records.front().payload.empty() );
+    }
+    QFile::remove( QString::fromUtf8( indexPath.c_str() ) );
+}
+
+namespace {
+
+void
+removeDirectory(const std::string& path)
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    QtCompat::removeRecursively( QString::fromUtf8( path.c_str() ) );
+#else
+    QDir( QString::fromUtf8( path.c_str() ) ).removeRecursively();
+#endif
+}
+
+} // anon namespace
+
+TEST(CacheTest, SharedImageCacheSharesImagesBetweenCaches)
+{
+    std::string directoryPath = ( QDir::tempPath() + QString::fromUtf8("/NatronCacheTestSharedImages") ).toStdString();
+    removeDirectory(directoryPath);
+
+    RectD rod(0, 0, 64, 64);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const std::size_t imageSize = 64 * 64 * 4 * sizeof(float);
+
+    // Each shared cache stands for a process with its own node cache
+    ImageCache producerCache("CacheTestProducer", NATRON_CACHE_VERSION, 16ULL * 1024ULL * 1024ULL, 1., 1);
+    ImageCache consumerCache("CacheTestConsumer", NATRON_CACHE_VERSION, 16ULL * 1024ULL * 1024ULL, 1., 1);
+    SharedImageCache producer(directoryPath, 4 * imageSize);
+    SharedImageCache consumer(directoryPath, 4 * imageSize);
+
+    const int nImages = 8;
+    for (int i = 0; i < nImages; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        ASSERT_FALSE( producerCache.getOrCreate(key, params, 0, &image) );
+        image->allocateMemory();
+        {
+            Image::WriteAccess acc = image->getWriteRights();
+            float* pix = (float*)acc.pixelAt(0, 0);
+            ASSERT_TRUE(pix);
+            for (int p = 0; p < 64 * 64 * 4; ++p) {
+                pix[p] = (float)(i * 7 + p);
+            }
+        }
+        image->markForRendered( image->getBounds() );
+        EXPECT_TRUE( producer.publish(image) );
+        // Publishing twice the same image does nothing
+        EXPECT_FALSE( producer.publish(image) );
+    }
+
+    // Only the last images fit in the budget
+    SharedImageCacheStats stats = consumer.getStats();
+    EXPECT_LE(stats.sharedSize, consumer.getMaximumSize() + imageSize);
+    EXPECT_LT(stats.sharedEntries, (std::size_t)nImages);
+
+    {
+        ImageKey key(0, (U64)0, false, 0, ViewIdx(0), 1., false, false);
+        std::list<ImagePtr> images;
+        EXPECT_FALSE( consumer.get(key, &consumerCache, &images) );
+    }
+    {
+        ImageKey key(0, (U64)(nImages - 1), false, 0, ViewIdx(0), 1., false, false);
+        std::list<ImagePtr> images;
+        ASSERT_TRUE( consumer.get(key, &consumerCache, &images) );
+        ASSERT_EQ( (std::size_t)1, images.size() );
+        Image::ReadAccess acc = images.front()->getReadRights();
+        const float* pix = (const float*)acc.pixelAt(0, 0);
+        ASSERT_TRUE(pix);
+        for (int p = 0; p < 64 * 64 * 4; ++p) {
+            ASSERT_EQ( (float)( (nImages - 1) * 7 + p ), pix[p] );
+        }
+
+        // The image is now in the node cache of the consumer
+        std::list<ImagePtr> cached;
+        EXPECT_TRUE( consumerCache.get(key, &cached) );
+    }
+    EXPECT_EQ( (U64)1, consumer.getStats().hits );
+
+    producer.clear();
+    EXPECT_EQ( (std::size_t)0, consumer.getStats().sharedEntries );
+    producerCache.waitForDeleterThread();
+    consumerCache.waitForDeleterThread();
+    removeDirectory(directoryPath);
+}
+
+TEST(CacheTest, SharedImageCachePublishesInBackground)
+{
+    std::string directoryPath = ( QDir::tempPath() + QString::fromUtf8("/NatronCacheTestSharedImagesBackground") ).toStdString();
+    removeDirectory(directoryPath);
+
+    RectD rod(0, 0, 32, 32);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    ImageCache producerCache("CacheTestProducer", NATRON_CACHE_VERSION, 16ULL * 1024ULL * 1024ULL, 1., 1);
+    ImageCache consumerCache("CacheTestConsumer", NATRON_CACHE_VERSION, 16ULL * 1024ULL * 1024ULL, 1., 1);
+    SharedImageCache producer(directoryPath, 16ULL * 1024ULL * 1024ULL);
+    SharedImageCache consumer(directoryPath, 16ULL * 1024ULL * 1024ULL);
+
+    ImageKey key(0, (U64)1, false, 0, ViewIdx(0), 1., false, false);
+    {
+        ImagePtr image;
+        ASSERT_FALSE( producerCache.getOrCreate(key, params, 0, &image) );
+        image->allocateMemory();
+        {
+            Image::WriteAccess acc = image->getWriteRights();
+            float* pix = (float*)acc.pixelAt(0, 0);
+            ASSERT_TRUE(pix);
+            for (int p = 0; p < 32 * 32 * 4; ++p) {
+                pix[p] = (float)p;
+            }
+        }
+        image->markForRendered( image->getBounds() );
+        producer.publishInBackground(image);
+    }
+    producer.waitForPendingPublications();
+    EXPECT_EQ( (U64)1, producer.getStats().publishedEntries );
+
+    std::list<ImagePtr> images;
+    ASSERT_TRUE( consumer.get(key, &consumerCache, &images) );
+    ASSERT_EQ( (std::size_t)1, images.size() );
+    Image::ReadAccess acc = images.front()->getReadRights();
+    const float* pix = (const float*)acc.pixelAt(0, 0);
+    ASSERT_TRUE(pix);
+    EXPECT_EQ( (float)(32 * 32 * 4 - 1), pix[32 * 32 * 4 - 1] );
+
+    images.clear();
+    producer.clear();
+    EXPECT_EQ( (std::size_t)0, consumer.getStats().sharedEntries );
+    producerCache.waitForDeleterThread();
+    consumerCache.waitForDeleterThread();
+    removeDirectory(directoryPath);
+}
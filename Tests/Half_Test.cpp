@@ -0,0 +1,121 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/Half.h"
+
+NATRON_NAMESPACE_USING
+
+TEST(Half, EveryHalfSurvivesARoundTrip)
+{
+    for (U32 i = 0; i < 0x10000; ++i) {
+        float f = Half::bitsToFloat( (U16)i );
+        if ( f != f ) {
+            // NaN stays NaN
+            EXPECT_EQ( 0x7c00, Half::floatToBits(f) & 0x7c00 );
+            EXPECT_NE( 0, Half::floatToBits(f) & 0x3ff );
+            continue;
+        }
+        ASSERT_EQ( (U16)i, Half::floatToBits(f) );
+    }
+}
+
+TEST(Half, KnownValues)
+{
+    EXPECT_EQ( 0x3c00, Half(1.f).bits() );
+    EXPECT_EQ( 0xc000, Half(-2.f).bits() );
+    EXPECT_EQ( 0x7bff, Half(65504.f).bits() );
+    EXPECT_EQ( 0x7c00, Half(1e6f).bits() );
+    EXPECT_EQ( 0xfc00, Half( -std::numeric_limits<float>::infinity() ).bits() );
+    EXPECT_EQ( 0x0001, Half( std::ldexp(1.f, -24) ).bits() );
+    EXPECT_EQ( 0x0000, Half( std::ldexp(1.f, -26) ).bits() );
+    EXPECT_EQ( 0.5f, (float)Half(0.5f) );
+
+    // Ties are rounded to even: 1 + 2^-11 is half-way between 1 and the next half
+    EXPECT_EQ( 0x3c00, Half( 1.f + std::ldexp(1.f, -11) ).bits() );
+    EXPECT_EQ( 0x3c02, Half( 1.f + 3 * std::ldexp(1.f, -11) ).bits() );
+
+    Half h(1.f);
+    h += 0.5f;
+    h *= 2.f;
+    EXPECT_EQ(3.f, (float)h);
+}
+
+TEST(Half, RoundsToNearest)
+{
+    U32 state = 12345;
+
+    for (int i = 0; i < 1000000; ++i) {
+        state = state * 1664525U + 1013904223U;
+        float f = std::ldexp( (float)(state >> 8) / (1 << 24), (int)(state % 40) - 28 );
+        if (state & 1) {
+            f = -f;
+        }
+        U16 bits = Half::floatToBits(f);
+        if ( ( (bits & 0x7fff) == 0 ) || ( (bits & 0x7fff) >= 0x7bff ) ) {
+            // Zero or out of range: there is no neighbour on one side
+            continue;
+        }
+        float rounded = Half::bitsToFloat(bits);
+        // Neither neighbour of the rounded value is closer to f
+        float below = Half::bitsToFloat(bits - 1);
+        float above = Half::bitsToFloat(bits + 1);
+        ASSERT_LE( std::fabs(rounded - f), std::fabs(below - f) );
+        ASSERT_LE( std::fabs(rounded - f), std::fabs(above - f) );
+    }
+}
+
+TEST(Half, BatchConversionsMatchScalarConversions)
+{
+    const std::size_t n = 0x10000 + 5;
+    std::vector<Half> halfs(n);
+    std::vector<float> floats(n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        halfs[i] = Half::fromBits( (U16)i );
+    }
+    Half::convertToFloat(&halfs[0], &floats[0], n);
+    for (std::size_t i = 0; i < n; ++i) {
+        float expected = Half::bitsToFloat( (U16)i );
+        if (expected == expected) {
+            ASSERT_EQ(expected, floats[i]);
+        }
+    }
+
+    for (std::size_t i = 0; i < n; ++i) {
+        floats[i] = (float)i / 1024.f - 32.f + 1.f / 3.f;
+    }
+    Half::convertFromFloat(&floats[0], &halfs[0], n);
+    for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ( Half::floatToBits(floats[i]), halfs[i].bits() );
+    }
+}
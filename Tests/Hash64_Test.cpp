@@ -25,9 +25,13 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <vector>
 #include <gtest/gtest.h>
 
+#include <boost/crc.hpp>
+
 #include "Engine/Hash64.h"
 
 NATRON_NAMESPACE_USING
@@ -91,3 +95,69 @@ TEST(Hash64,
     EXPECT_NE(hash1, hash2);
 } // TEST
 
+// The CRC-64 algorithm must give the same values as the checksum of all the values used by previous versions,
+// since these hashes are stored on disk
+TEST(Hash64,
+     CRC64MatchesPreviousVersions)
+{
+    std::vector<U64> values;
+    Hash64 hash(Hash64::eHashAlgorithmCRC64);
+
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back( Hash64::toU64<double>(i * 0.37) );
+        hash.append<double>(i * 0.37);
+    }
+    values.push_back( Hash64::toU64<int>(-5) );
+    hash.append<int>(-5);
+    values.push_back( Hash64::toU64<unsigned short>(65) );
+    hash.append<unsigned short>(65);
+    hash.computeHash();
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>( &values.front() );
+    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64;
+    crc_64 = std::for_each( data, data + values.size() * sizeof(values[0]), crc_64 );
+    EXPECT_EQ( crc_64(), hash.value() );
+}
+
+TEST(Hash64,
+     NoCollisions)
+{
+    std::vector<U64> hashes;
+
+    // pairs of small integers, as the ages and indices appended to the node hashes
+    for (int a = 0; a < 1000; ++a) {
+        for (int b = 0; b < 1000; ++b) {
+            Hash64 hash;
+            hash.append<int>(a);
+            hash.append<int>(b);
+            hash.computeHash();
+            ASSERT_TRUE( hash.valid() );
+            hashes.push_back( hash.value() );
+        }
+    }
+    // close floating point values, as the values of the knobs
+    for (int i = 0; i < 1000000; ++i) {
+        Hash64 hash;
+        hash.append<double>(i * 1e-3);
+        hash.computeHash();
+        hashes.push_back( hash.value() );
+    }
+    std::sort( hashes.begin(), hashes.end() );
+    EXPECT_TRUE( std::adjacent_find( hashes.begin(), hashes.end() ) == hashes.end() );
+
+    // the order and the number of the values matter
+    Hash64 ab, ba, zero, zeros;
+    ab.append<int>(1);
+    ab.append<int>(2);
+    ab.computeHash();
+    ba.append<int>(2);
+    ba.append<int>(1);
+    ba.computeHash();
+    EXPECT_NE(ab, ba);
+    zero.append<int>(0);
+    zero.computeHash();
+    zeros.append<int>(0);
+    zeros.append<int>(0);
+    zeros.computeHash();
+    EXPECT_NE(zero, zeros);
+}
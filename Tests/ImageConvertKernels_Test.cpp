@@ -0,0 +1,592 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <boost/make_shared.hpp>
+
+#include <QtCore/QThreadPool>
+
+#include "Engine/Image.h"
+#include "Engine/ImageConvertKernels.h"
+#include "Engine/ImageStatistics.h"
+#include "Engine/Lut.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+// Values around the rounding thresholds and the special values, then random values in [-0.25, 1.25]
+std::vector<float>
+makeTestValues(std::size_t count)
+{
+    std::vector<float> values;
+
+    values.push_back(0.f);
+    values.push_back(-0.f);
+    values.push_back(1.f);
+    values.push_back(-1.f);
+    values.push_back( std::numeric_limits<float>::infinity() );
+    values.push_back( -std::numeric_limits<float>::infinity() );
+    values.push_back( std::numeric_limits<float>::quiet_NaN() );
+    values.push_back( std::nextafter(1.f, 0.f) );
+    values.push_back( std::nextafter(1.f, 2.f) );
+    values.push_back( std::numeric_limits<float>::denorm_min() );
+    for (int i = 0; i < 256; ++i) {
+        values.push_back( (i + 0.5f) / 255.f );
+        values.push_back( std::nextafter( (i + 0.5f) / 255.f, 0.f ) );
+    }
+    std::srand(2000);
+    while (values.size() < count) {
+        // coverity[dont_call]
+        values.push_back( std::rand() / (float)RAND_MAX * 1.5f - 0.25f );
+    }
+
+    return values;
+}
+
+const ImageConvertKernels::InstructionSetEnum instructionSets[3] = {
+    ImageConvertKernels::eInstructionSetScalar, ImageConvertKernels::eInstructionSetSSE41, ImageConvertKernels::eInstructionSetAVX2
+};
+
+// An image of random values in [0, 1] (or [0, maxValue] for integer depths)
+ImagePtr
+makeRandomImage(const ImagePlaneDesc& components,
+                const RectI& bounds,
+                ImageBitDepthEnum depth)
+{
+    const RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    ImagePtr img = boost::make_shared<Image>(components, rod, bounds, 0, 1., depth, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const int rowElements = bounds.width() * components.getNumComponents();
+
+    std::srand(2000);
+    Image::WriteAccess acc( img.get() );
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        void* row = acc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < rowElements; ++i) {
+            // coverity[dont_call]
+            float value = std::rand() / (float)RAND_MAX;
+            switch (depth) {
+            case eImageBitDepthByte:
+                ( (unsigned char*)row )[i] = (unsigned char)(value * 255);
+                break;
+            case eImageBitDepthShort:
+                ( (unsigned short*)row )[i] = (unsigned short)(value * 65535);
+                break;
+            case eImageBitDepthHalf:
+                ( (Half*)row )[i] = Half(value);
+                break;
+            case eImageBitDepthFloat:
+                ( (float*)row )[i] = value;
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
+        }
+    }
+
+    return img;
+}
+
+// Downscales the roi of img from level 0 to the given level, with the kernels of the given instruction set
+// and at most maxThreads threads
+ImagePtr
+downscale(const ImagePtr& img,
+          const RectI& roi,
+          unsigned int level,
+          ImageConvertKernels::InstructionSetEnum set,
+          int maxThreads)
+{
+    const RectI dstBounds = roi.downscalePowerOfTwoSmallestEnclosing(level);
+    ImagePtr output = boost::make_shared<Image>(img->getComponents(), img->getRoD(), dstBounds, level, 1., img->getBitDepth(), eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const int previousMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+    ImageConvertKernels::setInstructionSet(set);
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    img->downscaleMipMap(img->getRoD(), roi, 0, level, false, output.get() );
+    QThreadPool::globalInstance()->setMaxThreadCount(previousMaxThreads);
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+
+    return output;
+}
+
+void
+expectSameRows(const ImagePtr& reference,
+               const ImagePtr& img,
+               const RectI& rect)
+{
+    const std::size_t rowBytes = rect.width() * reference->getComponentsCount() * getSizeOfForBitDepth( reference->getBitDepth() );
+
+    Image::ReadAccess referenceAcc( reference.get() );
+    Image::ReadAccess acc( img.get() );
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        ASSERT_EQ( 0, std::memcmp( referenceAcc.pixelAt(rect.x1, y), acc.pixelAt(rect.x1, y), rowBytes ) ) << "row " << y;
+    }
+}
+
+// Copies the unprocessed channels of original into img, mixes it with original with a mask and premultiplies it,
+// with the kernels of the given instruction set (in a single pass) and at most maxThreads threads
+void
+postRender(const ImagePtr& img,
+           const ImagePtr& original,
+           const ImagePtr& mask,
+           ImageConvertKernels::InstructionSetEnum set,
+           int maxThreads)
+{
+    const int previousMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    std::bitset<4> processChannels;
+
+    processChannels[0] = processChannels[1] = processChannels[2] = true;
+    ImageConvertKernels::setInstructionSet(set);
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    img->copyUnProcessedChannelsMaskMixAndPremult(img->getBounds(), eImagePremultiplicationPremultiplied, eImagePremultiplicationPremultiplied, processChannels, original, true,
+                                                  true, mask.get(), true, false, 0.8f, true);
+    QThreadPool::globalInstance()->setMaxThreadCount(previousMaxThreads);
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+// Computes the statistics of the whole image with the kernels of the given instruction set and at most maxThreads threads
+ImageStatistics
+computeStatistics(const ImagePtr& img,
+                  const ImageStatisticsRequest& request,
+                  ImageConvertKernels::InstructionSetEnum set,
+                  int maxThreads)
+{
+    const int previousMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    ImageStatistics stats;
+
+    ImageConvertKernels::setInstructionSet(set);
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    img->computeStatistics(img->getBounds(), request, &stats);
+    QThreadPool::globalInstance()->setMaxThreadCount(previousMaxThreads);
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+
+    return stats;
+}
+
+} // anon namespace
+
+// Instruction sets that are not supported by this processor fall back to the best supported one.
+// The sizes are not multiples of the vector sizes, to go through the scalar tails as well.
+
+TEST(ImageConvertKernels,
+     FloatToIntegerMatchesColorFloatToInt)
+{
+    std::vector<float> values = makeTestValues(4099);
+
+    for (int set = 0; set < 3; ++set) {
+        ImageConvertKernels::setInstructionSet(instructionSets[set]);
+        std::vector<unsigned char> bytes( values.size() );
+        std::vector<unsigned short> shorts( values.size() );
+        ImageConvertKernels::convertFloatToByte( &values[0], &bytes[0], values.size() );
+        ImageConvertKernels::convertFloatToShort( &values[0], &shorts[0], values.size() );
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            int expectedByte = (std::isnan)(values[i]) ? 0 : Color::floatToInt<256>(values[i]);
+            int expectedShort = (std::isnan)(values[i]) ? 0 : Color::floatToInt<65536>(values[i]);
+            ASSERT_EQ(expectedByte, (int)bytes[i]) << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getInstructionSet() ) << ", value " << values[i];
+            ASSERT_EQ(expectedShort, (int)shorts[i]) << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getInstructionSet() ) << ", value " << values[i];
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+TEST(ImageConvertKernels,
+     IntegerToFloatMatchesColorIntToFloat)
+{
+    std::vector<unsigned short> shorts(65536 + 7);
+    std::vector<unsigned char> bytes(256 + 7);
+
+    for (std::size_t i = 0; i < shorts.size(); ++i) {
+        shorts[i] = (unsigned short)i;
+    }
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = (unsigned char)i;
+    }
+    const Color::Lut* lut = Color::LutManager::sRGBLut();
+    lut->validate();
+
+    for (int set = 0; set < 3; ++set) {
+        ImageConvertKernels::setInstructionSet(instructionSets[set]);
+        std::vector<float> fromShorts( shorts.size() );
+        std::vector<float> fromBytes( bytes.size() );
+        std::vector<float> fromLut( bytes.size() );
+        ImageConvertKernels::convertShortToFloat( &shorts[0], &fromShorts[0], shorts.size() );
+        ImageConvertKernels::convertByteToFloat( &bytes[0], &fromBytes[0], bytes.size() );
+        lut->fromColorSpaceUint8ToLinearFloatFast( &bytes[0], &fromLut[0], bytes.size() );
+        for (std::size_t i = 0; i < shorts.size(); ++i) {
+            ASSERT_EQ(Color::intToFloat<65536>(shorts[i]), fromShorts[i]);
+        }
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            ASSERT_EQ(Color::intToFloat<256>(bytes[i]), fromBytes[i]);
+            ASSERT_EQ(lut->fromColorSpaceUint8ToLinearFloatFast(bytes[i]), fromLut[i]);
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+TEST(ImageConvertKernels,
+     ComponentsAreShuffled)
+{
+    const std::size_t count = 37;
+    std::vector<float> rgba(count * 4);
+
+    for (std::size_t i = 0; i < rgba.size(); ++i) {
+        rgba[i] = (float)i;
+    }
+    for (int set = 0; set < 3; ++set) {
+        ImageConvertKernels::setInstructionSet(instructionSets[set]);
+        std::vector<float> rgb(count * 3), rgbaFromRGB(count * 4), alpha(count);
+        ImageConvertKernels::convertRGBAToRGB(&rgba[0], &rgb[0], count);
+        ImageConvertKernels::convertRGBToRGBA(&rgb[0], &rgbaFromRGB[0], count, 1.f);
+        for (int channel = 0; channel < 4; ++channel) {
+            ImageConvertKernels::convertRGBAToAlpha(&rgba[0], &alpha[0], count, channel);
+            for (std::size_t i = 0; i < count; ++i) {
+                ASSERT_EQ(rgba[i * 4 + channel], alpha[i]);
+            }
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                ASSERT_EQ(rgba[i * 4 + c], rgb[i * 3 + c]);
+                ASSERT_EQ(rgba[i * 4 + c], rgbaFromRGB[i * 4 + c]);
+            }
+            ASSERT_EQ(1.f, rgbaFromRGB[i * 4 + 3]);
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+// Image::convertToFormat gives the same image with the generic per-pixel code (instruction set "none")
+// and with the kernels of each instruction set supported by this processor
+TEST(ImageConvertKernels,
+     ConvertToFormatMatchesGenericCode)
+{
+    const RectD rod(-3, 1, 1029, 131);
+    const RectI bounds(-3, 1, 1029, 131);
+    const ImageBitDepthEnum depths[2] = { eImageBitDepthByte, eImageBitDepthShort };
+    ImagePtr floatImg = boost::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    {
+        std::vector<float> values = makeTestValues(bounds.width() * 4);
+        Image::WriteAccess acc( floatImg.get() );
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            std::memcpy( acc.pixelAt(bounds.x1, y), &values[0], values.size() * sizeof(float) );
+        }
+    }
+
+    for (int d = 0; d < 2; ++d) {
+        ImagePtr reference, referenceBack;
+        for (int set = ImageConvertKernels::eInstructionSetNone; set <= ImageConvertKernels::getSupportedInstructionSet(); ++set) {
+            ImageConvertKernels::setInstructionSet( (ImageConvertKernels::InstructionSetEnum)set );
+            ImagePtr intImg = boost::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., depths[d], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            ImagePtr backImg = boost::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            floatImg->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, intImg.get() );
+            intImg->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, backImg.get() );
+
+            if (!reference) {
+                reference = intImg;
+                referenceBack = backImg;
+            } else {
+                expectSameRows(reference, intImg, bounds);
+                expectSameRows(referenceBack, backImg, bounds);
+            }
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+TEST(ImageConvertKernels,
+     HalveRowsAverage2x2Pixels)
+{
+    const std::size_t count = 37;
+    std::vector<float> floats(count * 2 * 4 * 2);
+    std::vector<unsigned short> shorts( floats.size() );
+    std::vector<unsigned char> bytes( floats.size() );
+
+    std::srand(2000);
+    for (std::size_t i = 0; i < floats.size(); ++i) {
+        // coverity[dont_call]
+        floats[i] = std::rand() / (float)RAND_MAX * 1.5f - 0.25f;
+        shorts[i] = (i % 5 == 0) ? 65535 : (unsigned short)(std::rand() % 65536);
+        bytes[i] = (i % 5 == 0) ? 255 : (unsigned char)(std::rand() % 256);
+    }
+    for (int set = 0; set < 3; ++set) {
+        ImageConvertKernels::setInstructionSet(instructionSets[set]);
+        for (int nComps = 1; nComps <= 4; ++nComps) {
+            const std::size_t rowSize = count * 2 * nComps;
+            std::vector<float> halvedFloats(count * nComps);
+            std::vector<unsigned short> halvedShorts(count * nComps);
+            std::vector<unsigned char> halvedBytes(count * nComps);
+            ImageConvertKernels::halveRowsFloat(&floats[0], &floats[rowSize], &halvedFloats[0], count, nComps);
+            ImageConvertKernels::halveRowsShort(&shorts[0], &shorts[rowSize], &halvedShorts[0], count, nComps);
+            ImageConvertKernels::halveRowsByte(&bytes[0], &bytes[rowSize], &halvedBytes[0], count, nComps);
+            for (std::size_t i = 0; i < count; ++i) {
+                for (int k = 0; k < nComps; ++k) {
+                    const std::size_t a = i * 2 * nComps + k;
+                    const std::size_t b = a + nComps;
+                    const std::size_t c = a + rowSize;
+                    const std::size_t d = b + rowSize;
+                    ASSERT_EQ( (floats[a] + floats[b] + floats[c] + floats[d]) / 4, halvedFloats[i * nComps + k] );
+                    ASSERT_EQ( (shorts[a] + shorts[b] + shorts[c] + shorts[d]) / 4, (int)halvedShorts[i * nComps + k] );
+                    ASSERT_EQ( (bytes[a] + bytes[b] + bytes[c] + bytes[d]) / 4, (int)halvedBytes[i * nComps + k] );
+                }
+            }
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+// The mipmaps built with the kernels and several threads must be identical to the ones of the generic code in a single thread
+TEST(ImageConvertKernels,
+     MipMapsMatchGenericCode)
+{
+    const ImageBitDepthEnum depths[4] = { eImageBitDepthByte, eImageBitDepthShort, eImageBitDepthHalf, eImageBitDepthFloat };
+    const ImagePlaneDesc* components[3] = { &ImagePlaneDesc::getRGBAComponents(), &ImagePlaneDesc::getRGBComponents(), &ImagePlaneDesc::getAlphaComponents() };
+    // bounds aligned on 8 pixels: all the pixels of the first 3 levels are written
+    const RectI alignedBounds(-32, 8, 1032, 536);
+    // odd bounds: the borders of level 1 only have 1 or 2 source pixels
+    const RectI oddBounds(-3, 1, 322, 97);
+    const RectI oddHalvedRoI(-1, 1, 161, 48);
+
+    for (int d = 0; d < 4; ++d) {
+        for (int c = 0; c < 3; ++c) {
+            ImagePtr img = makeRandomImage(*components[c], alignedBounds, depths[d]);
+            for (unsigned int level = 1; level <= 3; ++level) {
+                ImagePtr reference = downscale(img, alignedBounds, level, ImageConvertKernels::eInstructionSetNone, 1);
+                ImagePtr halved = downscale( img, alignedBounds, level, ImageConvertKernels::getSupportedInstructionSet(), QThreadPool::globalInstance()->maxThreadCount() );
+                ASSERT_EQ( reference->getBounds(), alignedBounds.downscalePowerOfTwoSmallestEnclosing(level) );
+                expectSameRows( reference, halved, reference->getBounds() );
+            }
+
+            ImagePtr oddImg = makeRandomImage(*components[c], oddBounds, depths[d]);
+            ImagePtr reference = downscale(oddImg, oddBounds, 1, ImageConvertKernels::eInstructionSetNone, 1);
+            ImagePtr halved = downscale( oddImg, oddBounds, 1, ImageConvertKernels::getSupportedInstructionSet(), QThreadPool::globalInstance()->maxThreadCount() );
+            expectSameRows(reference, halved, oddHalvedRoI);
+        }
+    }
+}
+
+TEST(ImageConvertKernels,
+     PostRenderKernelsMatchGenericCode)
+{
+    const std::size_t count = 37;
+    std::vector<float> pixels(count * 4), original(count * 4), mask(count);
+
+    std::srand(2000);
+    for (std::size_t i = 0; i < pixels.size(); ++i) {
+        // coverity[dont_call]
+        pixels[i] = std::rand() / (float)RAND_MAX * 1.5f - 0.25f;
+        // coverity[dont_call]
+        original[i] = std::rand() / (float)RAND_MAX;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        // coverity[dont_call]
+        mask[i] = std::rand() / (float)RAND_MAX;
+    }
+    // pixels with a zero and a NaN alpha
+    pixels[3] = 0.f;
+    pixels[7] = std::numeric_limits<float>::quiet_NaN();
+
+    for (int set = 0; set < 3; ++set) {
+        ImageConvertKernels::setInstructionSet(instructionSets[set]);
+        std::vector<float> premult(pixels), unpremult(pixels), copied(pixels), mixed(pixels), invertMixed(pixels), unmasked(pixels);
+        ImageConvertKernels::premultRGBA(&premult[0], count);
+        ImageConvertKernels::unpremultRGBA(&unpremult[0], count);
+        ImageConvertKernels::copyChannelsRGBA(&original[0], &copied[0], count, 0x9);
+        ImageConvertKernels::maskMixRGBA(&original[0], &mask[0], &mixed[0], count, 0.7f, false);
+        ImageConvertKernels::maskMixRGBA(&original[0], &mask[0], &invertMixed[0], count, 0.7f, true);
+        ImageConvertKernels::maskMixRGBA(&original[0], NULL, &unmasked[0], count, 0.3f, false);
+        for (std::size_t i = 0; i < count; ++i) {
+            const float* pix = &pixels[i * 4];
+            const float* src = &original[i * 4];
+            const float alpha = 0.7f * mask[i];
+            const float invertAlpha = 0.7f * (1.f - mask[i]);
+            for (int c = 0; c < 4; ++c) {
+                const float premultiplied = (c == 3) ? pix[c] : pix[c] * pix[3];
+                const float unpremultiplied = (c == 3 || pix[3] == 0) ? pix[c] : pix[c] / pix[3];
+                // compare the bits, to compare NaNs as well
+                ASSERT_EQ( 0, std::memcmp(&premultiplied, &premult[i * 4 + c], sizeof(float) ) ) << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getInstructionSet() );
+                ASSERT_EQ( 0, std::memcmp(&unpremultiplied, &unpremult[i * 4 + c], sizeof(float) ) ) << ImageConvertKernels::getInstructionSetName( ImageConvertKernels::getInstructionSet() );
+                ASSERT_EQ( (c == 0 || c == 3) ? src[c] : pix[c], copied[i * 4 + c] );
+                ASSERT_EQ( pix[c] * alpha + (1.f - alpha) * src[c], mixed[i * 4 + c] );
+                ASSERT_EQ( pix[c] * invertAlpha + (1.f - invertAlpha) * src[c], invertMixed[i * 4 + c] );
+                ASSERT_EQ( pix[c] * 0.3f + (1.f - 0.3f) * src[c], unmasked[i * 4 + c] );
+            }
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+// The operations done after a render with the kernels and several threads must give the same image as the generic code
+TEST(ImageConvertKernels,
+     PostRenderMatchesGenericCode)
+{
+    const RectI bounds(-3, 1, 1029, 517);
+    ImagePtr original = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds, eImageBitDepthFloat);
+    ImagePtr mask = makeRandomImage(ImagePlaneDesc::getAlphaComponents(), bounds, eImageBitDepthFloat);
+    ImagePtr reference = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds, eImageBitDepthFloat);
+    ImagePtr img = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds, eImageBitDepthFloat);
+
+    postRender(reference, original, mask, ImageConvertKernels::eInstructionSetNone, 1);
+    postRender( img, original, mask, ImageConvertKernels::getSupportedInstructionSet(), QThreadPool::globalInstance()->maxThreadCount() );
+    expectSameRows(reference, img, bounds);
+
+    // the same operations, one after the other
+    std::bitset<4> processChannels;
+    processChannels[0] = processChannels[1] = processChannels[2] = true;
+    ImagePtr separately = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds, eImageBitDepthFloat);
+    separately->copyUnProcessedChannels(bounds, eImagePremultiplicationPremultiplied, eImagePremultiplicationPremultiplied, processChannels, original, true);
+    separately->applyMaskMix(bounds, mask.get(), original.get(), true, false, 0.8f);
+    separately->premultImage(bounds);
+    expectSameRows(reference, separately, bounds);
+}
+
+TEST(ImageConvertKernels,
+     ReduceRowMatchesScalarCode)
+{
+    std::vector<float> values = makeTestValues(4 * 1001);
+
+    for (int nComps = 1; nComps <= 4; ++nComps) {
+        const std::size_t count = values.size() / nComps;
+        ImageConvertKernels::RowStatistics reference, referenceFixed;
+        std::vector<float> fixedReference(values);
+        ImageConvertKernels::setInstructionSet(ImageConvertKernels::eInstructionSetScalar);
+        ImageConvertKernels::reduceRow(&values[0], NULL, count, nComps, &reference);
+        ImageConvertKernels::reduceRow(&fixedReference[0], &fixedReference[0], count, nComps, &referenceFixed);
+        for (int s = 1; s < 3; ++s) {
+            ImageConvertKernels::RowStatistics stats, statsFixed;
+            std::vector<float> fixed(values);
+            ImageConvertKernels::setInstructionSet(instructionSets[s]);
+            ImageConvertKernels::reduceRow(&values[0], NULL, count, nComps, &stats);
+            ImageConvertKernels::reduceRow(&fixed[0], &fixed[0], count, nComps, &statsFixed);
+            ASSERT_EQ( 0, std::memcmp( &fixedReference[0], &fixed[0], fixedReference.size() * sizeof(float) ) ) << nComps << " components";
+            for (int c = 0; c < nComps; ++c) {
+                ASSERT_EQ(reference.min[c], stats.min[c]) << nComps << " components, channel " << c;
+                ASSERT_EQ(reference.max[c], stats.max[c]) << nComps << " components, channel " << c;
+                ASSERT_EQ(reference.nans[c], stats.nans[c]) << nComps << " components, channel " << c;
+                ASSERT_EQ(referenceFixed.min[c], statsFixed.min[c]) << nComps << " components, channel " << c;
+                ASSERT_EQ(referenceFixed.max[c], statsFixed.max[c]) << nComps << " components, channel " << c;
+                ASSERT_EQ(referenceFixed.nans[c], statsFixed.nans[c]) << nComps << " components, channel " << c;
+                // the sums are not accumulated in the same order (and are NaN if they contain both infinities)
+                if ( (std::isnan)(reference.sum[c]) ) {
+                    ASSERT_TRUE( (std::isnan)(stats.sum[c]) );
+                } else {
+                    ASSERT_NEAR(reference.sum[c], stats.sum[c], 1e-9 * count);
+                }
+            }
+        }
+    }
+    ImageConvertKernels::setInstructionSet( ImageConvertKernels::getSupportedInstructionSet() );
+}
+
+// The statistics computed in a single pass on several threads must match a straightforward per-pixel computation
+TEST(ImageConvertKernels,
+     StatisticsMatchGenericCode)
+{
+    const RectI bounds(-3, 1, 1029, 517);
+    ImagePtr img = makeRandomImage(ImagePlaneDesc::getRGBAComponents(), bounds, eImageBitDepthFloat);
+    {
+        Image::WriteAccess acc( img.get() );
+        ( (float*)acc.pixelAt(0, 10) )[1] = std::numeric_limits<float>::quiet_NaN();
+        ( (float*)acc.pixelAt(1028, 516) )[3] = std::numeric_limits<float>::quiet_NaN();
+        ( (float*)acc.pixelAt(500, 300) )[0] = 2.f;
+    }
+
+    ImageStatisticsRequest request;
+    request.luminance = true;
+    request.histograms.push_back(eImageStatisticsValueChannel0);
+    request.histograms.push_back(eImageStatisticsValueChannel3);
+    request.histograms.push_back(eImageStatisticsValueLuminance);
+    request.histogramBins = 100;
+    request.histogramMin = 0.;
+    request.histogramMax = 1.;
+
+    double min[4], max[4], sum[4];
+    std::size_t nans[4] = { 0, 0, 0, 0 };
+    double luminanceMin = std::numeric_limits<double>::infinity();
+    double luminanceMax = -std::numeric_limits<double>::infinity();
+    std::vector<std::vector<float> > histograms( 3, std::vector<float>(100, 0.f) );
+    for (int c = 0; c < 4; ++c) {
+        min[c] = std::numeric_limits<double>::infinity();
+        max[c] = -std::numeric_limits<double>::infinity();
+        sum[c] = 0.;
+    }
+    {
+        Image::ReadAccess acc( img.get() );
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            for (int x = bounds.x1; x < bounds.x2; ++x) {
+                const float* pix = (const float*)acc.pixelAt(x, y);
+                for (int c = 0; c < 4; ++c) {
+                    if ( (std::isnan)(pix[c]) ) {
+                        ++nans[c];
+                    } else {
+                        min[c] = std::min<double>(min[c], pix[c]);
+                        max[c] = std::max<double>(max[c], pix[c]);
+                        sum[c] += pix[c];
+                    }
+                }
+                const double luminance = 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+                luminanceMin = std::min(luminanceMin, luminance);
+                luminanceMax = std::max(luminanceMax, luminance);
+                const float values[3] = { pix[0], pix[3], (float)luminance };
+                for (int h = 0; h < 3; ++h) {
+                    if ( (0. <= values[h]) && (values[h] < 1.) ) {
+                        histograms[h][(int)( values[h] / (1. / 100) )] += 1.f;
+                    }
+                }
+            }
+        }
+    }
+
+    ImageStatistics stats = computeStatistics( img, request, ImageConvertKernels::getSupportedInstructionSet(), QThreadPool::globalInstance()->maxThreadCount() );
+    EXPECT_EQ( (std::size_t)bounds.area(), stats.pixelsCount );
+    EXPECT_EQ( (std::size_t)2, stats.getNaNsCount() );
+    for (int c = 0; c < 4; ++c) {
+        EXPECT_EQ(min[c], stats.min[c]) << "channel " << c;
+        EXPECT_EQ(max[c], stats.max[c]) << "channel " << c;
+        EXPECT_EQ(nans[c], stats.nans[c]) << "channel " << c;
+        EXPECT_NEAR(sum[c], stats.sum[c], 1e-6 * sum[c]) << "channel " << c;
+    }
+    EXPECT_EQ(2., stats.max[0]);
+    EXPECT_EQ(luminanceMin, stats.luminanceMin);
+    EXPECT_EQ(luminanceMax, stats.luminanceMax);
+    EXPECT_TRUE(histograms == stats.histograms);
+
+    // fixing the NaNs gives the same statistics, with the NaNs taken as 1
+    request.fixNaNs = true;
+    stats = computeStatistics( img, request, ImageConvertKernels::getSupportedInstructionSet(), QThreadPool::globalInstance()->maxThreadCount() );
+    EXPECT_EQ( (std::size_t)2, stats.getNaNsCount() );
+    EXPECT_NEAR(sum[1] + 1., stats.sum[1], 1e-6 * sum[1]);
+    EXPECT_FALSE( img->checkForNaNsAndFix(bounds) );
+    Image::ReadAccess acc( img.get() );
+    EXPECT_EQ( 1.f, ( (const float*)acc.pixelAt(0, 10) )[1] );
+    EXPECT_EQ( 1.f, ( (const float*)acc.pixelAt(1028, 516) )[3] );
+}
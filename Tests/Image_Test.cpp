@@ -26,6 +26,8 @@
 #include "Global/Macros.h"
 
 #include <cstring>
+#include <list>
+#include <random>
 #include <gtest/gtest.h>
 
 #include "Engine/Image.h"
@@ -117,6 +119,124 @@ TEST(BitmapTest,
     EXPECT_TRUE(nonRenderedRects.size() == 3);
 } // TEST
 
+namespace {
+enum ViewerPatternEnum
+{
+    eViewerPatternCacheHit = 0, // the whole frame was already rendered
+    eViewerPatternPan, // the viewer was panned: half of the frame was rendered
+    eViewerPatternZoomOut, // the viewer zoomed out: the center of the frame was rendered
+    eViewerPatternScattered, // scattered tiles were rendered by concurrent renders
+    eViewerPatternRenderingElsewhere, // as eViewerPatternZoomOut, with a region being rendered by another thread
+    eViewerPatternCount
+};
+
+const char* const viewerPatternNames[eViewerPatternCount] = {
+    "cache hit", "pan", "zoom out", "scattered", "rendering elsewhere"
+};
+
+// Marks the given pattern on a 4K bitmap, either keeping the tile states up to date or forcing the pixel scan
+void
+markViewerPattern(ViewerPatternEnum pattern,
+                  bool useTiles,
+                  Bitmap* bm)
+{
+    const RectI& bounds = bm->getBounds();
+
+    switch (pattern) {
+    case eViewerPatternCacheHit:
+        bm->markForRendered(bounds);
+        break;
+    case eViewerPatternPan:
+        bm->markForRendered( RectI(0, 0, 2000, bounds.y2) );
+        break;
+    case eViewerPatternZoomOut:
+    case eViewerPatternRenderingElsewhere:
+        bm->markForRendered( RectI(950, 530, 2890, 1630) );
+        if (pattern == eViewerPatternRenderingElsewhere) {
+            bm->markForRendering( RectI(2890, 530, 3200, 1630) );
+        }
+        break;
+    case eViewerPatternScattered: {
+        std::minstd_rand rng(1);
+        for (int i = 0; i < 200; ++i) {
+            int x1 = rng() % bounds.x2;
+            int y1 = rng() % bounds.y2;
+            bm->markForRendered( RectI( x1, y1, std::min<int>(x1 + 50 + rng() % 250, bounds.x2), std::min<int>(y1 + 50 + rng() % 250, bounds.y2) ) );
+        }
+        break;
+    }
+    case eViewerPatternCount:
+        break;
+    }
+    if (!useTiles) {
+        bm->invalidateTiles(bounds);
+    }
+}
+} // anon namespace
+
+TEST(BitmapTest,
+     TileStates)
+{
+    Bitmap bm( RectI(0, 0, 256, 200) );
+
+    EXPECT_EQ( 0, bm.getUniformValue( bm.getBounds() ) );
+    bm.markForRendered( RectI(0, 0, 128, 200) );
+    EXPECT_EQ( 1, bm.getUniformValue( RectI(0, 0, 128, 200) ) );
+    EXPECT_EQ( 0, bm.getUniformValue( RectI(128, 0, 256, 200) ) );
+    EXPECT_EQ( -1, bm.getUniformValue( bm.getBounds() ) );
+
+    // the tiles only partially covered lose their state, unless they already had the marked value
+    bm.clear( RectI(10, 10, 20, 20) );
+    EXPECT_EQ( -1, bm.getUniformValue( RectI(0, 0, 64, 64) ) );
+    EXPECT_EQ( 1, bm.getUniformValue( RectI(64, 0, 128, 200) ) );
+    bm.clear( RectI(130, 10, 140, 20) );
+    EXPECT_EQ( 0, bm.getUniformValue( RectI(128, 0, 256, 200) ) );
+    EXPECT_FALSE( bm.isNonMarked( RectI(0, 0, 64, 64) ) );
+    EXPECT_TRUE( bm.isNonMarked( RectI(10, 10, 20, 20) ) );
+
+    // the last row and column of tiles are clipped to the bounds
+    bm.markForRendered( RectI(192, 192, 256, 200) );
+    EXPECT_EQ( 1, bm.getUniformValue( RectI(192, 192, 256, 200) ) );
+
+    bm.invalidateTiles( bm.getBounds() );
+    EXPECT_EQ( -1, bm.getUniformValue( RectI(128, 0, 256, 64) ) );
+    EXPECT_TRUE( bm.isNonMarked( RectI(128, 0, 256, 64) ) );
+}
+
+TEST(BitmapTest,
+     TilesMatchPixelScan)
+{
+    const RectI bounds(0, 0, 3840, 2160);
+    // the full frame, and a region of interest that is not aligned on the tiles
+    const RectI rois[2] = { bounds, RectI(100, 37, 3000, 2000) };
+
+    for (int p = 0; p < eViewerPatternCount; ++p) {
+        Bitmap tiled(bounds);
+        Bitmap scanned(bounds);
+        markViewerPattern( (ViewerPatternEnum)p, true, &tiled );
+        markViewerPattern( (ViewerPatternEnum)p, false, &scanned );
+        ASSERT_EQ( 0, std::memcmp( tiled.getBitmap(), scanned.getBitmap(), bounds.area() ) );
+
+        for (int r = 0; r < 2; ++r) {
+            std::list<RectI> tiledRects, scannedRects;
+            tiled.minimalNonMarkedRects(rois[r], tiledRects);
+            scanned.minimalNonMarkedRects(rois[r], scannedRects);
+            EXPECT_TRUE(tiledRects == scannedRects) << viewerPatternNames[p];
+            EXPECT_TRUE( tiled.minimalNonMarkedBbox(rois[r]) == scanned.minimalNonMarkedBbox(rois[r]) ) << viewerPatternNames[p];
+            EXPECT_EQ( tiled.isNonMarked(rois[r]), scanned.isNonMarked(rois[r]) ) << viewerPatternNames[p];
+
+            tiledRects.clear();
+            scannedRects.clear();
+            bool tiledElsewhere = false, scannedElsewhere = false;
+            tiled.minimalNonMarkedRects_trimap(rois[r], tiledRects, &tiledElsewhere);
+            scanned.minimalNonMarkedRects_trimap(rois[r], scannedRects, &scannedElsewhere);
+            EXPECT_TRUE(tiledRects == scannedRects) << viewerPatternNames[p];
+            EXPECT_EQ(tiledElsewhere, scannedElsewhere) << viewerPatternNames[p];
+            EXPECT_EQ(p == eViewerPatternRenderingElsewhere, tiledElsewhere) << viewerPatternNames[p];
+        }
+    }
+}
+
 TEST(ImageKeyTest, Equality) {
     srand(2000);
     // coverity[dont_call]
@@ -160,3 +280,169 @@ TEST(ImageKeyTest, Difference) {
     ASSERT_TRUE(keyHash1 != keyHash2);
 }
 
+
+TEST(ImageTest, HalfImageConvertsAndDownscales)
+{
+    RectD rod(0, 0, 8, 8);
+    RectI bounds(0, 0, 8, 8);
+    Image floatImg(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image halfImg(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthHalf, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image floatBack(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    {
+        Image::WriteAccess acc(&floatImg);
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            float* pix = (float*)acc.pixelAt(bounds.x1, y);
+            for (int i = 0; i < bounds.width() * 4; ++i) {
+                pix[i] = (y * bounds.width() * 4 + i) / 64.f - 1.f;
+            }
+        }
+    }
+
+    floatImg.convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, &halfImg);
+    halfImg.convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, &floatBack);
+
+    // these values are exactly representable at half precision
+    {
+        Image::ReadAccess floatAcc(&floatImg);
+        Image::ReadAccess halfAcc(&halfImg);
+        Image::ReadAccess backAcc(&floatBack);
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            const float* src = (const float*)floatAcc.pixelAt(bounds.x1, y);
+            const Half* half = (const Half*)halfAcc.pixelAt(bounds.x1, y);
+            const float* back = (const float*)backAcc.pixelAt(bounds.x1, y);
+            for (int i = 0; i < bounds.width() * 4; ++i) {
+                EXPECT_EQ( src[i], (float)half[i] );
+                EXPECT_EQ( src[i], back[i] );
+            }
+        }
+    }
+
+    RectI halfBounds(0, 0, 4, 4);
+    Image floatLevel1(ImagePlaneDesc::getRGBAComponents(), rod, halfBounds, 1, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image halfLevel1(ImagePlaneDesc::getRGBAComponents(), rod, halfBounds, 1, 1., eImageBitDepthHalf, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    floatImg.downscaleMipMap(rod, bounds, 0, 1, false, &floatLevel1);
+    halfImg.downscaleMipMap(rod, bounds, 0, 1, false, &halfLevel1);
+    Image::ReadAccess floatLevel1Acc(&floatLevel1);
+    Image::ReadAccess halfLevel1Acc(&halfLevel1);
+    for (int y = halfBounds.y1; y < halfBounds.y2; ++y) {
+        const float* f = (const float*)floatLevel1Acc.pixelAt(halfBounds.x1, y);
+        const Half* h = (const Half*)halfLevel1Acc.pixelAt(halfBounds.x1, y);
+        for (int i = 0; i < halfBounds.width() * 4; ++i) {
+            EXPECT_NEAR(f[i], (float)h[i], 1e-3);
+        }
+    }
+}
+
+TEST(ImageTest, EnsureBoundsGrowsByTiles)
+{
+    RectD rod(-100, 0, 1000, 500);
+    {
+        // an image smaller than a tile grows to the requested bounds only
+        RectI bounds(10, 10, 20, 20);
+        Image img(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+        ASSERT_TRUE( img.ensureBounds( RectI(10, 10, 21, 20) ) );
+        EXPECT_EQ( RectI(10, 10, 21, 20), img.getBounds() );
+    }
+
+    RectI bounds(10, 10, 200, 200);
+    Image img(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    img.fillZero(bounds);
+    {
+        Image::WriteAccess acc(&img);
+        float* pix = (float*)acc.pixelAt(15, 15);
+        pix[0] = 1.f;
+    }
+
+    // a larger image grows towards the enclosing 128x128 tiles, by at most a quarter of its size on each side
+    ASSERT_TRUE( img.ensureBounds( RectI(10, 10, 201, 200) ) );
+    EXPECT_EQ( RectI(0, 0, 248, 247), img.getBounds() );
+    EXPECT_EQ( 1.f, ( (const float*)Image::ReadAccess(&img).pixelAt(15, 15) )[0] );
+
+    // successive small growths within the padding do not resize the image
+    for (int x = 202; x <= 248; ++x) {
+        ASSERT_FALSE( img.ensureBounds( RectI(10, 10, x, 200) ) );
+    }
+
+    // bounds outside of the region of definition are still honoured
+    ASSERT_TRUE( img.ensureBounds( RectI(10, 10, 20, 600) ) );
+    EXPECT_EQ( RectI(0, 0, 256, 600), img.getBounds() );
+    EXPECT_EQ( 1.f, ( (const float*)Image::ReadAccess(&img).pixelAt(15, 15) )[0] );
+}
+
+TEST(ImageTest, PasteSharesPixelsUntilWritten)
+{
+    RectD rod(0, 0, 64, 64);
+    RectI bounds(0, 0, 64, 64);
+    Image src(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image dst(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image tile(ImagePlaneDesc::getRGBAComponents(), rod, RectI(0, 0, 32, 32), 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    src.fill(bounds, 0.5f, 0.5f, 0.5f, 1.f);
+    dst.fillZero(bounds);
+
+    // a paste of a portion of the image copies the pixels
+    tile.pasteFrom( src, tile.getBounds() );
+    EXPECT_FALSE( tile.isSharingPixels() );
+    EXPECT_FALSE( src.isSharingPixels() );
+
+    // a paste of the whole image shares them, and they are only accounted by the source
+    const std::size_t dstSize = dst.size();
+    dst.pasteFrom(src, bounds);
+    EXPECT_TRUE( dst.isSharingPixels() );
+    EXPECT_TRUE( src.isSharingPixels() );
+    EXPECT_EQ( 0u, dst.dataSize() );
+    EXPECT_EQ( dstSize - src.dataSize(), dst.size() );
+    EXPECT_EQ( dstSize, src.size() );
+    {
+        Image::ReadAccess srcAcc(&src);
+        Image::ReadAccess dstAcc(&dst);
+        EXPECT_EQ( srcAcc.pixelAt(0, 0), dstAcc.pixelAt(0, 0) );
+        EXPECT_EQ( 0.5f, ( (const float*)dstAcc.pixelAt(10, 10) )[0] );
+    }
+
+    // writing one of them gives it its own copy and leaves the other untouched
+    {
+        Image::WriteAccess acc(&dst);
+        float* pix = (float*)acc.pixelAt(10, 10);
+        pix[0] = 2.f;
+    }
+    EXPECT_FALSE( dst.isSharingPixels() );
+    EXPECT_FALSE( src.isSharingPixels() );
+    EXPECT_EQ( dstSize, dst.size() );
+    {
+        Image::ReadAccess srcAcc(&src);
+        Image::ReadAccess dstAcc(&dst);
+        EXPECT_NE( srcAcc.pixelAt(0, 0), dstAcc.pixelAt(0, 0) );
+        EXPECT_EQ( 2.f, ( (const float*)dstAcc.pixelAt(10, 10) )[0] );
+        EXPECT_EQ( 0.5f, ( (const float*)srcAcc.pixelAt(10, 10) )[0] );
+        EXPECT_EQ( 0.5f, ( (const float*)dstAcc.pixelAt(11, 10) )[0] );
+    }
+
+    // a conversion to the same format shares the pixels as well
+    Image converted(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    src.convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, &converted);
+    EXPECT_TRUE( converted.isSharingPixels() );
+}
+
+TEST(ImageTest, PixelsAreNotSharedAnymoreOnceReleased)
+{
+    RectD rod(0, 0, 64, 64);
+    RectI bounds(0, 0, 64, 64);
+    Image src(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    src.fill(bounds, 0.5f, 0.5f, 0.5f, 1.f);
+    {
+        Image dst(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+        dst.pasteFrom(src, bounds);
+        EXPECT_TRUE( src.isSharingPixels() );
+    }
+    // the source owns its pixels again: they are neither copied when written nor considered shared
+    EXPECT_FALSE( src.isSharingPixels() );
+    const unsigned char* before = Image::ReadAccess(&src).pixelAt(0, 0);
+    {
+        Image::WriteAccess acc(&src);
+        EXPECT_EQ( before, acc.pixelAt(0, 0) );
+    }
+}
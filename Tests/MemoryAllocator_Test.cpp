@@ -0,0 +1,204 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#if defined(__NATRON_UNIX__)
+#include <unistd.h> // sysconf
+#endif
+
+#include "Engine/MemoryAllocator.h"
+
+NATRON_NAMESPACE_USING
+
+TEST(MemoryAllocator,
+     AllocationsAreUsableInEveryMode)
+{
+    const MemoryHugePagesModeEnum modes[3] = { eMemoryHugePagesModeNone, eMemoryHugePagesModeTransparent, eMemoryHugePagesModeExplicit };
+    const std::size_t sizes[2] = { 4096, NATRON_HUGE_PAGES_MIN_ALLOCATION_SIZE + 12345 };
+
+    for (int m = 0; m < 3; ++m) {
+        MemoryAllocator::setHugePagesMode(modes[m]);
+        for (int s = 0; s < 2; ++s) {
+            MemoryAllocationTypeEnum type;
+            unsigned char* data = (unsigned char*)MemoryAllocator::allocate(sizes[s], &type);
+            ASSERT_TRUE(data != NULL);
+            if ( (modes[m] == eMemoryHugePagesModeNone) || (sizes[s] < NATRON_HUGE_PAGES_MIN_ALLOCATION_SIZE) ) {
+                EXPECT_EQ(eMemoryAllocationTypeMalloc, type);
+            }
+            for (std::size_t i = 0; i < sizes[s]; ++i) {
+                data[i] = (unsigned char)(i * 7);
+            }
+            bool ok = true;
+            for (std::size_t i = 0; i < sizes[s]; ++i) {
+                ok &= data[i] == (unsigned char)(i * 7);
+            }
+            EXPECT_TRUE(ok);
+            MemoryAllocator::deallocate(data, sizes[s], type);
+        }
+    }
+    MemoryAllocator::setHugePagesMode(eMemoryHugePagesModeNone);
+}
+
+#if defined(__NATRON_LINUX__)
+TEST(MemoryAllocator,
+     DontNeedOnlyReleasesPagesInsideTheRange)
+{
+    std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+
+    MemoryAllocator::setHugePagesMode(eMemoryHugePagesModeTransparent);
+    std::size_t size = NATRON_HUGE_PAGES_MIN_ALLOCATION_SIZE;
+    MemoryAllocationTypeEnum type;
+    unsigned char* data = (unsigned char*)MemoryAllocator::allocate(size, &type);
+    ASSERT_TRUE(data != NULL);
+    std::memset(data, 1, size);
+
+    // Covers the end of page 0, page 1 and the beginning of page 2: only page 1 may be released.
+    // Anonymous private pages that were released read back as zeros.
+    EXPECT_TRUE( MemoryAllocator::advise(data + 1, 2 * pageSize, eMemoryAccessHintDontNeed) );
+    EXPECT_EQ(1, data[pageSize - 1]);
+    EXPECT_EQ(0, data[pageSize]);
+    EXPECT_EQ(0, data[2 * pageSize - 1]);
+    EXPECT_EQ(1, data[2 * pageSize]);
+
+    // A range smaller than a page is never released
+    EXPECT_FALSE( MemoryAllocator::advise(data + 3 * pageSize + 1, pageSize - 2, eMemoryAccessHintDontNeed) );
+    EXPECT_EQ(1, data[3 * pageSize + 1]);
+
+    // Hints are ignored when disabled
+    MemoryAllocator::setAccessHintsEnabled(false);
+    EXPECT_FALSE( MemoryAllocator::advise(data, size, eMemoryAccessHintDontNeed) );
+    EXPECT_EQ(1, data[0]);
+    MemoryAllocator::setAccessHintsEnabled(true);
+
+    EXPECT_TRUE( MemoryAllocator::advise(data, size, eMemoryAccessHintWillNeed) );
+
+    MemoryAllocator::deallocate(data, size, type);
+    MemoryAllocator::setHugePagesMode(eMemoryHugePagesModeNone);
+}
+
+#endif // __NATRON_LINUX__
+
+TEST(MemoryAllocator,
+     PoolReusesFreedBuffers)
+{
+    const std::size_t size = 3 * 1024 * 1024 + 17;
+
+    MemoryAllocator::setPoolCapacity(64 * 1024 * 1024);
+    MemoryAllocator::resetPoolStats();
+
+    MemoryAllocationTypeEnum type;
+    unsigned char* data = (unsigned char*)MemoryAllocator::allocate(size, &type);
+    ASSERT_TRUE(data != NULL);
+    std::memset(data, 0xff, size);
+    MemoryAllocator::deallocate(data, size, type);
+    EXPECT_LE( size, MemoryAllocator::getPoolStats().idleBytes );
+
+    // A slightly different size of the same size class gets the same buffer, with its content when not zeroed
+    MemoryAllocationTypeEnum type2;
+    unsigned char* data2 = (unsigned char*)MemoryAllocator::allocate(size + 100, &type2);
+    EXPECT_EQ(data, data2);
+    EXPECT_EQ(type, type2);
+    EXPECT_EQ(0xff, data2[size - 1]);
+    MemoryAllocator::deallocate(data2, size + 100, type2);
+
+    unsigned char* zeroed = (unsigned char*)MemoryAllocator::allocate(size, &type, true);
+    EXPECT_EQ(data, zeroed);
+    bool allZeros = true;
+    for (std::size_t i = 0; i < size; ++i) {
+        allZeros &= zeroed[i] == 0;
+    }
+    EXPECT_TRUE(allZeros);
+    MemoryAllocator::deallocate(zeroed, size, type);
+
+    // Buffers that do not fit in the pool are freed
+    MemoryAllocator::setPoolCapacity(4 * 1024 * 1024);
+    unsigned char* buffers[2];
+    for (int i = 0; i < 2; ++i) {
+        buffers[i] = (unsigned char*)MemoryAllocator::allocate(size, &type);
+    }
+    for (int i = 0; i < 2; ++i) {
+        MemoryAllocator::deallocate(buffers[i], size, type);
+    }
+
+    MemoryPoolStats stats = MemoryAllocator::getPoolStats();
+    EXPECT_EQ(3U, stats.hits);
+    EXPECT_EQ(2U, stats.misses);
+    EXPECT_EQ(1U, stats.overflows);
+    EXPECT_EQ(1U, stats.idleBuffers);
+
+    MemoryAllocator::releasePool();
+    stats = MemoryAllocator::getPoolStats();
+    EXPECT_EQ(0U, stats.idleBytes);
+    EXPECT_EQ(0U, stats.idleBuffers);
+    EXPECT_EQ(1U, stats.released);
+
+    // Small buffers are never pooled
+    data = (unsigned char*)MemoryAllocator::allocate(1024, &type);
+    MemoryAllocator::deallocate(data, 1024, type);
+    EXPECT_EQ(0U, MemoryAllocator::getPoolStats().idleBuffers);
+
+    MemoryAllocator::setPoolCapacity(0);
+}
+
+// Buffers freed by a thread are reused by the others, as the temporary images of renderRoI on several render threads
+TEST(MemoryAllocator,
+     PoolIsSharedBetweenThreads)
+{
+    const std::size_t size = 256 * 256 * 4 * sizeof(float);
+    const int iterations = 20;
+    const int nThreads = 4;
+
+    MemoryAllocator::setPoolCapacity(4 * nThreads * size);
+    MemoryAllocator::resetPoolStats();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) {
+        threads.push_back( std::thread([size, iterations]() {
+            for (int i = 0; i < iterations; ++i) {
+                MemoryAllocationTypeEnum type;
+                float* data = (float*)MemoryAllocator::allocate(size, &type);
+                for (std::size_t j = 0; j < size / sizeof(float); j += 1024) {
+                    data[j] = (float)j;
+                }
+                MemoryAllocator::deallocate(data, size, type);
+            }
+        }) );
+    }
+    for (int t = 0; t < nThreads; ++t) {
+        threads[t].join();
+    }
+
+    MemoryPoolStats stats = MemoryAllocator::getPoolStats();
+    EXPECT_EQ( (unsigned long long)nThreads * iterations, stats.hits + stats.misses );
+    // at most one miss per thread: the buffers it frees are then reused
+    EXPECT_LE( stats.misses, (unsigned long long)nThreads );
+    MemoryAllocator::setPoolCapacity(0);
+}
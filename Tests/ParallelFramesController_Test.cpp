@@ -0,0 +1,136 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <gtest/gtest.h>
+
+#include "Engine/ParallelFramesController.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+// Renders frames with the count returned by the controller, each frame taking secondsPerFrame(parallelFrames) and
+// growing the cache by frameMemory. Returns the last count.
+int
+simulate(ParallelFramesController& controller,
+         int threadsLimit,
+         std::size_t memoryBudget,
+         std::size_t frameMemory,
+         double (*secondsPerFrame)(int),
+         int nFrames,
+         double* now)
+{
+    int parallelFrames = 1;
+
+    for (int i = 0; i < nFrames; ++i) {
+        parallelFrames = controller.getMaxParallelFrames(threadsLimit, memoryBudget);
+        *now += secondsPerFrame(parallelFrames) / parallelFrames;
+        controller.recordFrame(*now, frameMemory * parallelFrames, parallelFrames, false);
+    }
+
+    return parallelFrames;
+}
+
+// Scales perfectly
+double
+linearSeconds(int /*parallelFrames*/)
+{
+    return 1.;
+}
+
+// Memory bound: past 10 frames in parallel, frames get slower
+double
+saturatedSeconds(int parallelFrames)
+{
+    return parallelFrames <= 10 ? 1. : parallelFrames / 10. * 1.2;
+}
+}
+
+TEST(ParallelFramesController, RampsUpToTheThreadsLimit)
+{
+    ParallelFramesController controller;
+    double now = 0.;
+
+    // Starts at half the threads and doubles once measured
+    EXPECT_EQ( 4, controller.getMaxParallelFrames(8, 0) );
+    EXPECT_EQ( 8, simulate(controller, 8, 0, 0, linearSeconds, 8, &now) );
+    EXPECT_EQ( 8, simulate(controller, 8, 0, 0, linearSeconds, 200, &now) );
+
+    ParallelFramesLimitEnum limit;
+    EXPECT_EQ( 8, controller.getPeakParallelFrames(&limit) );
+    EXPECT_EQ(eParallelFramesLimitThreads, limit);
+}
+
+TEST(ParallelFramesController, KeepsTheFramesInTheMemoryBudget)
+{
+    ParallelFramesController controller;
+    const std::size_t mb = 1024 * 1024;
+    double now = 0.;
+
+    // 2 GB of cache, half of it for frames of 300 MB each: 3 frames
+    EXPECT_EQ( 3, simulate(controller, 16, 2048 * mb, 300 * mb, linearSeconds, 200, &now) );
+    ParallelFramesLimitEnum limit;
+    controller.getPeakParallelFrames(&limit);
+    EXPECT_EQ(eParallelFramesLimitMemory, limit);
+    EXPECT_EQ( 300 * mb, controller.getFrameFootprint() );
+
+    // Growth measured while the cache is evicting is ignored
+    controller.recordFrame(1000., 0, 3, true);
+    EXPECT_EQ( 300 * mb, controller.getFrameFootprint() );
+
+    // The next render starts within the memory budget
+    controller.reset();
+    EXPECT_EQ( 300 * mb, controller.getFrameFootprint() );
+    EXPECT_EQ( 2, controller.getMaxParallelFrames(16, 2048 * mb) );
+}
+
+TEST(ParallelFramesController, StopsWhenTheThroughputDoesNotIncrease)
+{
+    ParallelFramesController controller;
+    double now = 0.;
+
+    EXPECT_EQ( 10, simulate(controller, 16, 0, 0, saturatedSeconds, 200, &now) );
+    ParallelFramesLimitEnum limit;
+    controller.getPeakParallelFrames(&limit);
+    EXPECT_EQ(eParallelFramesLimitThroughput, limit);
+    EXPECT_GT( controller.getFramesPerSecond(10), controller.getFramesPerSecond(8) );
+
+    controller.reset();
+    EXPECT_EQ( 8, controller.getMaxParallelFrames(16, 0) );
+    EXPECT_EQ( 0., controller.getFramesPerSecond(10) );
+}
+
+TEST(ParallelFramesController, RecoversWhenFramesGetCheaper)
+{
+    ParallelFramesController controller;
+    double now = 0.;
+
+    EXPECT_EQ( 10, simulate(controller, 16, 0, 0, saturatedSeconds, 200, &now) );
+    EXPECT_EQ( 16, simulate(controller, 16, 0, 0, linearSeconds, 400, &now) );
+    ParallelFramesLimitEnum limit;
+    controller.getPeakParallelFrames(&limit);
+    EXPECT_EQ(eParallelFramesLimitThreads, limit);
+}
@@ -0,0 +1,153 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/RenderPlan.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+// The steps of a frame where the root reads a merge of two branches, which both read the same source:
+//
+//   0 root <- 1 merge <- 2 left  <- 4 source
+//                     <- 3 right <- 4 source
+enum DiamondStepEnum
+{
+    eDiamondRoot = 0,
+    eDiamondMerge,
+    eDiamondLeft,
+    eDiamondRight,
+    eDiamondSource,
+    eDiamondCount
+};
+
+std::vector<RenderPlanStep>
+makeDiamond()
+{
+    std::vector<RenderPlanStep> steps(eDiamondCount);
+
+    for (std::size_t i = 0; i < steps.size(); ++i) {
+        steps[i].roi = RectI(0, 0, 100, 100);
+        steps[i].cachesOutput = true;
+    }
+    RenderPlan::addEdge(&steps, eDiamondMerge, eDiamondRoot);
+    RenderPlan::addEdge(&steps, eDiamondLeft, eDiamondMerge);
+    RenderPlan::addEdge(&steps, eDiamondRight, eDiamondMerge);
+    RenderPlan::addEdge(&steps, eDiamondSource, eDiamondLeft);
+    RenderPlan::addEdge(&steps, eDiamondSource, eDiamondRight);
+    RenderPlan::computeLevels(&steps);
+
+    return steps;
+}
+}
+
+TEST(RenderPlan, LevelsAreAboveInputs)
+{
+    std::vector<RenderPlanStep> steps = makeDiamond();
+
+    EXPECT_EQ(0, steps[eDiamondSource].level);
+    EXPECT_EQ(1, steps[eDiamondLeft].level);
+    EXPECT_EQ(1, steps[eDiamondRight].level);
+    EXPECT_EQ(2, steps[eDiamondMerge].level);
+    EXPECT_EQ(3, steps[eDiamondRoot].level);
+
+    // An edge given twice is only added once
+    RenderPlan::addEdge(&steps, eDiamondSource, eDiamondLeft);
+    EXPECT_EQ( 1u, steps[eDiamondLeft].inputs.size() );
+    EXPECT_EQ( 2u, steps[eDiamondSource].outputs.size() );
+}
+
+TEST(RenderPlan, SharedStepsAreDetected)
+{
+    EXPECT_TRUE( RenderPlan::hasSharedSteps(makeDiamond(), eDiamondRoot) );
+
+    // A chain does not share any step
+    std::vector<RenderPlanStep> chain(3);
+    RenderPlan::addEdge(&chain, 1, 0);
+    RenderPlan::addEdge(&chain, 2, 1);
+    EXPECT_FALSE( RenderPlan::hasSharedSteps(chain, 0) );
+
+    // Neither does a step read by the root and by one other step: the root renders it when it renders that step
+    RenderPlan::addEdge(&chain, 2, 0);
+    EXPECT_FALSE( RenderPlan::hasSharedSteps(chain, 0) );
+}
+
+TEST(RenderPlan, StepsReadByOthersArePreRendered)
+{
+    std::vector<RenderPlanStep> steps = makeDiamond();
+
+    RenderPlan::markPreRenderedSteps(&steps, eDiamondRoot);
+    for (int i = 0; i < eDiamondCount; ++i) {
+        EXPECT_TRUE(steps[i].isNeeded);
+    }
+    // The root and the step only read by the root are rendered by the caller
+    EXPECT_FALSE(steps[eDiamondRoot].isPreRendered);
+    EXPECT_FALSE(steps[eDiamondMerge].isPreRendered);
+    EXPECT_TRUE(steps[eDiamondLeft].isPreRendered);
+    EXPECT_TRUE(steps[eDiamondRight].isPreRendered);
+    EXPECT_TRUE(steps[eDiamondSource].isPreRendered);
+
+    // Steps whose output is not cached are rendered by the steps reading them
+    steps = makeDiamond();
+    steps[eDiamondSource].cachesOutput = false;
+    RenderPlan::markPreRenderedSteps(&steps, eDiamondRoot);
+    EXPECT_FALSE(steps[eDiamondSource].isPreRendered);
+    EXPECT_TRUE(steps[eDiamondLeft].isPreRendered);
+}
+
+TEST(RenderPlan, CachedStepsAreSkipped)
+{
+    // The source is still read by the branch that is not cached
+    std::vector<RenderPlanStep> steps = makeDiamond();
+
+    steps[eDiamondLeft].isCached = true;
+    RenderPlan::markPreRenderedSteps(&steps, eDiamondRoot);
+    EXPECT_TRUE(steps[eDiamondLeft].isNeeded);
+    EXPECT_FALSE(steps[eDiamondLeft].isPreRendered);
+    EXPECT_TRUE(steps[eDiamondRight].isPreRendered);
+    EXPECT_TRUE(steps[eDiamondSource].isNeeded);
+    EXPECT_TRUE(steps[eDiamondSource].isPreRendered);
+
+    // Both branches are cached: the source is not needed
+    steps = makeDiamond();
+    steps[eDiamondLeft].isCached = true;
+    steps[eDiamondRight].isCached = true;
+    RenderPlan::markPreRenderedSteps(&steps, eDiamondRoot);
+    EXPECT_FALSE(steps[eDiamondSource].isNeeded);
+    EXPECT_FALSE(steps[eDiamondSource].isPreRendered);
+
+    // The merge is cached: nothing below it is needed
+    steps = makeDiamond();
+    steps[eDiamondMerge].isCached = true;
+    RenderPlan::markPreRenderedSteps(&steps, eDiamondRoot);
+    for (int i = eDiamondLeft; i < eDiamondCount; ++i) {
+        EXPECT_FALSE(steps[i].isNeeded);
+        EXPECT_FALSE(steps[i].isPreRendered);
+    }
+}
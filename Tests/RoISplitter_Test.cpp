@@ -0,0 +1,129 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/RoISplitter.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+// The rects must cover roi exactly once
+void
+checkPartition(const RectI& roi,
+               const std::vector<RectI>& rects)
+{
+    double area = 0.;
+
+    for (std::size_t i = 0; i < rects.size(); ++i) {
+        EXPECT_FALSE( rects[i].isNull() );
+        EXPECT_TRUE( roi.contains(rects[i]) );
+        area += (double)rects[i].width() * rects[i].height();
+        for (std::size_t j = i + 1; j < rects.size(); ++j) {
+            EXPECT_FALSE( rects[i].intersects(rects[j]) );
+        }
+    }
+    EXPECT_EQ( (double)roi.width() * roi.height(), area );
+}
+}
+
+TEST(RoISplitter,
+     TallWindowsAreSplitInRowBands)
+{
+    RoISplitParams params;
+
+    params.threadsCount = 8;
+    params.minTileSize = 64;
+
+    const RectI roi(-13, 7, 1907, 1087);
+    RoISplitShapeEnum shape;
+    std::vector<RectI> rects = splitRoIForThreads(roi, params, &shape);
+    EXPECT_EQ(eRoISplitShapeRowBands, shape);
+    EXPECT_EQ(16U, rects.size());
+    checkPartition(roi, rects);
+    for (std::size_t i = 0; i < rects.size(); ++i) {
+        EXPECT_EQ(roi.x1, rects[i].x1);
+        EXPECT_EQ(roi.x2, rects[i].x2);
+        EXPECT_GE(rects[i].height(), params.minTileSize);
+    }
+}
+
+TEST(RoISplitter,
+     ShortWindowsAreSplitInAlignedTiles)
+{
+    RoISplitParams params;
+
+    params.threadsCount = 8;
+    params.minTileSize = 32;
+    params.bytesPerPixel = 16; // RGBA float: 4 pixels per cache line
+
+    const RectI roi(3, 0, 4003, 100);
+    RoISplitShapeEnum shape;
+    std::vector<RectI> rects = splitRoIForThreads(roi, params, &shape);
+    EXPECT_EQ(eRoISplitShapeTiles, shape);
+    EXPECT_GT(rects.size(), 1U);
+    EXPECT_LE(rects.size(), 16U);
+    checkPartition(roi, rects);
+    for (std::size_t i = 0; i < rects.size(); ++i) {
+        EXPECT_GE(rects[i].height(), params.minTileSize);
+        if (rects[i].x1 != roi.x1) {
+            EXPECT_EQ(0, rects[i].x1 % 4);
+        }
+    }
+}
+
+TEST(RoISplitter,
+     SmallOrCheapWindowsAreNotSplit)
+{
+    RoISplitParams params;
+
+    params.threadsCount = 8;
+    params.minTileSize = 128;
+
+    // Smaller than 2 minimum tiles
+    RoISplitShapeEnum shape;
+    std::vector<RectI> rects = splitRoIForThreads(RectI(0, 0, 200, 120), params, &shape);
+    ASSERT_EQ(1U, rects.size());
+    EXPECT_EQ(eRoISplitShapeNone, shape);
+
+    // A single thread available
+    params.threadsCount = 1;
+    EXPECT_EQ( 1U, splitRoIForThreads(RectI(0, 0, 4096, 4096), params).size() );
+
+    // A cheap effect gets fewer, larger rects than an expensive one
+    params.threadsCount = 8;
+    params.costPerPixel = 100.;
+    std::size_t expensive = splitRoIForThreads(RectI(0, 0, 1920, 1080), params).size();
+    params.costPerPixel = 0.5;
+    std::size_t cheap = splitRoIForThreads(RectI(0, 0, 1920, 1080), params).size();
+    EXPECT_LT(cheap, expensive);
+    EXPECT_EQ(16U, expensive);
+
+    // An empty window has no rects
+    EXPECT_TRUE( splitRoIForThreads(RectI(), params).empty() );
+}
@@ -0,0 +1,243 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QThreadPool>
+
+#include <boost/bind/bind.hpp>
+
+#include "Engine/TaskScheduler.h"
+
+using namespace boost::placeholders;
+
+NATRON_NAMESPACE_USING
+
+namespace {
+// Each item forks a group of its own, which forks again, as a tile calling the multi-thread suite
+// which processes bands of rows does.
+struct NestedItem
+{
+    int depth;
+    std::atomic<int>* leaves;
+
+    void operator()()
+    {
+        if (depth == 0) {
+            ++*leaves;
+
+            return;
+        }
+        std::vector<NestedItem> children( 4, NestedItem() );
+        for (std::size_t i = 0; i < children.size(); ++i) {
+            children[i].depth = depth - 1;
+            children[i].leaves = leaves;
+        }
+        TaskScheduler::blockingMap( children, boost::bind(&NestedItem::run, _1) );
+    }
+
+    static void run(NestedItem& item)
+    {
+        item();
+    }
+};
+
+void
+throwOnOddValue(int& value)
+{
+    if (value % 2) {
+        throw std::runtime_error("odd value");
+    }
+    value *= 2;
+}
+
+void
+throwBadAlloc()
+{
+    throw std::bad_alloc();
+}
+
+int
+squareValue(const int& value)
+{
+    return value * value;
+}
+
+double
+burnCycles(const int& seed)
+{
+    double x = seed;
+
+    for (int i = 0; i < 20000; ++i) {
+        x = x * 1.0000001 + 0.5;
+    }
+
+    return x;
+}
+}
+
+TEST(TaskScheduler,
+     NestedForkJoinDoesNotDeadlock)
+{
+    const int originalMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    const int threadCounts[4] = { 1, 2, 4, 8 };
+
+    for (int t = 0; t < 4; ++t) {
+        QThreadPool::globalInstance()->setMaxThreadCount(threadCounts[t]);
+        EXPECT_EQ( threadCounts[t], TaskScheduler::instance()->getMaxThreadsCount() );
+
+        std::atomic<int> leaves(0);
+        NestedItem root = { 5, &leaves };
+        root();
+        EXPECT_EQ(4 * 4 * 4 * 4 * 4, leaves.load());
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(originalMaxThreads);
+}
+
+TEST(TaskScheduler,
+     ConcurrentSpawnersFromOtherThreads)
+{
+    // Render threads that are not workers of the scheduler fork at the same time
+    const int nSpawners = 6;
+    std::vector<std::atomic<int> > leaves(nSpawners);
+    std::vector<std::thread> spawners;
+
+    for (int i = 0; i < nSpawners; ++i) {
+        leaves[i] = 0;
+        NestedItem root = { 4, &leaves[i] };
+        spawners.push_back( std::thread(root) );
+    }
+    for (int i = 0; i < nSpawners; ++i) {
+        spawners[i].join();
+        EXPECT_EQ(4 * 4 * 4 * 4, leaves[i].load());
+    }
+}
+
+TEST(TaskScheduler,
+     MappedResultsKeepTheSequenceOrder)
+{
+    std::vector<int> values(1000);
+
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = (int)i;
+    }
+    std::vector<int> squares;
+    TaskScheduler::blockingMapped(values, &squareValue, &squares);
+    ASSERT_EQ( values.size(), squares.size() );
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(values[i] * values[i], squares[i]);
+    }
+}
+
+TEST(TaskScheduler,
+     ExceptionsArePropagatedToTheWaitingThread)
+{
+    std::vector<int> values(100, 2);
+
+    values[57] = 3;
+    EXPECT_THROW( TaskScheduler::blockingMap(values, &throwOnOddValue), std::runtime_error );
+
+    // The scheduler is still usable and the other items were processed
+    EXPECT_EQ(4, values[0]);
+    EXPECT_EQ(4, values[99]);
+    values[57] = 2;
+    EXPECT_NO_THROW( TaskScheduler::blockingMap(values, &throwOnOddValue) );
+    EXPECT_EQ(8, values[0]);
+}
+
+TEST(TaskScheduler,
+     ExceptionsKeepTheirType)
+{
+    TaskGroup group;
+
+    for (int i = 0; i < 8; ++i) {
+        group.run(&throwBadAlloc);
+    }
+    EXPECT_THROW( group.wait(), std::bad_alloc );
+    // The exception is only rethrown once
+    EXPECT_NO_THROW( group.wait() );
+}
+
+// The results of a map do not depend on the number of threads running it
+TEST(TaskScheduler,
+     ResultsDoNotDependOnTheNumberOfThreads)
+{
+    const int originalMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+    const int maxThreads = std::max(2, (int)std::thread::hardware_concurrency());
+    std::vector<int> seeds(64);
+
+    for (std::size_t i = 0; i < seeds.size(); ++i) {
+        seeds[i] = (int)i;
+    }
+    std::vector<double> reference;
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
+        std::vector<double> results;
+        TaskScheduler::blockingMapped(seeds, &burnCycles, &results);
+        if (nThreads == 1) {
+            reference = results;
+        } else {
+            EXPECT_EQ(reference, results);
+        }
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(originalMaxThreads);
+}
+
+namespace {
+struct WorkerCheckItem
+{
+    std::thread::id waitingThread;
+    bool runByWaitingThread;
+    bool isWorkerThread;
+
+    static void run(WorkerCheckItem& item)
+    {
+        item.runByWaitingThread = ( std::this_thread::get_id() == item.waitingThread );
+        item.isWorkerThread = TaskScheduler::instance()->isWorkerThread();
+    }
+};
+}
+
+// Only the workers of the scheduler are reported as such: the waiting thread running tasks of its group is not one
+TEST(TaskScheduler,
+     IsWorkerThreadOnlyInWorkers)
+{
+    EXPECT_FALSE( TaskScheduler::instance()->isWorkerThread() );
+
+    WorkerCheckItem init = { std::this_thread::get_id(), false, false };
+    std::vector<WorkerCheckItem> items(256, init);
+    TaskScheduler::blockingMap( items, boost::bind(&WorkerCheckItem::run, _1) );
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        EXPECT_EQ(!items[i].runByWaitingThread, items[i].isWorkerThread);
+    }
+    EXPECT_FALSE( TaskScheduler::instance()->isWorkerThread() );
+}
@@ -44,9 +44,18 @@ SOURCES += \
     google-test/src/gtest-all.cc \
     google-mock/src/gmock-all.cc \
     BaseTest.cpp \
+    Cache_Test.cpp \
+    Half_Test.cpp \
     Hash64_Test.cpp \
     Image_Test.cpp \
+    ImageConvertKernels_Test.cpp \
     Lut_Test.cpp \
+    MemoryAllocator_Test.cpp \
+    ParallelFramesController_Test.cpp \
+    RenderPlan_Test.cpp \
+    RoISplitter_Test.cpp \
+    TaskScheduler_Test.cpp \
+    TraceRecorder_Test.cpp \
     KnobFile_Test.cpp \
     Curve_Test.cpp \
     Tracker_Test.cpp \
@@ -0,0 +1,111 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2021 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include "Engine/TraceRecorder.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+int
+countOccurrences(const std::string& str,
+                 const std::string& pattern)
+{
+    int ret = 0;
+
+    for (std::size_t pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + 1)) {
+        ++ret;
+    }
+
+    return ret;
+}
+
+void
+renderTiles(int nTiles)
+{
+    for (int i = 0; i < nTiles; ++i) {
+        TraceScope scope("render", "tile");
+        if ( scope.isActive() ) {
+            scope.setLabel("Blur1");
+            scope.setTime(12.);
+            scope.setRect( RectI(0, i * 10, 100, (i + 1) * 10) );
+        }
+    }
+}
+}
+
+TEST(TraceRecorder, NothingIsRecordedWhenStopped)
+{
+    TraceRecorder* recorder = TraceRecorder::instance();
+
+    recorder->start();
+    recorder->stop();
+    {
+        TraceScope scope("render", "tile");
+        EXPECT_FALSE( scope.isActive() );
+    }
+    std::stringstream ss;
+    recorder->writeChromeTrace(ss);
+    EXPECT_EQ( 0, countOccurrences(ss.str(), "\"ph\": \"X\"") );
+}
+
+TEST(TraceRecorder, EventsOfAllThreadsAreWritten)
+{
+    TraceRecorder* recorder = TraceRecorder::instance();
+
+    recorder->start();
+    {
+        TraceScope frame("scheduler", "frame");
+        EXPECT_TRUE( frame.isActive() );
+        std::thread t1(renderTiles, 3);
+        std::thread t2(renderTiles, 5);
+        t1.join();
+        t2.join();
+    }
+    recorder->stop();
+
+    std::stringstream ss;
+    recorder->writeChromeTrace(ss);
+    const std::string trace = ss.str();
+    EXPECT_EQ( 9, countOccurrences(trace, "\"ph\": \"X\"") );
+    EXPECT_EQ( 8, countOccurrences(trace, "\"name\": \"Blur1 tile\"") );
+    EXPECT_EQ( 1, countOccurrences(trace, "\"rect\": [0, 40, 100, 50]") );
+    EXPECT_GE( countOccurrences(trace, "\"thread_name\""), 3 );
+    EXPECT_EQ( '{', trace[0] );
+
+    // start() forgets the previous events, and the buffers of the threads that exited
+    recorder->start();
+    recorder->stop();
+    std::stringstream ss2;
+    recorder->writeChromeTrace(ss2);
+    EXPECT_EQ( 0, countOccurrences(ss2.str(), "\"ph\": \"X\"") );
+    EXPECT_EQ( 1, countOccurrences(ss2.str(), "\"thread_name\"") );
+}